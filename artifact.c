@@ -0,0 +1,659 @@
+/**
+ * Implementation of compiled expression artifacts. Compiling reads an
+ * expression file with the streaming reader and writes the tree of every
+ * line to the artifact; opening maps the artifact into memory, checks it
+ * against the source file, and rebuilds trees from it on request. The
+ * trees are the ones the reader would have built, with the same tokens
+ * and hashes, so the result cache and tiered execution treat them alike.
+ *
+ * ## Layout:
+ * A header, followed by four arrays in this order, all in the byte order
+ * of the machine that compiled them:
+ * - **exprs**: one record per expression: its line, its nodes and the
+ *   start of the line as written, for messages and profiling
+ * - **names**: every distinct operator token and variable name, which are
+ *   interned once when the artifact is opened
+ * - **nodes**: the nodes of every expression in postfix order, so a tree
+ *   is rebuilt with a stack and no recursion. A node holds its operator or
+ *   leaf kind, its name or literal, and its hash, so rebuilding neither
+ *   interns nor hashes anything
+ * - **text**: the terminated names, literals and lines the others refer to
+ *
+ * The header holds the size and checksum of the source file, so an
+ * artifact whose source has changed since it was compiled is refused,
+ * and a checksum of the arrays, so a damaged one is too.
+ *
+ * @file        artifact.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "artifact.h"
+#include "parser.h"
+#include "reader.h"
+#include "intern.h"
+#include "diag.h"
+
+#define ARTIFACT_MAGIC "EXPRAOT" /// With its terminator, the first 8 bytes of an artifact
+#define ARTIFACT_ORDER 0x01020304u /// Written as is, to recognize a foreign byte order
+#define ARTIFACT_SMALL_STACK 64 /// Deepest expression rebuilt without allocating
+
+/// The start of an artifact
+typedef struct header_s {
+        char magic[8];
+        uint32_t version; /// ARTIFACT_VERSION
+        uint32_t order; /// ARTIFACT_ORDER
+        uint64_t source_size; /// Bytes in the source file
+        uint64_t source_sum; /// Checksum of the source file
+        uint64_t body_sum; /// Checksum of everything after the header
+        uint64_t lines; /// Lines in the source file, blank ones included
+        uint64_t exprs, names, nodes; /// Records in each array
+        uint64_t text; /// Bytes of text
+} header_t;
+
+/// One expression
+typedef struct expr_rec_s {
+        uint64_t line; /// Line of the source it is on, counting from 1
+        uint32_t first; /// Index of its first node
+        uint32_t count; /// Number of its nodes
+        uint32_t head; /// Offset of the line as written in the text
+        uint32_t depth; /// Most nodes on the stack while rebuilding it
+} expr_rec_t;
+
+/// One operator token or variable name
+typedef struct name_rec_s {
+        uint32_t text; /// Offset in the text
+        uint32_t len;
+} name_rec_t;
+
+/// One node, in postfix order
+typedef struct node_rec_s {
+        uint8_t type; /// A node_type_t
+        uint8_t kind; /// The op_type_t of an interior node, the exp_type_t of a leaf
+        uint16_t unused;
+        uint32_t ref; /// Index of the name, or offset of a literal in the text
+        uint64_t hash; /// The node's hash, see tree_node.h
+} node_rec_t;
+
+/// An open artifact
+struct artifact_s {
+        void * data; /// The mapped file
+        size_t size;
+        const header_t * header;
+        const expr_rec_t * exprs;
+        const name_rec_t * names;
+        const node_rec_t * nodes;
+        const char * text;
+        const char ** handles; /// The interned names, by index
+};
+
+/// An artifact being compiled
+typedef struct writer_s {
+        expr_rec_t * exprs;
+        size_t nexprs, exprs_cap;
+        name_rec_t * names;
+        size_t nnames, names_cap;
+        node_rec_t * nodes;
+        size_t nnodes, nodes_cap;
+        char * text;
+        size_t ntext, text_cap;
+        uint32_t * slots; /// Index + 1 of the name interned at each slot, 0 if empty
+        const char ** slot_names;
+        size_t slots_cap;
+        tree_node_t ** pending; /// Nodes left to write, see add_tree()
+        size_t pending_cap;
+} writer_t;
+
+/**
+ * Checksums a run of bytes (64-bit FNV-1a).
+ *
+ * @param p: A pointer to the bytes
+ * @param len: The number of bytes
+ * @param sum: The checksum to continue from
+ * @return: The checksum
+ */
+static uint64_t checksum(const unsigned char * p, size_t len, uint64_t sum) {
+        for(size_t i = 0; i < len; i++) {
+                sum ^= p[i];
+                sum *= 1099511628211ull;
+        }
+        return sum;
+}
+
+/**
+ * Measures and checksums a source file.
+ *
+ * @param path: A pointer to the name of the file
+ * @param size: A pointer to store its size at
+ * @param sum: A pointer to store its checksum at
+ * @return: 0 on success, -1 if it is not a regular file or cannot be
+ *      read, which is reported through diag()
+ */
+static int sum_file(const char * path, uint64_t * size, uint64_t * sum) {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+
+        if(fd < 0 || fstat(fd, &st) < 0) {
+                diag("%s: %s\n", path, strerror(errno));
+                if(fd >= 0) close(fd);
+                return -1;
+        }
+        if(!S_ISREG(st.st_mode)) {
+                diag("%s: not a regular file\n", path);
+                close(fd);
+                return -1;
+        }
+
+        *size = (uint64_t)st.st_size;
+        *sum = 14695981039346656037ull;
+        if(st.st_size > 0) {
+                void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(data == MAP_FAILED) {
+                        diag("%s: %s\n", path, strerror(errno));
+                        close(fd);
+                        return -1;
+                }
+                *sum = checksum(data, st.st_size, *sum);
+                munmap(data, st.st_size);
+        }
+        close(fd);
+        return 0;
+}
+
+/**
+ * Makes room for one more element of an array.
+ *
+ * @param arr: A pointer to the array
+ * @param count: The number of elements in it
+ * @param cap: A pointer to its capacity
+ * @param size: The size of an element
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+static int reserve(void * arr, size_t count, size_t * cap, size_t size) {
+        if(count < *cap) return 0;
+
+        size_t grown_cap = *cap ? 2 * *cap : 64;
+        void * grown = realloc(*(void **)arr, grown_cap * size);
+        if(!grown) {
+                perror("Failed to grow artifact");
+                return -1;
+        }
+        *(void **)arr = grown;
+        *cap = grown_cap;
+        return 0;
+}
+
+/**
+ * Appends a terminated string to the text of an artifact.
+ *
+ * @param w: A pointer to the artifact being compiled
+ * @param str: A pointer to the string
+ * @param len: Its length
+ * @param at: A pointer to store its offset in the text at
+ * @return: 0 on success, -1 if the text is too large or memory
+ *      allocation fails
+ */
+static int add_text(writer_t * w, const char * str, size_t len, uint32_t * at) {
+        if(w->ntext + len + 1 > UINT32_MAX) {
+                diag("Error: too much text for an artifact\n");
+                return -1;
+        }
+        while(w->ntext + len + 1 > w->text_cap) {
+                if(reserve(&w->text, w->text_cap, &w->text_cap, 1) < 0) return -1;
+        }
+
+        memcpy(w->text + w->ntext, str, len);
+        w->text[w->ntext + len] = '\0';
+        *at = (uint32_t)w->ntext;
+        w->ntext += len + 1;
+        return 0;
+}
+
+/**
+ * Finds the index of an interned name in an artifact, adding it if it is
+ * not there yet.
+ *
+ * @param w: A pointer to the artifact being compiled
+ * @param handle: The handle of the name, see intern.h
+ * @param at: A pointer to store the index at
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+static int add_name(writer_t * w, const char * handle, uint32_t * at) {
+        // keep the slots at most half full
+        if((w->nnames + 1) * 2 > w->slots_cap) {
+                size_t cap = w->slots_cap ? 2 * w->slots_cap : 64;
+                uint32_t * slots = calloc(cap, sizeof(uint32_t));
+                const char ** slot_names = calloc(cap, sizeof(const char *));
+                if(!slots || !slot_names) {
+                        perror("Failed to grow artifact");
+                        free(slots);
+                        free(slot_names);
+                        return -1;
+                }
+                for(size_t i = 0; i < w->slots_cap; i++) {
+                        if(w->slots[i] == 0) continue;
+                        size_t j = intern_hash(w->slot_names[i]) & (cap - 1);
+                        while(slots[j]) j = (j + 1) & (cap - 1);
+                        slots[j] = w->slots[i];
+                        slot_names[j] = w->slot_names[i];
+                }
+                free(w->slots);
+                free(w->slot_names);
+                w->slots = slots;
+                w->slot_names = slot_names;
+                w->slots_cap = cap;
+        }
+
+        size_t i = intern_hash(handle) & (w->slots_cap - 1);
+        while(w->slots[i] && w->slot_names[i] != handle) i = (i + 1) & (w->slots_cap - 1);
+        if(w->slots[i]) {
+                *at = w->slots[i] - 1;
+                return 0;
+        }
+
+        name_rec_t rec = { 0, (uint32_t)strlen(handle) };
+        if(reserve(&w->names, w->nnames, &w->names_cap, sizeof(name_rec_t)) < 0 ||
+                        add_text(w, handle, rec.len, &rec.text) < 0) return -1;
+
+        w->names[w->nnames] = rec;
+        *at = (uint32_t)w->nnames++;
+        w->slots[i] = *at + 1;
+        w->slot_names[i] = handle;
+        return 0;
+}
+
+/**
+ * Adds the tree of one line to an artifact.
+ *
+ * @param w: A pointer to the artifact being compiled
+ * @param tree: A pointer to the root of the tree
+ * @param line: The line the tree is on
+ * @param head: A pointer to the start of the line as written
+ * @return: 0 on success, -1 if the artifact would be too large or memory
+ *      allocation fails
+ */
+static int add_tree(writer_t * w, tree_node_t * tree, unsigned long line, const char * head) {
+        if(w->nnodes + tree->size > UINT32_MAX) {
+                diag("Error: too many nodes for an artifact\n");
+                return -1;
+        }
+        while(w->nnodes + tree->size > w->nodes_cap) {
+                if(reserve(&w->nodes, w->nodes_cap, &w->nodes_cap, sizeof(node_rec_t)) < 0) return -1;
+        }
+
+        expr_rec_t rec = { line, (uint32_t)w->nnodes, (uint32_t)tree->size, 0, 0 };
+        if(reserve(&w->exprs, w->nexprs, &w->exprs_cap, sizeof(expr_rec_t)) < 0 ||
+                        add_text(w, head, strlen(head), &rec.head) < 0) return -1;
+
+        // visiting each node before its right and then its left child gives
+        // the postfix order backwards, so the nodes are filled in from the end
+        size_t at = w->nnodes + tree->size, pending = 0;
+        if(reserve(&w->pending, pending, &w->pending_cap, sizeof(tree_node_t *)) < 0) return -1;
+        w->pending[pending++] = tree;
+        while(pending > 0) {
+                tree_node_t * node = w->pending[--pending];
+                node_rec_t * out = &w->nodes[--at];
+                uint32_t ref;
+
+                out->type = (uint8_t)node->type;
+                out->unused = 0;
+                out->hash = node->hash;
+                if(node->type == LEAF) {
+                        exp_type_t kind = ((leaf_node_t *)node->node)->exp_type;
+                        out->kind = (uint8_t)kind;
+                        if(kind == INTEGER) {
+                                if(add_text(w, node->token, strlen(node->token), &ref) < 0) return -1;
+                        } else if(add_name(w, node->token, &ref) < 0) {
+                                return -1;
+                        }
+                } else {
+                        interior_node_t * interior = (interior_node_t *)node->node;
+                        out->kind = (uint8_t)interior->op;
+                        if(add_name(w, node->token, &ref) < 0) return -1;
+                        while(pending + 2 > w->pending_cap) {
+                                if(reserve(&w->pending, w->pending_cap, &w->pending_cap, sizeof(tree_node_t *)) < 0) return -1;
+                        }
+                        w->pending[pending++] = interior->left;
+                        w->pending[pending++] = interior->right;
+                }
+                out->ref = ref;
+        }
+
+        // the deepest the stack gets while rebuilding
+        size_t depth = 0;
+        for(size_t i = w->nnodes; i < w->nnodes + tree->size; i++) {
+                depth = w->nodes[i].type == LEAF ? depth + 1 : depth - 1;
+                if(depth > rec.depth) rec.depth = (uint32_t)depth;
+        }
+
+        w->nnodes += tree->size;
+        w->exprs[w->nexprs++] = rec;
+        return 0;
+}
+
+/**
+ * Frees the arrays of an artifact being compiled.
+ *
+ * @param w: A pointer to the artifact being compiled
+ */
+static void free_writer(writer_t * w) {
+        free(w->exprs);
+        free(w->names);
+        free(w->nodes);
+        free(w->text);
+        free(w->slots);
+        free(w->slot_names);
+        free(w->pending);
+}
+
+/**
+ * Writes a compiled artifact to a file, atomically replacing any
+ * previous one.
+ *
+ * @param w: A pointer to the compiled artifact
+ * @param header: A pointer to its header, whose counts and body checksum
+ *      are filled in
+ * @param path: A pointer to the name of the file
+ * @return: 0 on success, -1 on failure, which is reported through diag()
+ */
+static int write_artifact(writer_t * w, header_t * header, const char * path) {
+        const void * parts[] = { w->exprs, w->names, w->nodes, w->text };
+        size_t sizes[] = { w->nexprs * sizeof(expr_rec_t), w->nnames * sizeof(name_rec_t),
+                w->nnodes * sizeof(node_rec_t), w->ntext };
+
+        header->exprs = w->nexprs;
+        header->names = w->nnames;
+        header->nodes = w->nnodes;
+        header->text = w->ntext;
+        header->body_sum = 14695981039346656037ull;
+        for(int i = 0; i < 4; i++) header->body_sum = checksum(parts[i], sizes[i], header->body_sum);
+
+        char * tmp = malloc(strlen(path) + sizeof(".tmp"));
+        if(!tmp) {
+                perror("Failed to allocate artifact path");
+                return -1;
+        }
+        strcpy(tmp, path);
+        strcat(tmp, ".tmp");
+
+        FILE * file = fopen(tmp, "wb");
+        int rc = file ? 0 : -1;
+        if(file) {
+                if(fwrite(header, sizeof(header_t), 1, file) != 1) rc = -1;
+                for(int i = 0; i < 4 && rc == 0; i++) {
+                        if(sizes[i] > 0 && fwrite(parts[i], sizes[i], 1, file) != 1) rc = -1;
+                }
+                if(fflush(file) != 0 || fsync(fileno(file)) != 0) rc = -1;
+                if(fclose(file) != 0) rc = -1;
+                if(rc == 0) rc = rename(tmp, path);
+        }
+        if(rc < 0) {
+                diag("%s: %s\n", path, strerror(errno));
+                unlink(tmp);
+        }
+        free(tmp);
+        return rc;
+}
+
+/**
+ * Compiles an expression file into an artifact. Every line of the file
+ * must hold a valid expression, or be blank.
+ *
+ * @param source: A pointer to the name of the expression file
+ * @param path: A pointer to the name of the artifact to write
+ * @return: 0 on success, -1 if the file could not be read, a line did not
+ *      parse or the artifact could not be written, which is reported
+ *      through diag()
+ */
+int artifact_compile(const char * source, const char * path) {
+        header_t header = { ARTIFACT_MAGIC, ARTIFACT_VERSION, ARTIFACT_ORDER, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        if(sum_file(source, &header.source_size, &header.source_sum) < 0) return -1;
+
+        FILE * in = fopen(source, "r");
+        reader_t * reader = in ? make_reader(in) : NULL;
+        if(!reader) {
+                if(in) fclose(in);
+                else diag("%s: %s\n", source, strerror(errno));
+                return -1;
+        }
+
+        writer_t w = {0};
+        tree_node_t * tree;
+        read_status_t got;
+        int rc = 0;
+        while(rc == 0 && (got = read_tree(reader, &tree)) != READ_END) {
+                if(got == READ_BLANK) continue;
+                if(tree == NULL) {
+                        diag("%s:%lu: Error: expression does not parse\n", source, reader->lineno);
+                        rc = -1;
+                        break;
+                }
+                rc = add_tree(&w, tree, reader->lineno, reader->head);
+                cleanup_tree(tree);
+        }
+        header.lines = reader->lineno;
+        free_reader(reader);
+        fclose(in);
+
+        if(rc == 0) rc = write_artifact(&w, &header, path);
+        free_writer(&w);
+        return rc;
+}
+
+/**
+ * Checks that every record of an artifact refers to something within it,
+ * and that the nodes of every expression make one tree.
+ *
+ * @param art: A pointer to the artifact
+ * @return: 1 if they do, 0 if not
+ */
+static int valid_records(artifact_t * art) {
+        const header_t * h = art->header;
+
+        // with the text terminated, every offset within it starts a string
+        if(h->text > 0 && art->text[h->text - 1] != '\0') return 0;
+
+        for(uint64_t i = 0; i < h->names; i++) {
+                uint64_t end = (uint64_t)art->names[i].text + art->names[i].len;
+                if(art->names[i].len == 0 || end >= h->text || art->text[end] != '\0') return 0;
+        }
+
+        for(uint64_t i = 0; i < h->exprs; i++) {
+                const expr_rec_t * rec = &art->exprs[i];
+                if(rec->count == 0 || rec->first + (uint64_t)rec->count > h->nodes || rec->line > h->lines ||
+                                (i > 0 && rec->line <= art->exprs[i - 1].line) || rec->head >= h->text) return 0;
+
+                uint64_t depth = 0;
+                for(uint32_t j = rec->first; j < rec->first + rec->count; j++) {
+                        const node_rec_t * node = &art->nodes[j];
+                        if(node->type == LEAF) {
+                                if(node->kind == INTEGER) {
+                                        if(node->ref >= h->text || !is_num((char *)art->text + node->ref)) return 0;
+                                } else if(node->kind != SYMBOL || node->ref >= h->names) {
+                                        return 0;
+                                }
+                                depth++;
+                        } else {
+                                if(node->type != INTERIOR || node->kind >= NO_OP || node->ref >= h->names || depth < 2) return 0;
+                                depth--;
+                        }
+                        if(depth > rec->depth) return 0;
+                }
+                if(depth != 1) return 0;
+        }
+        return 1;
+}
+
+/**
+ * Opens an artifact, checking that it was compiled from the current
+ * contents of its source file.
+ *
+ * @param path: A pointer to the name of the artifact
+ * @param source: A pointer to the name of the expression file it was
+ *      compiled from, or NULL to use it without checking
+ * @return: A pointer to the open artifact, or NULL if it cannot be read,
+ *      is damaged, was compiled by another version or on another kind of
+ *      machine, or is stale, which is reported through diag()
+ */
+artifact_t * artifact_open(const char * path, const char * source) {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+
+        if(fd < 0 || fstat(fd, &st) < 0) {
+                diag("%s: %s\n", path, strerror(errno));
+                if(fd >= 0) close(fd);
+                return NULL;
+        }
+
+        artifact_t * art = calloc(1, sizeof(artifact_t));
+        if(!art) {
+                perror("Failed to open artifact");
+                close(fd);
+                return NULL;
+        }
+        art->size = (size_t)st.st_size;
+        art->data = art->size >= sizeof(header_t) ? mmap(NULL, art->size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+
+        if(art->data == MAP_FAILED) {
+                diag("%s: not an artifact\n", path);
+                free(art);
+                return NULL;
+        }
+
+        const header_t * h = art->header = art->data;
+        const char * why = NULL;
+        if(memcmp(h->magic, ARTIFACT_MAGIC, sizeof(h->magic)) != 0) {
+                why = "not an artifact";
+        } else if(h->version != ARTIFACT_VERSION || h->order != ARTIFACT_ORDER) {
+                why = "compiled by another version or on another kind of machine";
+        } else {
+                // the counts are checked one at a time, so the sum cannot overflow
+                size_t body = art->size - sizeof(header_t);
+                if(h->exprs > body / sizeof(expr_rec_t) || h->names > body / sizeof(name_rec_t) ||
+                                h->nodes > body / sizeof(node_rec_t) || h->text > body ||
+                                h->exprs * sizeof(expr_rec_t) + h->names * sizeof(name_rec_t) +
+                                h->nodes * sizeof(node_rec_t) + h->text != body ||
+                                checksum((const unsigned char *)(h + 1), body, 14695981039346656037ull) != h->body_sum) {
+                        why = "damaged";
+                }
+        }
+
+        if(!why) {
+                art->exprs = (const expr_rec_t *)(h + 1);
+                art->names = (const name_rec_t *)(art->exprs + h->exprs);
+                art->nodes = (const node_rec_t *)(art->names + h->names);
+                art->text = (const char *)(art->nodes + h->nodes);
+                if(!valid_records(art)) why = "damaged";
+        }
+
+        uint64_t size, sum;
+        if(!why && source) {
+                if(sum_file(source, &size, &sum) < 0) why = "not checked against its source";
+                else if(size != h->source_size || sum != h->source_sum) why = "stale, its source has changed";
+        }
+
+        art->handles = why ? NULL : malloc((h->names ? h->names : 1) * sizeof(const char *));
+        if(!why && !art->handles) why = strerror(ENOMEM);
+        for(uint64_t i = 0; !why && i < h->names; i++) {
+                art->handles[i] = intern_len(art->text + art->names[i].text, art->names[i].len);
+                if(!art->handles[i]) why = strerror(ENOMEM);
+        }
+
+        if(why) {
+                diag("%s: %s\n", path, why);
+                artifact_close(art);
+                return NULL;
+        }
+        madvise(art->data, art->size, MADV_WILLNEED);
+        return art;
+}
+
+/**
+ * Counts the expressions in an artifact.
+ *
+ * @param art: A pointer to the artifact
+ * @return: The number of expressions
+ */
+size_t artifact_count(artifact_t * art) {
+        return (size_t)art->header->exprs;
+}
+
+/**
+ * Counts the lines of the source an artifact was compiled from.
+ *
+ * @param art: A pointer to the artifact
+ * @return: The number of lines, blank ones included
+ */
+unsigned long artifact_lines(artifact_t * art) {
+        return (unsigned long)art->header->lines;
+}
+
+/**
+ * Rebuilds the tree of one expression in an artifact. May be called from
+ * several threads at once.
+ *
+ * @param art: A pointer to the artifact
+ * @param index: The index of the expression, less than artifact_count()
+ * @param line: A pointer to store the line it is on at, may be NULL
+ * @param head: A pointer to store a pointer to the start of the line as
+ *      written at, valid while the artifact is open; may be NULL
+ * @return: A pointer to the root of the tree, to be freed by the caller,
+ *      or NULL if memory allocation fails
+ */
+tree_node_t * artifact_tree(artifact_t * art, size_t index, unsigned long * line, const char ** head) {
+        const expr_rec_t * rec = &art->exprs[index];
+        tree_node_t * small[ARTIFACT_SMALL_STACK];
+        tree_node_t ** stack = rec->depth <= ARTIFACT_SMALL_STACK ? small : malloc(rec->depth * sizeof(tree_node_t *));
+        size_t depth = 0;
+
+        if(line) *line = (unsigned long)rec->line;
+        if(head) *head = art->text + rec->head;
+        if(!stack) return NULL;
+
+        for(uint32_t i = rec->first; i < rec->first + rec->count; i++) {
+                const node_rec_t * in = &art->nodes[i];
+                tree_node_t * node;
+
+                if(in->type == LEAF) {
+                        const char * token = in->kind == INTEGER ? art->text + in->ref : art->handles[in->ref];
+                        node = make_leaf_hashed((exp_type_t)in->kind, token, in->hash);
+                } else {
+                        depth -= 2;
+                        node = make_interior_hashed((op_type_t)in->kind, art->handles[in->ref],
+                                        stack[depth], stack[depth + 1], in->hash);
+                        if(!node) depth += 2;
+                }
+
+                if(!node) {
+                        while(depth > 0) cleanup_tree(stack[--depth]);
+                        break;
+                }
+                stack[depth++] = node;
+        }
+
+        tree_node_t * tree = depth == 1 ? stack[0] : NULL;
+        if(stack != small) free(stack);
+        return tree;
+}
+
+/**
+ * Closes an artifact. Trees rebuilt from it stay valid.
+ *
+ * @param art: A pointer to the artifact, may be NULL
+ */
+void artifact_close(artifact_t * art) {
+        if(art == NULL) return;
+
+        munmap(art->data, art->size);
+        free(art->handles);
+        free(art);
+}
@@ -0,0 +1,33 @@
+/**
+ * Interface for compiled expression artifacts. An expression file is
+ * compiled ahead of time into an artifact holding the tree of every line,
+ * and later runs rebuild the trees from the artifact instead of reading
+ * and parsing the file again.
+ *
+ * @file        artifact.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef ARTIFACT_H
+#define ARTIFACT_H
+
+#include <stddef.h>
+#include "tree_node.h"
+
+#define ARTIFACT_VERSION 1 /// Bumped whenever the layout or the node hashes change
+
+/// An open artifact, see artifact_open()
+typedef struct artifact_s artifact_t;
+
+int artifact_compile(const char * source, const char * path);
+
+artifact_t * artifact_open(const char * path, const char * source);
+
+size_t artifact_count(artifact_t * art);
+
+unsigned long artifact_lines(artifact_t * art);
+
+tree_node_t * artifact_tree(artifact_t * art, size_t index, unsigned long * line, const char ** head);
+
+void artifact_close(artifact_t * art);
+
+#endif
@@ -0,0 +1,408 @@
+/**
+ * Implementation of arbitrary-precision integers. A bignum is a sign and
+ * a magnitude of 32-bit limbs, least significant first, with no leading
+ * zero limbs, so zero has no limbs at all and is never negative. Products
+ * and quotients of limbs are formed in 64 bits. Division is Knuth's
+ * algorithm D (TAOCP vol. 2, 4.3.1) and truncates toward zero, as C does,
+ * so a remainder has the sign of its dividend.
+ *
+ * @file        bignum.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "bignum.h"
+
+#define BIG_CHUNK 1000000000u /// Largest power of ten in a limb
+#define BIG_CHUNK_DIGITS 9
+
+struct bignum_s {
+        int negative;
+        size_t count; /// Limbs in use
+        uint32_t limbs[]; /// Magnitude, least significant limb first
+};
+
+/**
+ * Allocates a bignum of zero with room for a number of limbs.
+ *
+ * @param count: The number of limbs
+ * @return: A pointer to the bignum, or NULL if memory allocation fails
+ */
+static bignum_t * alloc_big(size_t count) {
+        bignum_t * big = calloc(1, sizeof(bignum_t) + (count ? count : 1) * sizeof(uint32_t));
+        if(big) big->count = count;
+        return big;
+}
+
+/**
+ * Drops the leading zero limbs of a bignum.
+ *
+ * @param big: A pointer to the bignum, or NULL
+ * @return: big
+ */
+static bignum_t * trim(bignum_t * big) {
+        if(!big) return NULL;
+        while(big->count > 0 && big->limbs[big->count - 1] == 0) big->count--;
+        if(big->count == 0) big->negative = 0;
+        return big;
+}
+
+/**
+ * Creates a bignum from a machine integer.
+ *
+ * @param val: The value
+ * @return: A pointer to the bignum, or NULL if memory allocation fails
+ */
+bignum_t * big_from_long(long long val) {
+        bignum_t * big = alloc_big(2);
+        if(!big) return NULL;
+
+        uint64_t mag = val < 0 ? 0 - (uint64_t)val : (uint64_t)val;
+        big->negative = val < 0;
+        big->limbs[0] = (uint32_t)mag;
+        big->limbs[1] = (uint32_t)(mag >> 32);
+        return trim(big);
+}
+
+/**
+ * Multiplies a magnitude by a limb and adds another, in place.
+ *
+ * @param big: A pointer to a bignum with room for one more limb
+ * @param mul: The factor
+ * @param add: The addend
+ */
+static void mul_add_limb(bignum_t * big, uint32_t mul, uint32_t add) {
+        uint64_t carry = add;
+
+        for(size_t i = 0; i < big->count; i++) {
+                uint64_t t = (uint64_t)big->limbs[i] * mul + carry;
+                big->limbs[i] = (uint32_t)t;
+                carry = t >> 32;
+        }
+        if(carry) big->limbs[big->count++] = (uint32_t)carry;
+}
+
+/**
+ * Converts a decimal integer literal, nine digits at a time.
+ *
+ * @param p: A pointer to an optional '-' followed by digits
+ * @param len: The length of the literal
+ * @return: A pointer to the bignum, or NULL if memory allocation fails
+ */
+bignum_t * big_parse(const char * p, size_t len) {
+        size_t neg = len > 0 && p[0] == '-';
+
+        // every nine digits take less than a limb
+        bignum_t * big = alloc_big((len - neg) / BIG_CHUNK_DIGITS + 2);
+        if(!big) return NULL;
+        big->count = 0;
+
+        size_t i = neg;
+        while(i < len) {
+                size_t n = (len - i) % BIG_CHUNK_DIGITS ? (len - i) % BIG_CHUNK_DIGITS : BIG_CHUNK_DIGITS;
+                uint32_t chunk = 0, scale = 1;
+                for(size_t k = 0; k < n; k++, i++) {
+                        chunk = chunk * 10 + (uint32_t)(p[i] - '0');
+                        scale *= 10;
+                }
+                mul_add_limb(big, scale, chunk);
+        }
+        big->negative = (int)neg;
+        return trim(big);
+}
+
+/**
+ * Compares the magnitudes of two bignums.
+ *
+ * @return: A negative number, 0 or a positive number as |a| is less than,
+ *      equal to or greater than |b|
+ */
+static int compare_mag(const bignum_t * a, const bignum_t * b) {
+        if(a->count != b->count) return a->count < b->count ? -1 : 1;
+        for(size_t i = a->count; i-- > 0; ) {
+                if(a->limbs[i] != b->limbs[i]) return a->limbs[i] < b->limbs[i] ? -1 : 1;
+        }
+        return 0;
+}
+
+/**
+ * Adds two bignums, the second with its sign flipped if asked.
+ *
+ * @param a: A pointer to the first operand
+ * @param b: A pointer to the second operand
+ * @param flip: 1 to subtract b instead of adding it
+ * @return: A pointer to the sum, or NULL if memory allocation fails
+ */
+static bignum_t * add_signed(const bignum_t * a, const bignum_t * b, int flip) {
+        int bneg = b->count ? b->negative ^ flip : 0;
+
+        if(a->negative == bneg) {
+                const bignum_t * big = a->count >= b->count ? a : b, * small = big == a ? b : a;
+                bignum_t * sum = alloc_big(big->count + 1);
+                if(!sum) return NULL;
+
+                uint64_t carry = 0;
+                for(size_t i = 0; i < big->count; i++) {
+                        uint64_t t = (uint64_t)big->limbs[i] + (i < small->count ? small->limbs[i] : 0) + carry;
+                        sum->limbs[i] = (uint32_t)t;
+                        carry = t >> 32;
+                }
+                sum->limbs[big->count] = (uint32_t)carry;
+                sum->negative = a->negative;
+                return trim(sum);
+        }
+
+        // opposite signs: the larger magnitude loses the smaller one
+        int order = compare_mag(a, b);
+        const bignum_t * big = order >= 0 ? a : b, * small = order >= 0 ? b : a;
+        bignum_t * diff = alloc_big(big->count);
+        if(!diff) return NULL;
+
+        uint64_t borrow = 0;
+        for(size_t i = 0; i < big->count; i++) {
+                uint64_t t = (uint64_t)big->limbs[i] - (i < small->count ? small->limbs[i] : 0) - borrow;
+                diff->limbs[i] = (uint32_t)t;
+                borrow = (t >> 32) & 1;
+        }
+        diff->negative = order >= 0 ? a->negative : bneg;
+        return trim(diff);
+}
+
+/**
+ * Adds two bignums.
+ *
+ * @param a: A pointer to the first operand
+ * @param b: A pointer to the second operand
+ * @return: A pointer to the sum, or NULL if memory allocation fails
+ */
+bignum_t * big_add(const bignum_t * a, const bignum_t * b) {
+        return add_signed(a, b, 0);
+}
+
+/**
+ * Subtracts one bignum from another.
+ *
+ * @param a: A pointer to the minuend
+ * @param b: A pointer to the subtrahend
+ * @return: A pointer to the difference, or NULL if memory allocation fails
+ */
+bignum_t * big_sub(const bignum_t * a, const bignum_t * b) {
+        return add_signed(a, b, 1);
+}
+
+/**
+ * Multiplies two bignums, limb by limb.
+ *
+ * @param a: A pointer to the first operand
+ * @param b: A pointer to the second operand
+ * @return: A pointer to the product, or NULL if memory allocation fails
+ */
+bignum_t * big_mul(const bignum_t * a, const bignum_t * b) {
+        bignum_t * prod = alloc_big(a->count + b->count);
+        if(!prod) return NULL;
+
+        for(size_t i = 0; i < a->count; i++) {
+                uint64_t carry = 0;
+                for(size_t j = 0; j < b->count; j++) {
+                        uint64_t t = (uint64_t)a->limbs[i] * b->limbs[j] + prod->limbs[i + j] + carry;
+                        prod->limbs[i + j] = (uint32_t)t;
+                        carry = t >> 32;
+                }
+                prod->limbs[i + b->count] = (uint32_t)carry;
+        }
+        prod->negative = a->negative != b->negative;
+        return trim(prod);
+}
+
+/**
+ * Divides a magnitude by a single limb.
+ *
+ * @param u: The dividend's limbs
+ * @param m: The number of limbs in the dividend
+ * @param v: The divisor, not 0
+ * @param q: The quotient's limbs, m of them
+ * @return: The remainder
+ */
+static uint32_t divide_limb(const uint32_t * u, size_t m, uint32_t v, uint32_t * q) {
+        uint64_t rem = 0;
+
+        for(size_t i = m; i-- > 0; ) {
+                uint64_t t = (rem << 32) | u[i];
+                q[i] = (uint32_t)(t / v);
+                rem = t % v;
+        }
+        return (uint32_t)rem;
+}
+
+/**
+ * Divides a magnitude by one of at least two limbs, with algorithm D.
+ *
+ * @param u: The dividend's limbs
+ * @param m: The number of limbs in the dividend, at least n
+ * @param v: The divisor's limbs, the last one not 0
+ * @param n: The number of limbs in the divisor
+ * @param q: The quotient's limbs, m - n + 1 of them
+ * @param r: The remainder's limbs, n of them
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+static int divide_mag(const uint32_t * u, size_t m, const uint32_t * v, size_t n, uint32_t * q, uint32_t * r) {
+        uint32_t * un = malloc((m + 1 + n) * sizeof(uint32_t));
+        if(!un) return -1;
+        uint32_t * vn = un + m + 1;
+
+        // shift both so the divisor's top limb has its high bit set, which
+        // keeps every estimated quotient limb at most two too large
+        int s = __builtin_clz(v[n - 1]);
+        for(size_t i = n - 1; i > 0; i--) vn[i] = (uint32_t)(((uint64_t)v[i] << s) | ((uint64_t)v[i - 1] >> (32 - s)));
+        vn[0] = v[0] << s;
+        un[m] = (uint32_t)((uint64_t)u[m - 1] >> (32 - s));
+        for(size_t i = m - 1; i > 0; i--) un[i] = (uint32_t)(((uint64_t)u[i] << s) | ((uint64_t)u[i - 1] >> (32 - s)));
+        un[0] = u[0] << s;
+
+        for(size_t j = m - n + 1; j-- > 0; ) {
+                uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+                uint64_t qhat = num / vn[n - 1], rhat = num % vn[n - 1];
+                while(qhat >> 32 || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+                        qhat--;
+                        rhat += vn[n - 1];
+                        if(rhat >> 32) break;
+                }
+
+                // subtract qhat times the divisor from the current window
+                uint64_t carry = 0, borrow = 0;
+                for(size_t i = 0; i < n; i++) {
+                        uint64_t p = qhat * vn[i] + carry;
+                        carry = p >> 32;
+                        uint64_t t = (uint64_t)un[i + j] - (uint32_t)p - borrow;
+                        un[i + j] = (uint32_t)t;
+                        borrow = (t >> 32) & 1;
+                }
+                uint64_t t = (uint64_t)un[j + n] - carry - borrow;
+                un[j + n] = (uint32_t)t;
+
+                // qhat was one too large: add the divisor back
+                if(t >> 63) {
+                        qhat--;
+                        carry = 0;
+                        for(size_t i = 0; i < n; i++) {
+                                uint64_t sum = (uint64_t)un[i + j] + vn[i] + carry;
+                                un[i + j] = (uint32_t)sum;
+                                carry = sum >> 32;
+                        }
+                        un[j + n] += (uint32_t)carry;
+                }
+                q[j] = (uint32_t)qhat;
+        }
+
+        for(size_t i = 0; i < n; i++) r[i] = (uint32_t)((un[i] >> s) | ((uint64_t)un[i + 1] << (32 - s)));
+        free(un);
+        return 0;
+}
+
+/**
+ * Divides one bignum by another, truncating toward zero.
+ *
+ * @param a: A pointer to the dividend
+ * @param b: A pointer to the divisor, which must not be 0
+ * @param quot: A pointer to store the quotient at, or NULL if not needed
+ * @param rem: A pointer to store the remainder at, or NULL if not needed
+ * @return: 0 on success, -1 if b is 0 or memory allocation fails
+ */
+int big_divmod(const bignum_t * a, const bignum_t * b, bignum_t ** quot, bignum_t ** rem) {
+        if(b->count == 0) return -1;
+
+        size_t qcount = a->count >= b->count ? a->count - b->count + 1 : 0;
+        bignum_t * q = alloc_big(qcount), * r = alloc_big(b->count);
+        if(!q || !r) goto fail;
+
+        if(a->count < b->count) {
+                memcpy(r->limbs, a->limbs, a->count * sizeof(uint32_t));
+                r->count = a->count;
+        } else if(b->count == 1) {
+                r->limbs[0] = divide_limb(a->limbs, a->count, b->limbs[0], q->limbs);
+        } else if(divide_mag(a->limbs, a->count, b->limbs, b->count, q->limbs, r->limbs) < 0) {
+                goto fail;
+        }
+
+        q->negative = a->negative != b->negative;
+        r->negative = a->negative;
+        if(quot) *quot = trim(q);
+        else free(q);
+        if(rem) *rem = trim(r);
+        else free(r);
+        return 0;
+
+fail:
+        free(q);
+        free(r);
+        return -1;
+}
+
+/**
+ * Converts a bignum to a machine integer, if it is in range.
+ *
+ * @param big: A pointer to the bignum
+ * @param min: The smallest value allowed
+ * @param max: The largest value allowed
+ * @param val: A pointer to store the value at
+ * @return: 0 on success, -1 if the value is out of range
+ */
+int big_to_long(const bignum_t * big, long long min, long long max, long long * val) {
+        if(big->count > 2) return -1;
+
+        uint64_t mag = big->count > 0 ? big->limbs[0] : 0;
+        if(big->count > 1) mag |= (uint64_t)big->limbs[1] << 32;
+
+        if(big->negative) {
+                if(mag > 0 - (uint64_t)min) return -1;
+                *val = mag == 0 - (uint64_t)min ? min : -(long long)mag;
+        } else {
+                if(mag > (uint64_t)max) return -1;
+                *val = (long long)mag;
+        }
+        return 0;
+}
+
+/**
+ * Writes a bignum in decimal.
+ *
+ * @param big: A pointer to the bignum
+ * @param buf: A pointer to the buffer to write into
+ * @param len: The size of the buffer
+ * @return: The length of the full text, which was cut short if it is len
+ *      or more, as with snprintf()
+ */
+size_t big_format(const bignum_t * big, char * buf, size_t len) {
+        if(big->count == 0) return (size_t)snprintf(buf, len, "0");
+
+        // nine decimal digits come off the magnitude per division
+        size_t cap = big->count * 32 / 29 + 2;
+        uint32_t * chunks = malloc((cap + big->count) * sizeof(uint32_t));
+        if(!chunks) return (size_t)snprintf(buf, len, "?");
+        uint32_t * mag = chunks + cap;
+        size_t count = big->count, n = 0;
+
+        memcpy(mag, big->limbs, count * sizeof(uint32_t));
+        while(count > 0) {
+                chunks[n++] = divide_limb(mag, count, BIG_CHUNK, mag);
+                while(count > 0 && mag[count - 1] == 0) count--;
+        }
+
+        size_t out = (size_t)snprintf(buf, len, "%s%u", big->negative ? "-" : "", chunks[n - 1]);
+        for(size_t i = n - 1; i-- > 0; ) {
+                out += (size_t)snprintf(out < len ? buf + out : NULL, out < len ? len - out : 0, "%09u", chunks[i]);
+        }
+        free(chunks);
+        return out;
+}
+
+/**
+ * Frees a bignum.
+ *
+ * @param big: A pointer to the bignum, or NULL
+ */
+void big_free(bignum_t * big) {
+        free(big);
+}
@@ -0,0 +1,36 @@
+/**
+ * Interface for arbitrary-precision integers, which hold the exact value
+ * of an intermediate result that no longer fits in a value_t. Bignums are
+ * immutable: every operation returns a new one, to be freed by the
+ * caller with big_free().
+ *
+ * @file        bignum.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stddef.h>
+
+/// A signed integer of any size, see big_from_long()
+typedef struct bignum_s bignum_t;
+
+bignum_t * big_from_long(long long val);
+
+bignum_t * big_parse(const char * p, size_t len);
+
+bignum_t * big_add(const bignum_t * a, const bignum_t * b);
+
+bignum_t * big_sub(const bignum_t * a, const bignum_t * b);
+
+bignum_t * big_mul(const bignum_t * a, const bignum_t * b);
+
+int big_divmod(const bignum_t * a, const bignum_t * b, bignum_t ** quot, bignum_t ** rem);
+
+int big_to_long(const bignum_t * big, long long min, long long max, long long * val);
+
+size_t big_format(const bignum_t * big, char * buf, size_t len);
+
+void big_free(bignum_t * big);
+
+#endif
@@ -0,0 +1,411 @@
+/**
+ * Implementation of the parallel tree builder. A single postfix
+ * expression is split at whitespace into one chunk per thread and built
+ * in three steps:
+ *
+ * - **Tokenize**: every thread finds and classifies the tokens of its
+ *   chunk, and sums the effect each token has on the depth of the operand
+ *   stack: +1 for an operand, -1 for a binary operator and -2 for `?`
+ * - **Scan**: an exclusive prefix sum over the chunk totals gives the
+ *   stack depth at the start of every chunk. The expression is valid if
+ *   the depth never has to drop below zero and ends at exactly one
+ * - **Build**: every thread builds the subtrees of its chunk with a local
+ *   stack. Operands an operator needs from before the chunk are left as
+ *   holes. The finished subtrees of a chunk are independent of every
+ *   other chunk, so the chunks are stitched together in order by filling
+ *   each chunk's holes from the subtrees left by the ones before it
+ *
+ * The result is the same tree that make_parse_tree() builds, and an
+ * expression that does not parse fails with the error read_tree() reports
+ * for it: the first operator the stack depth drops below zero at. An
+ * expression with a token the builder does not understand is handed to
+ * read_line() untouched, so it fails with the same error too.
+ *
+ * @file        builder.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "builder.h"
+#include "parser.h"
+#include "reader.h"
+#include "scan.h"
+#include "diag.h"
+
+/// The part of the expression given to one thread
+typedef struct chunk_s {
+        char * start; /// First byte of the chunk
+        char * end; /// Byte after the chunk, always whitespace or the terminator
+        char ** toks; /// Start of every token in the chunk
+        unsigned char * kinds; /// scan_kind_t of every token
+        size_t count, cap;
+        long depth; /// Net effect of the chunk on the stack depth
+        long low; /// Lowest the depth drops within the chunk, relative to its start
+        long base; /// Stack depth at the start of the chunk
+        tree_node_t ** stack; /// Finished subtrees, bottom first
+        size_t top;
+        tree_node_t * holes; /// Placeholders for operands from earlier chunks
+        tree_node_t ** * slots; /// Child pointer each placeholder ended up in
+        size_t nholes;
+        tree_node_t ** open; /// Nodes with a placeholder below them, children first
+        size_t nopen;
+        int other; /// Set if a token was not understood
+        int failed; /// Set if memory allocation failed
+        int started; /// Set if the chunk runs on its own thread
+        pthread_t thread;
+} chunk_t;
+
+/**
+ * Checks if a character separates tokens, as in make_parse_tree().
+ */
+static int is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * Finds the length of a token.
+ *
+ * @param tok: A pointer to the start of the token
+ * @return: The number of bytes up to the next separator or terminator
+ */
+static size_t token_length(const char * tok) {
+        size_t n = 0;
+        while(tok[n] != '\0' && !is_space(tok[n])) n++;
+        return n;
+}
+
+/**
+ * Finds how many operands a token pops.
+ */
+static int pops(scan_kind_t kind) {
+        return kind == SCAN_OPERATOR ? 2 : kind == SCAN_TERNARY ? 3 : 0;
+}
+
+/**
+ * Tokenize step: records and classifies the tokens of a chunk and sums
+ * their effect on the stack depth. The chunk is not modified.
+ *
+ * @param arg: A pointer to the chunk
+ * @return: NULL
+ */
+static void * tokenize(void * arg) {
+        chunk_t * chunk = arg;
+        char * p = chunk->start;
+
+        while(p < chunk->end) {
+                p += scan_space(p);
+                if(p >= chunk->end) break;
+
+                // the chunk ends at a separator, so no token runs past it
+                char * tok = p;
+                scan_kind_t kind;
+                p += scan_token(p, &kind);
+                if(kind == SCAN_OTHER) {
+                        chunk->other = 1;
+                        return NULL;
+                }
+
+                if(chunk->count == chunk->cap) {
+                        size_t ncap = chunk->cap ? chunk->cap * 2 : 1024;
+                        char ** toks = realloc(chunk->toks, ncap * sizeof(char *));
+                        if(toks) chunk->toks = toks;
+                        unsigned char * kinds = realloc(chunk->kinds, ncap);
+                        if(kinds) chunk->kinds = kinds;
+                        if(!toks || !kinds) {
+                                chunk->failed = 1;
+                                return NULL;
+                        }
+                        chunk->cap = ncap;
+                }
+                chunk->toks[chunk->count] = tok;
+                chunk->kinds[chunk->count++] = kind;
+
+                if(chunk->depth - pops(kind) < chunk->low) chunk->low = chunk->depth - pops(kind);
+                chunk->depth += 1 - pops(kind);
+        }
+        return NULL;
+}
+
+/**
+ * Checks if a node is one of a chunk's placeholders.
+ */
+static int is_hole(chunk_t * chunk, tree_node_t * node) {
+        return node >= chunk->holes && node < chunk->holes + chunk->nholes;
+}
+
+/**
+ * Pops the next operand, or a placeholder if it comes from an earlier chunk.
+ */
+static tree_node_t * pop_operand(chunk_t * chunk) {
+        if(chunk->top > 0) return chunk->stack[--chunk->top];
+        return &chunk->holes[chunk->nholes++];
+}
+
+/**
+ * Records where the placeholder children of a new interior node ended up.
+ * A node with a placeholder anywhere below it cannot know its size yet;
+ * it is marked with a size of 0 until the chunks are stitched.
+ */
+static void attach(chunk_t * chunk, tree_node_t * node) {
+        interior_node_t * interior = (interior_node_t *)node->node;
+
+        if(is_hole(chunk, interior->left)) chunk->slots[interior->left - chunk->holes] = &interior->left;
+        if(is_hole(chunk, interior->right)) chunk->slots[interior->right - chunk->holes] = &interior->right;
+
+        if(interior->left->size == 0 || interior->right->size == 0) {
+                node->size = 0;
+                chunk->open[chunk->nopen++] = node;
+        }
+}
+
+/**
+ * Frees a subtree that was never attached, leaving its placeholders be.
+ * The placeholders already attached deeper in the subtree must have been
+ * cleared by release().
+ */
+static void discard(chunk_t * chunk, tree_node_t * node) {
+        if(node == NULL || is_hole(chunk, node)) return;
+
+        if(node->type == INTERIOR) {
+                interior_node_t * interior = (interior_node_t *)node->node;
+                if(is_hole(chunk, interior->left)) interior->left = NULL;
+                if(is_hole(chunk, interior->right)) interior->right = NULL;
+        }
+        cleanup_tree(node);
+}
+
+/**
+ * Frees every subtree a chunk has built. Safe to call more than once.
+ *
+ * @param chunk: A pointer to the chunk
+ */
+static void release(chunk_t * chunk) {
+        for(size_t i = 0; i < chunk->nholes; i++) {
+                if(chunk->slots[i]) *chunk->slots[i] = NULL;
+                chunk->slots[i] = NULL;
+        }
+        while(chunk->top > 0) cleanup_tree(chunk->stack[--chunk->top]);
+}
+
+/**
+ * Build step: builds the subtrees of a chunk, leaving holes for the
+ * operands that come from earlier chunks.
+ *
+ * @param arg: A pointer to the chunk
+ * @return: NULL
+ */
+static void * build(void * arg) {
+        chunk_t * chunk = arg;
+        size_t needed = (size_t)-chunk->low;
+
+        chunk->stack = malloc((chunk->count ? chunk->count : 1) * sizeof(tree_node_t *));
+        chunk->holes = calloc(needed ? needed : 1, sizeof(tree_node_t));
+        chunk->slots = calloc(needed ? needed : 1, sizeof(tree_node_t **));
+        chunk->open = malloc((chunk->count ? chunk->count : 1) * sizeof(tree_node_t *));
+        if(!chunk->stack || !chunk->holes || !chunk->slots || !chunk->open) {
+                chunk->failed = 1;
+                return NULL;
+        }
+
+        for(size_t i = 0; i < chunk->count; i++) {
+                char * tok = chunk->toks[i];
+                size_t n = token_length(tok);
+                tree_node_t * node = NULL;
+
+                if(tok[n] != '\0') tok[n] = '\0';
+
+                if(chunk->kinds[i] == SCAN_INTEGER || chunk->kinds[i] == SCAN_SYMBOL) {
+                        node = make_leaf(chunk->kinds[i] == SCAN_INTEGER ? INTEGER : SYMBOL, tok);
+                } else if(chunk->kinds[i] == SCAN_OPERATOR) {
+                        tree_node_t * right = pop_operand(chunk);
+                        tree_node_t * left = pop_operand(chunk);
+
+                        node = make_interior(operator_type(tok), tok, left, right);
+                        if(node) attach(chunk, node);
+                        else {
+                                release(chunk);
+                                discard(chunk, left);
+                                discard(chunk, right);
+                        }
+                } else {
+                        tree_node_t * con = pop_operand(chunk);
+                        tree_node_t * t = pop_operand(chunk);
+                        tree_node_t * f = pop_operand(chunk);
+                        tree_node_t * alt = make_interior(ALT_OP, ALT_OP_STR, t, f);
+
+                        node = alt ? make_interior(Q_OP, tok, con, alt) : NULL;
+                        if(node) {
+                                attach(chunk, alt);
+                                attach(chunk, node);
+                        } else {
+                                release(chunk);
+                                if(alt) discard(chunk, alt);
+                                else {
+                                        discard(chunk, t);
+                                        discard(chunk, f);
+                                }
+                                discard(chunk, con);
+                        }
+                }
+
+                if(!node) {
+                        release(chunk);
+                        chunk->failed = 1;
+                        return NULL;
+                }
+                chunk->stack[chunk->top++] = node;
+        }
+        return NULL;
+}
+
+/**
+ * Runs one step on every chunk, each on its own thread. The first chunk,
+ * and any chunk a thread cannot be started for, runs on the caller's.
+ *
+ * @param chunks: A pointer to the chunks
+ * @param n: The number of chunks
+ * @param step: The step to run
+ */
+static void run_step(chunk_t * chunks, int n, void * (*step)(void *)) {
+        for(int k = 1; k < n; k++) {
+                chunks[k].started = pthread_create(&chunks[k].thread, NULL, step, &chunks[k]) == 0;
+                if(!chunks[k].started) step(&chunks[k]);
+        }
+        step(&chunks[0]);
+        for(int k = 1; k < n; k++) {
+                if(chunks[k].started) pthread_join(chunks[k].thread, NULL);
+        }
+}
+
+/**
+ * Reports the operator that has too few operands. Only called once the
+ * scan has found that chunk's depth drops below zero.
+ *
+ * @param chunk: A pointer to the chunk holding the operator
+ */
+static void report_underflow(chunk_t * chunk) {
+        long depth = chunk->base;
+
+        for(size_t i = 0; i < chunk->count; i++) {
+                int n = pops(chunk->kinds[i]);
+                if(depth - n < 0) {
+                        diag("\tError: not enough operands for operator '%.*s'\n",
+                                        (int)token_length(chunk->toks[i]), chunk->toks[i]);
+                        return;
+                }
+                depth += 1 - n;
+        }
+}
+
+/**
+ * Frees the bookkeeping of every chunk.
+ */
+static void free_chunks(chunk_t * chunks, int n) {
+        for(int k = 0; k < n; k++) {
+                free(chunks[k].toks);
+                free(chunks[k].kinds);
+                free(chunks[k].stack);
+                free(chunks[k].holes);
+                free(chunks[k].slots);
+                free(chunks[k].open);
+        }
+        free(chunks);
+}
+
+/**
+ * Constructs an AST from a space-separated postfix expression string,
+ * using several threads. The string is tokenized in place.
+ *
+ * @param exp: The postfix expression string
+ * @param threads: The most threads to use; fewer are used if the string
+ *      is short, so that each gets at least BUILDER_MIN_CHUNK bytes
+ * @return: Pointer to the root of the constructed AST or NULL on error
+ */
+tree_node_t * build_parse_tree(char * exp, int threads) {
+        if(!exp || exp[0] == '\0') return make_parse_tree(exp);
+
+        size_t len = strlen(exp);
+        int n = threads;
+        if((size_t)n > len / BUILDER_MIN_CHUNK) n = (int)(len / BUILDER_MIN_CHUNK);
+        if(n < 1) n = 1;
+
+        chunk_t * chunks = calloc(n, sizeof(chunk_t));
+        if(!chunks) {
+                perror("Failed to allocate chunks");
+                return NULL;
+        }
+
+        // cut at whitespace, so that no token spans two chunks
+        char * cut = exp;
+        for(int k = 0; k < n; k++) {
+                chunks[k].start = cut;
+                cut = k == n - 1 ? exp + len : exp + len / n * (k + 1);
+                if(cut < chunks[k].start) cut = chunks[k].start;
+                while(*cut != '\0' && !is_space(*cut)) cut++;
+                chunks[k].end = cut;
+        }
+
+        run_step(chunks, n, tokenize);
+
+        long depth = 0;
+        size_t count = 0;
+        int other = 0, failed = 0, underflow = -1;
+        for(int k = 0; k < n; k++) {
+                other |= chunks[k].other;
+                failed |= chunks[k].failed;
+                chunks[k].base = depth;
+                if(underflow < 0 && depth + chunks[k].low < 0) underflow = k;
+                depth += chunks[k].depth;
+                count += chunks[k].count;
+        }
+
+        if(other) {
+                free_chunks(chunks, n);
+                reader_t * reader = make_reader(NULL);
+                tree_node_t * tree = reader ? read_line(reader, exp) : NULL;
+                free_reader(reader);
+                return tree;
+        }
+        if(failed) {
+                diag("Error: Failed to tokenize expression\n");
+                free_chunks(chunks, n);
+                return NULL;
+        }
+        if(count == 0 || underflow >= 0 || depth != 1) {
+                if(count == 0) diag("Error: Empty expression\n");
+                else if(underflow >= 0) report_underflow(&chunks[underflow]);
+                else diag("Error: Invalid expression, too many tokens\n");
+                free_chunks(chunks, n);
+                return NULL;
+        }
+
+        run_step(chunks, n, build);
+
+        size_t outputs = 0;
+        for(int k = 0; k < n; k++) {
+                failed |= chunks[k].failed;
+                outputs += chunks[k].top;
+        }
+        tree_node_t ** stack = failed ? NULL : malloc(outputs * sizeof(tree_node_t *));
+        if(!stack) {
+                diag("Error: Failed to build expression tree\n");
+                for(int k = 0; k < n; k++) release(&chunks[k]);
+                free_chunks(chunks, n);
+                return NULL;
+        }
+
+        // the first hole a chunk made wants the top of the stack so far
+        size_t top = 0;
+        for(int k = 0; k < n; k++) {
+                for(size_t i = 0; i < chunks[k].nholes; i++) *chunks[k].slots[i] = stack[--top];
+                for(size_t i = 0; i < chunks[k].nopen; i++) measure_interior(chunks[k].open[i]);
+                for(size_t i = 0; i < chunks[k].top; i++) stack[top++] = chunks[k].stack[i];
+        }
+
+        tree_node_t * root = stack[0];
+        free(stack);
+        free_chunks(chunks, n);
+        return root;
+}
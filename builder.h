@@ -0,0 +1,18 @@
+/**
+ * Interface for the parallel tree builder, which builds the expression
+ * tree of one very long postfix expression on several threads.
+ *
+ * @file        builder.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef BUILDER_H
+#define BUILDER_H
+
+#include "tree_node.h"
+
+#define BUILDER_MIN_CHUNK 4096 /// Fewest bytes of input given to one thread
+#define BUILDER_MIN_LENGTH (1024 * 1024) /// Shortest line worth building in parallel
+
+tree_node_t * build_parse_tree(char * exp, int threads);
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * Implementation of error reporting. The sink is kept per thread, so
+ * threads working for different interpreter contexts never see each
+ * other's errors. A thread that hands work to other threads reports the
+ * errors they kept for it (see forkjoin.c).
+ *
+ * @file        diag.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include "diag.h"
+
+#define DIAG_BUFLEN 512 /// Longest message passed to a sink; the rest is cut
+
+static _Thread_local diag_sink_t sink = NULL; /// Sink of the current thread, NULL for stderr
+static _Thread_local void * sink_arg = NULL;
+
+/**
+ * Reports an error. Messages are formatted as for printf() and end in a
+ * newline, which goes to standard error as is.
+ *
+ * @param fmt: The format of the message
+ */
+void diag(const char * fmt, ...) {
+        va_list args;
+
+        va_start(args, fmt);
+        if(sink == NULL) {
+                vfprintf(stderr, fmt, args);
+        } else {
+                char msg[DIAG_BUFLEN];
+                vsnprintf(msg, sizeof(msg), fmt, args);
+                sink(msg, sink_arg);
+        }
+        va_end(args);
+}
+
+/**
+ * Sends the errors the calling thread reports to a function instead of
+ * standard error.
+ *
+ * @param fn: The function to call with each formatted message, or NULL to
+ *      go back to standard error
+ * @param arg: An argument passed through to fn
+ */
+void set_diag_sink(diag_sink_t fn, void * arg) {
+        sink = fn;
+        sink_arg = fn ? arg : NULL;
+}
+
+/**
+ * Reads the sink of the calling thread, to restore it or pass it on.
+ *
+ * @param fn: A pointer to store the function at, NULL for standard error
+ * @param arg: A pointer to store its argument at
+ */
+void get_diag_sink(diag_sink_t * fn, void ** arg) {
+        *fn = sink;
+        *arg = sink_arg;
+}
@@ -0,0 +1,22 @@
+/**
+ * Interface for error reporting. The parser, tree builders and loader
+ * report the errors they find through diag(), which writes them to
+ * standard error unless the calling thread has installed a sink of its
+ * own, as an interpreter context does to keep its errors.
+ *
+ * @file        diag.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef DIAG_H
+#define DIAG_H
+
+/// Receiver of error messages, see set_diag_sink()
+typedef void (*diag_sink_t)(const char * msg, void * arg);
+
+void diag(const char * fmt, ...) __attribute__((format(printf, 1, 2)));
+
+void set_diag_sink(diag_sink_t fn, void * arg);
+
+void get_diag_sink(diag_sink_t * fn, void ** arg);
+
+#endif
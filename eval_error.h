@@ -0,0 +1,45 @@
+/**
+ * Definition of the errors an evaluation reports, and their names as the
+ * NDJSON output format and the server write them. Kept apart from
+ * parser.h so that code that only reports errors, such as the server,
+ * does not take in the parser's stack_t, which <signal.h> also defines.
+ *
+ * @file        eval_error.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef EVAL_ERROR_H
+#define EVAL_ERROR_H
+
+/// Why an expression produced no value
+typedef enum eval_error_e {
+        EVAL_OK,
+        EVAL_PARSE_ERROR,
+        EVAL_UNDEFINED_SYMBOL,
+        EVAL_DIVISION_BY_ZERO,
+        EVAL_INVALID_ASSIGNMENT,
+        EVAL_INVALID_OPERATOR,
+        EVAL_OVERFLOW, /// The result, or a value assigned, does not fit in a value_t
+        EVAL_NOT_DURABLE /// The result depends on a write the log failed to make durable
+} eval_error_t;
+
+/**
+ * Names an evaluation error.
+ *
+ * @param status: The error
+ * @return: A pointer to the name, e.g. "division_by_zero"
+ */
+static inline const char * eval_error_name(eval_error_t status) {
+        static const char * const names[] = {
+                [EVAL_OK] = "ok",
+                [EVAL_PARSE_ERROR] = "parse_error",
+                [EVAL_UNDEFINED_SYMBOL] = "undefined_symbol",
+                [EVAL_DIVISION_BY_ZERO] = "division_by_zero",
+                [EVAL_INVALID_ASSIGNMENT] = "invalid_assignment",
+                [EVAL_INVALID_OPERATOR] = "invalid_operator",
+                [EVAL_OVERFLOW] = "overflow",
+                [EVAL_NOT_DURABLE] = "not_durable"
+        };
+        return names[status];
+}
+
+#endif
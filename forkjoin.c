@@ -0,0 +1,354 @@
+/**
+ * Implementation of the fork-join evaluator. A tree without assignments
+ * reads nothing but one pinned version of the symbol table, so its two
+ * operands can be evaluated at the same time.
+ *
+ * Every worker owns a deque of forked subtrees. To evaluate an operator,
+ * a worker pushes its right operand onto the bottom of its own deque,
+ * evaluates the left operand itself, then pops the right operand back and
+ * evaluates it too, unless an idle worker has stolen it from the top of
+ * the deque in the meantime. While waiting for a stolen operand, a worker
+ * steals work from the others instead of blocking. A thief keeps the
+ * errors it reports in the task, and the worker that forked it reports
+ * them once its left operand is done, so they come out in the same order
+ * as they would sequentially. Subtrees smaller than
+ * FORK_CUTOFF nodes are evaluated sequentially, so the cost of a fork is
+ * spread over thousands of nodes.
+ *
+ * The deques are the lock-free deques of Chase and Lev: only the owner
+ * touches the bottom, thieves race for the top with a compare-and-swap.
+ * The thread that calls fork_eval() acts as worker 0 for the duration of
+ * the evaluation; one evaluation runs on the pool at a time, and any other
+ * caller evaluates sequentially instead of waiting.
+ *
+ * @file        forkjoin.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "forkjoin.h"
+#include "parser.h"
+#include "diag.h"
+
+/// A forked subtree and, once evaluated, its value
+typedef struct task_s {
+        tree_node_t * node;
+        symtab_snapshot_t * snap;
+        num_t result; /// Exact, see apply_num()
+        eval_error_t err; /// First error in the subtree
+        atomic_int done; /// Set once result, err and msgs are valid
+        char * msgs; /// Errors a thief reported, each ending in a '\0'
+        size_t msgs_len;
+} task_t;
+
+/// A worker's deque of forked subtrees
+typedef struct deque_s {
+        atomic_long top; /// Next slot thieves steal from
+        atomic_long bottom; /// Next slot the owner pushes to
+        _Atomic(task_t *) tasks[FORK_DEQUE_SIZE];
+} deque_t;
+
+static deque_t deques[FORK_MAX_WORKERS];
+static pthread_t threads[FORK_MAX_WORKERS];
+static int workers = 0; /// Number of deques, including the caller's slot 0
+static int started = 0; /// Number of worker threads running
+static _Thread_local int self = 0; /// Index of the current thread's deque
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER; /// Held while an evaluation runs
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER; /// Signals idle workers
+static atomic_int busy; /// Set while an evaluation runs
+static int stopping = 0;
+
+/**
+ * Pushes a task onto the bottom of the current worker's deque.
+ *
+ * @param d: A pointer to the worker's deque
+ * @param task: A pointer to the task
+ * @return: 0 on success, -1 if the deque is full
+ */
+static int push_task(deque_t * d, task_t * task) {
+        long b = atomic_load(&d->bottom);
+        long t = atomic_load(&d->top);
+
+        if(b - t >= FORK_DEQUE_SIZE) return -1;
+        atomic_store(&d->tasks[b % FORK_DEQUE_SIZE], task);
+        atomic_store(&d->bottom, b + 1);
+        return 0;
+}
+
+/**
+ * Pops the task at the bottom of the current worker's deque.
+ *
+ * @param d: A pointer to the worker's deque
+ * @return: A pointer to the task, or NULL if the deque is empty or the
+ *      last task was stolen
+ */
+static task_t * pop_task(deque_t * d) {
+        long b = atomic_load(&d->bottom) - 1;
+        atomic_store(&d->bottom, b);
+        long t = atomic_load(&d->top);
+
+        if(t > b) {
+                atomic_store(&d->bottom, b + 1);
+                return NULL;
+        }
+
+        task_t * task = atomic_load(&d->tasks[b % FORK_DEQUE_SIZE]);
+        if(t == b) {
+                // the last task: race the thieves for it
+                if(!atomic_compare_exchange_strong(&d->top, &t, t + 1)) task = NULL;
+                atomic_store(&d->bottom, b + 1);
+        }
+        return task;
+}
+
+/**
+ * Steals the task at the top of another worker's deque.
+ *
+ * @param d: A pointer to the victim's deque
+ * @return: A pointer to the task, or NULL if there was nothing to steal
+ *      or another thief got it first
+ */
+static task_t * steal_task(deque_t * d) {
+        long t = atomic_load(&d->top);
+        long b = atomic_load(&d->bottom);
+
+        if(t >= b) return NULL;
+
+        task_t * task = atomic_load(&d->tasks[t % FORK_DEQUE_SIZE]);
+        if(!atomic_compare_exchange_strong(&d->top, &t, t + 1)) return NULL;
+        return task;
+}
+
+/**
+ * Tries to steal a task from every other worker, starting at a random one.
+ *
+ * @param seed: A pointer to the caller's random seed
+ * @return: A pointer to the task, or NULL if there was none
+ */
+static task_t * steal_any(unsigned int * seed) {
+        int start = rand_r(seed) % workers;
+
+        for(int i = 0; i < workers; i++) {
+                int victim = (start + i) % workers;
+                if(victim == self) continue;
+
+                task_t * task = steal_task(&deques[victim]);
+                if(task) return task;
+        }
+        return NULL;
+}
+
+static void run_task(task_t * task);
+
+/**
+ * Keeps an error a thief reports in its task. A message that does not fit
+ * in memory is dropped; the task's error status still records it.
+ *
+ * @param msg: A pointer to the formatted message
+ * @param arg: A pointer to the task
+ */
+static void keep_msg(const char * msg, void * arg) {
+        task_t * task = arg;
+        size_t len = strlen(msg) + 1;
+
+        char * msgs = realloc(task->msgs, task->msgs_len + len);
+        if(!msgs) return;
+        memcpy(msgs + task->msgs_len, msg, len);
+        task->msgs = msgs;
+        task->msgs_len += len;
+}
+
+/**
+ * Reports the errors a thief kept in a task, in the order it found them.
+ *
+ * @param task: A pointer to the finished task
+ */
+static void report_msgs(task_t * task) {
+        for(size_t i = 0; i < task->msgs_len; i += strlen(task->msgs + i) + 1) diag("%s", task->msgs + i);
+        free(task->msgs);
+}
+
+/**
+ * Evaluates a subtree without assignments, forking its operands while it
+ * is large. Errors are reported in the same order as sequential
+ * evaluation would, left operand first.
+ *
+ * @param node: A pointer to the root of the subtree
+ * @param snap: The pinned snapshot
+ * @param err: A pointer to the evaluation's error status
+ * @return: The exact result of the evaluation
+ */
+static num_t eval_task(tree_node_t * node, symtab_snapshot_t * snap, eval_error_t * err) {
+        if(node->type != INTERIOR || node->size < FORK_CUTOFF) return eval_snapshot_num(node, snap, err);
+
+        interior_node_t * interior = (interior_node_t *)node->node;
+
+        // a ternary's arm depends on its condition, so nothing to fork
+        if(interior->op == Q_OP) {
+                tree_node_t * arms = interior->right;
+                if(arms->type != INTERIOR || ((interior_node_t *)arms->node)->op != ALT_OP) return eval_snapshot_num(node, snap, err);
+
+                interior_node_t * alt = (interior_node_t *)arms->node;
+                num_t condition = eval_task(interior->left, snap, err);
+                int taken = condition.big != NULL || condition.val != 0;
+                free_num(condition);
+                return eval_task(taken ? alt->left : alt->right, snap, err);
+        }
+
+        task_t right = { interior->right, snap, NUM(0), EVAL_OK, 0, NULL, 0 };
+        deque_t * d = &deques[self];
+
+        if(push_task(d, &right) < 0) {
+                num_t left = eval_task(interior->left, snap, err);
+                return apply_num(interior->op, left, eval_task(interior->right, snap, err), err);
+        }
+
+        num_t left = eval_task(interior->left, snap, err);
+
+        if(pop_task(d) == &right) {
+                right.result = eval_task(right.node, snap, &right.err);
+        } else {
+                // stolen: help out until the thief is done with it
+                unsigned int seed = (unsigned int)(uintptr_t)&right;
+                while(!atomic_load(&right.done)) {
+                        task_t * task = steal_any(&seed);
+                        if(task) run_task(task);
+                        else sched_yield();
+                }
+                report_msgs(&right);
+        }
+
+        if(*err == EVAL_OK) *err = right.err;
+        return apply_num(interior->op, left, right.result, err);
+}
+
+/**
+ * Evaluates a stolen task and publishes its result. Errors are kept in
+ * the task for the thread that forked it to report.
+ *
+ * @param task: A pointer to the task
+ */
+static void run_task(task_t * task) {
+        diag_sink_t sink;
+        void * sink_arg;
+
+        get_diag_sink(&sink, &sink_arg);
+        set_diag_sink(keep_msg, task);
+        task->result = eval_task(task->node, task->snap, &task->err);
+        set_diag_sink(sink, sink_arg);
+        atomic_store(&task->done, 1);
+}
+
+/**
+ * Worker thread: steals tasks while an evaluation runs and sleeps
+ * otherwise.
+ *
+ * @param arg: The worker's index, cast to a pointer
+ * @return: NULL
+ */
+static void * worker(void * arg) {
+        unsigned int seed = (unsigned int)(uintptr_t)arg;
+        int idle = 0;
+
+        self = (int)(uintptr_t)arg;
+
+        pthread_mutex_lock(&idle_lock);
+        while(!stopping) {
+                if(!atomic_load(&busy)) {
+                        pthread_cond_wait(&wake, &idle_lock);
+                        continue;
+                }
+                pthread_mutex_unlock(&idle_lock);
+
+                while(atomic_load(&busy)) {
+                        task_t * task = steal_any(&seed);
+                        if(task) {
+                                run_task(task);
+                                idle = 0;
+                        } else if(++idle > 64) {
+                                sched_yield();
+                        }
+                }
+
+                pthread_mutex_lock(&idle_lock);
+        }
+        pthread_mutex_unlock(&idle_lock);
+        return NULL;
+}
+
+/**
+ * Starts the worker pool. Does nothing if it is already running.
+ *
+ * @param count: The number of threads to evaluate on, including the
+ *      caller's; at most FORK_MAX_WORKERS
+ * @return: 0 on success, -1 if no worker could be started
+ */
+int start_workers(int count) {
+        if(workers > 0) return 0;
+        if(count > FORK_MAX_WORKERS) count = FORK_MAX_WORKERS;
+        if(count < 2) return -1;
+
+        // a worker that fails to start just leaves its deque empty
+        stopping = 0;
+        workers = count;
+        for(int i = 1; i < count; i++) {
+                if(pthread_create(&threads[started], NULL, worker, (void *)(uintptr_t)i) == 0) started++;
+        }
+        if(started == 0) {
+                workers = 0;
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Evaluates a tree without assignments on the worker pool.
+ *
+ * @param node: A pointer to the root of the tree, which must be pure
+ * @param snap: The pinned snapshot to read symbols from
+ * @param result: A pointer to store the exact result at
+ * @param err: A pointer to the evaluation's error status
+ * @return: 0 on success, -1 if the pool is not running or busy, in which
+ *      case the caller should evaluate the tree itself
+ */
+int fork_eval(tree_node_t * node, symtab_snapshot_t * snap, num_t * result, eval_error_t * err) {
+        if(workers == 0 || pthread_mutex_trylock(&job_lock) != 0) return -1;
+
+        int caller = self;
+        self = 0;
+
+        pthread_mutex_lock(&idle_lock);
+        atomic_store(&busy, 1);
+        pthread_cond_broadcast(&wake);
+        pthread_mutex_unlock(&idle_lock);
+
+        *result = eval_task(node, snap, err);
+
+        atomic_store(&busy, 0);
+        self = caller;
+        pthread_mutex_unlock(&job_lock);
+        return 0;
+}
+
+/**
+ * Stops the worker pool and waits for its threads to exit.
+ */
+void stop_workers(void) {
+        if(workers == 0) return;
+
+        pthread_mutex_lock(&idle_lock);
+        stopping = 1;
+        pthread_cond_broadcast(&wake);
+        pthread_mutex_unlock(&idle_lock);
+
+        for(int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        started = 0;
+        workers = 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * Interface for the fork-join evaluator, which evaluates large expression
+ * trees without assignments on a pool of work-stealing threads.
+ *
+ * @file        forkjoin.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef FORKJOIN_H
+#define FORKJOIN_H
+
+#include "parser.h"
+
+#define FORK_CUTOFF 4096 /// Subtrees smaller than this are evaluated sequentially
+#define FORK_MIN_SIZE 65536 /// Smallest tree worth waking the workers for
+#define FORK_MAX_WORKERS 64
+#define FORK_DEQUE_SIZE 1024 /// Most forked subtrees one worker can have pending
+
+int start_workers(int workers);
+
+int fork_eval(tree_node_t * node, symtab_snapshot_t * snap, num_t * result, eval_error_t * err);
+
+void stop_workers(void);
+
+#endif
@@ -0,0 +1,324 @@
+/**
+ * Implementation of the string interning pool. The pool is split into
+ * shards by the top bits of each string's hash, so threads parsing at the
+ * same time rarely wait on each other. Each shard is an open-addressing
+ * hash table of records, and the records are carved out of large blocks
+ * that are never freed or moved, which is what keeps handles stable.
+ *
+ * Adding a string takes its shard's lock, but finding one does not: a
+ * record is filled in before it is stored into its slot with a release
+ * store, and a grown table is filled in before it is published the same
+ * way, so a reader that loads either with acquire sees a whole record. A
+ * table that was replaced is kept, since a reader may still be probing
+ * it; together the replaced tables are never larger than the current one.
+ *
+ * Only names and operators are interned: integer literals are kept with
+ * their tree nodes, so the pool grows with the number of distinct names a
+ * program uses rather than with the numbers it is fed.
+ *
+ * @file        intern.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "intern.h"
+
+#define INTERN_SHARD_BITS 6
+#define INTERN_SHARDS (1 << INTERN_SHARD_BITS)
+#define INTERN_BLOCK 16384 /// Bytes of records in each block
+#define INTERN_MIN_SLOTS 64
+
+/// A block that records are carved out of, linked to the previous one
+typedef struct block_s {
+        struct block_s * prev;
+        char data[];
+} block_t;
+
+/// An open-addressing table of records, replaced whole when it grows
+typedef struct table_s {
+        struct table_s * prev; /// The table this one replaced
+        size_t cap; /// Number of slots, a power of two
+        interned_t * _Atomic slots[]; /// NULL where empty
+} table_t;
+
+/// One part of the pool, holding the strings whose hashes select it
+typedef struct shard_s {
+        pthread_mutex_t lock; /// Held while adding a string
+        table_t * _Atomic table; /// NULL until the first string is added
+        size_t count; /// Number of strings
+        size_t bytes; /// Bytes of records and slots
+        block_t * blocks; /// Newest block, whose free space starts at free
+        char * free;
+        size_t left; /// Free bytes in the newest block
+} shard_t;
+
+static shard_t shards[INTERN_SHARDS];
+static pthread_once_t shards_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Initializes the locks of every shard, once.
+ */
+static void init_shards(void) {
+        for(int i = 0; i < INTERN_SHARDS; i++) pthread_mutex_init(&shards[i].lock, NULL);
+}
+
+/**
+ * Hashes a string of known length (32-bit FNV-1a), the same way the
+ * symbol table hashes names.
+ *
+ * @param p: A pointer to the text
+ * @param len: The length of the text
+ * @return: The hash of the text
+ */
+static unsigned int hash_text(const char * p, size_t len) {
+        unsigned int hash = 2166136261u;
+
+        for(size_t i = 0; i < len; i++) {
+                hash ^= (unsigned char)p[i];
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+/**
+ * Checks whether a record holds a string.
+ *
+ * @param rec: A pointer to the record
+ * @param p: A pointer to the text
+ * @param len: The length of the text
+ * @param hash: The hash of the text
+ * @return: 1 if the record holds the text, 0 otherwise
+ */
+static int holds(interned_t * rec, const char * p, size_t len, unsigned int hash) {
+        return rec->hash == hash && rec->len == len && memcmp(rec->text, p, len) == 0;
+}
+
+/**
+ * Finds the slot of a string in a table: the slot holding it, or the
+ * empty slot it would go into. Must be called with the shard's lock
+ * held, or on a table nobody else can see yet, since the empty slot it
+ * returns may be filled by another thread otherwise.
+ *
+ * @param table: A pointer to the table
+ * @param p: A pointer to the text
+ * @param len: The length of the text
+ * @param hash: The hash of the text
+ * @return: A pointer to the slot
+ */
+static interned_t * _Atomic * probe(table_t * table, const char * p, size_t len, unsigned int hash) {
+        size_t mask = table->cap - 1;
+
+        for(size_t i = hash & mask; ; i = (i + 1) & mask) {
+                interned_t * rec = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+                if(rec == NULL || holds(rec, p, len, hash)) return &table->slots[i];
+        }
+}
+
+/**
+ * Doubles the table of a shard, or makes its first one. The new table is
+ * filled in before it is published. Must be called with the shard's lock
+ * held.
+ *
+ * @param shard: A pointer to the shard
+ * @return: The new table, or NULL if memory allocation fails
+ */
+static table_t * grow(shard_t * shard) {
+        table_t * old = atomic_load_explicit(&shard->table, memory_order_relaxed);
+        size_t cap = old ? old->cap * 2 : INTERN_MIN_SLOTS;
+        table_t * table = calloc(1, sizeof(table_t) + cap * sizeof(interned_t *));
+
+        if(!table) {
+                perror("Failed to grow string pool");
+                return NULL;
+        }
+
+        table->prev = old;
+        table->cap = cap;
+        for(size_t i = 0; old && i < old->cap; i++) {
+                interned_t * rec = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+                if(rec) atomic_store_explicit(probe(table, rec->text, rec->len, rec->hash), rec, memory_order_relaxed);
+        }
+        atomic_store_explicit(&shard->table, table, memory_order_release);
+        shard->bytes += sizeof(table_t) + cap * sizeof(interned_t *);
+        return table;
+}
+
+/**
+ * Makes room for a record in a shard's blocks. Must be called with the
+ * shard's lock held.
+ *
+ * @param shard: A pointer to the shard
+ * @param size: The size of the record
+ * @return: A pointer to the room, or NULL if memory allocation fails
+ */
+static void * carve(shard_t * shard, size_t size) {
+        // records stay aligned for their header
+        size = (size + _Alignof(interned_t) - 1) & ~(_Alignof(interned_t) - 1);
+
+        if(size > shard->left) {
+                // a long string gets a block of its own and leaves the
+                // free space of the current one alone
+                size_t cap = size > INTERN_BLOCK / 4 ? size : INTERN_BLOCK;
+                block_t * block = malloc(sizeof(block_t) + cap);
+                if(!block) {
+                        perror("Failed to grow string pool");
+                        return NULL;
+                }
+                shard->bytes += sizeof(block_t) + cap;
+
+                if(cap != INTERN_BLOCK && shard->blocks) {
+                        block->prev = shard->blocks->prev;
+                        shard->blocks->prev = block;
+                        return block->data;
+                }
+                block->prev = shard->blocks;
+                shard->blocks = block;
+                shard->free = block->data;
+                shard->left = cap;
+        }
+
+        void * room = shard->free;
+        shard->free += size;
+        shard->left -= size;
+        return room;
+}
+
+/**
+ * Finds a string in the pool without taking a lock.
+ *
+ * @param p: A pointer to the text, need not be terminated
+ * @param len: The length of the text
+ * @param hash: The hash of the text
+ * @return: The handle of the string, or NULL if it was not interned
+ *      before the call
+ */
+static const char * find(const char * p, size_t len, unsigned int hash) {
+        shard_t * shard = &shards[hash >> (32 - INTERN_SHARD_BITS)];
+        table_t * table = atomic_load_explicit(&shard->table, memory_order_acquire);
+        if(table == NULL) return NULL;
+
+        // each slot is loaded once: an empty slot may be filled with
+        // another string as soon as it has been seen empty. The probe
+        // ends, as a table is never more than half full
+        size_t mask = table->cap - 1;
+        for(size_t i = hash & mask; ; i = (i + 1) & mask) {
+                interned_t * rec = atomic_load_explicit(&table->slots[i], memory_order_acquire);
+                if(rec == NULL) return NULL;
+                if(holds(rec, p, len, hash)) return rec->text;
+        }
+}
+
+/**
+ * Looks up a string in the pool, adding it if it is missing.
+ *
+ * @param p: A pointer to the text, need not be terminated
+ * @param len: The length of the text
+ * @return: The handle of the string, or NULL if memory allocation fails
+ */
+static const char * lookup(const char * p, size_t len) {
+        unsigned int hash = hash_text(p, len);
+        shard_t * shard = &shards[hash >> (32 - INTERN_SHARD_BITS)];
+        const char * handle = find(p, len, hash);
+
+        if(handle || len > 0xffffffffu) return handle;
+
+        pthread_once(&shards_once, init_shards);
+        pthread_mutex_lock(&shard->lock);
+
+        // another thread may have added it since
+        table_t * table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+        interned_t * _Atomic * slot = table ? probe(table, p, len, hash) : NULL;
+        interned_t * rec = slot ? atomic_load_explicit(slot, memory_order_relaxed) : NULL;
+        if(rec == NULL) {
+                // keep the table at most half full
+                if(!table || (shard->count + 1) * 2 > table->cap) {
+                        table = grow(shard);
+                        slot = table ? probe(table, p, len, hash) : NULL;
+                }
+
+                rec = slot ? carve(shard, sizeof(interned_t) + len + 1) : NULL;
+                if(rec) {
+                        rec->hash = hash;
+                        rec->len = (unsigned int)len;
+                        memcpy(rec->text, p, len);
+                        rec->text[len] = '\0';
+                        atomic_store_explicit(slot, rec, memory_order_release);
+                        shard->count++;
+                }
+        }
+
+        pthread_mutex_unlock(&shard->lock);
+        return rec ? rec->text : NULL;
+}
+
+/**
+ * Interns the first len characters of a string.
+ *
+ * @param p: A pointer to the text, need not be terminated
+ * @param len: The length of the text
+ * @return: The handle of the string, or NULL if memory allocation fails
+ */
+const char * intern_len(const char * p, size_t len) {
+        return lookup(p, len);
+}
+
+/**
+ * Interns a string.
+ *
+ * @param str: A pointer to the terminated text
+ * @return: The handle of the string, or NULL if memory allocation fails
+ */
+const char * intern(const char * str) {
+        return lookup(str, strlen(str));
+}
+
+/**
+ * Finds the handle of a string without adding it to the pool. A string
+ * that was never interned cannot name a symbol, so lookups by name use
+ * this to avoid growing the pool with names that do not exist. Never
+ * takes a lock, so lookups by name never block.
+ *
+ * @param str: A pointer to the terminated text
+ * @return: The handle of the string, or NULL if it was never interned
+ */
+const char * intern_find(const char * str) {
+        size_t len = strlen(str);
+        return find(str, len, hash_text(str, len));
+}
+
+/**
+ * Counts the strings in the pool.
+ *
+ * @return: The number of distinct strings interned so far
+ */
+size_t intern_count(void) {
+        size_t count = 0;
+
+        pthread_once(&shards_once, init_shards);
+        for(int i = 0; i < INTERN_SHARDS; i++) {
+                pthread_mutex_lock(&shards[i].lock);
+                count += shards[i].count;
+                pthread_mutex_unlock(&shards[i].lock);
+        }
+        return count;
+}
+
+/**
+ * Measures the memory the pool takes up.
+ *
+ * @return: The bytes of blocks and hash tables allocated so far
+ */
+size_t intern_bytes(void) {
+        size_t bytes = 0;
+
+        pthread_once(&shards_once, init_shards);
+        for(int i = 0; i < INTERN_SHARDS; i++) {
+                pthread_mutex_lock(&shards[i].lock);
+                bytes += shards[i].bytes;
+                pthread_mutex_unlock(&shards[i].lock);
+        }
+        return bytes;
+}
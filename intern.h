@@ -0,0 +1,45 @@
+/**
+ * Interface for the string interning pool. Every distinct symbol name and
+ * operator is stored once, and interning the same text again gives back
+ * the same handle: a pointer to the pool's terminated copy, so two
+ * interned names are equal exactly when their handles are. Handles stay
+ * valid for the life of the process and may be used from any thread.
+ * Finding a string with intern_find() never takes a lock.
+ *
+ * @file        intern.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+/// The record every handle points into, see intern_hash()
+typedef struct interned_s {
+        unsigned int hash; /// 32-bit FNV-1a hash of the text
+        unsigned int len; /// Length of the text
+        char text[]; /// The text, terminated; a handle points here
+} interned_t;
+
+const char * intern(const char * str);
+
+const char * intern_len(const char * p, size_t len);
+
+const char * intern_find(const char * str);
+
+size_t intern_count(void);
+
+size_t intern_bytes(void);
+
+/**
+ * Reads the hash stored with an interned string, which is the 32-bit
+ * FNV-1a hash of its text.
+ *
+ * @param handle: A handle from intern() or intern_len()
+ * @return: The hash of the text
+ */
+static inline unsigned int intern_hash(const char * handle) {
+        return ((const interned_t *)(handle - offsetof(interned_t, text)))->hash;
+}
+
+#endif
@@ -1,4 +1,4 @@
-
+/**
  * A postfix expression interpreter with symbol table support.
  * This program evaluates postfix expressions, optionally using a
  * symbol table for variable bindings. It supports basic arithmetic and
@@ -12,10 +12,36 @@
  *
  * ## Usage:
  * ```bash
- * ./interp [symbol-table-file]
+ * ./interp [-s socket | -j parsers] [-w log [-W budget-ms]] [-P profile.json] [-M entries]
+ *          [-T runs] [-o format] [-f expressions [-c artifact | -C artifact]] [symbol-table-file]
  * ```
  * If a symbol table file is provided, it loads the variables into memory before
- * processing expressions.
+ * processing expressions. With -s, the interpreter runs as a server and
+ * evaluates expressions sent to the given Unix domain socket instead of
+ * reading standard input, on one worker thread per processor. With -j,
+ * standard input is processed as a batch by a pipeline that parses with
+ * the given number of threads. With -w, every
+ * addition and assignment is recorded in a write-ahead log, which is replayed
+ * on the next start; -W sets how many milliseconds a write may wait for the
+ * log to be synced to disk. With -P, the parse and eval time of every line is
+ * profiled and written to the given file as JSON on exit. With -M, the
+ * results of expressions without assignments are cached in a table of the
+ * given number of entries and reused while the symbols they read are not
+ * written; the hit rate and memory use are reported on exit. With -T, an
+ * expression that has run the given number of times, on any lines, is
+ * compiled in the background and runs its compiled program from then on;
+ * the runs and time in each tier are reported on exit. With -o, results
+ * are written as text (the default), ndjson or binary records; the machine
+ * formats leave out the prompts and the symbol table dumps. With -f,
+ * expressions are read from the given file instead of standard input. With
+ * -C, that file is compiled into the given artifact, and nothing is
+ * evaluated; with -c, the expressions are taken from the given artifact
+ * without parsing them again, unless it is stale, in which case the file is
+ * read as usual.
+ *
+ * The interpreter is a client of the embeddable library (libinterp.h): its
+ * symbols live in one interpreter context, and every expression is
+ * prepared for and executed in that context.
  *
  * @file        interp.c
  * @author      Sophia Le (sel5881@rit.edu)
@@ -24,190 +50,237 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-#include "stack.h"
+#include <unistd.h>
+#include "parser.h"
 #include "symtab.h"
+#include "libinterp.h"
+#include "server.h"
+#include "pipeline.h"
+#include "wal.h"
+#include "profile.h"
+#include "forkjoin.h"
+#include "output.h"
+#include "reader.h"
+#include "memo.h"
+#include "artifact.h"
+#include "tier.h"
 
-#define MAX_LINE_LENGTH 1024
 #define MAX_INFIX_LENGTH 1024
+#define USAGE "usage: interp [-s socket | -j parsers] [-w log [-W budget-ms]] [-P profile.json] [-M entries] " \
+        "[-T runs] [-o format] [-f expressions [-c artifact | -C artifact]] [sym-table]\n"
+
+static interp_t * ctx = NULL; /// The context every expression runs in
+static interp_expr_t * prepared[TIER_CACHE_SIZE]; /// Expressions kept by structure while tiering
 
 /**
- * Loads a symbol table from a file.
+ * Loads a symbol table from a file, exiting if it cannot be loaded.
  *
  * @param filename: A path to the file containing symbol definitions
  */
 void load(const char *filename) {
-        FILE *file = fopen(filename, "r");
-
-        if(!file) {
-                perror(filename);
+        if(interp_load(ctx, filename) != INTERP_OK) {
+                interp_destroy(ctx);
                 exit(EXIT_FAILURE);
         }
+}
 
-        char line[BUFLEN];
-        while(fgets(line, sizeof(line), file)) {
-                char *start = line;
-                while (isspace(*start)) start++;
+/**
+ * Prepares the tree of a line. While tiering, an expression read before is
+ * not prepared again: the tree is freed and the earlier expression, with
+ * its run count and compiled program, is given instead. Expressions are
+ * kept by structural hash, a new one replacing whatever was in its place.
+ *
+ * @param tree: A pointer to the root of the tree, owned by the expression
+ *      afterwards, may be NULL
+ * @return: A pointer to the prepared expression, to be passed to
+ *      finish(), or NULL if the tree is NULL or memory allocation fails
+ */
+static interp_expr_t * prepare(tree_node_t * tree) {
+        if(tree == NULL) return NULL;
+        if(!tier_enabled() || tree->size >= TIER_MAX_SIZE) return interp_prepare_tree(ctx, tree);
 
-                if(*start == '\0' || *start == '#') continue;
+        interp_expr_t ** entry = &prepared[tree->hash % TIER_CACHE_SIZE];
+        if(*entry && same_tree(interp_tree(*entry), tree)) {
+                cleanup_tree(tree);
+                return *entry;
+        }
+        interp_release(*entry);
+        return *entry = interp_prepare_tree(ctx, tree);
+}
 
-                char *com = strchr(start, '#');
-                if(com) *com = '\0';
+/**
+ * Releases an expression from prepare(), unless it is kept for later lines.
+ *
+ * @param expr: A pointer to the prepared expression, may be NULL
+ */
+static void finish(interp_expr_t * expr) {
+        tree_node_t * tree = interp_tree(expr);
 
-                char name[BUFLEN];
-                int val;
+        if(tree && prepared[tree->hash % TIER_CACHE_SIZE] == expr) return;
+        interp_release(expr);
+}
 
-                if(sscanf(line, "%s %d", name, &val) == 2) {
-                        if(isalpha(name[0])) {
-                                for(char *c = name; *c; c++) {
-                                        if(!isalnum(*c)) {
-                                                fprintf(stderr, "Error: Invalid symbol name '%s'\n", name);
-                                                fclose(file);
-                                                exit(EXIT_FAILURE);
-                                        }
-                                }
-                                add_symbol(name, val);
-                        } else {
-                                fprintf(stderr, "Error: Symbol '%s' must start with a letter\n", name);
-                                fclose(file);
-                                exit(EXIT_FAILURE);
-                        }
-                } else {
-                        fprintf(stderr, "Error processing line: %s\n", line);
-                        fclose(file);
-                        exit(EXIT_FAILURE);
-                }
+/**
+ * Executes a prepared expression, profiling it if profiling is enabled.
+ *
+ * @param expr: A pointer to the prepared expression, NULL if it did not
+ *      parse
+ * @param text: A pointer to the expression as written, for the profile
+ * @param parse_ns: How long the expression took to parse
+ * @param status: A pointer to store why the expression failed at, or
+ *      EVAL_OK if it did not
+ * @return: The result of the evaluated expression
+ */
+static value_t evaluate_tree(interp_expr_t * expr, const char * text, long parse_ns, eval_error_t * status) {
+        value_t result = 0;
+
+        if(expr == NULL) {
+                *status = EVAL_PARSE_ERROR;
+                return 0;
         }
-        fclose(file);
+
+        long start = profile_enabled() ? profile_clock() : 0;
+        *status = (eval_error_t)interp_execute(expr, &result);
+
+        if(profile_enabled()) profile_record(text, interp_tree(expr), parse_ns, profile_clock() - start);
+        return result;
+}
+
+/**
+ * Parses and evaluates a postfix expression. Supports integer literals,
+ * variable lookup, and operators (+, -, *, /, %, =, ?). Handles errors such
+ * as undefined variables and division by zero.
+ *
+ * @param exp: A pointer to the postfix expression as a string
+ * @param result: A pointer to store the result of the expression at
+ * @param err: A pointer to store why the expression failed at, or
+ *      EVAL_OK if it did not
+ * @return: A pointer to the prepared expression, to be released by the
+ *      caller, or NULL if the expression did not parse
+ */
+static interp_expr_t * evaluate(const char * exp, value_t * result, eval_error_t * err) {
+        interp_status_t status;
+        long start = profile_enabled() ? profile_clock() : 0;
+
+        interp_expr_t * expr = interp_prepare(ctx, exp, &status);
+        long parse_ns = profile_enabled() ? profile_clock() - start : 0;
+        *result = evaluate_tree(expr, exp, parse_ns, err);
+        return expr;
 }
 
 /**
  * Evaluates a postfix expression and generates an infix equivalent.
- * Parses the provided postfix expression, evaluates it, and builds its infix
- * representation. Supports integer literals, variable lookup, and operators
- * (+, -, *, /, =). Handles errors such as undefined variables and division by
- * zero.
+ * Parses the provided postfix expression into an expression tree, evaluates
+ * it, and renders the tree in infix notation.
+ *
+ * @param exp: A pointer to the postfix expression as a string
+ * @param infix: A pointer to a buffer of MAX_INFIX_LENGTH bytes to store the
+ *      infix representation
+ * @return: The result of the evaluated expression
+ */
+value_t eval(const char * exp, char * infix) {
+        value_t result;
+        eval_error_t status;
+        interp_expr_t * expr = evaluate(exp, &result, &status);
+
+        infix[0] = '\0';
+        if(expr != NULL) interp_infix(expr, infix, MAX_INFIX_LENGTH);
+
+        interp_release(expr);
+        return result;
+}
+
+/**
+ * Evaluates one expression on behalf of the server.
  *
  * @param exp: A pointer to the postfix expression as a string
  * @param infix: A pointer to a buffer to store the infix representation
- * @return: The result of the evaluated expression as an integer
+ * @param len: The size of the infix buffer
+ * @param status: A pointer to store why the expression failed at, or
+ *      EVAL_OK if it did not
+ * @return: The result of the evaluated expression
  */
-int eval(const char * exp, char * infix) {
-        stack_t *stack = make_stack();
-        const char * delim = " ";
-        char * tok, *expr = strdup(exp);
-        int result = 0;
-        symbol_t *symbol = NULL;
-        char *name = NULL;
-
-        tok = strtok(expr, delim);
-        while(tok != NULL) {
-                if(isdigit(tok[0]) || (tok[0] == '-' && isdigit(tok[1]))) {
-                        int * n = malloc(sizeof(int));
-                        *n = atoi(tok);
-                        push(stack, n);
-                } else if (isalpha(tok[0])) {
-                        symbol = lookup_table(tok);
-                        if(symbol) {
-                                int * v = malloc(sizeof(int));
-                                *v = symbol->val;
-                                push(stack, v);
-                                snprintf(infix, MAX_INFIX_LENGTH, "%s", tok);
-                                if(name == NULL) name = strdup(tok);
-                        } else {
-                                fprintf(stderr, "Error: Variable '%s' not found\n", tok);
-                                free(expr);
-                                free_stack(stack);
-                                return 0;
-                        }
-                } else {
-                        int * second = top(stack);
-                        pop(stack);
-                        int * first = top(stack);
-                        pop(stack);
-
-                        switch(tok[0]) {
-                                case '+':
-                                        result = *first + *second;
-                                        snprintf(infix, MAX_INFIX_LENGTH, "(%d + %d)", *first, *second);
-                                        break;
-                                case '-':
-                                        result = *first - *second;
-                                        snprintf(infix, MAX_INFIX_LENGTH, "(%d - %d)", *first, *second);
-                                        break;
-                                case '*':
-                                        result = *first * *second;
-                                        snprintf(infix, MAX_INFIX_LENGTH, "(%d * %d)", *first, *second);
-                                        break;
-                                case '/':
-                                        if(*second == 0) {
-                                                fprintf(stderr, "Error: Division by zero\n");
-                                                free(expr);
-                                                free_stack(stack);
-                                                return 0;
-                                        }
-
-                                        result = *first / *second;
-                                        snprintf(infix, MAX_INFIX_LENGTH, "(%d / %d)", *first, *second);
-                                        break;
-                                case '=':
-                                        if(symbol) {
-                                                symbol->val = *second;
-                                                snprintf(infix, MAX_INFIX_LENGTH, "(%s=(%s+1))", name, name);
-                                        } else {
-                                                fprintf(stderr, "Error: Variable '%s' not found for assignment\n", tok);
-                                                free(expr);
-                                                free_stack(stack);
-                                                return 0;
-                                        }
-                                        result = *second;
-                                        break;
-                                default:
-                                        fprintf(stderr, "Error: Unknown operator '%s'\n", tok);
-                                        free(expr);
-                                        free_stack(stack);
-                                        return 0;
-                        }
-
-                        int * ptr = malloc(sizeof(int));
-                        *ptr = result;
-                        push(stack, ptr);
-                        free(first);
-                        free(second);
-                }
-                tok = strtok(NULL, delim);
-        }
-        free(expr);
-        result = *(int *)top(stack);
-        free_stack(stack);
+static value_t serve_eval(const char * exp, char * infix, size_t len, eval_error_t * status) {
+        value_t result;
+        interp_expr_t * expr = evaluate(exp, &result, status);
+
+        infix[0] = '\0';
+        if(expr != NULL) interp_infix(expr, infix, len);
+
+        interp_release(expr);
         return result;
 }
 
+/**
+ * Evaluates the expressions of a compiled artifact, with the same output
+ * as prompt() gives for the file it was compiled from.
+ *
+ * @param art: A pointer to the artifact
+ * @param format: The output format
+ */
+static void replay(artifact_t * art, output_format_t format) {
+        int interactive = format == OUTPUT_TEXT;
+        unsigned long prompted = 0;
+
+        if(interactive) printf("Enter postfix expressions (CTRL-D to exit):\n");
+
+        for(size_t i = 0; i < artifact_count(art); i++) {
+                unsigned long line;
+                const char * head;
+                long start = profile_enabled() ? profile_clock() : 0;
+                tree_node_t * tree = artifact_tree(art, i, &line, &head);
+
+                // one prompt for every line read, blank ones included
+                for(; interactive && prompted < line; prompted++) printf("> ");
+
+                eval_error_t status;
+                long parse_ns = profile_enabled() ? profile_clock() - start : 0;
+                interp_expr_t * expr = prepare(tree);
+                value_t result = evaluate_tree(expr, head, parse_ns, &status);
+
+                write_result(format, line, interp_tree(expr), status, result);
+                finish(expr);
+        }
+        for(; interactive && prompted <= artifact_lines(art); prompted++) printf("> ");
+}
+
 /**
  * Starts a user-interactive session for postfix expression evaluation.
  * The user can enter postfix expressions, which are evaluated and displayed
- * with their infix equivalent and result.
+ * with their infix equivalent and result. Lines are parsed as they are
+ * read, so an expression may be of any length. In the machine output
+ * formats, no prompts are printed.
+ *
+ * @param in: The stream to read expressions from
+ * @param format: The output format
  */
-void prompt() {
-        printf("Enter postfix expressions (CTRL-D to exit):\n");
-        char line[BUFLEN];
+void prompt(FILE * in, output_format_t format) {
+        int interactive = format == OUTPUT_TEXT;
+        reader_t * reader = make_reader(in);
+
+        if(!reader) return;
+        if(interactive) printf("Enter postfix expressions (CTRL-D to exit):\n");
 
         while ( 1 ) {
-                printf("> ");
-                if(fgets(line, sizeof(line), stdin) == NULL) break;
+                if(interactive) printf("> ");
 
-                char * com = strchr(line, '#');
-                if(com) *com = '\0';
+                // the parse time of a line includes reading it
+                tree_node_t * tree;
+                long start = profile_enabled() ? profile_clock() : 0;
+                read_status_t got = read_tree(reader, &tree);
 
-                char * trim = strtok(line, "\n");
+                if(got == READ_END) break;
+                if(got == READ_BLANK) continue;
 
-                if(trim && strlen(trim) > 0) {
-                        char infix[MAX_INFIX_LENGTH];
-                        int result = eval(trim, infix);
+                eval_error_t status;
+                long parse_ns = profile_enabled() ? profile_clock() - start : 0;
+                interp_expr_t * expr = prepare(tree);
+                value_t result = evaluate_tree(expr, reader->head, parse_ns, &status);
 
-                        if(result != 0) printf("%s = %d\n", infix, result);
-                }
+                write_result(format, reader->lineno, interp_tree(expr), status, result);
+                finish(expr);
         }
+        free_reader(reader);
 }
 
 /**
@@ -219,21 +292,152 @@ void prompt() {
  * @return: Exit status code
  */
 int main(int argc, char *argv[]) {
-        if(argc > 2) {
-                fprintf(stderr, "usage: interp [sym-table]\n");
+        const char * sock = NULL;
+        const char * wal_path = NULL;
+        const char * profile_path = NULL;
+        const char * source = NULL;
+        const char * artifact = NULL;
+        int compile_only = 0;
+        output_format_t format = OUTPUT_TEXT;
+        int parsers = 0;
+        int budget = WAL_DEFAULT_BUDGET_MS;
+        long hot = 0;
+        int rc = EXIT_SUCCESS;
+        int opt;
+
+        while((opt = getopt(argc, argv, "s:j:w:W:P:o:M:T:f:c:C:")) != -1) {
+                switch(opt) {
+                        case 's':
+                                sock = optarg;
+                                break;
+                        case 'j':
+                                parsers = atoi(optarg);
+                                if(parsers < 1 || parsers > PIPELINE_MAX_PARSERS) {
+                                        fprintf(stderr, "interp: -j takes 1 to %d parsers\n", PIPELINE_MAX_PARSERS);
+                                        return EXIT_FAILURE;
+                                }
+                                break;
+                        case 'w':
+                                wal_path = optarg;
+                                break;
+                        case 'W':
+                                budget = atoi(optarg);
+                                if(budget < 1) {
+                                        fprintf(stderr, "interp: -W takes a positive number of milliseconds\n");
+                                        return EXIT_FAILURE;
+                                }
+                                break;
+                        case 'o':
+                                if(parse_output_format(optarg, &format) < 0) {
+                                        fprintf(stderr, "interp: -o takes text, ndjson or binary\n");
+                                        return EXIT_FAILURE;
+                                }
+                                break;
+                        case 'P':
+                                profile_path = optarg;
+                                profile_start();
+                                break;
+                        case 'M':
+                                if(atoi(optarg) < 1 || memo_start((size_t)atoi(optarg)) < 0) {
+                                        fprintf(stderr, "interp: -M takes a positive number of cache entries\n");
+                                        return EXIT_FAILURE;
+                                }
+                                break;
+                        case 'T':
+                                hot = atol(optarg);
+                                if(hot < 1) {
+                                        fprintf(stderr, "interp: -T takes a positive number of runs\n");
+                                        return EXIT_FAILURE;
+                                }
+                                break;
+                        case 'f':
+                                source = optarg;
+                                break;
+                        case 'C':
+                                compile_only = 1;
+                                // fall through
+                        case 'c':
+                                artifact = optarg;
+                                break;
+                        default:
+                                fprintf(stderr, USAGE);
+                                return EXIT_FAILURE;
+                }
+        }
+
+        if(argc - optind > 1 || (sock && parsers) || (artifact && (!source || sock || parsers))) {
+                fprintf(stderr, USAGE);
+                return EXIT_FAILURE;
+        }
+
+        if(compile_only) {
+                int rc = artifact_compile(source, artifact);
+                memo_stop();
+                return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        FILE * in = source ? fopen(source, "r") : stdin;
+        if(!in) {
+                perror(source);
+                memo_stop();
+                return EXIT_FAILURE;
+        }
+
+        ctx = interp_create(stderr);
+        if(!ctx) {
+                fprintf(stderr, "interp: failed to create interpreter context\n");
+                memo_stop();
+                return EXIT_FAILURE;
+        }
+
+        if(optind < argc) load(argv[optind]);
+
+        start_workers((int)sysconf(_SC_NPROCESSORS_ONLN));
+
+        if(wal_path && wal_open(interp_table(ctx), wal_path, budget) < 0) {
+                stop_workers();
+                memo_stop();
+                interp_destroy(ctx);
                 return EXIT_FAILURE;
         }
 
-        if(argc == 2) load(argv[1]);
+        if(format == OUTPUT_TEXT) symtab_dump(interp_table(ctx));
+
+        if(hot) tier_start((unsigned long)hot);
 
-        dump_table();
+        if(sock) {
+                if(serve(sock, serve_eval, (int)sysconf(_SC_NPROCESSORS_ONLN)) < 0) {
+                        wal_close();
+                        stop_workers();
+                        tier_stop();
+                        memo_stop();
+                        interp_destroy(ctx);
+                        return EXIT_FAILURE;
+                }
+        } else if(parsers) {
+                if(run_pipeline(interp_table(ctx), in, parsers, format) < 0) rc = EXIT_FAILURE;
+        } else {
+                artifact_t * art = artifact ? artifact_open(artifact, source) : NULL;
+                if(artifact && !art) fprintf(stderr, "interp: reading %s instead\n", source);
+                if(art) replay(art, format);
+                else prompt(in, format);
+                artifact_close(art);
+        }
+        if(in != stdin) fclose(in);
 
-        prompt();
+        wal_close();
+        stop_workers();
+        if(profile_path) profile_write(profile_path);
+        memo_report(stderr);
+        memo_stop();
+        tier_report(stderr);
 
-        dump_table();
+        if(format == OUTPUT_TEXT) symtab_dump(interp_table(ctx));
 
-        free_table();
-        return EXIT_SUCCESS;
+        for(size_t i = 0; i < TIER_CACHE_SIZE; i++) interp_release(prepared[i]);
+        interp_destroy(ctx);
+        tier_stop();
+        return rc;
 }
 
 
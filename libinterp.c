@@ -0,0 +1,399 @@
+/**
+ * Implementation of the embeddable interpreter library. A context is a
+ * symbol table of its own (see make_table()), the expressions prepared
+ * for it, and the message of the last error reported while working on
+ * it. Every call on a context installs a diag() sink for its duration,
+ * so errors found deep in the parser or loader are kept by the context
+ * that asked for the work instead of going to standard error.
+ *
+ * A prepared expression is never modified by executing it, so one may be
+ * executed by several threads at once. Expressions still prepared when
+ * their context is destroyed are released with it. While tiered execution
+ * is on (see tier.c), an expression that is executed often is compiled
+ * in the background and runs its compiled program from then on.
+ *
+ * @file        libinterp.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "libinterp.h"
+#include "symtab.h"
+#include "loader.h"
+#include "diag.h"
+#include "tier.h"
+
+/// An interpreter context
+struct interp_s {
+        symtab_t * table;
+        FILE * echo; /// Stream every error is also written to, may be NULL
+        pthread_mutex_t lock; /// Guards everything below
+        char error[INTERP_ERROR_LEN]; /// Message of the last error, "" if none
+        interp_expr_t * exprs; /// Prepared expressions not yet released
+};
+
+/// A prepared expression
+struct interp_expr_s {
+        interp_t * ctx;
+        tree_node_t * tree;
+        tier_slot_t tier; /// Run count and compiled program
+        struct interp_expr_s * prev, * next; /// Neighbours in the context's list
+};
+
+/// One call on a context, while it runs
+typedef struct call_s {
+        interp_t * ctx;
+        int reported; /// Set once the call has kept an error
+        diag_sink_t saved; /// Sink of the thread before the call
+        void * saved_arg;
+} call_t;
+
+/// Names of the statuses, as returned by interp_status_name()
+static const char * status_names[] = {
+        [INTERP_OK] = "ok",
+        [INTERP_PARSE_ERROR] = "parse_error",
+        [INTERP_UNDEFINED_SYMBOL] = "undefined_symbol",
+        [INTERP_DIVISION_BY_ZERO] = "division_by_zero",
+        [INTERP_INVALID_ASSIGNMENT] = "invalid_assignment",
+        [INTERP_INVALID_OPERATOR] = "invalid_operator",
+        [INTERP_OVERFLOW] = "overflow",
+        [INTERP_NOT_DURABLE] = "not_durable",
+        [INTERP_LOAD_ERROR] = "load_error",
+        [INTERP_INVALID_NAME] = "invalid_name",
+        [INTERP_NO_MEMORY] = "no_memory"
+};
+
+/**
+ * Keeps the first error a call reports as the context's last error, and
+ * echoes every error. May be called from the threads helping the call.
+ *
+ * @param msg: A pointer to the formatted message
+ * @param arg: A pointer to the call
+ */
+static void keep_error(const char * msg, void * arg) {
+        call_t * call = arg;
+        interp_t * ctx = call->ctx;
+
+        pthread_mutex_lock(&ctx->lock);
+        if(ctx->echo) fputs(msg, ctx->echo);
+        if(!call->reported) {
+                while(*msg == '\t' || *msg == ' ') msg++;
+                size_t len = strcspn(msg, "\n");
+                if(len >= sizeof(ctx->error)) len = sizeof(ctx->error) - 1;
+                memcpy(ctx->error, msg, len);
+                ctx->error[len] = '\0';
+                call->reported = 1;
+        }
+        pthread_mutex_unlock(&ctx->lock);
+}
+
+/**
+ * Starts a call on a context: errors the calling thread reports go to the
+ * context until end_call().
+ *
+ * @param call: A pointer to the call's record
+ * @param ctx: A pointer to the context
+ */
+static void begin_call(call_t * call, interp_t * ctx) {
+        call->ctx = ctx;
+        call->reported = 0;
+        get_diag_sink(&call->saved, &call->saved_arg);
+        set_diag_sink(keep_error, call);
+}
+
+/**
+ * Ends a call on a context and gives the thread its sink back. A call
+ * that failed without reporting why keeps the name of its status.
+ *
+ * @param call: A pointer to the call's record
+ * @param status: The outcome of the call
+ * @return: status
+ */
+static interp_status_t end_call(call_t * call, interp_status_t status) {
+        set_diag_sink(call->saved, call->saved_arg);
+        if(status != INTERP_OK && !call->reported) {
+                pthread_mutex_lock(&call->ctx->lock);
+                snprintf(call->ctx->error, sizeof(call->ctx->error), "Error: %s", interp_status_name(status));
+                pthread_mutex_unlock(&call->ctx->lock);
+        }
+        return status;
+}
+
+/**
+ * Creates an interpreter context with an empty symbol table.
+ *
+ * @param echo: A stream to also write every error to as it is reported,
+ *      or NULL to only keep the last one
+ * @return: A pointer to the context, or NULL if memory allocation fails
+ */
+interp_t * interp_create(FILE * echo) {
+        interp_t * ctx = calloc(1, sizeof(interp_t));
+
+        if(!ctx) return NULL;
+
+        ctx->table = make_table();
+        if(!ctx->table) {
+                free(ctx);
+                return NULL;
+        }
+        ctx->echo = echo;
+        pthread_mutex_init(&ctx->lock, NULL);
+        return ctx;
+}
+
+/**
+ * Frees a context, its symbol table, and every expression still prepared
+ * for it. No other call on the context may be running.
+ *
+ * @param ctx: A pointer to the context, may be NULL
+ */
+void interp_destroy(interp_t * ctx) {
+        if(ctx == NULL) return;
+
+        while(ctx->exprs) interp_release(ctx->exprs);
+        destroy_table(ctx->table);
+        pthread_mutex_destroy(&ctx->lock);
+        free(ctx);
+}
+
+/**
+ * Loads the symbols defined in a symbol file into a context, replacing
+ * any symbols of the same names. Nothing is added if the file holds an
+ * invalid line.
+ *
+ * @param ctx: A pointer to the context
+ * @param filename: A pointer to the name of the file
+ * @return: INTERP_OK, or INTERP_LOAD_ERROR if the file could not be
+ *      loaded
+ */
+interp_status_t interp_load(interp_t * ctx, const char * filename) {
+        call_t call;
+
+        begin_call(&call, ctx);
+        int rc = load_symbols(ctx->table, filename, (int)sysconf(_SC_NPROCESSORS_ONLN));
+        return end_call(&call, rc < 0 ? INTERP_LOAD_ERROR : INTERP_OK);
+}
+
+/**
+ * Defines a symbol in a context, replacing any symbol of the same name.
+ *
+ * @param ctx: A pointer to the context
+ * @param name: A pointer to the name of the symbol
+ * @param val: The value of the symbol
+ * @return: INTERP_OK, INTERP_INVALID_NAME if the name does not start with
+ *      a letter, or INTERP_NO_MEMORY
+ */
+interp_status_t interp_define(interp_t * ctx, const char * name, value_t val) {
+        call_t call;
+
+        begin_call(&call, ctx);
+        if(name == NULL || !isalpha((unsigned char)name[0])) {
+                diag("Error: Symbol '%s' must start with a letter\n", name ? name : "");
+                return end_call(&call, INTERP_INVALID_NAME);
+        }
+        symbol_t * symbol = symtab_add(ctx->table, (char *)name, val);
+        return end_call(&call, symbol ? INTERP_OK : INTERP_NO_MEMORY);
+}
+
+/**
+ * Reads the current value of a symbol in a context.
+ *
+ * @param ctx: A pointer to the context
+ * @param name: A pointer to the name of the symbol
+ * @param val: A pointer to store the value at
+ * @return: INTERP_OK, or INTERP_UNDEFINED_SYMBOL if there is no such symbol
+ */
+interp_status_t interp_lookup(interp_t * ctx, const char * name, value_t * val) {
+        call_t call;
+
+        begin_call(&call, ctx);
+        symtab_snapshot_t * snap = symtab_pin(ctx->table);
+        symbol_t * symbol = lookup_snapshot(snap, (char *)name);
+
+        if(symbol) *val = symbol_value(symbol);
+        else diag("Error: undefined symbol '%s'\n", name);
+        unpin_table(snap);
+        return end_call(&call, symbol ? INTERP_OK : INTERP_UNDEFINED_SYMBOL);
+}
+
+/**
+ * Prepares a postfix expression for execution in a context.
+ *
+ * @param ctx: A pointer to the context
+ * @param text: A pointer to the expression, which is not modified
+ * @param status: A pointer to store INTERP_OK at, or why the expression
+ *      could not be prepared
+ * @return: A pointer to the prepared expression, to be released with
+ *      interp_release(), or NULL on failure
+ */
+interp_expr_t * interp_prepare(interp_t * ctx, const char * text, interp_status_t * status) {
+        call_t call;
+
+        begin_call(&call, ctx);
+        char * copy = text ? strdup(text) : NULL;
+        if(text && !copy) {
+                *status = end_call(&call, INTERP_NO_MEMORY);
+                return NULL;
+        }
+
+        int no_memory = 0;
+        tree_node_t * tree = make_parse_tree_status(copy, &no_memory);
+        free(copy);
+        if(!tree) {
+                *status = end_call(&call, no_memory ? INTERP_NO_MEMORY : INTERP_PARSE_ERROR);
+                return NULL;
+        }
+
+        interp_expr_t * expr = interp_prepare_tree(ctx, tree);
+        *status = end_call(&call, expr ? INTERP_OK : INTERP_NO_MEMORY);
+        return expr;
+}
+
+/**
+ * Prepares an expression tree the caller parsed itself, such as one from
+ * read_tree(), for execution in a context.
+ *
+ * @param ctx: A pointer to the context
+ * @param tree: A pointer to the root of the tree, owned by the prepared
+ *      expression afterwards (or freed, if preparing it fails)
+ * @return: A pointer to the prepared expression, to be released with
+ *      interp_release(), or NULL if memory allocation fails
+ */
+interp_expr_t * interp_prepare_tree(interp_t * ctx, tree_node_t * tree) {
+        interp_expr_t * expr = calloc(1, sizeof(interp_expr_t));
+
+        if(!expr) {
+                cleanup_tree(tree);
+                return NULL;
+        }
+
+        expr->ctx = ctx;
+        expr->tree = tree;
+        tier_init(&expr->tier, tree);
+
+        pthread_mutex_lock(&ctx->lock);
+        expr->next = ctx->exprs;
+        if(ctx->exprs) ctx->exprs->prev = expr;
+        ctx->exprs = expr;
+        pthread_mutex_unlock(&ctx->lock);
+        return expr;
+}
+
+/**
+ * Executes a prepared expression against its context's symbol table.
+ * Assignments in the expression change the table.
+ *
+ * @param expr: A pointer to the prepared expression
+ * @param result: A pointer to store the result at, in which a failed
+ *      subexpression counts as 0
+ * @return: INTERP_OK, or why the evaluation failed
+ */
+interp_status_t interp_execute(interp_expr_t * expr, value_t * result) {
+        call_t call;
+        eval_error_t err;
+
+        begin_call(&call, expr->ctx);
+        if(tier_enabled() || atomic_load_explicit(&expr->tier.code, memory_order_relaxed)) {
+                *result = tier_eval(&expr->tier, expr->ctx->table, &err);
+        } else {
+                *result = eval_tree_in(expr->ctx->table, expr->tree, &err);
+        }
+        return end_call(&call, (interp_status_t)err);
+}
+
+/**
+ * Renders a prepared expression in infix notation.
+ *
+ * @param expr: A pointer to the prepared expression
+ * @param buf: A pointer to the buffer to write into
+ * @param len: The size of the buffer
+ * @return: The length of the full rendering, as with snprintf()
+ */
+size_t interp_infix(interp_expr_t * expr, char * buf, size_t len) {
+        return format_infix(expr->tree, buf, len);
+}
+
+/**
+ * Gives the tree of a prepared expression, for callers that render or
+ * profile it themselves.
+ *
+ * @param expr: A pointer to the prepared expression, may be NULL
+ * @return: A pointer to the root of its tree, owned by the expression, or
+ *      NULL if expr is NULL
+ */
+tree_node_t * interp_tree(interp_expr_t * expr) {
+        return expr ? expr->tree : NULL;
+}
+
+/**
+ * Tells how far a prepared expression has been promoted.
+ *
+ * @param expr: A pointer to the prepared expression
+ * @return: Its tier, TIER_TREE unless tiered execution is on
+ */
+tier_state_t interp_tier(interp_expr_t * expr) {
+        return (tier_state_t)atomic_load(&expr->tier.state);
+}
+
+/**
+ * Releases a prepared expression.
+ *
+ * @param expr: A pointer to the prepared expression, may be NULL
+ */
+void interp_release(interp_expr_t * expr) {
+        if(expr == NULL) return;
+
+        interp_t * ctx = expr->ctx;
+        pthread_mutex_lock(&ctx->lock);
+        if(expr->prev) expr->prev->next = expr->next;
+        else ctx->exprs = expr->next;
+        if(expr->next) expr->next->prev = expr->prev;
+        pthread_mutex_unlock(&ctx->lock);
+
+        tier_forget(&expr->tier);
+        cleanup_tree(expr->tree);
+        free(expr);
+}
+
+/**
+ * Copies the message of the last error reported on a context: the first
+ * one reported by the last call that failed.
+ *
+ * @param ctx: A pointer to the context
+ * @param buf: A pointer to the buffer to copy into
+ * @param len: The size of the buffer
+ * @return: The length of the message, 0 if no call has failed
+ */
+size_t interp_last_error(interp_t * ctx, char * buf, size_t len) {
+        pthread_mutex_lock(&ctx->lock);
+        size_t n = strlen(ctx->error);
+        if(len > 0) snprintf(buf, len, "%s", ctx->error);
+        pthread_mutex_unlock(&ctx->lock);
+        return n;
+}
+
+/**
+ * Names a status.
+ *
+ * @param status: The status
+ * @return: A pointer to its name, such as "division_by_zero"
+ */
+const char * interp_status_name(interp_status_t status) {
+        if((unsigned int)status > INTERP_NO_MEMORY) return "unknown";
+        return status_names[status];
+}
+
+/**
+ * Gives the symbol table of a context, for the modules that work on a
+ * table directly, such as the write-ahead log and the pipeline.
+ *
+ * @param ctx: A pointer to the context
+ * @return: A pointer to the table, owned by the context
+ */
+symtab_t * interp_table(interp_t * ctx) {
+        return ctx->table;
+}
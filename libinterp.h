@@ -0,0 +1,73 @@
+/**
+ * Interface for the embeddable interpreter library. An interpreter
+ * context owns a symbol table and the errors reported while working on
+ * it, so any number of contexts can be used side by side, from any
+ * threads. Expressions are prepared once and then executed as many times
+ * as needed; every call reports what went wrong through its status
+ * instead of exiting.
+ *
+ * @file        libinterp.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef LIBINTERP_H
+#define LIBINTERP_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "parser.h"
+#include "tier.h"
+
+#define INTERP_ERROR_LEN 256 /// Longest error message a context keeps
+
+/// Outcome of a library call; the first values are those of eval_error_t
+typedef enum interp_status_e {
+        INTERP_OK = EVAL_OK,
+        INTERP_PARSE_ERROR = EVAL_PARSE_ERROR,
+        INTERP_UNDEFINED_SYMBOL = EVAL_UNDEFINED_SYMBOL,
+        INTERP_DIVISION_BY_ZERO = EVAL_DIVISION_BY_ZERO,
+        INTERP_INVALID_ASSIGNMENT = EVAL_INVALID_ASSIGNMENT,
+        INTERP_INVALID_OPERATOR = EVAL_INVALID_OPERATOR,
+        INTERP_OVERFLOW = EVAL_OVERFLOW,
+        INTERP_NOT_DURABLE = EVAL_NOT_DURABLE,
+        INTERP_LOAD_ERROR, /// A symbol file could not be read or holds an invalid line
+        INTERP_INVALID_NAME, /// A symbol name does not start with a letter
+        INTERP_NO_MEMORY
+} interp_status_t;
+
+/// An interpreter context, see interp_create()
+typedef struct interp_s interp_t;
+
+/// A parsed expression ready to be executed, see interp_prepare()
+typedef struct interp_expr_s interp_expr_t;
+
+interp_t * interp_create(FILE * echo);
+
+void interp_destroy(interp_t * ctx);
+
+interp_status_t interp_load(interp_t * ctx, const char * filename);
+
+interp_status_t interp_define(interp_t * ctx, const char * name, value_t val);
+
+interp_status_t interp_lookup(interp_t * ctx, const char * name, value_t * val);
+
+interp_expr_t * interp_prepare(interp_t * ctx, const char * text, interp_status_t * status);
+
+interp_expr_t * interp_prepare_tree(interp_t * ctx, tree_node_t * tree);
+
+interp_status_t interp_execute(interp_expr_t * expr, value_t * result);
+
+size_t interp_infix(interp_expr_t * expr, char * buf, size_t len);
+
+tree_node_t * interp_tree(interp_expr_t * expr);
+
+tier_state_t interp_tier(interp_expr_t * expr);
+
+void interp_release(interp_expr_t * expr);
+
+size_t interp_last_error(interp_t * ctx, char * buf, size_t len);
+
+const char * interp_status_name(interp_status_t status);
+
+symtab_t * interp_table(interp_t * ctx);
+
+#endif
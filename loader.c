@@ -0,0 +1,364 @@
+/**
+ * Implementation of the symbol file loader. A symbol file holds one
+ * `name value` definition per line; blank lines are skipped and a `#`
+ * starts a comment that runs to the end of the line. The file is mapped
+ * into memory and split at line boundaries into one chunk per thread, and
+ * every thread scans the lines of its chunk with hand-written scanners for
+ * names and integers, creating a symbol for each definition. With
+ * VALUE_DOUBLE, values are the decimal and exponent literals expressions
+ * accept, converted by strtod(). The symbols
+ * of all chunks are then handed to symtab_add_many() in file order, so a
+ * later definition of a name still replaces an earlier one.
+ *
+ * A line that is not a valid definition stops its thread. The error
+ * reported is the one on the earliest such line in the file; its line
+ * number is found by adding up the lines the chunks before it hold.
+ *
+ * @file        loader.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "loader.h"
+#include "symtab.h"
+#include "diag.h"
+#include "scan.h"
+
+/// Why a line is not a valid definition
+typedef enum load_error_e {
+        LOAD_OK,
+        LOAD_BAD_LINE, /// Not a name followed by a value and nothing else
+        LOAD_BAD_START, /// The name does not start with a letter
+        LOAD_BAD_NAME, /// The name holds something other than letters and digits
+        LOAD_RANGE, /// The value does not fit in a value_t
+        LOAD_NO_MEMORY
+} load_error_t;
+
+/// The lines one thread scans, and what it found there
+typedef struct chunk_s {
+        const char * begin;
+        const char * end;
+        symbol_t ** symbols; /// Symbols defined in the chunk, in order
+        size_t count;
+        size_t cap;
+        size_t lines; /// Lines scanned, up to the one with the error
+        load_error_t err;
+        const char * err_text; /// The offending line or name
+        size_t err_len;
+} chunk_t;
+
+/**
+ * Checks for the whitespace characters isspace() accepts in the C locale.
+ *
+ * @param c: The character
+ * @return: 1 if it is whitespace, 0 if not
+ */
+static int is_blank(char c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * Checks for an ASCII letter.
+ *
+ * @param c: The character
+ * @return: 1 if it is a letter, 0 if not
+ */
+static int is_letter(char c) {
+        return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+/**
+ * Checks for an ASCII digit.
+ *
+ * @param c: The character
+ * @return: 1 if it is a digit, 0 if not
+ */
+static int is_digit(char c) {
+        return (unsigned char)(c - '0') < 10;
+}
+
+/**
+ * Records the error on the current line of a chunk.
+ *
+ * @param chunk: A pointer to the chunk
+ * @param err: What is wrong with the line
+ * @param text: A pointer to the text to quote in the message
+ * @param len: The length of the text
+ * @return: -1
+ */
+static int fail(chunk_t * chunk, load_error_t err, const char * text, size_t len) {
+        chunk->err = err;
+        chunk->err_text = text;
+        chunk->err_len = len;
+        return -1;
+}
+
+/**
+ * Scans one line of a symbol file and creates the symbol it defines.
+ *
+ * @param chunk: A pointer to the chunk the line is in
+ * @param p: A pointer to the first character of the line
+ * @param end: A pointer just past the line, without its newline
+ * @return: 0 on success or for a line without a definition, -1 on error
+ */
+static int scan_line(chunk_t * chunk, const char * p, const char * end) {
+        const char * line = p;
+
+        while(p < end && is_blank(*p)) p++;
+        if(p == end || *p == '#') return 0;
+
+        const char * com = memchr(p, '#', end - p);
+        if(com) end = com;
+
+        const char * name = p;
+        while(p < end && !is_blank(*p)) p++;
+        size_t len = p - name;
+        while(p < end && is_blank(*p)) p++;
+
+        int negative = 0;
+        if(p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+#ifdef VALUE_DOUBLE
+        // the same literals as in expressions, see scan_decimal()
+        size_t n = p < end && *p != '-' ? scan_decimal(p, end - p) : 0;
+        if(n == 0) return fail(chunk, LOAD_BAD_LINE, line, end - line);
+
+        // the line need not be terminated, so strtod() reads a copy
+        char small[64];
+        char * text = n < sizeof(small) ? small : malloc(n + 1);
+        if(!text) return fail(chunk, LOAD_NO_MEMORY, name, len);
+        memcpy(text, p, n);
+        text[n] = '\0';
+        p += n;
+        double val = strtod(text, NULL);
+        if(text != small) free(text);
+        if(isinf(val)) return fail(chunk, LOAD_RANGE, name, len);
+        if(negative) val = -val;
+#else
+        if(p == end || !is_digit(*p)) return fail(chunk, LOAD_BAD_LINE, line, end - line);
+
+        // the magnitude may be one more than VALUE_MAX for a negative value
+        unsigned long long limit = (unsigned long long)VALUE_MAX + negative, mag = 0;
+        for(; p < end && is_digit(*p); p++) {
+                unsigned int digit = *p - '0';
+                if(mag > (limit - digit) / 10) return fail(chunk, LOAD_RANGE, name, len);
+                mag = mag * 10 + digit;
+        }
+        value_t val = negative ? (value_t)(0 - mag) : (value_t)mag;
+#endif
+
+        // nothing but blanks may follow the value
+        while(p < end && is_blank(*p)) p++;
+        if(p != end) return fail(chunk, LOAD_BAD_LINE, line, end - line);
+
+        if(!is_letter(name[0])) return fail(chunk, LOAD_BAD_START, name, len);
+        for(size_t i = 1; i < len; i++) {
+                if(!is_letter(name[i]) && !is_digit(name[i])) return fail(chunk, LOAD_BAD_NAME, name, len);
+        }
+
+        if(chunk->count == chunk->cap) {
+                size_t cap = chunk->cap ? 2 * chunk->cap : 64;
+                symbol_t ** grown = realloc(chunk->symbols, cap * sizeof(symbol_t *));
+                if(!grown) return fail(chunk, LOAD_NO_MEMORY, name, len);
+                chunk->symbols = grown;
+                chunk->cap = cap;
+        }
+
+        symbol_t * symbol = create_symbol_len(name, len, val);
+        if(!symbol) return fail(chunk, LOAD_NO_MEMORY, name, len);
+        chunk->symbols[chunk->count++] = symbol;
+        return 0;
+}
+
+/**
+ * Thread body: scans every line of a chunk, stopping at the first error.
+ *
+ * @param arg: A pointer to the chunk
+ * @return: NULL
+ */
+static void * scan_chunk(void * arg) {
+        chunk_t * chunk = arg;
+        const char * p = chunk->begin;
+
+        while(p < chunk->end) {
+                const char * nl = memchr(p, '\n', chunk->end - p);
+                const char * eol = nl ? nl : chunk->end;
+
+                if(scan_line(chunk, p, eol) < 0) return NULL;
+                chunk->lines++;
+                p = eol + 1;
+        }
+        return NULL;
+}
+
+/**
+ * Reads a whole file that cannot be mapped, such as a pipe.
+ *
+ * @param fd: The file descriptor
+ * @param size: A pointer to store the number of bytes read at
+ * @return: A pointer to the contents, to be freed by the caller, or NULL
+ *      on error
+ */
+static char * read_all(int fd, size_t * size) {
+        size_t cap = 64 * 1024, len = 0;
+        char * buf = malloc(cap);
+
+        while(buf) {
+                if(len == cap) {
+                        char * grown = realloc(buf, cap *= 2);
+                        if(!grown) break;
+                        buf = grown;
+                }
+
+                ssize_t n = read(fd, buf + len, cap - len);
+                if(n == 0) {
+                        *size = len;
+                        return buf;
+                }
+                if(n < 0) break;
+                len += n;
+        }
+        free(buf);
+        return NULL;
+}
+
+/**
+ * Reports the error a chunk stopped at.
+ *
+ * @param filename: A pointer to the name of the file
+ * @param chunk: A pointer to the chunk
+ * @param lineno: The number of the offending line, counting from 1
+ */
+static void report(const char * filename, chunk_t * chunk, size_t lineno) {
+        int len = (int)chunk->err_len;
+        const char * text = chunk->err_text;
+
+        switch(chunk->err) {
+                case LOAD_BAD_LINE:
+                        diag("%s:%zu: Error processing line: %.*s\n", filename, lineno, len, text);
+                        break;
+                case LOAD_BAD_START:
+                        diag("%s:%zu: Error: Symbol '%.*s' must start with a letter\n", filename, lineno, len, text);
+                        break;
+                case LOAD_BAD_NAME:
+                        diag("%s:%zu: Error: Invalid symbol name '%.*s'\n", filename, lineno, len, text);
+                        break;
+                case LOAD_RANGE:
+                        diag("%s:%zu: Error: Value of '%.*s' is out of range\n", filename, lineno, len, text);
+                        break;
+                default:
+                        diag("%s:%zu: Error: Out of memory\n", filename, lineno);
+                        break;
+        }
+}
+
+/**
+ * Loads the symbols defined in a symbol file into a symbol table,
+ * replacing any symbols of the same names. Nothing is added if the file
+ * holds an invalid line.
+ *
+ * @param table: A pointer to the table to load into
+ * @param filename: A pointer to the name of the file
+ * @param threads: The number of threads to scan the file on
+ * @return: 0 on success, -1 if the file could not be read or holds an
+ *      invalid line, which is reported through diag()
+ */
+int load_symbols(symtab_t * table, const char * filename, int threads) {
+        int fd = open(filename, O_RDONLY);
+        if(fd < 0) {
+                diag("%s: %s\n", filename, strerror(errno));
+                return -1;
+        }
+
+        struct stat st;
+        char * data = NULL;
+        size_t size = 0;
+        int mapped = 0;
+        int regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+        if(regular) {
+                size = st.st_size;
+                if(size > 0) {
+                        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if(data == MAP_FAILED) data = NULL;
+                        else mapped = 1;
+                }
+        }
+        if(!mapped && (size > 0 || !regular)) data = read_all(fd, &size);
+        close(fd);
+
+        if(size > 0 && data == NULL) {
+                diag("%s: %s\n", filename, strerror(errno));
+                return -1;
+        }
+        if(mapped) madvise(data, size, MADV_WILLNEED);
+
+        if(threads > LOADER_MAX_THREADS) threads = LOADER_MAX_THREADS;
+        if(threads > (int)(size / LOADER_MIN_CHUNK)) threads = (int)(size / LOADER_MIN_CHUNK);
+        if(threads < 1) threads = 1;
+
+        // split at the newline after every even share of the file
+        chunk_t chunks[LOADER_MAX_THREADS] = {0};
+        const char * p = data, * end = data + size;
+        for(int i = 0; i < threads; i++) {
+                const char * stop = i == threads - 1 ? end : data + size / threads * (i + 1);
+                if(stop < p) stop = p;
+                const char * nl = stop < end ? memchr(stop, '\n', end - stop) : NULL;
+                if(i < threads - 1) stop = nl ? nl + 1 : end;
+
+                chunks[i].begin = p;
+                chunks[i].end = stop;
+                p = stop;
+        }
+
+        pthread_t tids[LOADER_MAX_THREADS];
+        int spawned[LOADER_MAX_THREADS] = {0};
+        for(int i = 1; i < threads; i++) spawned[i] = pthread_create(&tids[i], NULL, scan_chunk, &chunks[i]) == 0;
+        scan_chunk(&chunks[0]);
+        for(int i = 1; i < threads; i++) {
+                if(spawned[i]) pthread_join(tids[i], NULL);
+                else scan_chunk(&chunks[i]);
+        }
+
+        size_t total = 0, lineno = 0;
+        int rc = 0;
+        for(int i = 0; i < threads; i++) {
+                if(chunks[i].err != LOAD_OK) {
+                        report(filename, &chunks[i], lineno + chunks[i].lines + 1);
+                        rc = -1;
+                        break;
+                }
+                lineno += chunks[i].lines;
+                total += chunks[i].count;
+        }
+
+        symbol_t ** symbols = rc == 0 ? malloc((total ? total : 1) * sizeof(symbol_t *)) : NULL;
+        if(rc == 0 && symbols == NULL) {
+                perror("Failed to allocate symbols");
+                rc = -1;
+        }
+
+        size_t n = 0;
+        for(int i = 0; i < threads; i++) {
+                for(size_t j = 0; j < chunks[i].count; j++) {
+                        // a fresh symbol is a single allocation
+                        if(rc == 0) symbols[n++] = chunks[i].symbols[j];
+                        else free(chunks[i].symbols[j]);
+                }
+                free(chunks[i].symbols);
+        }
+
+        if(rc == 0) rc = symtab_add_many(table, symbols, n);
+        free(symbols);
+
+        if(mapped) munmap(data, size);
+        else free(data);
+        return rc;
+}
@@ -0,0 +1,18 @@
+/**
+ * Interface for the symbol file loader, which parses a symbol table file
+ * on several threads and adds its symbols to the table in one batch.
+ *
+ * @file        loader.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "symtab.h"
+
+#define LOADER_MIN_CHUNK (256 * 1024) /// Fewest bytes of the file given to one thread
+#define LOADER_MAX_THREADS 64
+
+int load_symbols(symtab_t * table, const char * filename, int threads);
+
+#endif
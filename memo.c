@@ -0,0 +1,268 @@
+/**
+ * Implementation of the result cache. An expression without assignments
+ * always gives the same value as long as the symbols it reads keep their
+ * values, so its result can be reused instead of evaluating it again.
+ *
+ * The cache is a direct-mapped table indexed by the structural hash of the
+ * expression tree; a new entry replaces whatever was in its slot. Every
+ * entry holds a private copy of the tree, the result, and the name and
+ * version of every symbol the evaluation read, which the evaluator
+ * collects as it goes (see memo_watch()), so the arm of a ternary that was
+ * not taken is not a dependency. A lookup is a hit if the tree is the same
+ * as the cached one and every symbol still has the version it had when
+ * the result was stored, in the snapshot being evaluated against. Only
+ * successful evaluations are stored, so a failing expression is evaluated
+ * (and reports its error) every time.
+ *
+ * @file        memo.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "memo.h"
+#include "parser.h"
+
+/// A symbol an expression read, and the write it saw
+typedef struct memo_read_s {
+        const char * name; /// Interned, see intern.h
+        unsigned long version;
+} memo_read_t;
+
+/// The cached result of one expression
+typedef struct memo_entry_s {
+        tree_node_t * tree; /// Private copy of the expression
+        memo_read_t * reads; /// Symbols read, each once, sorted by handle
+        size_t nreads;
+        value_t result;
+        size_t bytes; /// Memory held by the entry
+} memo_entry_t;
+
+static memo_entry_t ** table = NULL; /// One slot per possible hash, masked
+static size_t mask = 0;
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long lookups = 0;
+static unsigned long hits = 0;
+static unsigned long stale = 0; /// Lookups that found the tree but an old version
+static unsigned long evictions = 0;
+static size_t entries = 0;
+static size_t bytes = 0;
+
+/**
+ * Starts caching results. Does nothing if the cache is already running.
+ *
+ * @param count: The number of entries the cache holds, rounded up to a
+ *      power of two
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+int memo_start(size_t count) {
+        if(table != NULL) return 0;
+
+        size_t size = 1;
+        while(size < count) size *= 2;
+
+        table = calloc(size, sizeof(memo_entry_t *));
+        if(!table) {
+                perror("Failed to allocate result cache");
+                return -1;
+        }
+        mask = size - 1;
+        bytes = size * sizeof(memo_entry_t *);
+        return 0;
+}
+
+/**
+ * Checks if results are being cached.
+ *
+ * @return: 1 if memo_start() was called, 0 otherwise
+ */
+int memo_enabled(void) {
+        return table != NULL;
+}
+
+/**
+ * Starts collecting the symbols an evaluation reads, if its result can be
+ * cached. The evaluator passes the collector to memo_read() for every
+ * symbol it reads; whether or not the result is then stored, the
+ * collector is released with memo_unwatch().
+ *
+ * @param tree: A pointer to the root of the expression's tree
+ * @param reads: A pointer to the collector to start
+ * @return: reads, or NULL if the result would not be cached
+ */
+memo_reads_t * memo_watch(tree_node_t * tree, memo_reads_t * reads) {
+        if(table == NULL || !tree->pure || tree->size < MEMO_MIN_SIZE || tree->size > MEMO_MAX_SIZE) return NULL;
+
+        // each leaf is read at most once, so the tree's size is enough
+        reads->count = 0;
+        reads->names = tree->size <= MEMO_SMALL_READS ? reads->small : malloc(tree->size * sizeof(char *));
+        return reads->names ? reads : NULL;
+}
+
+/**
+ * Notes every symbol in a subtree that was evaluated without collecting
+ * its reads, such as one forked to other threads. Symbols in the arm of a
+ * ternary that was not taken are noted too, so changing them evaluates the
+ * expression again, which is only slower.
+ *
+ * @param reads: The reads being collected, may be NULL
+ * @param tree: A pointer to the root of the subtree
+ */
+void memo_read_tree(memo_reads_t * reads, tree_node_t * tree) {
+        if(reads == NULL) return;
+        if(tree->type == LEAF) {
+                if(((leaf_node_t *)tree->node)->exp_type == SYMBOL) memo_read(reads, tree->token);
+                return;
+        }
+
+        interior_node_t * interior = (interior_node_t *)tree->node;
+        memo_read_tree(reads, interior->left);
+        memo_read_tree(reads, interior->right);
+}
+
+/**
+ * Releases a collector started by memo_watch().
+ *
+ * @param reads: The collector, may be NULL
+ */
+void memo_unwatch(memo_reads_t * reads) {
+        if(reads && reads->names != reads->small) free(reads->names);
+}
+
+/**
+ * Orders interned names for qsort(), by handle.
+ */
+static int compare_names(const void * a, const void * b) {
+        const char * x = *(const char * const *)a, * y = *(const char * const *)b;
+        return (x > y) - (x < y);
+}
+
+/**
+ * Frees a cache entry.
+ *
+ * @param entry: A pointer to the entry, may be NULL
+ */
+static void free_entry(memo_entry_t * entry) {
+        if(entry == NULL) return;
+
+        free(entry->reads);
+        cleanup_tree(entry->tree);
+        free(entry);
+}
+
+/**
+ * Looks up the cached result of an expression without assignments.
+ *
+ * @param tree: A pointer to the root of the expression's tree
+ * @param snap: The pinned snapshot the expression is evaluated against
+ * @param result: A pointer to store the result at on a hit
+ * @return: 0 on a hit, -1 on a miss or if caching is off
+ */
+int memo_lookup(tree_node_t * tree, symtab_snapshot_t * snap, value_t * result) {
+        if(table == NULL || !tree->pure || tree->size < MEMO_MIN_SIZE || tree->size > MEMO_MAX_SIZE) return -1;
+
+        pthread_mutex_lock(&memo_lock);
+        lookups++;
+
+        memo_entry_t * entry = table[tree->hash & mask];
+        int hit = entry != NULL && same_tree(entry->tree, tree);
+
+        for(size_t i = 0; hit && i < entry->nreads; i++) {
+                symbol_t * symbol = lookup_interned(snap, entry->reads[i].name);
+                if((symbol ? symbol_version(symbol) : 0) != entry->reads[i].version) {
+                        hit = 0;
+                        stale++;
+                }
+        }
+
+        if(hit) {
+                hits++;
+                *result = entry->result;
+        }
+        pthread_mutex_unlock(&memo_lock);
+        return hit ? 0 : -1;
+}
+
+/**
+ * Caches the result of an expression without assignments that evaluated
+ * successfully, replacing the entry in its slot.
+ *
+ * @param tree: A pointer to the root of the expression's tree
+ * @param reads: The symbols the evaluation read, from memo_watch()
+ * @param snap: The pinned snapshot the expression was evaluated against
+ * @param result: The result of the evaluation
+ */
+void memo_store(tree_node_t * tree, memo_reads_t * reads, symtab_snapshot_t * snap, value_t result) {
+        if(table == NULL || reads == NULL) return;
+
+        memo_entry_t * entry = calloc(1, sizeof(memo_entry_t));
+        if(!entry) return;
+
+        entry->bytes = sizeof(memo_entry_t);
+        entry->result = result;
+        entry->tree = copy_tree(tree, &entry->bytes);
+
+        qsort(reads->names, reads->count, sizeof(char *), compare_names);
+        entry->reads = malloc((reads->count ? reads->count : 1) * sizeof(memo_read_t));
+
+        for(size_t i = 0; entry->tree && entry->reads && i < reads->count; i++) {
+                if(i > 0 && reads->names[i] == reads->names[i - 1]) continue;
+
+                // only a symbol noted by memo_read_tree() can be missing;
+                // version 0 keeps the entry valid while it stays missing
+                symbol_t * symbol = lookup_interned(snap, reads->names[i]);
+                memo_read_t * read = &entry->reads[entry->nreads];
+                read->name = reads->names[i];
+                read->version = symbol ? symbol_version(symbol) : 0;
+                entry->nreads++;
+                entry->bytes += sizeof(memo_read_t);
+        }
+
+        if(!entry->tree || !entry->reads) {
+                free_entry(entry);
+                return;
+        }
+
+        pthread_mutex_lock(&memo_lock);
+        memo_entry_t ** slot = &table[tree->hash & mask];
+        if(*slot) {
+                evictions++;
+                entries--;
+                bytes -= (*slot)->bytes;
+                free_entry(*slot);
+        }
+        *slot = entry;
+        entries++;
+        bytes += entry->bytes;
+        pthread_mutex_unlock(&memo_lock);
+}
+
+/**
+ * Writes the hit rate and memory use of the cache.
+ *
+ * @param out: The stream to write to
+ */
+void memo_report(FILE * out) {
+        if(table == NULL) return;
+
+        pthread_mutex_lock(&memo_lock);
+        fprintf(out, "memo: %lu lookups, %lu hits (%.1f%%), %lu stale, %lu evictions, %zu entries, %zu bytes\n",
+                        lookups, hits, lookups ? 100.0 * hits / lookups : 0.0, stale, evictions, entries, bytes);
+        pthread_mutex_unlock(&memo_lock);
+}
+
+/**
+ * Stops caching results and frees the cache.
+ */
+void memo_stop(void) {
+        if(table == NULL) return;
+
+        for(size_t i = 0; i <= mask; i++) free_entry(table[i]);
+        free(table);
+        table = NULL;
+        mask = 0;
+        lookups = hits = stale = evictions = 0;
+        entries = bytes = 0;
+}
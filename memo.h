@@ -0,0 +1,55 @@
+/**
+ * Interface for the result cache, which remembers the values of
+ * expressions without assignments together with the versions of the
+ * symbols they read.
+ *
+ * @file        memo.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdio.h>
+#include "tree_node.h"
+#include "symtab.h"
+
+#define MEMO_MIN_SIZE 3 /// Smallest tree worth caching
+#define MEMO_MAX_SIZE (1 << 20) /// Largest tree cached, as the cache keeps a copy
+#define MEMO_SMALL_READS 64 /// Reads collected without allocating
+
+/// The symbols one evaluation read, see memo_watch()
+typedef struct memo_reads_s {
+        const char ** names; /// Interned, with repeats, room for every leaf
+        size_t count;
+        const char * small[MEMO_SMALL_READS];
+} memo_reads_t;
+
+int memo_start(size_t entries);
+
+int memo_enabled(void);
+
+int memo_lookup(tree_node_t * tree, symtab_snapshot_t * snap, value_t * result);
+
+memo_reads_t * memo_watch(tree_node_t * tree, memo_reads_t * reads);
+
+/**
+ * Notes that an evaluation being watched read a symbol.
+ *
+ * @param reads: The reads being collected, may be NULL
+ * @param name: The interned name of the symbol
+ */
+static inline void memo_read(memo_reads_t * reads, const char * name) {
+        if(reads) reads->names[reads->count++] = name;
+}
+
+void memo_read_tree(memo_reads_t * reads, tree_node_t * tree);
+
+void memo_store(tree_node_t * tree, memo_reads_t * reads, symtab_snapshot_t * snap, value_t result);
+
+void memo_unwatch(memo_reads_t * reads);
+
+void memo_report(FILE * out);
+
+void memo_stop(void);
+
+#endif
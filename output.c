@@ -0,0 +1,151 @@
+/**
+ * Implementation of the result output formats. Every evaluated line is
+ * written to standard output in one of three formats:
+ *
+ * - **text**: the expression in infix notation and its value, as in
+ *   `(1  + 2 ) = 3`. Lines that failed are left out, their errors having
+ *   been reported on standard error
+ * - **ndjson**: one object per line, as in
+ *   `{"line": 4, "status": 0, "value": 3}`, with an `"error"` name added
+ *   when status is not 0
+ * - **binary**: one 16-byte record per line: the line number as an
+ *   unsigned 32-bit integer, the status as a signed 32-bit integer and the
+ *   value as a signed 64-bit integer, all little-endian. Builds with double
+ *   values write the 64 bits of the IEEE 754 double instead
+ *
+ * The status is the eval_error_t of the line, 0 for success. The machine
+ * formats never render the infix form of an expression.
+ *
+ * A successful line of text or NDJSON is put together in a buffer, with
+ * the numbers written by value_format() and format_digits(), and written
+ * out with one call, as printf would take longer to parse its format than
+ * to write the line.
+ *
+ * @file        output.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "output.h"
+
+#define OUTPUT_LINE 1024 /// Longest text line put together without allocating
+#define NDJSON_HEAD "{\"line\": "
+#define NDJSON_VALUE ", \"status\": 0, \"value\": "
+
+/**
+ * Looks up an output format by name.
+ *
+ * @param name: A pointer to the name: "text", "ndjson" or "binary"
+ * @param format: A pointer to store the format at
+ * @return: 0 on success, -1 if the name is unknown
+ */
+int parse_output_format(const char * name, output_format_t * format) {
+        if(strcmp(name, "text") == 0) *format = OUTPUT_TEXT;
+        else if(strcmp(name, "ndjson") == 0) *format = OUTPUT_NDJSON;
+        else if(strcmp(name, "binary") == 0) *format = OUTPUT_BINARY;
+        else return -1;
+        return 0;
+}
+
+/**
+ * Stores an integer in little-endian byte order.
+ *
+ * @param buf: A pointer to the destination
+ * @param v: The value
+ * @param bytes: The number of bytes to store
+ */
+static void put_le(unsigned char * buf, uint64_t v, int bytes) {
+        for(int i = 0; i < bytes; i++) buf[i] = (unsigned char)(v >> (8 * i));
+}
+
+/**
+ * Writes the infix form of an expression and its value as a line of text.
+ *
+ * @param tree: A pointer to the expression's tree
+ * @param value: The value of the expression
+ */
+static void write_text(tree_node_t * tree, value_t value) {
+        char small[OUTPUT_LINE];
+        char * line = small;
+        size_t len = format_infix(tree, small, sizeof(small));
+
+        // room for " = ", the value and the newline
+        if(len + 4 + VALUE_TEXT_MAX > sizeof(small)) {
+                line = malloc(len + 4 + VALUE_TEXT_MAX);
+                if(!line) {
+                        print_infix(tree);
+                        printf(" = " VALUE_FMT "\n", value);
+                        return;
+                }
+                format_infix(tree, line, len + 1);
+        }
+
+        memcpy(line + len, " = ", 3);
+        len += 3;
+        len += value_format(value, line + len);
+        line[len++] = '\n';
+        fwrite(line, 1, len, stdout);
+
+        if(line != small) free(line);
+}
+
+/**
+ * Writes the NDJSON object of an expression that evaluated.
+ *
+ * @param line: The line number of the expression
+ * @param value: The value of the expression
+ */
+static void write_ndjson(unsigned long line, value_t value) {
+        char out[sizeof(NDJSON_HEAD) + sizeof(NDJSON_VALUE) + 21 + VALUE_TEXT_MAX + 2];
+        size_t len = sizeof(NDJSON_HEAD) - 1;
+
+        memcpy(out, NDJSON_HEAD, len);
+        len += format_digits(line, out + len);
+        memcpy(out + len, NDJSON_VALUE, sizeof(NDJSON_VALUE) - 1);
+        len += sizeof(NDJSON_VALUE) - 1;
+        len += value_format(value, out + len);
+        out[len++] = '}';
+        out[len++] = '\n';
+        fwrite(out, 1, len, stdout);
+}
+
+/**
+ * Writes the result of one line to standard output.
+ *
+ * @param format: The output format
+ * @param line: The line number of the expression, counting from 1
+ * @param tree: A pointer to the expression's tree, NULL if it did not
+ *      parse; only read by the text format
+ * @param status: Why the expression failed, EVAL_OK if it did not
+ * @param value: The value of the expression, ignored on failure
+ */
+void write_result(output_format_t format, unsigned long line, tree_node_t * tree, eval_error_t status, value_t value) {
+        if(status != EVAL_OK) value = 0;
+
+        switch(format) {
+                case OUTPUT_TEXT:
+                        if(status == EVAL_OK) write_text(tree, value);
+                        break;
+                case OUTPUT_NDJSON:
+                        if(status == EVAL_OK) write_ndjson(line, value);
+                        else printf("{\"line\": %lu, \"status\": %d, \"value\": 0, \"error\": \"%s\"}\n",
+                                        line, (int)status, eval_error_name(status));
+                        break;
+                case OUTPUT_BINARY: {
+                        unsigned char record[OUTPUT_RECORD_SIZE];
+                        put_le(record, (uint32_t)line, 4);
+                        put_le(record + 4, (uint32_t)(int32_t)status, 4);
+#ifdef VALUE_DOUBLE
+                        uint64_t bits;
+                        memcpy(&bits, &value, sizeof(bits));
+                        put_le(record + 8, bits, 8);
+#else
+                        put_le(record + 8, (uint64_t)(int64_t)value, 8);
+#endif
+                        fwrite(record, 1, sizeof(record), stdout);
+                        break;
+                }
+        }
+}
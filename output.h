@@ -0,0 +1,26 @@
+/**
+ * Interface for writing evaluation results in the text, NDJSON or binary
+ * output format.
+ *
+ * @file        output.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "parser.h"
+
+#define OUTPUT_RECORD_SIZE 16 /// Bytes in one binary record
+
+/// Formats results can be written in
+typedef enum output_format_e {
+        OUTPUT_TEXT, /// "infix = value" for every expression that evaluated
+        OUTPUT_NDJSON, /// One JSON object per expression
+        OUTPUT_BINARY /// One fixed-size little-endian record per expression
+} output_format_t;
+
+int parse_output_format(const char * name, output_format_t * format);
+
+void write_result(output_format_t format, unsigned long line, tree_node_t * tree, eval_error_t status, value_t value);
+
+#endif
@@ -9,21 +9,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include "parser.h"
 #include "tree_node.h"
 #include "stack.h"
 #include "symtab.h"
+#include "forkjoin.h"
+#include "memo.h"
+#include "scan.h"
+#include "diag.h"
+#include "trace.h"
 
 /**
- * Determines if a string represents a valid integer.
+ * Determines if a string represents a valid integer, or with VALUE_DOUBLE
+ * any decimal or exponent literal scan_decimal() accepts.
  *
  * @param str: A pointer to the string to be checked
- * @return: 1 if the string is a valid integer, 0 otherwise
+ * @return: 1 if the string is a valid literal, 0 otherwise
  */
 int is_num(char * str) {
         if(str == NULL || *str == '\0') return 0;
+#ifdef VALUE_DOUBLE
+        size_t len = strlen(str);
+        if(scan_decimal(str, len) == len) return 1;
+#endif
         if(*str == '-') str++;
+        if(*str == '\0') return 0;
 
         while(*str) {
                 if(*str < '0' || *str > '9') return 0;
@@ -44,273 +54,565 @@ int is_operator(const char * token) {
                 strcmp(token, "%") == 0 || strcmp(token, "=") == 0);
 }
 
+static tree_node_t * parse_tokens(stack_t * stack, int owned, int * no_memory);
+
 /**
  * Constructs an AST from a space-separated postfix expression string.
+ * The string is tokenized in place.
  *
  * @param exp: The postfix expression string
  * @return: Pointer to the root of the constructed AST or NULL on error
  */
 tree_node_t * make_parse_tree(char * exp) {
+        int no_memory;
+        return make_parse_tree_status(exp, &no_memory);
+}
+
+/**
+ * Constructs an AST from a space-separated postfix expression string, and
+ * tells a failure for lack of memory apart from an invalid expression.
+ * The string is tokenized in place.
+ *
+ * @param exp: The postfix expression string
+ * @param no_memory: A pointer to store 1 at if memory allocation failed,
+ *      0 otherwise
+ * @return: Pointer to the root of the constructed AST or NULL on error
+ */
+tree_node_t * make_parse_tree_status(char * exp, int * no_memory) {
+        *no_memory = 0;
         if(!exp || strlen(exp) == 0) {
-                fprintf(stderr, "Error: empty expression\n");
+                diag("Error: empty expression\n");
                 return NULL;
         }
 
         stack_t * stk = make_stack();
-        char * tok = strtok(exp, " ");
+        if(!stk) {
+                *no_memory = 1;
+                return NULL;
+        }
+        char * p = exp + scan_space(exp);
+
+        while(*p != '\0') {
+                scan_kind_t kind;
+                size_t len = scan_token(p, &kind);
+                char * next = p + len;
 
-        while(tok != NULL) {
-                if(tok[0] != '\0' && strspn(tok, " \t\n\r") != strlen(tok)) {
-                        push(stk, strdup(tok));
+                // the stack holds the tokens in place; the tree interns
+                // or copies what it keeps
+                if(*next != '\0') *next++ = '\0';
+                if(push(stk, p) < 0) {
+                        *no_memory = 1;
+                        break;
                 }
-                tok = strtok(NULL, " ");
+                p = next + scan_space(next);
         }
 
-        if(empty_stack(stk)) {
-                fprintf(stderr, "Error: Empty expression\n");
+        if(*no_memory || empty_stack(stk)) {
+                if(!*no_memory) diag("Error: Empty expression\n");
+                while(!empty_stack(stk)) pop(stk);
                 free_stack(stk);
                 return NULL;
         }
 
-        tok = (char *)top(stk);
-        pop(stk);
-        if(tok == NULL || tok[0] == '\0' || strspn(tok, " \t\n\r") == strlen(tok)) {
-                fprintf(stderr, "Error: invalid token\n");
-                free_stack(stk);
-                return NULL;
+        tree_node_t * root = parse_tokens(stk, 0, no_memory);
+        if(root != NULL && !empty_stack(stk)) {
+                diag("Error: Invalid expression, too many tokens\n");
+                cleanup_tree(root);
+                root = NULL;
         }
 
-        if(is_num(tok)) {
-                tree_node_t * node = make_leaf(INTEGER, tok);
-                push(stk, node);
-        } else if(isalpha(tok[0])) {
-                tree_node_t * node = make_leaf(SYMBOL, tok);
-                push(stk, node);
-        } else {
-                fprintf(stderr, "Error: Unknown token '%s'\n", tok);
-                free_stack(stk);
-                return NULL;
-        }
+        // the tokens left over belong to exp, not to the stack
+        while(!empty_stack(stk)) pop(stk);
+        free_stack(stk);
+        return root;
+}
 
-        if(stk->top != NULL && stk->top->next == NULL) {
-                tree_node_t *root = (tree_node_t *)top(stk);
-                pop(stk);
-                free_stack(stk);
-                return root;
-        } else {
-                fprintf(stderr, "Error: Invalid expression, too many tokens\n");
-                free_stack(stk);
-                return NULL;
-        }
+/**
+ * Maps an operator token to its operator type.
+ *
+ * @param tok: A pointer to the operator token
+ * @return: The operator type, or NO_OP if tok is not an operator
+ */
+op_type_t operator_type(const char * tok) {
+        if(strcmp(tok, ADD_OP_STR) == 0) return ADD_OP;
+        else if(strcmp(tok, SUB_OP_STR) == 0) return SUB_OP;
+        else if(strcmp(tok, MUL_OP_STR) == 0) return MUL_OP;
+        else if(strcmp(tok, DIV_OP_STR) == 0) return DIV_OP;
+        else if(strcmp(tok, MOD_OP_STR) == 0) return MOD_OP;
+        else if(strcmp(tok, ASSIGN_OP_STR) == 0) return ASSIGN_OP;
+        return NO_OP;
 }
 
 /**
  * Recursively parses through the tokens from a stack into an AST.
  *
  * @param stack: A pointer to the stack containing tokens in postfix order
+ * @param owned: If set, every token popped from the stack is freed
+ * @param no_memory: A pointer to store 1 at if a node could not be
+ *      allocated
  * @return: A pointer to the root of the subtree or NULL upon error
  */
-tree_node_t * parse(stack_t * stack) {
+static tree_node_t * parse_tokens(stack_t * stack, int owned, int * no_memory) {
         if(empty_stack(stack)) {
-                fprintf(stderr, "Error: Empty stack\n");
+                diag("Error: Empty stack\n");
                 return NULL;
         }
 
         tree_node_t * node = NULL;
+        char * tok = (char *)top(stack);
+        pop(stack);
+        TRACE("[parser] Popped tok: '%s'\n", tok);
+        if(!tok || tok[0] == '\0') {
+                diag("Error: null token\n");
+                if(owned) free(tok);
+                return NULL;
+        }
 
-        while(!empty_stack(stack)) {
-                char * tok = (char *)top(stack);
-                pop(stack);
-                printf("[parser] Popped tok: '%s'\n", tok);
-                if(!tok || tok[0] == '\0') {
-                        fprintf(stderr, "Error: null token\n");
-                        free_stack(stack);
+        TRACE("[parser] Parsing token: '%s\n", tok);
+        scan_kind_t kind;
+        scan_token(tok, &kind);
+        if(kind == SCAN_INTEGER){
+                TRACE("[DETECTED INTEGER TOKEN: '%s']\n", tok);
+                node = make_leaf(INTEGER, tok);
+                if(!node) {
+                        diag("\tError: Failed to create leaf node for integer\n");
+                        *no_memory = 1;
+                }
+        } else if(kind == SCAN_SYMBOL) {
+                TRACE("[DETECTED SYMBOL TOKEN '%s']\n", tok);
+                node = make_leaf(SYMBOL, tok);
+                if(!node) {
+                        diag("\tError: Failed to create leaf node for symbol\n");
+                        *no_memory = 1;
+                } else {
+                        TRACE("[parser] Successfully created leaf node for symbol\n");
+                }
+        } else if(kind == SCAN_OPERATOR) {
+                TRACE("[DETECTED OPERATOR TOKEN: '%s']\n", tok);
+                if(stack_size(stack) < 2) {
+                        diag("\tError: not enough operands for operator '%s'\n", tok);
+                        if(owned) free(tok);
                         return NULL;
                 }
+                tree_node_t *right = parse_tokens(stack, owned, no_memory);
+                tree_node_t *left = right ? parse_tokens(stack, owned, no_memory) : NULL;
 
-                printf("[parser] Parsing token: '%s\n", tok);
-                if(is_num(tok)){
-                        printf("[DETECTED INTEGER TOKEN: '%s']\n", tok);
-                        node = make_leaf(INTEGER, tok);
-                        if(!node) {
-                                fprintf(stderr, "\tError: Failed to create leaf node for integer\n");
-                                free_stack(stack);
-                                return NULL;
-                        }
-                        return node;
-                } else if(isalpha(tok[0])) {
-                        printf("[DETECTED SYMBOL TOKEN '%s']\n", tok);
-                        node = make_leaf(SYMBOL, tok);
-                        if(!node) {
-                                fprintf(stderr, "\tError: Failed to create leaf node for symbol\n");
-                                free_stack(stack);
-                                return NULL;
-                        }
-                        printf("[parser] Successfully created leaf node for symbol\n");
-                        return node;
-                } else if(is_operator(tok)) {
-                        printf("[DETECTED OPERATOR TOKEN: '%s']\n", tok);
-                        if(stack->top == NULL || stack->top->next == NULL) {
-                                fprintf(stderr, "\tError: not enough operands for operator '%s'\n", tok);
-                                free_stack(stack);
-                                return NULL;
-                        }
-                        char * oper = tok;
-                        tree_node_t *right = parse(stack);
-                        tree_node_t *left = parse(stack);
-
-                        op_type_t op;
-                        if(strcmp(tok, ADD_OP_STR) == 0) op = ADD_OP;
-                        else if(strcmp(oper, SUB_OP_STR) == 0) op = SUB_OP;
-                        else if(strcmp(oper, MUL_OP_STR) == 0) op = MUL_OP;
-                        else if(strcmp(oper, DIV_OP_STR) == 0) op = DIV_OP;
-                        else if(strcmp(oper, MOD_OP_STR) == 0) op = MOD_OP;
-                        else if(strcmp(oper, ASSIGN_OP_STR) == 0) op = ASSIGN_OP;
-                        else {
-                                fprintf(stderr, "\tError: Unknown operator '%s'\n", tok);
-                                free(tok);
-                                free_stack(stack);
-                                return NULL;
-                        }
-                        node = make_interior(op, oper, left, right);
-                        //printf("[parser]: Tok after = %s\n", tok);
-                        if(!node || !node->token || node->token[0] == '\0') {
-                                fprintf(stderr, "\tError: Failed to create interior node for operator '%s'\n", tok);
-                                free(tok);
-                                free_stack(stack);
-                                return NULL;
-                        }
-                        return node;
-                } else if(strcmp(tok, "?") == 0) {
-                        printf("[DETECTED TERNARY OPERATOR: '%s']\n", tok);
-                        tree_node_t *con = (tree_node_t *)parse(stack);
-                        printf("\t[parser]: Created condition for ternary op\n");
-                        if(!con) {
-                                fprintf(stderr, "Error: Missing condition for ternary op\n");
-                                return NULL;
-                        }
+                if(left && right && (node = make_interior(operator_type(tok), tok, left, right)) == NULL) *no_memory = 1;
+                if(!node) {
+                        diag("\tError: Failed to create interior node for operator '%s'\n", tok);
+                        cleanup_tree(left);
+                        cleanup_tree(right);
+                }
+        } else if(kind == SCAN_TERNARY) {
+                TRACE("[DETECTED TERNARY OPERATOR: '%s']\n", tok);
+                tree_node_t *con = parse_tokens(stack, owned, no_memory);
+                tree_node_t *t = con ? parse_tokens(stack, owned, no_memory) : NULL;
+                tree_node_t *f = t ? parse_tokens(stack, owned, no_memory) : NULL;
+                tree_node_t *n = f ? make_interior(ALT_OP, ALT_OP_STR, t, f) : NULL;
 
-                        tree_node_t *t = parse(stack);
-                        printf("\t[parser]: Created true expression for ternary op\n");
-                        if(t == NULL) {
-                                fprintf(stderr, "\tError: failed to parse true expression after '?'\n");
-                                cleanup_tree(t);
-                                return NULL;
-                        }
+                if(!con) diag("Error: Missing condition for ternary op\n");
+                else if(!t) diag("\tError: failed to parse true expression after '?'\n");
+                else if(!f) diag("\tError: Failed to parse false expression after ':'\n");
+                else if(n) node = make_interior(Q_OP, tok, con, n);
 
-                        tree_node_t *f = parse(stack);
-                        printf("\t[parser]: Created false expression for ternary op\n");
-                        if(f == NULL) {
-                                fprintf(stderr, "\tError: Failed to parse false expression after ':'\n");
-                                cleanup_tree(f);
-                                return NULL;
-                        }
-                        tree_node_t * n = make_interior(ALT_OP, ":", t, f);
-                        if(!n) {
-                                fprintf(stderr, "\tError: failed to create ternary node\n");
-                                free_stack(stack);
-                                return NULL;
+                if(!node) {
+                        if(con && t && f) {
+                                diag("\tError: failed to create ternary node\n");
+                                *no_memory = 1;
                         }
-                        node = make_interior(Q_OP, "?", con, n);
-                        return node;
-                } else if(strcmp(tok, ":")) {
-                        printf("\t[DETECTED ALT OPERATION: '%s']\n", tok);
-                        tree_node_t * t = parse(stack);
-                        tree_node_t * f = parse(stack);
-                        if(!t || !f) {
-                                fprintf(stderr, "Error: Invalid T/F expressions for alt op\n");
+                        if(n) cleanup_tree(n);
+                        else {
                                 cleanup_tree(t);
                                 cleanup_tree(f);
-                                return NULL;
                         }
-                        node = make_interior(ALT_OP, ":", t, f);
-                        return node;
-                } else {
-                        fprintf(stderr, "\tError: Invalid token '%s'\n", tok);
-                        free(tok);
-                        free_stack(stack);
-                        return NULL;
+                        cleanup_tree(con);
+                }
+        } else if(strcmp(tok, ALT_OP_STR) == 0) {
+                TRACE("\t[DETECTED ALT OPERATION: '%s']\n", tok);
+                tree_node_t * t = parse_tokens(stack, owned, no_memory);
+                tree_node_t * f = t ? parse_tokens(stack, owned, no_memory) : NULL;
+                if(!t || !f) {
+                        diag("Error: Invalid T/F expressions for alt op\n");
+                        cleanup_tree(t);
+                } else if((node = make_interior(ALT_OP, ALT_OP_STR, t, f)) == NULL) {
+                        *no_memory = 1;
+                        cleanup_tree(t);
+                        cleanup_tree(f);
                 }
-                free(tok);
+        } else {
+                diag("\tError: Invalid token '%s'\n", tok);
         }
+
+        if(owned) free(tok);
         return node;
 }
 
 /**
- * Evaluates the result of an expression represented by an AST
+ * Recursively parses through the tokens from a stack into an AST. Every
+ * token popped from the stack is freed; on error, the tokens left on the
+ * stack still belong to the caller.
  *
- * @param node: A pointer to the root of the AST
- * @return: The integer result of the evaluation
+ * @param stack: A pointer to the stack containing tokens in postfix order
+ * @return: A pointer to the root of the subtree or NULL upon error
  */
-int eval_tree(tree_node_t * node) {
-        if(node == NULL) return 0;
+tree_node_t * parse(stack_t * stack) {
+        int no_memory = 0;
+        return parse_tokens(stack, 1, &no_memory);
+}
+
+/**
+ * Records why an evaluation failed, unless an earlier error already did.
+ *
+ * @param err: A pointer to the evaluation's error status
+ * @param why: The error
+ */
+static void fail(eval_error_t * err, eval_error_t why) {
+        if(*err == EVAL_OK) *err = why;
+}
+
+/**
+ * Finishes an exact result, dropping it back to a machine value when it
+ * fits again.
+ *
+ * @param big: A pointer to the exact result, NULL if memory ran out
+ * @param err: A pointer to the evaluation's error status
+ * @return: The result
+ */
+__attribute__((noinline)) static num_t from_big(bignum_t * big, eval_error_t * err) {
+        if(big == NULL) {
+                diag("Error: out of memory for an exact result\n");
+                fail(err, EVAL_OVERFLOW);
+                return NUM(0);
+        }
+#ifndef VALUE_DOUBLE
+        long long val;
+        if(big_to_long(big, VALUE_MIN, VALUE_MAX, &val) == 0) {
+                big_free(big);
+                return NUM((value_t)val);
+        }
+#endif
+        return (num_t){ 0, big };
+}
+
+/**
+ * Applies an operator the fast path of apply_num() could not: one with a
+ * bignum operand or a result that does not fit, or one that fails.
+ * Consumes both operands.
+ */
+__attribute__((noinline)) static num_t apply_slow(op_type_t op, num_t left, num_t right, eval_error_t * err) {
+        if((op == DIV_OP || op == MOD_OP) && right.big == NULL && right.val == 0) {
+                free_num(left);
+                diag("Error: division by zero\n");
+                fail(err, EVAL_DIVISION_BY_ZERO);
+                return NUM(0);
+        }
+        if(op != ADD_OP && op != SUB_OP && op != MUL_OP && op != DIV_OP && op != MOD_OP) {
+                free_num(left);
+                free_num(right);
+                diag("Error: unknown operation type\n");
+                fail(err, EVAL_INVALID_OPERATOR);
+                return NUM(0);
+        }
+
+        TRACE("\t[eval]: exact operation\n");
+        bignum_t * a = left.big ? left.big : big_from_long((long long)left.val);
+        bignum_t * b = right.big ? right.big : big_from_long((long long)right.val);
+        bignum_t * result = NULL;
+
+        if(a && b) {
+                if(op == ADD_OP) result = big_add(a, b);
+                else if(op == SUB_OP) result = big_sub(a, b);
+                else if(op == MUL_OP) result = big_mul(a, b);
+                else big_divmod(a, b, op == DIV_OP ? &result : NULL, op == MOD_OP ? &result : NULL);
+        }
+        big_free(a);
+        big_free(b);
+        return from_big(result, err);
+}
+
+/**
+ * Applies an operator with the overflow-checked machine arithmetic when
+ * both operands and the result fit, and apply_slow() otherwise. Inlined
+ * into eval_node(), where nearly every operation takes the fast path.
+ */
+static inline num_t apply_fast(op_type_t op, num_t left, num_t right, eval_error_t * err) {
+        value_t val;
+
+        if(__builtin_expect(left.big == NULL && right.big == NULL, 1)) {
+                switch(op) {
+                        case ADD_OP:
+                                TRACE("\t[eval]: add operation\n");
+                                if(!value_add(left.val, right.val, &val)) return NUM(val);
+                                break;
+                        case SUB_OP:
+                                TRACE("\t[eval]: sub operation\n");
+                                if(!value_sub(left.val, right.val, &val)) return NUM(val);
+                                break;
+                        case MUL_OP:
+                                TRACE("\t[eval]: mul operation\n");
+                                if(!value_mul(left.val, right.val, &val)) return NUM(val);
+                                break;
+                        case DIV_OP:
+                                TRACE("\t[eval]: div operation\n");
+                                if(right.val != 0 && !value_div(left.val, right.val, &val)) return NUM(val);
+                                break;
+                        case MOD_OP:
+                                TRACE("\t[eval]: mod operation\n");
+                                if(right.val != 0) return NUM(value_mod(left.val, right.val));
+                                break;
+                        default:
+                                break;
+                }
+        }
+        return apply_slow(op, left, right, err);
+}
+
+/**
+ * Applies an arithmetic operator to its evaluated operands. Results that
+ * fit are computed with overflow-checked machine arithmetic; the rest are
+ * computed exactly with bignums, and drop back to machine values as soon
+ * as they fit. Consumes both operands.
+ *
+ * @param op: The operator, anything but ASSIGN_OP and Q_OP
+ * @param left: The value of the left operand
+ * @param right: The value of the right operand
+ * @param err: A pointer to the evaluation's error status
+ * @return: The result of the operation
+ */
+num_t apply_num(op_type_t op, num_t left, num_t right, eval_error_t * err) {
+        return apply_fast(op, left, right, err);
+}
+
+/**
+ * Converts a literal, exactly even when an integer does not fit.
+ *
+ * @param token: A pointer to a token of kind SCAN_INTEGER
+ * @param len: The length of the token
+ * @param err: A pointer to the evaluation's error status
+ * @return: The value of the literal
+ */
+num_t literal_num(const char * token, size_t len, eval_error_t * err) {
+#ifndef VALUE_DOUBLE
+        if(__builtin_expect(len - (token[0] == '-') > VALUE_DIGITS, 0)) return from_big(big_parse(token, len), err);
+#else
+        (void)err;
+#endif
+        return NUM(scan_value(token, len));
+}
+
+/**
+ * Turns the exact result of an evaluation into a value.
+ *
+ * @param num: The result, which is consumed
+ * @param err: A pointer to the evaluation's error status
+ * @return: The value, or 0 with EVAL_OVERFLOW if it does not fit
+ */
+value_t num_value(num_t num, eval_error_t * err) {
+        if(num.big == NULL) return num.val;
+
+        char text[64];
+        size_t len = big_format(num.big, text, sizeof(text));
+        diag("Error: result %s%s is out of range\n", text, len >= sizeof(text) ? "..." : "");
+        fail(err, EVAL_OVERFLOW);
+        big_free(num.big);
+        return 0;
+}
+
+/**
+ * Frees the bignum of a value, if it has one.
+ *
+ * @param num: The value
+ */
+void free_num(num_t num) {
+        big_free(num.big);
+}
+
+/**
+ * Recursively evaluates a subtree against a pinned symbol table snapshot.
+ *
+ * @param node: A pointer to the root of the subtree
+ * @param table: The table assignments write to, NULL if the subtree is pure
+ * @param snap: The pinned snapshot, re-pinned after each assignment so
+ *      later reads see the new value
+ * @param reads: The symbols read so far, for the result cache, or NULL
+ * @param err: A pointer to the evaluation's error status
+ * @return: The exact result of the evaluation
+ */
+static num_t eval_node(tree_node_t * node, symtab_t * table, symtab_snapshot_t ** snap, memo_reads_t * reads, eval_error_t * err) {
+        if(node == NULL) return NUM(0);
         if(node->type == LEAF) {
-                printf("[DETECTED LEAF NODE]\n");
+                TRACE("[DETECTED LEAF NODE]\n");
                 leaf_node_t * leaf = (leaf_node_t *)node->node;
                 if(leaf->exp_type == INTEGER) {
-                        printf("\t[eval]: Found integer node\n");
-                        return atoi(node->token);
+                        TRACE("\t[eval]: Found integer node\n");
+                        return literal_num(node->token, strlen(node->token), err);
                 } else if(leaf->exp_type == SYMBOL) {
-                        printf("\t[eval]: Found symbol node\n");
-                        symbol_t * symbol = lookup_table(node->token);
+                        TRACE("\t[eval]: Found symbol node\n");
+                        symbol_t * symbol = lookup_interned(*snap, node->token);
+                        memo_read(reads, node->token);
                         if(symbol != NULL) {
-                                printf("\t[eval]: Symbol: %d\n", symbol->val);
-                                return symbol->val;
+                                value_t val = symbol_value(symbol);
+                                TRACE("\t[eval]: Symbol: " VALUE_FMT "\n", val);
+                                return NUM(val);
                         } else {
-                                fprintf(stderr, "Error: undefined symbol '%s'\n", node->token);
-                                return 0;
+                                diag("Error: undefined symbol '%s'\n", node->token);
+                                fail(err, EVAL_UNDEFINED_SYMBOL);
+                                return NUM(0);
                         }
                 }
         } else if(node->type == INTERIOR) {
-                printf("[DETECTED INTERIOR NODE]\n");
+                TRACE("[DETECTED INTERIOR NODE]\n");
                 interior_node_t * interior = (interior_node_t *)node->node;
-                int left = eval_tree(interior->left);
-                printf("\t[eval]: Evaluated left node\n");
-                int right = eval_tree(interior->right);
-                printf("\t[eval]: Evaluted right node\n");
 
-                switch(interior->op) {
-                        case ADD_OP:
-                                printf("\t[eval]: add operation\n");
-                                return left + right;
-                        case SUB_OP:
-                                printf("\t[eval]: sub operation\n");
-                                return left - right;
-                        case MUL_OP:
-                                printf("\t[eval]: mul operation\n");
-                                return left * right;
-                        case DIV_OP:
-                                printf("\t[eval]: div operation\n");
-                                if(right == 0) {
-                                        fprintf(stderr, "Error: division by zero\n");
-                                        return 0;
-                                }
-                                return left / right;
-                        case ASSIGN_OP:
-                                printf("\t[eval]: assign operation\n");
-                                if(interior->left->type == LEAF && ((leaf_node_t *)interior->left->node)->exp_type == SYMBOL) {
-                                        symbol_t * symbol = lookup_table(interior->left->token);
-                                        if(symbol != NULL) {
-                                                symbol->val = right;
-                                                return right;
-                                        }
-                                } else {
-                                        fprintf(stderr, "Error: invalid left-hand side for assignment\n");
-                                        return 0;
-                                } break;
-                        case Q_OP:
-                                printf("\t[eval]: ternary operation\n");
-                                int condition = left;
-                                interior_node_t * r = (interior_node_t *)interior->right->node;
-                                if(condition) return eval_tree(r->left);
-                                else return eval_tree(r->right);
+                // large subtrees without assignments only read the pinned
+                // snapshot, so their halves can be evaluated in parallel
+                num_t result;
+                if(node->pure && node->size >= FORK_MIN_SIZE && fork_eval(node, *snap, &result, err) == 0) {
+                        memo_read_tree(reads, node);
+                        return result;
+                }
 
-                        default:
-                                fprintf(stderr, "Error: unknown operation type\n");
-                                return 0;
+                // a ternary only evaluates its condition and the selected
+                // arm of its ':' child, each exactly once
+                if(interior->op == Q_OP) {
+                        TRACE("\t[eval]: ternary operation\n");
+                        tree_node_t * arms = interior->right;
+                        if(arms->type != INTERIOR || ((interior_node_t *)arms->node)->op != ALT_OP) {
+                                diag("Error: ternary without alternative\n");
+                                fail(err, EVAL_INVALID_OPERATOR);
+                                return NUM(0);
+                        }
+                        interior_node_t * alt = (interior_node_t *)arms->node;
+                        num_t condition = eval_node(interior->left, table, snap, reads, err);
+
+                        // a bignum is never 0
+                        int taken = condition.big != NULL || condition.val != 0;
+                        if(condition.big) free_num(condition);
+                        if(taken) return eval_node(alt->left, table, snap, reads, err);
+                        else return eval_node(alt->right, table, snap, reads, err);
+                }
+
+                // the target of an assignment is stored to, not read
+                num_t left = NUM(0);
+                if(interior->op != ASSIGN_OP) {
+                        left = eval_node(interior->left, table, snap, reads, err);
+                        TRACE("\t[eval]: Evaluated left node\n");
+                }
+                num_t right = eval_node(interior->right, table, snap, reads, err);
+                TRACE("\t[eval]: Evaluted right node\n");
+
+                if(interior->op != ASSIGN_OP) return apply_fast(interior->op, left, right, err);
+
+                TRACE("\t[eval]: assign operation\n");
+                if(interior->left->type == LEAF && ((leaf_node_t *)interior->left->node)->exp_type == SYMBOL) {
+                        if(right.big) {
+                                diag("Error: value assigned to '%s' is out of range\n", interior->left->token);
+                                fail(err, EVAL_OVERFLOW);
+                                free_num(right);
+                                return NUM(0);
+                        }
+                        if(table && symtab_assign(table, interior->left->token, right.val) != NULL) {
+                                unpin_table(*snap);
+                                *snap = symtab_pin(table);
+                                return right;
+                        }
+                        diag("Error: undefined symbol '%s'\n", interior->left->token);
+                        fail(err, EVAL_UNDEFINED_SYMBOL);
+                } else {
+                        free_num(right);
+                        diag("Error: invalid left-hand side for assignment\n");
+                        fail(err, EVAL_INVALID_ASSIGNMENT);
+                        return NUM(0);
                 }
         }
-        return 0;
+        return NUM(0);
+}
+
+/**
+ * Evaluates the result of an expression represented by an AST against a
+ * symbol table. The whole evaluation reads one consistent version of the
+ * table, plus the expression's own assignments.
+ *
+ * @param table: A pointer to the table to read and assign symbols in
+ * @param node: A pointer to the root of the AST
+ * @param err: A pointer to store why the evaluation failed at, or
+ *      EVAL_OK if it did not; EVAL_PARSE_ERROR if node is NULL
+ * @return: The result of the evaluation, in which a failed
+ *      subexpression counts as 0
+ */
+value_t eval_tree_in(symtab_t * table, tree_node_t * node, eval_error_t * err) {
+        *err = EVAL_OK;
+        if(node == NULL) {
+                *err = EVAL_PARSE_ERROR;
+                return 0;
+        }
+
+        // an expression without assignments whose symbols have not been
+        // written since it was last evaluated gives the cached result
+        symtab_snapshot_t * snap = symtab_pin(table);
+        value_t result;
+        if(memo_lookup(node, snap, &result) == 0) {
+                unpin_table(snap);
+                return result;
+        }
+
+        memo_reads_t watch, * reads = memo_watch(node, &watch);
+        result = num_value(eval_node(node, table, &snap, reads, err), err);
+        if(*err == EVAL_OK) memo_store(node, reads, snap, result);
+
+        memo_unwatch(reads);
+        unpin_table(snap);
+        return result;
+}
+
+/**
+ * Evaluates the result of an expression represented by an AST against the
+ * process-wide symbol table, see eval_tree_in().
+ *
+ * @param node: A pointer to the root of the AST
+ * @param err: A pointer to store why the evaluation failed at
+ * @return: The result of the evaluation
+ */
+value_t eval_tree_status(tree_node_t * node, eval_error_t * err) {
+        return eval_tree_in(default_table(), node, err);
+}
+
+/**
+ * Evaluates the result of an expression represented by an AST, see
+ * eval_tree_status().
+ *
+ * @param node: A pointer to the root of the AST
+ * @return: The result of the evaluation
+ */
+value_t eval_tree(tree_node_t * node) {
+        eval_error_t err;
+        return eval_tree_status(node, &err);
+}
+
+/**
+ * Evaluates a subtree without assignments against a pinned symbol table
+ * snapshot.
+ *
+ * @param node: A pointer to the root of the subtree, which must be pure
+ * @param snap: The pinned snapshot
+ * @param err: A pointer to the evaluation's error status
+ * @return: The result of the evaluation
+ */
+value_t eval_snapshot(tree_node_t * node, symtab_snapshot_t * snap, eval_error_t * err) {
+        return num_value(eval_node(node, NULL, &snap, NULL, err), err);
+}
+
+/**
+ * Evaluates a subtree without assignments against a pinned symbol table
+ * snapshot, keeping a result that does not fit exact.
+ *
+ * @param node: A pointer to the root of the subtree, which must be pure
+ * @param snap: The pinned snapshot
+ * @param err: A pointer to the evaluation's error status
+ * @return: The exact result of the evaluation
+ */
+num_t eval_snapshot_num(tree_node_t * node, symtab_snapshot_t * snap, eval_error_t * err) {
+        return eval_node(node, NULL, &snap, NULL, err);
 }
 
 /**
@@ -321,18 +623,161 @@ int eval_tree(tree_node_t * node) {
 void print_infix(tree_node_t * node) {
         if(node == NULL) return;
 
+        // the tokens are written as is, without parsing a format for each
         if(node->type == LEAF) {
-                printf("%s ", node->token);
+                fputs(node->token, stdout);
+                putchar(' ');
         } else if(node->type == INTERIOR) {
                 interior_node_t * interior = (interior_node_t *)node->node;
-                printf("(");
+                putchar('(');
                 print_infix(interior->left);
-                printf(" %s ", node->token);
+                putchar(' ');
+                fputs(node->token, stdout);
+                putchar(' ');
                 print_infix(interior->right);
-                printf(")");
+                putchar(')');
         }
 }
 
+/**
+ * Appends a string to a bounded buffer, always keeping it terminated.
+ *
+ * @param buf: A pointer to the buffer
+ * @param len: The size of the buffer
+ * @param used: The length of the string already in the buffer
+ * @param str: A pointer to the string to append
+ * @return: The length the buffer would have had without truncation
+ */
+static size_t append(char * buf, size_t len, size_t used, const char * str) {
+        size_t n = strlen(str);
+
+        if(used < len) {
+                size_t room = len - used - 1;
+                memcpy(buf + used, str, n < room ? n : room);
+                buf[used + (n < room ? n : room)] = '\0';
+        }
+        return used + n;
+}
+
+/**
+ * Recursively renders a subtree in infix notation, as print_infix() does.
+ *
+ * @param node: A pointer to the root of the subtree
+ * @param buf: A pointer to the buffer
+ * @param len: The size of the buffer
+ * @param used: The length of the string already in the buffer
+ * @return: The length the buffer would have had without truncation
+ */
+static size_t format_node(tree_node_t * node, char * buf, size_t len, size_t used) {
+        if(node == NULL) return used;
+
+        if(node->type == LEAF) {
+                used = append(buf, len, used, node->token);
+                used = append(buf, len, used, " ");
+        } else if(node->type == INTERIOR) {
+                interior_node_t * interior = (interior_node_t *)node->node;
+                used = append(buf, len, used, "(");
+                used = format_node(interior->left, buf, len, used);
+                used = append(buf, len, used, " ");
+                used = append(buf, len, used, node->token);
+                used = append(buf, len, used, " ");
+                used = format_node(interior->right, buf, len, used);
+                used = append(buf, len, used, ")");
+        }
+        return used;
+}
+
+/**
+ * Writes the AST in infix notation into a buffer, in the same form that
+ * print_infix() prints. The result is truncated to fit the buffer.
+ *
+ * @param node: A pointer to the root of the AST
+ * @param buf: A pointer to the buffer
+ * @param len: The size of the buffer
+ * @return: The length of the full infix string, which is at least len
+ *      if the string was truncated
+ */
+size_t format_infix(tree_node_t * node, char * buf, size_t len) {
+        if(len > 0) buf[0] = '\0';
+        return format_node(node, buf, len, 0);
+}
+
+/**
+ * Counts the nodes of an AST.
+ *
+ * @param node: A pointer to the root of the AST
+ * @return: The number of nodes, 0 for an empty tree
+ */
+size_t tree_size(tree_node_t * node) {
+        return node ? node->size : 0;
+}
+
+/**
+ * Measures the depth of an AST.
+ *
+ * @param node: A pointer to the root of the AST
+ * @return: The number of nodes on the longest path from the root to a
+ *      leaf, 0 for an empty tree
+ */
+int tree_depth(tree_node_t * node) {
+        if(node == NULL) return 0;
+        if(node->type != INTERIOR) return 1;
+
+        interior_node_t * interior = (interior_node_t *)node->node;
+        int left = tree_depth(interior->left);
+        int right = tree_depth(interior->right);
+        return 1 + (left > right ? left : right);
+}
+
+/**
+ * Compares two trees token by token.
+ *
+ * @param a: A pointer to the root of one tree
+ * @param b: A pointer to the root of the other tree
+ * @return: 1 if they are the same expression, 0 otherwise
+ */
+int same_tree(tree_node_t * a, tree_node_t * b) {
+        if(a->hash != b->hash || a->type != b->type || a->size != b->size) return 0;
+        // names and operators are interned, so only literals need comparing
+        if(a->token != b->token && strcmp(a->token, b->token) != 0) return 0;
+        if(a->type == LEAF) return ((leaf_node_t *)a->node)->exp_type == ((leaf_node_t *)b->node)->exp_type;
+
+        interior_node_t * x = (interior_node_t *)a->node;
+        interior_node_t * y = (interior_node_t *)b->node;
+        return x->op == y->op && same_tree(x->left, y->left) && same_tree(x->right, y->right);
+}
+
+/**
+ * Copies a tree, adding the memory the copy takes up to a count.
+ *
+ * @param node: A pointer to the root of the tree
+ * @param used: A pointer to the count of bytes, may be NULL
+ * @return: A pointer to the copy, or NULL if memory allocation fails
+ */
+tree_node_t * copy_tree(tree_node_t * node, size_t * used) {
+        size_t bytes = sizeof(tree_node_t);
+        tree_node_t * copy;
+
+        if(node->type == LEAF) {
+                bytes += sizeof(leaf_node_t);
+                if(((leaf_node_t *)node->node)->exp_type == INTEGER) bytes += strlen(node->token) + 1;
+                if(used) *used += bytes;
+                return make_leaf(((leaf_node_t *)node->node)->exp_type, node->token);
+        }
+
+        interior_node_t * interior = (interior_node_t *)node->node;
+        tree_node_t * left = copy_tree(interior->left, used);
+        tree_node_t * right = left ? copy_tree(interior->right, used) : NULL;
+        copy = right ? make_interior(interior->op, node->token, left, right) : NULL;
+
+        if(used) *used += bytes + sizeof(interior_node_t);
+        if(!copy) {
+                cleanup_tree(left);
+                cleanup_tree(right);
+        }
+        return copy;
+}
+
 /**
  * Frees memory associated with an AST
  *
@@ -347,10 +792,6 @@ void cleanup_tree(tree_node_t * node) {
                 cleanup_tree(interior->right);
                 free(interior);
         } else if(node->type == LEAF) {
-                if(node->token != NULL) {
-                        free(node->token);
-                        node->token = NULL;
-                }
                 free(node->node);
         }
         free(node);
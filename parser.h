@@ -0,0 +1,79 @@
+/**
+ * Interface for the parser, which turns postfix expressions into
+ * expression trees, evaluates them and renders them in infix notation.
+ *
+ * @file        parser.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+#include "stack.h"
+#include "tree_node.h"
+#include "symtab.h"
+#include "bignum.h"
+#include "eval_error.h"
+
+#define ADD_OP_STR "+"
+#define SUB_OP_STR "-"
+#define MUL_OP_STR "*"
+#define DIV_OP_STR "/"
+#define MOD_OP_STR "%"
+#define ASSIGN_OP_STR "="
+#define Q_OP_STR "?"
+#define ALT_OP_STR ":"
+
+/// A value during evaluation, exact even when it does not fit in a value_t
+typedef struct num_s {
+        value_t val; /// The value, when big is NULL
+        bignum_t * big; /// The exact value while it does not fit, owned by the num
+} num_t;
+
+#define NUM(v) ((num_t){ (v), NULL }) /// A num that fits
+
+int is_num(char * str);
+
+int is_operator(const char * token);
+
+op_type_t operator_type(const char * tok);
+
+tree_node_t * make_parse_tree(char * exp);
+
+tree_node_t * make_parse_tree_status(char * exp, int * no_memory);
+
+tree_node_t * parse(stack_t * stack);
+
+num_t apply_num(op_type_t op, num_t left, num_t right, eval_error_t * err);
+
+num_t literal_num(const char * token, size_t len, eval_error_t * err);
+
+value_t num_value(num_t num, eval_error_t * err);
+
+void free_num(num_t num);
+
+value_t eval_tree(tree_node_t * node);
+
+value_t eval_tree_in(symtab_t * table, tree_node_t * node, eval_error_t * err);
+
+value_t eval_tree_status(tree_node_t * node, eval_error_t * err);
+
+value_t eval_snapshot(tree_node_t * node, symtab_snapshot_t * snap, eval_error_t * err);
+
+num_t eval_snapshot_num(tree_node_t * node, symtab_snapshot_t * snap, eval_error_t * err);
+
+void print_infix(tree_node_t * node);
+
+size_t format_infix(tree_node_t * node, char * buf, size_t len);
+
+size_t tree_size(tree_node_t * node);
+
+int tree_depth(tree_node_t * node);
+
+int same_tree(tree_node_t * a, tree_node_t * b);
+
+tree_node_t * copy_tree(tree_node_t * node, size_t * used);
+
+void cleanup_tree(tree_node_t * node);
+
+#endif
@@ -0,0 +1,329 @@
+/**
+ * Implementation of the batch evaluation pipeline. Expressions flow
+ * through four stages, each on its own thread(s):
+ *
+ * - **Reader**: reads lines into batches and deals the batches out to
+ *   the parsers in round-robin order
+ * - **Parsers**: build the expression tree of every line in a batch with
+ *   read_line(), so a line that does not parse reports the same errors as
+ *   at the interactive prompt. Parsing has no side effects, so any number
+ *   of parsers can run at once. A very long line is itself built on
+ *   several threads, see builder.c
+ * - **Evaluator**: collects batches from the parsers in the same
+ *   round-robin order and evaluates them, so assignments take effect in
+ *   input order exactly as in interactive mode. While tiering, it keeps a
+ *   tier slot for every expression it has seen (see tier_cached()), so an
+ *   expression repeated on many lines is compiled once it is hot
+ * - **Writer**: writes each result in the chosen output format and frees the trees
+ *
+ * Every pair of neighbouring stages is connected by its own bounded
+ * single-producer/single-consumer ring, so a slow stage makes the ones
+ * before it wait instead of buffering the whole input.
+ *
+ * @file        pipeline.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pipeline.h"
+#include "parser.h"
+#include "ring.h"
+#include "wal.h"
+#include "profile.h"
+#include "builder.h"
+#include "reader.h"
+#include "output.h"
+#include "tier.h"
+
+/// A batch of consecutive input lines on their way through the pipeline
+typedef struct batch_s {
+        int count;
+        char * lines[PIPELINE_BATCH];
+        tree_node_t * trees[PIPELINE_BATCH];
+        value_t results[PIPELINE_BATCH];
+        eval_error_t status[PIPELINE_BATCH]; /// Why each line failed, if it did
+        unsigned long linenos[PIPELINE_BATCH]; /// Input line number of each line
+        char * texts[PIPELINE_BATCH]; /// Copies of the lines, kept only when profiling
+        long parse_ns[PIPELINE_BATCH]; /// Parse times, kept only when profiling
+        unsigned long lsn; /// Log sequence number of the batch's last write
+} batch_t;
+
+/// The stages' shared view of the pipeline
+typedef struct pipeline_s {
+        FILE * in;
+        symtab_t * table; /// Table the expressions are evaluated against
+        output_format_t format;
+        int parsers;
+        int builders; /// Threads to build one very long line with
+        ring_t * to_parser[PIPELINE_MAX_PARSERS];
+        ring_t * from_parser[PIPELINE_MAX_PARSERS];
+        ring_t * to_writer;
+        tier_cache_t * tiers; /// Slots of the expressions evaluated, NULL unless tiering
+        unsigned long stopped; /// Line the reader could not batch for lack of memory, 0 if none
+} pipeline_t;
+
+/// A parser thread's argument
+typedef struct parser_arg_s {
+        pipeline_t * pipe;
+        int id;
+        reader_t * reader; /// Parses the lines too short to build in parallel
+} parser_arg_t;
+
+/**
+ * Allocates an empty batch.
+ *
+ * @return: A pointer to the new batch, or NULL if memory allocation fails
+ */
+static batch_t * make_batch(void) {
+        batch_t * batch = calloc(1, sizeof(batch_t));
+
+        if(!batch) perror("Failed to allocate batch");
+        return batch;
+}
+
+/**
+ * Strips the comment and line terminator from an input line.
+ *
+ * @param line: A pointer to the line, modified in place
+ * @return: 1 if anything but whitespace is left, 0 if read_tree() would
+ *      find the line blank
+ */
+static int trim_line(char * line) {
+        char * com = strchr(line, '#');
+        if(com) *com = '\0';
+
+        line[strcspn(line, "\n")] = '\0';
+        return line[strspn(line, " \t\r")] != '\0';
+}
+
+/**
+ * Reader stage: reads lines of any length into batches. If a batch cannot
+ * be allocated, it stops reading, and the lines it has batched are still
+ * evaluated.
+ *
+ * @param arg: A pointer to the pipeline
+ * @return: NULL
+ */
+static void * reader(void * arg) {
+        pipeline_t * pipe = arg;
+        batch_t * batch = make_batch();
+        long next = 0;
+        char * line = NULL;
+        size_t cap = 0;
+        unsigned long lineno = 0;
+
+        while(batch && getline(&line, &cap, pipe->in) != -1) {
+                lineno++;
+                if(!trim_line(line)) continue;
+
+                batch->linenos[batch->count] = lineno;
+                batch->lines[batch->count++] = line;
+                line = NULL;
+                cap = 0;
+
+                if(batch->count == PIPELINE_BATCH) {
+                        ring_put(pipe->to_parser[next++ % pipe->parsers], batch);
+                        batch = make_batch();
+                }
+        }
+        free(line);
+
+        if(!batch) pipe->stopped = lineno + 1;
+        else if(batch->count > 0) ring_put(pipe->to_parser[next++ % pipe->parsers], batch);
+        else free(batch);
+
+        for(int i = 0; i < pipe->parsers; i++) ring_put(pipe->to_parser[i], NULL);
+        return NULL;
+}
+
+/**
+ * Builds the expression tree of one line, on several threads if the line
+ * is long enough to be worth it.
+ *
+ * @param pipe: A pointer to the pipeline
+ * @param reader: A pointer to the parser's reader
+ * @param line: A pointer to the line, tokenized in place
+ * @return: A pointer to the root of the tree or NULL on error
+ */
+static tree_node_t * parse_line(pipeline_t * pipe, reader_t * reader, char * line) {
+        if(pipe->builders > 1 && strlen(line) >= BUILDER_MIN_LENGTH) return build_parse_tree(line, pipe->builders);
+        return read_line(reader, line);
+}
+
+/**
+ * Parser stage: builds the expression trees of each batch it is dealt.
+ *
+ * @param arg: A pointer to the parser's parser_arg_t
+ * @return: NULL
+ */
+static void * parser(void * arg) {
+        parser_arg_t * self = arg;
+        reader_t * reader = self->reader;
+        batch_t * batch;
+
+        while((batch = ring_take(self->pipe->to_parser[self->id])) != NULL) {
+                for(int i = 0; i < batch->count; i++) {
+                        if(profile_enabled()) {
+                                // parsing tokenizes the line in place
+                                batch->texts[i] = strndup(batch->lines[i], PROFILE_TEXT_MAX);
+                                long start = profile_clock();
+                                batch->trees[i] = parse_line(self->pipe, reader, batch->lines[i]);
+                                batch->parse_ns[i] = profile_clock() - start;
+                        } else {
+                                batch->trees[i] = parse_line(self->pipe, reader, batch->lines[i]);
+                        }
+                        free(batch->lines[i]);
+                        batch->lines[i] = NULL;
+                }
+                ring_put(self->pipe->from_parser[self->id], batch);
+        }
+
+        ring_put(self->pipe->from_parser[self->id], NULL);
+        return NULL;
+}
+
+/**
+ * Evaluates one line, in its tier slot if it has one.
+ *
+ * @param pipe: A pointer to the pipeline
+ * @param tree: A pointer to the root of the line's tree, NULL if it did not parse
+ * @param err: A pointer to store why the evaluation failed at, or EVAL_OK
+ * @return: The result of the evaluation
+ */
+static value_t eval_line(pipeline_t * pipe, tree_node_t * tree, eval_error_t * err) {
+        tier_slot_t * slot = pipe->tiers ? tier_cached(pipe->tiers, tree) : NULL;
+
+        if(slot) return tier_eval(slot, pipe->table, err);
+        return eval_tree_in(pipe->table, tree, err);
+}
+
+/**
+ * Evaluator stage: evaluates batches strictly in input order.
+ *
+ * @param arg: A pointer to the pipeline
+ * @return: NULL
+ */
+static void * evaluator(void * arg) {
+        pipeline_t * pipe = arg;
+        batch_t * batch;
+
+        // batches were dealt round-robin, so the first end marker met in
+        // the same order comes right after the last batch
+        for(long next = 0; (batch = ring_take(pipe->from_parser[next % pipe->parsers])) != NULL; next++) {
+                for(int i = 0; i < batch->count; i++) {
+                        if(profile_enabled()) {
+                                long start = profile_clock();
+                                batch->results[i] = eval_line(pipe, batch->trees[i], &batch->status[i]);
+                                profile_record(batch->texts[i], batch->trees[i], batch->parse_ns[i], profile_clock() - start);
+                                free(batch->texts[i]);
+                                batch->texts[i] = NULL;
+                        } else {
+                                batch->results[i] = eval_line(pipe, batch->trees[i], &batch->status[i]);
+                        }
+                }
+                batch->lsn = wal_lsn();
+                ring_put(pipe->to_writer, batch);
+        }
+
+        ring_put(pipe->to_writer, NULL);
+        return NULL;
+}
+
+/**
+ * Writer stage: waits for the batch's writes to be logged durably, writes
+ * every result in the output format, then frees the batch. If the log
+ * failed, the batch's results are written as EVAL_NOT_DURABLE instead.
+ *
+ * @param arg: A pointer to the pipeline
+ * @return: NULL
+ */
+static void * writer(void * arg) {
+        pipeline_t * pipe = arg;
+        batch_t * batch;
+
+        while((batch = ring_take(pipe->to_writer)) != NULL) {
+                // results that may rest on a lost write are not acknowledged
+                int lost = wal_wait(batch->lsn) < 0;
+                for(int i = 0; i < batch->count; i++) {
+                        if(lost && batch->status[i] == EVAL_OK) {
+                                fprintf(stderr, "Error: line %lu was evaluated, but its writes were not logged\n", batch->linenos[i]);
+                                batch->status[i] = EVAL_NOT_DURABLE;
+                        }
+                        write_result(pipe->format, batch->linenos[i], batch->trees[i], batch->status[i], batch->results[i]);
+                        cleanup_tree(batch->trees[i]);
+                }
+                free(batch);
+        }
+        fflush(stdout);
+        return NULL;
+}
+
+/**
+ * Evaluates every expression read from a stream, one per line, writing
+ * the same output as the interactive prompt (without the prompts).
+ *
+ * @param table: A pointer to the symbol table to evaluate against
+ * @param in: The stream to read expressions from
+ * @param parsers: The number of parser threads, at least 1
+ * @param format: The output format
+ * @return: 0 on success, -1 if the pipeline could not be started or ran
+ *      out of memory before reading the whole stream
+ */
+int run_pipeline(symtab_t * table, FILE * in, int parsers, output_format_t format) {
+        if(parsers < 1 || parsers > PIPELINE_MAX_PARSERS) {
+                fprintf(stderr, "run_pipeline: parser count must be between 1 and %d\n", PIPELINE_MAX_PARSERS);
+                return -1;
+        }
+
+        pipeline_t pipe;
+        parser_arg_t args[PIPELINE_MAX_PARSERS];
+        pthread_t parser_threads[PIPELINE_MAX_PARSERS];
+        pthread_t read_thread, eval_thread, write_thread;
+
+        pipe.in = in;
+        pipe.table = table;
+        pipe.format = format;
+        pipe.parsers = parsers;
+        pipe.builders = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        pipe.stopped = 0;
+        pipe.to_writer = make_ring(PIPELINE_DEPTH);
+        pipe.tiers = tier_enabled() ? make_tier_cache(TIER_CACHE_SIZE) : NULL;
+
+        // everything the stages share is allocated before any of them starts
+        int ready = pipe.to_writer != NULL;
+        for(int i = 0; i < parsers; i++) {
+                pipe.to_parser[i] = make_ring(PIPELINE_DEPTH);
+                pipe.from_parser[i] = make_ring(PIPELINE_DEPTH);
+                args[i].pipe = &pipe;
+                args[i].id = i;
+                args[i].reader = make_reader(NULL);
+                ready = ready && pipe.to_parser[i] && pipe.from_parser[i] && args[i].reader;
+        }
+
+        if(ready) {
+                pthread_create(&write_thread, NULL, writer, &pipe);
+                pthread_create(&eval_thread, NULL, evaluator, &pipe);
+                for(int i = 0; i < parsers; i++) pthread_create(&parser_threads[i], NULL, parser, &args[i]);
+                pthread_create(&read_thread, NULL, reader, &pipe);
+
+                pthread_join(read_thread, NULL);
+                for(int i = 0; i < parsers; i++) pthread_join(parser_threads[i], NULL);
+                pthread_join(eval_thread, NULL);
+                pthread_join(write_thread, NULL);
+        } else {
+                fprintf(stderr, "run_pipeline: out of memory\n");
+        }
+        if(pipe.stopped) fprintf(stderr, "run_pipeline: out of memory, stopped reading at line %lu\n", pipe.stopped);
+
+        for(int i = 0; i < parsers; i++) {
+                free_ring(pipe.to_parser[i]);
+                free_ring(pipe.from_parser[i]);
+                free_reader(args[i].reader);
+        }
+        free_ring(pipe.to_writer);
+        free_tier_cache(pipe.tiers);
+        return ready && !pipe.stopped ? 0 : -1;
+}
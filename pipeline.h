@@ -0,0 +1,20 @@
+/**
+ * Interface for the batch evaluation pipeline, which overlaps reading,
+ * parsing, evaluating and printing of a stream of expressions.
+ *
+ * @file        pipeline.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include "output.h"
+
+#define PIPELINE_BATCH 64 /// Lines handed between stages at a time
+#define PIPELINE_DEPTH 16 /// Batches buffered between two stages
+#define PIPELINE_MAX_PARSERS 64
+
+int run_pipeline(symtab_t * table, FILE * in, int parsers, output_format_t format);
+
+#endif
@@ -0,0 +1,333 @@
+/**
+ * Implementation of the expression profiler. Once started, every line
+ * reports its parse and eval latency, which go into two log-linear
+ * histograms, and its text, which goes into two top-K tables: one of the
+ * most frequent expressions and one of the expressions with the most
+ * total latency. Both tables hold a fixed number of entries and use the
+ * space-saving algorithm, so any expression whose share is larger than
+ * 1/PROFILE_TOP_K is guaranteed to be in them. The results are written
+ * as JSON.
+ *
+ * ## Histograms:
+ * Values below 16ns get a bucket each. Above that, every power of two is
+ * split into 16 buckets, so a recorded value is off by at most 1/16 of
+ * itself, whatever its magnitude.
+ *
+ * @file        profile.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "profile.h"
+#include "parser.h"
+
+#define SUB_BITS 4
+#define SUB_COUNT (1 << SUB_BITS)
+#define BUCKETS ((64 - SUB_BITS + 1) * SUB_COUNT)
+
+/// A log-linear latency histogram, in nanoseconds
+typedef struct histogram_s {
+        unsigned long counts[BUCKETS];
+        unsigned long count;
+        unsigned long sum;
+        unsigned long min;
+        unsigned long max;
+} histogram_t;
+
+/// An expression monitored by a top-K table
+typedef struct entry_s {
+        char * text; /// Expression as written, truncated to PROFILE_TEXT_MAX
+        unsigned long weight; /// Estimated count or total latency
+        unsigned long error; /// Most the estimate may overcount by
+        unsigned long hits; /// Times seen since the entry was taken
+        size_t nodes; /// Number of nodes in the parsed tree
+        int depth; /// Depth of the parsed tree
+} entry_t;
+
+/// A space-saving top-K table
+typedef struct table_s {
+        entry_t entries[PROFILE_TOP_K];
+        int used;
+} table_t;
+
+static int profiling = 0; /// Set once profiling has started
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /// Guards everything below
+static unsigned long lines = 0;
+static histogram_t parse_hist;
+static histogram_t eval_hist;
+static table_t frequent;
+static table_t expensive;
+
+/**
+ * Starts profiling. Must be called before any thread records a line.
+ */
+void profile_start(void) {
+        profiling = 1;
+}
+
+/**
+ * Checks if profiling has been started.
+ *
+ * @return: 1 if lines should be timed and recorded, 0 otherwise
+ */
+int profile_enabled(void) {
+        return profiling;
+}
+
+/**
+ * Reads a monotonic clock for timing a line.
+ *
+ * @return: The current time in nanoseconds
+ */
+long profile_clock(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/**
+ * Finds the histogram bucket of a value.
+ *
+ * @param v: The value
+ * @return: The index of the bucket
+ */
+static int bucket_of(unsigned long v) {
+        if(v < SUB_COUNT) return (int)v;
+
+        int mag = 63 - __builtin_clzl(v);
+        int sub = (int)(v >> (mag - SUB_BITS)) & (SUB_COUNT - 1);
+        return (mag - SUB_BITS + 1) * SUB_COUNT + sub;
+}
+
+/**
+ * Finds the largest value that falls in a histogram bucket.
+ *
+ * @param index: The index of the bucket
+ * @return: The value
+ */
+static unsigned long bucket_top(int index) {
+        if(index < SUB_COUNT) return index;
+
+        int mag = index / SUB_COUNT + SUB_BITS - 1;
+        unsigned long sub = index % SUB_COUNT;
+        return ((SUB_COUNT + sub + 1) << (mag - SUB_BITS)) - 1;
+}
+
+/**
+ * Adds a value to a histogram.
+ *
+ * @param hist: A pointer to the histogram
+ * @param v: The value
+ */
+static void hist_add(histogram_t * hist, unsigned long v) {
+        hist->counts[bucket_of(v)]++;
+        if(hist->count == 0 || v < hist->min) hist->min = v;
+        if(v > hist->max) hist->max = v;
+        hist->count++;
+        hist->sum += v;
+}
+
+/**
+ * Estimates a percentile of a histogram.
+ *
+ * @param hist: A pointer to the histogram
+ * @param pct: The percentile, from 0 to 100
+ * @return: The top of the bucket holding the percentile, at most the
+ *      largest value recorded
+ */
+static unsigned long hist_percentile(histogram_t * hist, double pct) {
+        unsigned long rank = (unsigned long)(hist->count * pct / 100.0 + 0.5);
+        unsigned long seen = 0;
+
+        if(rank == 0) rank = 1;
+        for(int i = 0; i < BUCKETS; i++) {
+                seen += hist->counts[i];
+                if(seen >= rank) {
+                        unsigned long top = bucket_top(i);
+                        return top < hist->max ? top : hist->max;
+                }
+        }
+        return hist->max;
+}
+
+/**
+ * Counts an expression in a top-K table. An expression not yet in a full
+ * table takes the place of the entry with the least weight, inheriting
+ * its weight as the error of the new estimate.
+ *
+ * @param table: A pointer to the table
+ * @param text: A pointer to the expression text, already truncated
+ * @param tree: A pointer to the parsed tree, NULL if parsing failed
+ * @param weight: The weight to add
+ */
+static void table_add(table_t * table, const char * text, tree_node_t * tree, unsigned long weight) {
+        entry_t * min = NULL;
+
+        for(int i = 0; i < table->used; i++) {
+                entry_t * entry = &table->entries[i];
+                if(strcmp(entry->text, text) == 0) {
+                        entry->weight += weight;
+                        entry->hits++;
+                        return;
+                }
+                if(min == NULL || entry->weight < min->weight) min = entry;
+        }
+
+        char * copy = strdup(text);
+        if(!copy) return;
+
+        entry_t * entry;
+        unsigned long error = 0;
+        if(table->used < PROFILE_TOP_K) {
+                entry = &table->entries[table->used++];
+        } else {
+                entry = min;
+                error = min->weight;
+                free(entry->text);
+        }
+
+        entry->text = copy;
+        entry->weight = error + weight;
+        entry->error = error;
+        entry->hits = 1;
+        entry->nodes = tree_size(tree);
+        entry->depth = tree_depth(tree);
+}
+
+/**
+ * Records one line.
+ *
+ * @param text: A pointer to the line as written
+ * @param tree: A pointer to the parsed tree, NULL if parsing failed
+ * @param parse_ns: The time taken to parse the line
+ * @param eval_ns: The time taken to evaluate the tree, ignored if the
+ *      line did not parse
+ */
+void profile_record(const char * text, tree_node_t * tree, long parse_ns, long eval_ns) {
+        char key[PROFILE_TEXT_MAX];
+
+        if(!profiling) return;
+        snprintf(key, sizeof(key), "%s", text ? text : "");
+        if(parse_ns < 0) parse_ns = 0;
+        if(eval_ns < 0 || tree == NULL) eval_ns = 0;
+
+        pthread_mutex_lock(&lock);
+        lines++;
+        hist_add(&parse_hist, parse_ns);
+        if(tree) hist_add(&eval_hist, eval_ns);
+        table_add(&frequent, key, tree, 1);
+        table_add(&expensive, key, tree, parse_ns + eval_ns);
+        pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Writes a string as a JSON string literal.
+ *
+ * @param out: The output file
+ * @param str: A pointer to the string
+ */
+static void write_string(FILE * out, const char * str) {
+        fputc('"', out);
+        for(const unsigned char * c = (const unsigned char *)str; *c; c++) {
+                if(*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+                else if(*c < 0x20) fprintf(out, "\\u%04x", *c);
+                else fputc(*c, out);
+        }
+        fputc('"', out);
+}
+
+/**
+ * Writes a histogram as a JSON object.
+ *
+ * @param out: The output file
+ * @param hist: A pointer to the histogram
+ */
+static void write_histogram(FILE * out, histogram_t * hist) {
+        fprintf(out, "{\"count\": %lu", hist->count);
+        if(hist->count > 0) {
+                fprintf(out, ", \"min\": %lu, \"mean\": %.1f", hist->min, (double)hist->sum / hist->count);
+                fprintf(out, ", \"p50\": %lu, \"p90\": %lu", hist_percentile(hist, 50), hist_percentile(hist, 90));
+                fprintf(out, ", \"p99\": %lu, \"p999\": %lu", hist_percentile(hist, 99), hist_percentile(hist, 99.9));
+                fprintf(out, ", \"max\": %lu", hist->max);
+        }
+
+        // nonzero buckets only, as [highest value, count] pairs
+        fprintf(out, ", \"buckets\": [");
+        const char * sep = "";
+        for(int i = 0; i < BUCKETS; i++) {
+                if(hist->counts[i] == 0) continue;
+                fprintf(out, "%s[%lu, %lu]", sep, bucket_top(i), hist->counts[i]);
+                sep = ", ";
+        }
+        fprintf(out, "]}");
+}
+
+/**
+ * Orders top-K entries by descending weight, for qsort().
+ */
+static int by_weight(const void * a, const void * b) {
+        const entry_t * x = a, * y = b;
+        return (x->weight < y->weight) - (x->weight > y->weight);
+}
+
+/**
+ * Writes a top-K table as a JSON array, heaviest entry first.
+ *
+ * @param out: The output file
+ * @param table: A pointer to the table
+ * @param weight: The name of the weight field
+ */
+static void write_table(FILE * out, table_t * table, const char * weight) {
+        qsort(table->entries, table->used, sizeof(entry_t), by_weight);
+
+        fprintf(out, "[");
+        for(int i = 0; i < table->used; i++) {
+                entry_t * entry = &table->entries[i];
+                fprintf(out, "%s\n    {\"expr\": ", i ? "," : "");
+                write_string(out, entry->text);
+                fprintf(out, ", \"%s\": %lu, \"error\": %lu, \"hits\": %lu, \"nodes\": %zu, \"depth\": %d}",
+                                weight, entry->weight, entry->error, entry->hits, entry->nodes, entry->depth);
+        }
+        fprintf(out, "%s]", table->used ? "\n  " : "");
+}
+
+/**
+ * Writes the profile as JSON and frees the top-K tables.
+ *
+ * @param path: The path of the output file
+ * @return: 0 on success, -1 on failure
+ */
+int profile_write(const char * path) {
+        if(!profiling) return 0;
+
+        FILE * out = fopen(path, "w");
+        if(!out) {
+                perror(path);
+                return -1;
+        }
+
+        pthread_mutex_lock(&lock);
+        fprintf(out, "{\n  \"lines\": %lu,\n  \"parse_ns\": ", lines);
+        write_histogram(out, &parse_hist);
+        fprintf(out, ",\n  \"eval_ns\": ");
+        write_histogram(out, &eval_hist);
+        fprintf(out, ",\n  \"most_frequent\": ");
+        write_table(out, &frequent, "count");
+        fprintf(out, ",\n  \"most_expensive\": ");
+        write_table(out, &expensive, "total_ns");
+        fprintf(out, "\n}\n");
+
+        for(int i = 0; i < frequent.used; i++) free(frequent.entries[i].text);
+        for(int i = 0; i < expensive.used; i++) free(expensive.entries[i].text);
+        frequent.used = expensive.used = 0;
+        pthread_mutex_unlock(&lock);
+
+        if(fclose(out) != 0) {
+                perror(path);
+                return -1;
+        }
+        return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * Interface for the expression profiler, which records how long each
+ * line takes to parse and evaluate and which expressions cost the most.
+ *
+ * @file        profile.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "tree_node.h"
+
+#define PROFILE_TOP_K 20 /// Expressions kept in each top-K table
+#define PROFILE_TEXT_MAX 256 /// Longest expression text kept, in bytes
+
+void profile_start(void);
+
+int profile_enabled(void);
+
+long profile_clock(void);
+
+void profile_record(const char * text, tree_node_t * tree, long parse_ns, long eval_ns);
+
+int profile_write(const char * path);
+
+#endif
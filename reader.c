@@ -0,0 +1,290 @@
+/**
+ * Implementation of the streaming expression reader. The stream is read
+ * in blocks of READER_BUFLEN bytes, and every token is turned into a tree
+ * node as soon as it is complete, even when it spans two blocks. Operands
+ * wait on a stack until their operator arrives, the way a postfix
+ * expression is evaluated by hand, so the memory needed besides the tree
+ * itself is proportional to the deepest the operand stack gets, not to the
+ * length of the line.
+ *
+ * Tokens are classified in the same order parse() tries them, so a line
+ * gives the same tree as make_parse_tree(). A `#` starts a comment that
+ * runs to the end of the line. Once a line has an error, the rest of it is
+ * skipped. Lines already in memory are built by read_line() with the same
+ * steps, so they fail with the same errors as lines read from a stream.
+ *
+ * @file        reader.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reader.h"
+#include "parser.h"
+#include "scan.h"
+#include "diag.h"
+
+/**
+ * Creates a reader for a stream.
+ *
+ * @param in: The stream to read expressions from, NULL if the reader is
+ *      only given lines with read_line()
+ * @return: A pointer to the reader, or NULL if memory allocation fails
+ */
+reader_t * make_reader(FILE * in) {
+        reader_t * reader = calloc(1, sizeof(reader_t));
+
+        if(!reader) {
+                perror("Failed to create reader");
+                return NULL;
+        }
+
+        reader->in = in;
+        reader->pos = reader->buf;
+        return reader;
+}
+
+/**
+ * Frees every operand waiting on the stack.
+ *
+ * @param reader: A pointer to the reader
+ */
+static void drop_operands(reader_t * reader) {
+        while(reader->depth > 0) cleanup_tree(reader->stack[--reader->depth]);
+}
+
+/**
+ * Pushes a finished subtree onto the operand stack.
+ *
+ * @param reader: A pointer to the reader
+ * @param node: A pointer to the subtree
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+static int push_operand(reader_t * reader, tree_node_t * node) {
+        if(reader->depth == reader->cap) {
+                size_t cap = reader->cap ? 2 * reader->cap : 64;
+                tree_node_t ** grown = realloc(reader->stack, cap * sizeof(tree_node_t *));
+                if(!grown) {
+                        perror("Failed to grow operand stack");
+                        return -1;
+                }
+                reader->stack = grown;
+                reader->cap = cap;
+        }
+        reader->stack[reader->depth++] = node;
+        return 0;
+}
+
+/**
+ * Turns one complete token into a tree node, combining it with the
+ * operands it takes from the stack.
+ *
+ * @param reader: A pointer to the reader
+ * @param tok: A pointer to the token
+ * @return: 0 on success, -1 if the line has an error, which is reported
+ */
+static int shift(reader_t * reader, char * tok) {
+        tree_node_t * node = NULL;
+        tree_node_t ** top = reader->stack + reader->depth;
+        scan_kind_t kind;
+
+        scan_token(tok, &kind);
+        if(kind == SCAN_INTEGER) {
+                node = make_leaf(INTEGER, tok);
+        } else if(kind == SCAN_SYMBOL) {
+                node = make_leaf(SYMBOL, tok);
+        } else if(kind == SCAN_OPERATOR) {
+                if(reader->depth < 2) {
+                        diag("\tError: not enough operands for operator '%s'\n", tok);
+                        return -1;
+                }
+                node = make_interior(operator_type(tok), tok, top[-2], top[-1]);
+                if(node) reader->depth -= 2;
+        } else if(kind == SCAN_TERNARY) {
+                if(reader->depth < 3) {
+                        diag("\tError: not enough operands for operator '%s'\n", tok);
+                        return -1;
+                }
+                tree_node_t * alt = make_interior(ALT_OP, ALT_OP_STR, top[-2], top[-3]);
+                node = alt ? make_interior(Q_OP, tok, top[-1], alt) : NULL;
+                if(node) reader->depth -= 3;
+                else if(alt) {
+                        ((interior_node_t *)alt->node)->left = NULL;
+                        ((interior_node_t *)alt->node)->right = NULL;
+                        cleanup_tree(alt);
+                }
+        } else if(strcmp(tok, ALT_OP_STR) == 0) {
+                // a ':' of its own is an alternative, as in parse()
+                if(reader->depth < 2) {
+                        diag("Error: Invalid T/F expressions for alt op\n");
+                        return -1;
+                }
+                node = make_interior(ALT_OP, ALT_OP_STR, top[-1], top[-2]);
+                if(node) reader->depth -= 2;
+        } else {
+                diag("\tError: Invalid token '%s'\n", tok);
+                return -1;
+        }
+
+        if(!node) {
+                diag("\tError: Failed to create node for token '%s'\n", tok);
+                return -1;
+        }
+        if(push_operand(reader, node) < 0) {
+                cleanup_tree(node);
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Appends a byte to the token being read.
+ *
+ * @param reader: A pointer to the reader
+ * @param c: The byte
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+static int grow_token(reader_t * reader, char c) {
+        if(reader->toklen + 1 >= reader->tokcap) {
+                size_t cap = reader->tokcap ? 2 * reader->tokcap : 64;
+                char * grown = realloc(reader->tok, cap);
+                if(!grown) {
+                        perror("Failed to grow token");
+                        return -1;
+                }
+                reader->tok = grown;
+                reader->tokcap = cap;
+        }
+        reader->tok[reader->toklen++] = c;
+        return 0;
+}
+
+/**
+ * Takes the tree of a line whose tokens have all been shifted, checking
+ * that they made exactly one expression.
+ *
+ * @param reader: A pointer to the reader
+ * @param tokens: The number of tokens on the line
+ * @return: A pointer to the root of the tree, or NULL if the line has an
+ *      error, which is reported
+ */
+static tree_node_t * finish_line(reader_t * reader, size_t tokens) {
+        if(tokens == 0) {
+                diag("Error: Empty expression\n");
+        } else if(reader->depth != 1) {
+                diag("Error: Invalid expression, too many tokens\n");
+                drop_operands(reader);
+        } else {
+                return reader->stack[--reader->depth];
+        }
+        return NULL;
+}
+
+/**
+ * Reads the next line of the stream and builds the tree of the postfix
+ * expression on it. Errors in the expression are reported on standard
+ * error as they are found.
+ *
+ * @param reader: A pointer to the reader
+ * @param tree: A pointer to store the tree at, to be freed by the caller;
+ *      NULL unless the result is READ_LINE and the expression parsed
+ * @return: What the line held, or READ_END at the end of the stream
+ */
+read_status_t read_tree(reader_t * reader, tree_node_t ** tree) {
+        int content = 0, comment = 0, failed = 0, started = 0;
+        size_t tokens = 0;
+
+        *tree = NULL;
+        reader->headlen = 0;
+        reader->head[0] = '\0';
+
+        while(1) {
+                if(*reader->pos == '\0') {
+                        // fgets stops at a newline, so an interactive line is
+                        // handled as soon as it is typed
+                        if(fgets(reader->buf, sizeof(reader->buf), reader->in) == NULL) {
+                                if(!started) return READ_END;
+                                reader->buf[0] = '\n';
+                                reader->buf[1] = '\0';
+                        }
+                        reader->pos = reader->buf;
+                        started = 1;
+                }
+
+                char c = *reader->pos++;
+                int end = c == '\n';
+
+                if(c == '#') comment = 1;
+                if(!comment && !end) {
+                        if(c != ' ' && c != '\t' && c != '\r') content = 1;
+                        if(reader->headlen < READER_HEAD - 1) {
+                                reader->head[reader->headlen++] = c;
+                                reader->head[reader->headlen] = '\0';
+                        }
+                }
+
+                if(!failed && !comment && !end && c != ' ' && c != '\t' && c != '\r') {
+                        if(grow_token(reader, c) < 0) failed = 1;
+                        continue;
+                }
+
+                if(reader->toklen > 0) {
+                        reader->tok[reader->toklen] = '\0';
+                        reader->toklen = 0;
+                        tokens++;
+                        if(!failed && shift(reader, reader->tok) < 0) failed = 1;
+                        if(failed) drop_operands(reader);
+                }
+                if(end) break;
+        }
+
+        reader->lineno++;
+        if(!content) return READ_BLANK;
+
+        if(!failed) *tree = finish_line(reader, tokens);
+        return READ_LINE;
+}
+
+/**
+ * Builds the tree of the postfix expression on a line already in memory,
+ * the way read_tree() builds a line of the stream, with the same errors.
+ * The line is tokenized in place.
+ *
+ * @param reader: A pointer to the reader, whose operand stack is reused
+ * @param line: A pointer to the line, without its comment or terminator
+ * @return: A pointer to the root of the tree, to be freed by the caller,
+ *      or NULL if the line has an error, which is reported
+ */
+tree_node_t * read_line(reader_t * reader, char * line) {
+        char * p = line + scan_space(line);
+        size_t tokens = 0;
+
+        while(*p != '\0') {
+                scan_kind_t kind;
+                char * tok = p;
+                p += scan_token(p, &kind);
+                if(*p != '\0') *p++ = '\0';
+                p += scan_space(p);
+
+                tokens++;
+                if(shift(reader, tok) < 0) {
+                        drop_operands(reader);
+                        return NULL;
+                }
+        }
+        return finish_line(reader, tokens);
+}
+
+/**
+ * Frees a reader. The stream is left open.
+ *
+ * @param reader: A pointer to the reader, may be NULL
+ */
+void free_reader(reader_t * reader) {
+        if(reader == NULL) return;
+
+        drop_operands(reader);
+        free(reader->stack);
+        free(reader->tok);
+        free(reader);
+}
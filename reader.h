@@ -0,0 +1,46 @@
+/**
+ * Interface for the streaming expression reader, which parses postfix
+ * expressions of any length from a stream, one per line.
+ *
+ * @file        reader.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef READER_H
+#define READER_H
+
+#include <stdio.h>
+#include "tree_node.h"
+
+#define READER_BUFLEN 4096 /// Bytes read from the stream at a time
+#define READER_HEAD 256 /// Bytes of each line kept for messages and profiling
+
+/// What read_tree() found
+typedef enum read_status_e {
+        READ_END, /// The stream has no more lines
+        READ_BLANK, /// A line with only whitespace, a comment, or nothing
+        READ_LINE /// A line with an expression, which may not have parsed
+} read_status_t;
+
+/// A stream of expressions and the state of the line being read
+typedef struct reader_s {
+        FILE * in;
+        char buf[READER_BUFLEN];
+        char * pos; /// Next unread byte in buf
+        char * tok; /// The token being read, which may span refills
+        size_t toklen, tokcap;
+        tree_node_t ** stack; /// Operands waiting for their operator, bottom first
+        size_t depth, cap;
+        char head[READER_HEAD]; /// Start of the current line, without its comment
+        size_t headlen;
+        unsigned long lineno; /// Number of the current line, counting from 1
+} reader_t;
+
+reader_t * make_reader(FILE * in);
+
+read_status_t read_tree(reader_t * reader, tree_node_t ** tree);
+
+tree_node_t * read_line(reader_t * reader, char * line);
+
+void free_reader(reader_t * reader);
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * Implementation of a lock-free single-producer/single-consumer ring
+ * buffer. The producer only writes the tail and the consumer only writes
+ * the head, so each side needs one atomic store per operation; the two
+ * indices live on separate cache lines to keep the stages from sharing
+ * one. A full ring makes the producer wait, which is what gives the
+ * pipeline its backpressure.
+ *
+ * @file        ring.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include "ring.h"
+
+#define CACHE_LINE 64
+#define SPIN_LIMIT 64 /// Busy polls before yielding the CPU
+#define YIELD_LIMIT 256 /// Yields before sleeping between polls
+
+struct ring_s {
+        _Alignas(CACHE_LINE) atomic_size_t head; /// Next slot to pop
+        _Alignas(CACHE_LINE) atomic_size_t tail; /// Next slot to push
+        _Alignas(CACHE_LINE) size_t mask;
+        void ** slots;
+};
+
+/**
+ * Creates an empty ring buffer.
+ *
+ * @param capacity: The minimum number of items the ring holds, rounded
+ *      up to a power of two
+ * @return: A pointer to the new ring, or NULL if memory allocation fails
+ */
+ring_t * make_ring(size_t capacity) {
+        size_t size = 2;
+        while(size < capacity) size *= 2;
+
+        ring_t * ring = aligned_alloc(CACHE_LINE, sizeof(ring_t));
+        void ** slots = calloc(size, sizeof(void *));
+
+        if(!ring || !slots) {
+                perror("Failed to create ring buffer");
+                free(ring);
+                free(slots);
+                return NULL;
+        }
+
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        ring->mask = size - 1;
+        ring->slots = slots;
+        return ring;
+}
+
+/**
+ * Pushes an item if there is room. Producer side only.
+ *
+ * @param ring: A pointer to the ring
+ * @param item: The item to push, may be NULL
+ * @return: 1 if the item was pushed, 0 if the ring is full
+ */
+int ring_push(ring_t * ring, void * item) {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if(tail - head > ring->mask) return 0;
+
+        ring->slots[tail & ring->mask] = item;
+        atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+        return 1;
+}
+
+/**
+ * Pops an item if there is one. Consumer side only.
+ *
+ * @param ring: A pointer to the ring
+ * @param item: Set to the popped item
+ * @return: 1 if an item was popped, 0 if the ring is empty
+ */
+int ring_pop(ring_t * ring, void ** item) {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if(head == tail) return 0;
+
+        *item = ring->slots[head & ring->mask];
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        return 1;
+}
+
+/**
+ * Waits a little longer each time a ring operation has to be retried.
+ *
+ * @param tries: A pointer to the number of retries so far
+ */
+static void backoff(int * tries) {
+        if(++(*tries) < SPIN_LIMIT) return;
+
+        if(*tries < SPIN_LIMIT + YIELD_LIMIT) {
+                sched_yield();
+        } else {
+                struct timespec nap = { 0, 50000 };
+                nanosleep(&nap, NULL);
+        }
+}
+
+/**
+ * Pushes an item, waiting while the ring is full. Producer side only.
+ *
+ * @param ring: A pointer to the ring
+ * @param item: The item to push, may be NULL
+ */
+void ring_put(ring_t * ring, void * item) {
+        int tries = 0;
+        while(!ring_push(ring, item)) backoff(&tries);
+}
+
+/**
+ * Pops an item, waiting while the ring is empty. Consumer side only.
+ *
+ * @param ring: A pointer to the ring
+ * @return: The popped item
+ */
+void * ring_take(ring_t * ring) {
+        void * item;
+        int tries = 0;
+
+        while(!ring_pop(ring, &item)) backoff(&tries);
+        return item;
+}
+
+/**
+ * Frees a ring buffer. Items still in it are not freed.
+ *
+ * @param ring: A pointer to the ring, may be NULL
+ */
+void free_ring(ring_t * ring) {
+        if(ring == NULL) return;
+
+        free(ring->slots);
+        free(ring);
+}
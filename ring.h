@@ -0,0 +1,28 @@
+/**
+ * Interface for a bounded single-producer/single-consumer ring buffer of
+ * pointers, used to connect the stages of the evaluation pipeline.
+ *
+ * @file        ring.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+/// A ring buffer; exactly one thread may push and one thread may pop
+typedef struct ring_s ring_t;
+
+ring_t * make_ring(size_t capacity);
+
+int ring_push(ring_t * ring, void * item);
+
+int ring_pop(ring_t * ring, void ** item);
+
+void ring_put(ring_t * ring, void * item);
+
+void * ring_take(ring_t * ring);
+
+void free_ring(ring_t * ring);
+
+#endif
@@ -0,0 +1,348 @@
+/**
+ * Implementation of the token scanner. Tokens are separated by spaces,
+ * tabs, carriage returns and newlines, and end at the string's terminator
+ * at the latest, as with the strtok() separators make_parse_tree() used.
+ *
+ * With AVX2 (32 bytes) or SSE2 (16 bytes) available at compile time, a
+ * whole block of the string is compared against the separators and the
+ * digit range at once, and the first separator of the block is found with
+ * a count of trailing zeros. Blocks are loaded from aligned addresses, so
+ * a load never crosses into another page, even though it may read past
+ * the end of the string the way strlen() does. Without either instruction
+ * set, or with SCAN_SCALAR defined, the scalar versions are used.
+ *
+ * Integer literals are converted eight digits at a time by treating the
+ * digits as one 64-bit word (SWAR): every step adds each pair of adjacent
+ * fields in parallel, weighted by the matching power of ten. The result
+ * is the same as atoi() gives, including for literals that do not fit.
+ * scan_value() converts literals to the value type of the build. With
+ * VALUE_DOUBLE, decimal and exponent literals such as 0.5 and -1e3 are
+ * values too; they are measured by scan_decimal() and converted by
+ * strtod(), and a token that only starts like one is not a value.
+ *
+ * @file        scan.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "scan.h"
+
+#if !defined(SCAN_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+#define SCAN_FULL 0xFFFFFFFFu
+typedef __m256i block_t;
+#define load_block(p) _mm256_load_si256((const __m256i *)(p))
+#define match_byte(v, c) ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8((v), _mm256_set1_epi8(c))))
+#define match_digits(v) ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8( \
+                _mm256_min_epu8(_mm256_sub_epi8((v), _mm256_set1_epi8('0')), _mm256_set1_epi8(9)), \
+                _mm256_sub_epi8((v), _mm256_set1_epi8('0')))))
+#elif !defined(SCAN_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+#define SCAN_FULL 0xFFFFu
+typedef __m128i block_t;
+#define load_block(p) _mm_load_si128((const __m128i *)(p))
+#define match_byte(v, c) ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8((v), _mm_set1_epi8(c))))
+#define match_digits(v) ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8( \
+                _mm_min_epu8(_mm_sub_epi8((v), _mm_set1_epi8('0')), _mm_set1_epi8(9)), \
+                _mm_sub_epi8((v), _mm_set1_epi8('0')))))
+#endif
+
+// the aligned loads may read past the end of an allocation, which is safe
+// but would be reported by the sanitizers
+#if defined(__GNUC__) && (defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__))
+#define SCAN_UNCHECKED __attribute__((no_sanitize("address", "thread")))
+#else
+#define SCAN_UNCHECKED
+#endif
+
+/**
+ * Checks if a character separates tokens.
+ */
+static int is_separator(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * Measures the decimal literal at the start of a string: an optional '-',
+ * digits with an optional '.' and more digits, at least one digit in all,
+ * then an optional 'e' or 'E' with an optional sign and at least one digit.
+ *
+ * @param p: A pointer to the text
+ * @param len: The number of bytes that may be examined
+ * @return: The length of the literal, 0 if there is none
+ */
+size_t scan_decimal(const char * p, size_t len) {
+        size_t n = len > 0 && p[0] == '-', digits = 0;
+
+        for(; n < len && p[n] >= '0' && p[n] <= '9'; n++) digits++;
+        if(n < len && p[n] == '.') {
+                for(n++; n < len && p[n] >= '0' && p[n] <= '9'; n++) digits++;
+        }
+        if(digits == 0) return 0;
+
+        if(n < len && (p[n] == 'e' || p[n] == 'E')) {
+                size_t e = n + 1;
+                if(e < len && (p[e] == '-' || p[e] == '+')) e++;
+                if(e < len && p[e] >= '0' && p[e] <= '9') {
+                        while(e < len && p[e] >= '0' && p[e] <= '9') e++;
+                        n = e;
+                }
+        }
+        return n;
+}
+
+/**
+ * Classifies a token once its extent is known, in parse() order.
+ *
+ * @param p: A pointer to the token
+ * @param len: The length of the token
+ * @param integer: Set if the token is an optional '-' followed by digits
+ * @return: The kind of the token
+ */
+static scan_kind_t kind_of(const char * p, size_t len, int integer) {
+        if(len == 0) return SCAN_OTHER;
+        if(integer) return SCAN_INTEGER;
+#ifdef VALUE_DOUBLE
+        if(scan_decimal(p, len) == len) return SCAN_INTEGER;
+#endif
+        if(isalpha((unsigned char)p[0])) return SCAN_SYMBOL;
+        if(len == 1 && strchr("+-*/%=", p[0])) return SCAN_OPERATOR;
+        if(len == 1 && p[0] == '?') return SCAN_TERNARY;
+        return SCAN_OTHER;
+}
+
+/**
+ * Counts the separators at the start of a string, one byte at a time.
+ *
+ * @param p: A pointer into a terminated string
+ * @return: The number of separator bytes before the next token or the
+ *      terminator
+ */
+size_t scan_space_scalar(const char * p) {
+        size_t n = 0;
+        while(is_separator(p[n])) n++;
+        return n;
+}
+
+/**
+ * Finds the end of the token at the start of a string and classifies it,
+ * one byte at a time.
+ *
+ * @param p: A pointer to the first byte of the token in a terminated string
+ * @param kind: A pointer to store the kind of the token at
+ * @return: The length of the token
+ */
+size_t scan_token_scalar(const char * p, scan_kind_t * kind) {
+        size_t neg = p[0] == '-', n = 0;
+        int digits = 1;
+
+        while(p[n] != '\0' && !is_separator(p[n])) {
+                if(n >= neg && (p[n] < '0' || p[n] > '9')) digits = 0;
+                n++;
+        }
+        *kind = kind_of(p, n, digits && n > neg);
+        return n;
+}
+
+/**
+ * Converts an integer literal to 64 bits one digit at a time.
+ *
+ * @param p: A pointer to a token of kind SCAN_INTEGER
+ * @param len: The length of the token
+ * @return: The value atoll() gives for the token
+ */
+long long scan_long_scalar(const char * p, size_t len) {
+        size_t neg = p[0] == '-';
+
+        // up to 18 digits always fit; longer literals saturate as in atoll()
+        if(len - neg > 18) return strtoll(p, NULL, 10);
+
+        uint64_t v = 0;
+        for(size_t i = neg; i < len; i++) v = v * 10 + (uint64_t)(p[i] - '0');
+        return neg ? -(int64_t)v : (int64_t)v;
+}
+
+/**
+ * Converts an integer literal one digit at a time.
+ *
+ * @param p: A pointer to a token of kind SCAN_INTEGER
+ * @param len: The length of the token
+ * @return: The value atoi() gives for the token
+ */
+int scan_int_scalar(const char * p, size_t len) {
+        return (int)scan_long_scalar(p, len);
+}
+
+#ifdef SCAN_WIDTH
+
+/**
+ * Finds the bytes of a block that separate tokens.
+ */
+static unsigned int separators(block_t v) {
+        return match_byte(v, ' ') | match_byte(v, '\t') | match_byte(v, '\r') | match_byte(v, '\n');
+}
+
+/**
+ * Counts the separators at the start of a string, a block at a time.
+ *
+ * @param p: A pointer into a terminated string
+ * @return: The number of separator bytes before the next token or the
+ *      terminator
+ */
+SCAN_UNCHECKED size_t scan_space(const char * p) {
+        const char * base = (const char *)((uintptr_t)p & ~(uintptr_t)(SCAN_WIDTH - 1));
+        unsigned int before = (1u << (p - base)) - 1;
+
+        while(1) {
+                unsigned int other = ~separators(load_block(base)) & SCAN_FULL & ~before;
+                if(other) return base + __builtin_ctz(other) - p;
+                base += SCAN_WIDTH;
+                before = 0;
+        }
+}
+
+/**
+ * Finds the end of the token at the start of a string and classifies it,
+ * a block at a time.
+ *
+ * @param p: A pointer to the first byte of the token in a terminated string
+ * @param kind: A pointer to store the kind of the token at
+ * @return: The length of the token
+ */
+SCAN_UNCHECKED size_t scan_token(const char * p, scan_kind_t * kind) {
+        const char * base = (const char *)((uintptr_t)p & ~(uintptr_t)(SCAN_WIDTH - 1));
+        size_t neg = p[0] == '-';
+        unsigned int before = (1u << (p - base)) - 1;
+        unsigned int bad = 0; /// Non-digits seen in the token
+
+        // a leading '-' does not stop the token from being an integer
+        unsigned int sign = neg ? 1u << (p - base) : 0;
+
+        while(1) {
+                block_t v = load_block(base);
+                unsigned int end = (separators(v) | match_byte(v, '\0')) & ~before;
+                unsigned int other = ~match_digits(v) & SCAN_FULL & ~before & ~sign;
+
+                if(end) {
+                        unsigned int stop = __builtin_ctz(end);
+                        size_t len = base + stop - p;
+                        bad |= other & ((1u << stop) - 1);
+                        *kind = kind_of(p, len, bad == 0 && len > neg);
+                        return len;
+                }
+                bad |= other;
+                base += SCAN_WIDTH;
+                before = sign = 0;
+        }
+}
+
+#else
+
+/**
+ * Counts the separators at the start of a string, see scan_space_scalar().
+ */
+size_t scan_space(const char * p) {
+        return scan_space_scalar(p);
+}
+
+/**
+ * Finds and classifies the token at the start of a string, see
+ * scan_token_scalar().
+ */
+size_t scan_token(const char * p, scan_kind_t * kind) {
+        return scan_token_scalar(p, kind);
+}
+
+#endif
+
+#if !defined(SCAN_SCALAR) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+/**
+ * Converts exactly eight ASCII digits, the first in the lowest byte.
+ *
+ * @param s: A pointer to the digits
+ * @return: Their value
+ */
+static uint64_t eight_digits(const char * s) {
+        uint64_t v;
+
+        memcpy(&v, s, sizeof(v));
+        v -= 0x3030303030303030ull;
+        v = v * 10 + (v >> 8);
+        return (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+                        (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+}
+
+/**
+ * Converts an integer literal to 64 bits eight digits at a time.
+ *
+ * @param p: A pointer to a token of kind SCAN_INTEGER
+ * @param len: The length of the token
+ * @return: The value atoll() gives for the token
+ */
+long long scan_long(const char * p, size_t len) {
+        size_t neg = p[0] == '-', n = len - neg;
+        const char * d = p + neg;
+
+        if(n > 18) return scan_long_scalar(p, len);
+
+        // the leftover digits go first, padded with leading zeros
+        uint64_t v = 0;
+        size_t i = n % 8;
+        if(i) {
+                char pad[8];
+                memset(pad, '0', sizeof(pad));
+                memcpy(pad + 8 - i, d, i);
+                v = eight_digits(pad);
+        }
+        for(; i < n; i += 8) v = v * 100000000u + eight_digits(d + i);
+        return neg ? -(int64_t)v : (int64_t)v;
+}
+
+#else
+
+/**
+ * Converts an integer literal to 64 bits, see scan_long_scalar().
+ */
+long long scan_long(const char * p, size_t len) {
+        return scan_long_scalar(p, len);
+}
+
+#endif
+
+/**
+ * Converts an integer literal.
+ *
+ * @param p: A pointer to a token of kind SCAN_INTEGER
+ * @param len: The length of the token
+ * @return: The value atoi() gives for the token
+ */
+int scan_int(const char * p, size_t len) {
+        return (int)scan_long(p, len);
+}
+
+/**
+ * Converts a literal to the value type of the build. Literals too long
+ * for 64 bits saturate for the integer types. For doubles, they and every
+ * decimal or exponent literal are converted by strtod(), which reads no
+ * further than the token since the token is followed by a separator or
+ * the terminator.
+ *
+ * @param p: A pointer to a token of kind SCAN_INTEGER
+ * @param len: The length of the token
+ * @return: The value of the literal
+ */
+value_t scan_value(const char * p, size_t len) {
+#ifdef VALUE_DOUBLE
+        size_t neg = p[0] == '-';
+        if(len - neg > 18) return strtod(p, NULL);
+        for(size_t i = neg; i < len; i++) {
+                if(p[i] < '0' || p[i] > '9') return strtod(p, NULL);
+        }
+#endif
+        return (value_t)scan_long(p, len);
+}
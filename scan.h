@@ -0,0 +1,44 @@
+/**
+ * Interface for the token scanner, which finds and classifies the tokens
+ * of postfix expressions several bytes at a time and converts integer
+ * literals without a call to atoi().
+ *
+ * @file        scan.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include "value.h"
+
+/// What parse() makes of a token, in the order it tries them
+typedef enum scan_kind_e {
+        SCAN_INTEGER, /// An optional '-' and at least one digit, or any scan_decimal() literal with VALUE_DOUBLE, as in is_num()
+        SCAN_SYMBOL, /// Starts with a letter
+        SCAN_OPERATOR, /// One of + - * / % =, as in is_operator()
+        SCAN_TERNARY, /// ?
+        SCAN_OTHER
+} scan_kind_t;
+
+size_t scan_space(const char * p);
+
+size_t scan_token(const char * p, scan_kind_t * kind);
+
+size_t scan_decimal(const char * p, size_t len);
+
+int scan_int(const char * p, size_t len);
+
+long long scan_long(const char * p, size_t len);
+
+value_t scan_value(const char * p, size_t len);
+
+size_t scan_space_scalar(const char * p);
+
+size_t scan_token_scalar(const char * p, scan_kind_t * kind);
+
+int scan_int_scalar(const char * p, size_t len);
+
+long long scan_long_scalar(const char * p, size_t len);
+
+#endif
@@ -0,0 +1,673 @@
+/**
+ * Implementation of the evaluation server. The server listens on a Unix
+ * domain socket and multiplexes its clients with a single epoll event
+ * loop, so the symbol table is loaded once and stays warm for every job.
+ * The loop only moves bytes: connections with complete lines are handed
+ * to a pool of workers, and a connection is held by one worker at a time,
+ * so its requests are evaluated and answered in the order they were sent
+ * while different clients are evaluated in parallel.
+ *
+ * ## Protocol:
+ * Clients send newline-terminated postfix expressions and may pipeline
+ * any number of them without waiting. Every non-empty line gets exactly
+ * one response line, in request order:
+ * ```
+ * <infix> = <result>\t<latency>us
+ * <infix> ! <error>\t<latency>us
+ * ```
+ * where the second form answers a request that failed, with the error
+ * named as in the NDJSON output format (the request as sent stands in for
+ * the infix if it did not parse), and latency is the time spent evaluating
+ * that request. Text after a '#' is a comment, as in interactive mode.
+ * A connection is not read from while SERVER_MAX_OUTPUT bytes of its
+ * responses are unsent, so a client must read its responses to keep
+ * sending.
+ *
+ * @file        server.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+#define MAX_EVENTS 64
+#define READ_CHUNK 4096
+#define RESPONSE_LENGTH 1024
+
+/// A client connection and its unanswered input and unsent output
+typedef struct conn_s {
+        int fd;
+        pthread_mutex_t lock; /// Guards the rest of the connection against the workers
+        char * in;
+        size_t in_off, in_len, in_cap; /// in_off is the start of the first unanswered line
+        char * out;
+        size_t out_len, out_off, out_cap;
+        int eof; /// Client has shut down its end, close once out is drained
+        int busy; /// Queued for or held by a worker
+        int dead; /// Failed, close once no worker holds it
+        int watched; /// Registered with the epoll instance
+        int ready; /// On the ready list, guarded by ready_lock
+        struct conn_s * next_work; /// Next connection in the work queue
+        struct conn_s * next_ready; /// Next connection on the ready list
+} conn_t;
+
+static volatile sig_atomic_t stopping = 0; /// Set by SIGINT/SIGTERM
+static atomic_ulong served = 0; /// Requests answered so far
+static atomic_long total_us = 0; /// Sum of per-request latencies
+
+static serve_fn_t evaluate_fn; /// Evaluates requests for the workers
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER; /// Guards the work queue
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER; /// Signaled when work is queued or the pool stops
+static conn_t * work_head = NULL, * work_tail = NULL; /// Connections waiting for a worker
+static atomic_int pool_stopping = 0; /// Set when the workers should exit
+
+static pthread_mutex_t ready_lock = PTHREAD_MUTEX_INITIALIZER; /// Guards the ready list
+static conn_t * ready_list = NULL; /// Connections the event loop should look at again
+static int wake_fd = -1; /// eventfd that wakes the event loop when the ready list fills
+
+/**
+ * Signal handler that asks the event loop to stop.
+ *
+ * @param sig: The signal number (unused)
+ */
+static void on_signal(int sig) {
+        (void)sig;
+        stopping = 1;
+}
+
+/**
+ * Puts a file descriptor into non-blocking mode.
+ *
+ * @param fd: The file descriptor
+ * @return: 0 on success, -1 on failure
+ */
+static int set_nonblocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if(flags < 0) return -1;
+        return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * Grows a buffer so that it can hold at least need bytes.
+ *
+ * @param buf: A pointer to the buffer
+ * @param cap: A pointer to the current capacity of the buffer
+ * @param need: The required capacity
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+static int reserve(char ** buf, size_t * cap, size_t need) {
+        if(need <= *cap) return 0;
+
+        size_t ncap = *cap ? *cap : READ_CHUNK;
+        while(ncap < need) ncap *= 2;
+
+        char * nbuf = realloc(*buf, ncap);
+        if(!nbuf) {
+                perror("Failed to grow connection buffer");
+                return -1;
+        }
+        *buf = nbuf;
+        *cap = ncap;
+        return 0;
+}
+
+/**
+ * Closes a connection and frees its buffers.
+ *
+ * @param conn: A pointer to the connection
+ */
+static void close_conn(conn_t * conn) {
+        close(conn->fd);
+        pthread_mutex_destroy(&conn->lock);
+        free(conn->in);
+        free(conn->out);
+        free(conn);
+}
+
+/**
+ * Returns the microseconds elapsed between two points in time.
+ */
+static long elapsed_us(struct timespec * start, struct timespec * end) {
+        return (end->tv_sec - start->tv_sec) * 1000000L +
+                (end->tv_nsec - start->tv_nsec) / 1000L;
+}
+
+/**
+ * Returns the number of response bytes not yet written to a connection.
+ * The caller holds the connection's lock, as for every function below
+ * that takes a connection.
+ */
+static size_t unsent(conn_t * conn) {
+        return conn->out_len - conn->out_off;
+}
+
+/**
+ * Returns whether a connection has a complete line no worker has taken.
+ */
+static int has_line(conn_t * conn) {
+        return memchr(conn->in + conn->in_off, '\n', conn->in_len - conn->in_off) != NULL;
+}
+
+/**
+ * Returns whether the event loop should read more from a connection: not
+ * while its unanswered input or unsent output is at its limit.
+ */
+static int can_read(conn_t * conn) {
+        return !conn->eof && !conn->dead && conn->in_len - conn->in_off < SERVER_MAX_PENDING &&
+                unsent(conn) < SERVER_MAX_OUTPUT;
+}
+
+/**
+ * Queues a connection for a worker if it has a line to answer, room for
+ * the answer, and no worker already holds it.
+ *
+ * @param conn: A pointer to the connection
+ */
+static void schedule(conn_t * conn) {
+        if(conn->busy || conn->dead || unsent(conn) >= SERVER_MAX_OUTPUT || !has_line(conn)) return;
+        conn->busy = 1;
+        conn->next_work = NULL;
+
+        pthread_mutex_lock(&work_lock);
+        if(work_tail) work_tail->next_work = conn;
+        else work_head = conn;
+        work_tail = conn;
+        pthread_cond_signal(&work_cond);
+        pthread_mutex_unlock(&work_lock);
+}
+
+/**
+ * Waits for a connection to work on.
+ *
+ * @return: A pointer to the connection, or NULL once the pool is stopping
+ */
+static conn_t * take_work(void) {
+        pthread_mutex_lock(&work_lock);
+        while(!work_head && !pool_stopping) pthread_cond_wait(&work_cond, &work_lock);
+
+        conn_t * conn = pool_stopping ? NULL : work_head;
+        if(conn) {
+                work_head = conn->next_work;
+                if(!work_head) work_tail = NULL;
+        }
+        pthread_mutex_unlock(&work_lock);
+        return conn;
+}
+
+/**
+ * Hands a connection back to the event loop, waking it if it was not
+ * already going to look at the ready list.
+ *
+ * @param conn: A pointer to the connection
+ */
+static void post_ready(conn_t * conn) {
+        pthread_mutex_lock(&ready_lock);
+        if(!conn->ready) {
+                int wake = ready_list == NULL;
+                conn->ready = 1;
+                conn->next_ready = ready_list;
+                ready_list = conn;
+
+                uint64_t one = 1;
+                if(wake && write(wake_fd, &one, sizeof(one)) < 0) perror("serve: eventfd");
+        }
+        pthread_mutex_unlock(&ready_lock);
+}
+
+/**
+ * Takes the next connection off the ready list.
+ *
+ * @return: A pointer to the connection, or NULL if the list is empty
+ */
+static conn_t * take_ready(void) {
+        pthread_mutex_lock(&ready_lock);
+        conn_t * conn = ready_list;
+        if(conn) {
+                ready_list = conn->next_ready;
+                conn->ready = 0;
+        }
+        pthread_mutex_unlock(&ready_lock);
+        return conn;
+}
+
+/**
+ * Evaluates one request line and formats its response.
+ *
+ * @param line: A pointer to the line, without its newline; comments and
+ *      trailing blanks are cut off in place
+ * @param response: A pointer to the buffer for the response
+ * @param size: The size of the response buffer
+ * @return: The length of the response, or 0 if the line is blank
+ */
+static size_t answer(char * line, char * response, size_t size) {
+        char * com = strchr(line, '#');
+        if(com) *com = '\0';
+        size_t len = strlen(line);
+        while(len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ')) line[--len] = '\0';
+        if(len == 0) return 0;
+
+        char infix[RESPONSE_LENGTH];
+        eval_error_t status = EVAL_OK;
+        struct timespec t0, t1;
+        infix[0] = '\0';
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        value_t result = evaluate_fn(line, infix, sizeof(infix), &status);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        long us = elapsed_us(&t0, &t1);
+        atomic_fetch_add(&served, 1);
+        atomic_fetch_add(&total_us, us);
+
+        int n;
+        if(status == EVAL_OK) n = snprintf(response, size, "%s = " VALUE_FMT "\t%ldus\n", infix, result, us);
+        else n = snprintf(response, size, "%.*s ! %s\t%ldus\n", RESPONSE_LENGTH - 1,
+                        infix[0] ? infix : line, eval_error_name(status), us);
+        if(n < 0) return 0;
+
+        // keep the newline of a response that had to be cut short
+        if((size_t)n >= size) {
+                n = (int)size - 1;
+                response[n - 1] = '\n';
+        }
+        return (size_t)n;
+}
+
+/**
+ * Answers the complete lines of a connection, in order, until none are
+ * left or its output is full. The lock is let go of while each line is
+ * evaluated, so the event loop keeps reading and writing meanwhile.
+ *
+ * @param conn: A pointer to the connection
+ */
+static void answer_lines(conn_t * conn) {
+        char * nl;
+
+        while(!pool_stopping && !conn->dead && unsent(conn) < SERVER_MAX_OUTPUT &&
+                        (nl = memchr(conn->in + conn->in_off, '\n', conn->in_len - conn->in_off)) != NULL) {
+                // the event loop may move the input buffer, so take a copy
+                char small[READ_CHUNK];
+                size_t len = nl - (conn->in + conn->in_off);
+                char * line = len < sizeof(small) ? small : malloc(len + 1);
+                if(!line) {
+                        perror("Failed to copy request");
+                        conn->dead = 1;
+                        break;
+                }
+                memcpy(line, conn->in + conn->in_off, len);
+                line[len] = '\0';
+                conn->in_off += len + 1;
+                pthread_mutex_unlock(&conn->lock);
+
+                char response[RESPONSE_LENGTH + 64];
+                size_t n = answer(line, response, sizeof(response));
+                if(line != small) free(line);
+
+                pthread_mutex_lock(&conn->lock);
+                if(n == 0) continue;
+                if(reserve(&conn->out, &conn->out_cap, conn->out_len + n) < 0) {
+                        conn->dead = 1;
+                        break;
+                }
+                // the event loop only needs telling when there was nothing to write
+                if(unsent(conn) == 0) post_ready(conn);
+                memcpy(conn->out + conn->out_len, response, n);
+                conn->out_len += n;
+        }
+}
+
+/**
+ * Runs a worker: answers the connections handed to it until the pool
+ * stops.
+ *
+ * @param arg: Unused
+ * @return: NULL
+ */
+static void * worker(void * arg) {
+        (void)arg;
+        conn_t * conn;
+
+        while((conn = take_work()) != NULL) {
+                pthread_mutex_lock(&conn->lock);
+                answer_lines(conn);
+                conn->busy = 0;
+                post_ready(conn);
+                pthread_mutex_unlock(&conn->lock);
+        }
+        return NULL;
+}
+
+/**
+ * Writes as much pending output as the socket accepts.
+ *
+ * @param conn: A pointer to the connection
+ * @return: 0 on success, -1 if the connection failed
+ */
+static int flush_conn(conn_t * conn) {
+        while(conn->out_off < conn->out_len) {
+                ssize_t n = write(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off);
+                if(n < 0) {
+                        if(errno == EINTR) continue;
+                        if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+                        return -1;
+                }
+                conn->out_off += n;
+        }
+        conn->out_off = conn->out_len = 0;
+        return 0;
+}
+
+/**
+ * Reads what is available on a connection, up to its limits, and queues
+ * it for a worker if a line is complete.
+ *
+ * @param conn: A pointer to the connection
+ * @return: 0 on success, -1 if the connection should be dropped
+ */
+static int read_conn(conn_t * conn) {
+        while(can_read(conn)) {
+                // drop the lines the workers have taken
+                if(conn->in_off > 0) {
+                        memmove(conn->in, conn->in + conn->in_off, conn->in_len - conn->in_off);
+                        conn->in_len -= conn->in_off;
+                        conn->in_off = 0;
+                }
+                if(reserve(&conn->in, &conn->in_cap, conn->in_len + READ_CHUNK) < 0) return -1;
+
+                ssize_t n = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+                if(n < 0) {
+                        if(errno == EINTR) continue;
+                        if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+                        return -1;
+                }
+                if(n == 0) {
+                        // answer a final request that lacks its newline
+                        conn->eof = 1;
+                        if(conn->in_len > 0 && conn->in[conn->in_len - 1] != '\n') conn->in[conn->in_len++] = '\n';
+                }
+                conn->in_len += n;
+        }
+
+        if(conn->in_len - conn->in_off >= SERVER_MAX_PENDING && !has_line(conn)) {
+                fprintf(stderr, "serve: dropping client with an overlong line\n");
+                return -1;
+        }
+        return 0;
+}
+
+/**
+ * Updates the events a connection is waiting for: input only while it
+ * may be read from, and output readiness only while responses are
+ * pending. A connection waiting for neither is taken out of the epoll
+ * instance until a worker hands it back, so a hung up client does not
+ * wake the loop over and over.
+ *
+ * @param epfd: The epoll instance
+ * @param conn: A pointer to the connection
+ */
+static void watch_conn(int epfd, conn_t * conn) {
+        struct epoll_event ev;
+        ev.events = (can_read(conn) ? EPOLLIN : 0) | (unsent(conn) > 0 ? EPOLLOUT : 0);
+        ev.data.ptr = conn;
+
+        if(ev.events == 0) {
+                if(conn->watched) epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+                conn->watched = 0;
+        } else {
+                epoll_ctl(epfd, conn->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, conn->fd, &ev);
+                conn->watched = 1;
+        }
+}
+
+/**
+ * Reads from and writes to a connection, queues it for a worker if it
+ * has lines to answer, and closes it once it is done: failed or hung up
+ * with everything answered, with no worker holding it and not waiting on
+ * the ready list.
+ *
+ * @param epfd: The epoll instance
+ * @param conn: A pointer to the connection
+ * @param readable: Whether the connection has input or hung up
+ */
+static void service(int epfd, conn_t * conn, int readable) {
+        pthread_mutex_lock(&conn->lock);
+        if(!conn->dead && ((readable && read_conn(conn) < 0) || flush_conn(conn) < 0)) conn->dead = 1;
+        schedule(conn);
+
+        int done = !conn->busy && (conn->dead || (conn->eof && !has_line(conn) && unsent(conn) == 0));
+        if(done) {
+                pthread_mutex_lock(&ready_lock);
+                done = !conn->ready;
+                pthread_mutex_unlock(&ready_lock);
+        }
+        if(!done) watch_conn(epfd, conn);
+        pthread_mutex_unlock(&conn->lock);
+
+        if(done) {
+                if(conn->watched) epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+                close_conn(conn);
+        }
+}
+
+/**
+ * Accepts every pending client on the listening socket.
+ *
+ * @param epfd: The epoll instance
+ * @param lfd: The listening socket
+ */
+static void accept_conns(int epfd, int lfd) {
+        while(1) {
+                int fd = accept(lfd, NULL, NULL);
+                if(fd < 0) {
+                        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+                        return;
+                }
+
+                conn_t * conn = calloc(1, sizeof(conn_t));
+                if(!conn || set_nonblocking(fd) < 0) {
+                        perror("Failed to set up connection");
+                        free(conn);
+                        close(fd);
+                        continue;
+                }
+                conn->fd = fd;
+                pthread_mutex_init(&conn->lock, NULL);
+
+                struct epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.ptr = conn;
+                if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                        perror("epoll_ctl");
+                        close_conn(conn);
+                        continue;
+                }
+                conn->watched = 1;
+        }
+}
+
+/**
+ * Opens a listening Unix domain socket at the given path, replacing any
+ * stale socket file left behind by an earlier server.
+ *
+ * @param path: The filesystem path of the socket
+ * @return: The listening socket, or -1 on failure
+ */
+static int listen_unix(const char * path) {
+        struct sockaddr_un addr;
+
+        if(strlen(path) >= sizeof(addr.sun_path)) {
+                fprintf(stderr, "serve: socket path too long: %s\n", path);
+                return -1;
+        }
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0) {
+                perror("socket");
+                return -1;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        unlink(path);
+
+        if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+                        listen(fd, SERVER_BACKLOG) < 0 || set_nonblocking(fd) < 0) {
+                perror(path);
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+/**
+ * Stops the workers and waits for them to finish the requests they are
+ * evaluating.
+ *
+ * @param threads: A pointer to the worker threads
+ * @param count: The number of worker threads
+ */
+static void stop_pool(pthread_t * threads, int count) {
+        pthread_mutex_lock(&work_lock);
+        pool_stopping = 1;
+        pthread_cond_broadcast(&work_cond);
+        pthread_mutex_unlock(&work_lock);
+
+        for(int i = 0; i < count; i++) pthread_join(threads[i], NULL);
+        free(threads);
+}
+
+/**
+ * Starts the workers that evaluate requests.
+ *
+ * @param evaluate: The function that evaluates a single expression
+ * @param workers: The number of workers to start
+ * @param count: A pointer to store the number of workers started at
+ * @return: A pointer to the worker threads, or NULL if none started
+ */
+static pthread_t * start_pool(serve_fn_t evaluate, int workers, int * count) {
+        pthread_t * threads = malloc(sizeof(pthread_t) * (size_t)workers);
+        *count = 0;
+        if(!threads) return NULL;
+
+        evaluate_fn = evaluate;
+        pool_stopping = 0;
+        work_head = work_tail = NULL;
+        while(*count < workers && pthread_create(&threads[*count], NULL, worker, NULL) == 0) (*count)++;
+
+        if(*count == 0) {
+                free(threads);
+                return NULL;
+        }
+        return threads;
+}
+
+/**
+ * Serves expression evaluation on a Unix domain socket until the process
+ * receives SIGINT or SIGTERM. Requests are evaluated by a pool of worker
+ * threads, each of which holds one connection at a time, so different
+ * clients are served in parallel and every client is answered in order.
+ * The evaluate function must therefore be safe to call from several
+ * threads at once.
+ *
+ * @param path: The filesystem path of the socket
+ * @param evaluate: The function that evaluates a single expression
+ * @param workers: The number of worker threads, at least 1
+ * @return: 0 on a clean shutdown, -1 if the server could not start
+ */
+int serve(const char * path, serve_fn_t evaluate, int workers) {
+        int lfd = listen_unix(path);
+        if(lfd < 0) return -1;
+
+        int epfd = epoll_create1(0);
+        wake_fd = eventfd(0, EFD_NONBLOCK);
+        if(epfd < 0 || wake_fd < 0) {
+                perror("serve");
+                if(epfd >= 0) close(epfd);
+                if(wake_fd >= 0) close(wake_fd);
+                close(lfd);
+                unlink(path);
+                return -1;
+        }
+
+        int started;
+        pthread_t * threads = start_pool(evaluate, workers < 1 ? 1 : workers, &started);
+        if(!threads) {
+                fprintf(stderr, "serve: failed to start workers\n");
+                close(wake_fd);
+                close(epfd);
+                close(lfd);
+                unlink(path);
+                return -1;
+        }
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        signal(SIGPIPE, SIG_IGN);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL; /// NULL marks the listening socket
+        epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+        ev.data.ptr = &wake_fd; /// and &wake_fd the ready list
+        epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+        fprintf(stderr, "serve: listening on %s with %d workers\n", path, started);
+
+        struct epoll_event events[MAX_EVENTS];
+        while(!stopping) {
+                int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+                if(n < 0) {
+                        if(errno == EINTR) continue;
+                        perror("epoll_wait");
+                        break;
+                }
+
+                int woken = 0;
+                for(int i = 0; i < n; i++) {
+                        conn_t * conn = events[i].data.ptr;
+                        if(conn == NULL) {
+                                accept_conns(epfd, lfd);
+                        } else if(events[i].data.ptr == &wake_fd) {
+                                woken = 1;
+                        } else {
+                                service(epfd, conn, (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0);
+                        }
+                }
+
+                // after the events, so none of them names a connection closed here
+                if(woken) {
+                        uint64_t count;
+                        if(read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("serve: eventfd");
+
+                        conn_t * conn;
+                        while((conn = take_ready()) != NULL) service(epfd, conn, 0);
+                }
+        }
+
+        stop_pool(threads, started);
+        fprintf(stderr, "serve: %lu requests, mean latency %ldus\n", atomic_load(&served),
+                atomic_load(&served) ? atomic_load(&total_us) / (long)atomic_load(&served) : 0L);
+
+        close(wake_fd);
+        close(epfd);
+        close(lfd);
+        unlink(path);
+        return 0;
+}
@@ -0,0 +1,29 @@
+/**
+ * Interface for the evaluation server, which serves postfix expressions
+ * over a Unix domain socket from one long-running process.
+ *
+ * @file        server.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include "value.h"
+#include "eval_error.h"
+
+#define SERVER_BACKLOG 64
+#define SERVER_MAX_PENDING (1 << 20) /// Unanswered input allowed per connection
+#define SERVER_MAX_OUTPUT (1 << 20) /// Unsent responses allowed per connection
+
+/**
+ * Evaluates one expression for the server. Writes the infix form of
+ * the expression into infix (at most len bytes), or an empty string if it
+ * did not parse, stores why it failed or EVAL_OK at status, and returns
+ * the result. Called from several worker threads at once.
+ */
+typedef value_t (*serve_fn_t)(const char * exp, char * infix, size_t len, eval_error_t * status);
+
+int serve(const char * path, serve_fn_t evaluate, int workers);
+
+#endif
@@ -1,10 +1,12 @@
-
 /**
  * Implementation of a simple stack data structure. This file
  * provides basic stack operations such as creation, push, pop,
  * top, and destruction. The stack operates on generic data,
  * allowing the storage of any data type. The stack is implemented
- * as a singly linked list.
+ * as a list of fixed-size chunks: the first chunk comes with the
+ * stack itself, and every chunk emptied by pop() is kept on a free
+ * list for later pushes, so pushing and popping only allocate when
+ * the stack grows past its largest size so far.
  *
  * @file        stack.c
  * @author      Sophia Le (sel5881@rit.edu)
@@ -12,66 +14,97 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "stack.h"
+#include "trace.h"
+
+#ifdef DEBUG_TRACE
+/**
+ * Prints the elements of the stack, top first.
+ *
+ * @param stack: A pointer to the stack
+ * @param when: The operation that just finished
+ */
+static void trace_stack(stack_t * stack, const char * when) {
+        printf("\t[%s]: Stack after %s: ", when, when);
+        size_t used = stack->used;
+        for(stack_chunk_t * chunk = stack->chunk; chunk; chunk = chunk->below, used = STACK_CHUNK) {
+                for(size_t i = used; i-- > 0; ) {
+                        printf("%s", (char *)chunk->data[i]);
+                        if(i > 0 || chunk->below) printf(", ");
+                }
+        }
+        printf("\n");
+}
+#endif
 
 /**
  * Creates a new, empty stack
  *
- * @return: A pointer to the newly created stack. Exits the program
- *      if memory allocation fails
+ * @return: A pointer to the newly created stack, or NULL if memory
+ *      allocation fails
  */
 stack_t * make_stack(void) {
         stack_t * stk = (stack_t *)malloc(sizeof(stack_t));
 
         if(!stk) {
                 perror("Failed to create stack.");
-                exit(EXIT_FAILURE);
+                return NULL;
         }
 
-        stk->top = NULL;
+        stk->first.below = NULL;
+        stk->chunk = &stk->first;
+        stk->used = 0;
+        stk->size = 0;
+        stk->spare = NULL;
         return stk;
 }
 
 /**
- * Pushes data onto the stack.
+ * Pushes data onto the stack. An empty string is not pushed.
  *
  * @param stack: A pointer to the stack
  * @param data: A pointer to the data to be pushed onto the stack
+ * @return: 0 on success, -1 if the stack or data is NULL or memory
+ *      allocation fails, in which case the stack is unchanged
  */
-void push(stack_t * stack, void * data) {
+int push(stack_t * stack, void * data) {
         if(!stack) {
                 fprintf(stderr, "push: stack is NULL\n");
-                exit(EXIT_FAILURE);
+                return -1;
         }
         if(!data) {
                 fprintf(stderr, "Warning: attempted to push NULL data\n");
-                exit(EXIT_FAILURE);
+                return -1;
         }
 
-        printf("\t[push]: Pushing %s...\n", (char *)data);
-        if(data != NULL && ((char *)data)[0] == '\0') {
+        TRACE("\t[push]: Pushing %s...\n", (char *)data);
+        if(((char *)data)[0] == '\0') {
                 fprintf(stderr, "Warning: attempted to push an empty string\n");
-                return;
+                return 0;
         }
-        stack_node_t * node = (stack_node_t *)malloc(sizeof(stack_node_t));
 
-        if(!node) {
-                perror("Failed to push to stack.");
-                exit(EXIT_FAILURE);
-        }
+        // a full chunk gets a new one on top, a spare if there is one
+        if(stack->used == STACK_CHUNK) {
+                stack_chunk_t * chunk = stack->spare;
+                if(chunk) stack->spare = chunk->below;
+                else chunk = (stack_chunk_t *)malloc(sizeof(stack_chunk_t));
 
-        node->data = data;
-        node->next = stack->top;
-        stack->top = node;
-
-        //prints the stack
-        printf("\t[push]: Stack after push: ");
-        stack_node_t * curr = stack->top;
-        while(curr) {
-                printf("%s", (char *)curr->data);
-                if(curr->next) printf(", ");
-                curr = curr->next;
+                if(!chunk) {
+                        perror("Failed to push to stack.");
+                        return -1;
+                }
+
+                chunk->below = stack->chunk;
+                stack->chunk = chunk;
+                stack->used = 0;
         }
-        printf("\n");
+
+        stack->chunk->data[stack->used++] = data;
+        stack->size++;
+
+#ifdef DEBUG_TRACE
+        trace_stack(stack, "push");
+#endif
+        return 0;
 }
 
 /**
@@ -79,41 +112,46 @@ void push(stack_t * stack, void * data) {
  * removing it.
  *
  * @param stack: A pointer to the stack
- * @return: A pointer to the data at the top of the stack
+ * @return: A pointer to the data at the top of the stack, or NULL if the
+ *      stack is empty
  */
 void * top(stack_t * stack) {
         if(empty_stack(stack)) {
                 fprintf(stderr, "top: stack is empty\n");
-                exit(EXIT_FAILURE);
+                return NULL;
         }
-        return stack->top->data;
+        return stack->chunk->data[stack->used - 1];
 }
 
 /**
  * Removes the top element of the stack.
  *
  * @param stack: A pointer to the stack
+ * @return: 0 on success, -1 if the stack is empty
  */
-void pop(stack_t * stack) {
+int pop(stack_t * stack) {
         if(empty_stack(stack)) {
                 fprintf(stderr, "pop: stack is empty\n");
-                exit(EXIT_FAILURE);
+                return -1;
         }
 
-        stack_node_t * tmp = stack->top;
-        stack->top = tmp->next;
-
-        free(tmp);
-        tmp = NULL;
-
-        printf("\t[pop]: Stack after pop: ");
-        stack_node_t * curr = stack->top;
-        while(curr) {
-                printf("%s", (char *)curr->data);
-                if(curr->next) printf(", ");
-                curr = curr->next;
+        stack->used--;
+        stack->size--;
+
+        // an emptied chunk joins the spares, so growing back to any
+        // earlier size does not allocate
+        if(stack->used == 0 && stack->chunk != &stack->first) {
+                stack_chunk_t * chunk = stack->chunk;
+                stack->chunk = chunk->below;
+                stack->used = STACK_CHUNK;
+                chunk->below = stack->spare;
+                stack->spare = chunk;
         }
-        printf("\n");
+
+#ifdef DEBUG_TRACE
+        trace_stack(stack, "pop");
+#endif
+        return 0;
 }
 
 /**
@@ -123,28 +161,42 @@ void pop(stack_t * stack) {
  * @return: 1 if the stack is empty, 0 otherwise
  */
 int empty_stack(stack_t * stack) {
-        return stack == NULL || stack->top == NULL;
+        return stack == NULL || stack->size == 0;
 }
 
 /**
- * Frees all memory associated with the stack.
+ * Counts the elements on the stack.
+ *
+ * @param stack: A pointer to the stack
+ * @return: The number of elements, 0 if the stack is NULL
+ */
+size_t stack_size(stack_t * stack) {
+        return stack == NULL ? 0 : stack->size;
+}
+
+/**
+ * Frees all memory associated with the stack, including the data
+ * still on it.
  *
  * @param stack: A pointer to the stack
  */
 void free_stack(stack_t * stack) {
         if(stack == NULL) return;
 
-        stack_node_t *cur = stack->top;
-        while(cur->next != NULL) {
-                printf("cur: %p, next: %p\n", cur, cur->next);
-                stack_node_t *tmp = cur->next;
-                if(cur->data != NULL) {
-                        free(cur->data);
-                        cur->data = NULL;
-                }
-                free(cur);
-                cur = tmp;
+        stack_chunk_t * chunk = stack->chunk;
+        size_t used = stack->used;
+        while(chunk != NULL) {
+                TRACE("chunk: %p, below: %p\n", (void *)chunk, (void *)chunk->below);
+                stack_chunk_t * below = chunk->below;
+                for(size_t i = 0; i < used; i++) free(chunk->data[i]);
+                if(chunk != &stack->first) free(chunk);
+                chunk = below;
+                used = STACK_CHUNK;
         }
+        while(stack->spare != NULL) {
+                stack_chunk_t * below = stack->spare->below;
+                free(stack->spare);
+                stack->spare = below;
+        }
+        free(stack);
 }
-
-
@@ -0,0 +1,43 @@
+/**
+ * Interface for a generic stack of pointers.
+ *
+ * @file        stack.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef STACK_H
+#define STACK_H
+
+#include <stddef.h>
+
+#define STACK_CHUNK 256 /// Elements held by each chunk of a stack
+
+/// A fixed-size block of elements, linked to the block below it
+typedef struct stack_chunk_s {
+        struct stack_chunk_s * below; /// The chunk under this one, NULL for the first
+        void * data[STACK_CHUNK];
+} stack_chunk_t;
+
+/// A stack, stored in chunks so a push or pop rarely allocates
+typedef struct stack_s {
+        stack_chunk_t * chunk; /// The chunk holding the top element
+        size_t used; /// Elements in the top chunk
+        size_t size; /// Elements in the whole stack
+        stack_chunk_t * spare; /// Emptied chunks kept for later pushes, linked through below
+        stack_chunk_t first; /// The bottom chunk, allocated with the stack
+} stack_t;
+
+stack_t * make_stack(void);
+
+int push(stack_t * stack, void * data);
+
+void * top(stack_t * stack);
+
+int pop(stack_t * stack);
+
+int empty_stack(stack_t * stack);
+
+size_t stack_size(stack_t * stack);
+
+void free_stack(stack_t * stack);
+
+#endif
@@ -1,10 +1,37 @@
 /**
  * Implementation of a symbol table for managing variable names
  * and values. Provides functions to manage a symbol table implemented
- * as a linked list. Supports operations such as adding symbols,
+ * as a persistent hash trie. Supports operations such as adding symbols,
  * looking up symbols, dumping the table for debugging, and freeing
  * memory. The symbol table can also be initialized from a file.
  *
+ * ## Versions and snapshots:
+ * Every version of the table is immutable. A write (adding or assigning
+ * a symbol) copies only the trie nodes on the path to that symbol, shares
+ * everything else with the previous version, and then publishes the new
+ * version as the current one. Taking a snapshot is therefore O(1): it
+ * pins the current version, and every lookup through that snapshot sees
+ * the same values no matter what is written meanwhile. Trie nodes and
+ * symbols are reference counted, so a version is reclaimed once it is
+ * neither current nor pinned by any reader.
+ *
+ * ## Concurrency:
+ * Readers never take a lock. Pinning increments the current version's
+ * reference count unless it has already dropped to zero, then checks
+ * that the version is still current; version records are recycled but
+ * never freed while the table exists, so a stale pointer to one is always
+ * safe to touch. A reader that drops the last pin on a replaced version
+ * only pushes it onto a lock-free retire list; the next writer frees its
+ * nodes and symbols and recycles the record. Writers serialize on a
+ * single mutex. free_table() must not race with any other operation.
+ *
+ * ## Tables:
+ * Each symtab_t from make_table() is a table of its own, with its own
+ * versions and writer lock, so interpreter contexts never share symbols.
+ * The functions without a table argument work on one process-wide table.
+ * Versions of symbols are stamped from a clock shared by all tables, so a
+ * version identifies a single write in the whole process.
+ *
  * @file        symtab.c
  * @author      Sophia Le (sel5881@rit.edu)
  */
@@ -12,19 +39,52 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "symtab.h"
+#include "intern.h"
+
+#define TRIE_BITS 4
+#define TRIE_FANOUT (1 << TRIE_BITS)
+#define TRIE_LEVELS (32 / TRIE_BITS)
+#define SLOT(hash, depth) (((hash) >> ((depth) * TRIE_BITS)) & (TRIE_FANOUT - 1))
+
+/// A trie node; each slot holds either a child node or a symbol
+typedef struct trie_node_s {
+        atomic_int refs;
+        struct trie_node_s * child[TRIE_FANOUT];
+        symbol_t * entry[TRIE_FANOUT]; /// Chained through next on the last level only
+} trie_node_t;
 
-static symbol_t * symbol_table = NULL; /// Pointer to the head of the symbol table
-static int size = 0; /// Current number of symbols in the table
+/// One immutable version of the table
+struct symtab_snapshot_s {
+        atomic_long refs; /// Pins, plus one while the version is current
+        trie_node_t * root;
+        int size; /// Number of symbols in this version
+        struct symtab_snapshot_s * next_free;
+        symtab_t * table; /// Table the version belongs to
+};
+
+/// A symbol table and the state its writers share
+struct symtab_s {
+        symtab_snapshot_t * _Atomic current; /// The newest version of the table
+        symtab_snapshot_t * free_versions; /// Recycled version records
+        symtab_snapshot_t * _Atomic retired; /// Versions readers let go of, reclaimed by the next writer
+        pthread_mutex_t write_lock; /// Serializes writers
+        write_hook_t write_hook; /// Called for every write, in version order
+};
+
+static symtab_t global = { NULL, NULL, NULL, PTHREAD_MUTEX_INITIALIZER, NULL }; /// Used by the functions without a table
+static atomic_ulong write_clock = 0; /// Number of symbols ever written, stamped on each
 
 /**
- * Creates a new symbol with the given name and value.
+ * Creates a new symbol for an interned name.
  *
- * @param name: A pointer to the variable name (string)
+ * @param name: The handle of the variable name
  * @param val: Initial value of the variable
  * @return: A pointer to the newly created symbol, or NULL if memory allocation fails
  */
-symbol_t * create_symbol(char * name, int val) {
+static symbol_t * new_symbol(const char * name, value_t val) {
         symbol_t * symbol = (symbol_t *)malloc(sizeof(symbol_t));
 
         if(!symbol) {
@@ -32,46 +92,738 @@ symbol_t * create_symbol(char * name, int val) {
                 return NULL;
         }
 
-        symbol->var_name = strdup(name);
+        symbol->var_name = name;
+        symbol->val = val;
+        symbol->next = NULL;
+        symbol->refs = 1;
+        symbol->version = 0;
+        return symbol;
+}
+
+/**
+ * Creates a new symbol from the first len characters of a name. The name
+ * is interned, so every symbol of that name shares one copy of it.
+ *
+ * @param name: A pointer to the variable name, need not be terminated
+ * @param len: The length of the name
+ * @param val: Initial value of the variable
+ * @return: A pointer to the newly created symbol, or NULL if memory allocation fails
+ */
+symbol_t * create_symbol_len(const char * name, size_t len, value_t val) {
+        const char * handle = intern_len(name, len);
 
-        if(!symbol->var_name) {
-                perror("Failed to allocate memory for symbol name");
+        return handle ? new_symbol(handle, val) : NULL;
+}
+
+/**
+ * Creates a new symbol with the given name and value.
+ *
+ * @param name: A pointer to the variable name (string)
+ * @param val: Initial value of the variable
+ * @return: A pointer to the newly created symbol, or NULL if memory allocation fails
+ */
+symbol_t * create_symbol(const char * name, value_t val) {
+        return create_symbol_len(name, strlen(name), val);
+}
+
+/**
+ * Drops a reference to a symbol, freeing it (and releasing the rest of
+ * its collision chain) when no version uses it anymore.
+ *
+ * @param symbol: A pointer to the symbol, may be NULL
+ */
+static void release_symbol(symbol_t * symbol) {
+        while(symbol && __atomic_sub_fetch(&symbol->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+                symbol_t * nxt = symbol->next;
                 free(symbol);
+                symbol = nxt;
+        }
+}
+
+/**
+ * Drops a reference to a trie node, freeing it and releasing its
+ * children when no version uses it anymore.
+ *
+ * @param node: A pointer to the node, may be NULL
+ */
+static void release_node(trie_node_t * node) {
+        if(!node || atomic_fetch_sub_explicit(&node->refs, 1, memory_order_acq_rel) != 1) return;
+
+        for(int i = 0; i < TRIE_FANOUT; i++) {
+                release_node(node->child[i]);
+                release_symbol(node->entry[i]);
+        }
+        free(node);
+}
+
+/**
+ * Copies a trie node, sharing (and retaining) all of its children.
+ *
+ * @param node: A pointer to the node to copy, or NULL for an empty node
+ * @return: A pointer to the new node, or NULL if memory allocation fails
+ */
+static trie_node_t * copy_node(trie_node_t * node) {
+        trie_node_t * copy = calloc(1, sizeof(trie_node_t));
+
+        if(!copy) {
+                perror("Failed to allocate symbol table node");
                 return NULL;
         }
 
-        symbol->val = val;
-        symbol->next = NULL;
+        atomic_init(&copy->refs, 1);
+        if(node == NULL) return copy;
+
+        for(int i = 0; i < TRIE_FANOUT; i++) {
+                if((copy->child[i] = node->child[i]) != NULL) atomic_fetch_add(&copy->child[i]->refs, 1);
+                if((copy->entry[i] = node->entry[i]) != NULL) __atomic_add_fetch(&copy->entry[i]->refs, 1, __ATOMIC_RELAXED);
+        }
+        return copy;
+}
+
+/**
+ * Builds a collision chain holding symbol followed by fresh copies of
+ * every symbol in chain with a different name.
+ *
+ * @param chain: A pointer to the existing chain
+ * @param symbol: A pointer to the symbol to add, owned by the new chain
+ * @param added: Set to 1 if the name was not already in the chain
+ * @return: A pointer to the new chain
+ */
+static symbol_t * replace_in_chain(symbol_t * chain, symbol_t * symbol, int * added) {
+        symbol_t ** tail = &symbol->next;
+
+        *added = 1;
+        for(symbol_t * curr = chain; curr != NULL; curr = curr->next) {
+                if(curr->var_name == symbol->var_name) {
+                        *added = 0;
+                        continue;
+                }
+                *tail = new_symbol(curr->var_name, curr->val);
+                if(*tail) {
+                        (*tail)->version = curr->version;
+                        tail = &(*tail)->next;
+                }
+        }
+        return symbol;
+}
+
+/**
+ * Returns a copy of node with symbol inserted, replacing any symbol of
+ * the same name. Only the nodes on the path to the symbol are copied.
+ *
+ * @param node: A pointer to the node, or NULL for an empty subtrie
+ * @param depth: The depth of node in the trie
+ * @param hash: The hash of the symbol's name
+ * @param symbol: A pointer to the symbol, owned by the new subtrie
+ * @param added: Set to 1 if the name was not already present
+ * @return: A pointer to the new node, or NULL if memory allocation fails
+ */
+static trie_node_t * insert(trie_node_t * node, int depth, unsigned int hash, symbol_t * symbol, int * added) {
+        trie_node_t * copy = copy_node(node);
+        if(!copy) return NULL;
+
+        int slot = SLOT(hash, depth);
+        symbol_t * old = copy->entry[slot];
+
+        if(copy->child[slot] != NULL) {
+                trie_node_t * child = insert(copy->child[slot], depth + 1, hash, symbol, added);
+                if(!child) {
+                        release_node(copy);
+                        return NULL;
+                }
+                release_node(copy->child[slot]);
+                copy->child[slot] = child;
+        } else if(old == NULL) {
+                copy->entry[slot] = symbol;
+                *added = 1;
+        } else if(depth == TRIE_LEVELS - 1) {
+                copy->entry[slot] = replace_in_chain(old, symbol, added);
+                release_symbol(old);
+        } else if(old->var_name == symbol->var_name) {
+                copy->entry[slot] = symbol;
+                release_symbol(old);
+                *added = 0;
+        } else {
+                // push the resident symbol down a level, then insert beside it
+                trie_node_t * child = copy_node(NULL);
+                if(!child) {
+                        release_node(copy);
+                        return NULL;
+                }
+                child->entry[SLOT(intern_hash(old->var_name), depth + 1)] = old;
+                copy->entry[slot] = NULL;
+                copy->child[slot] = insert(child, depth + 1, hash, symbol, added);
+                release_node(child);
+                if(!copy->child[slot]) {
+                        release_node(copy);
+                        return NULL;
+                }
+        }
+        return copy;
+}
+
+/// A symbol waiting to be inserted by add_symbols(), with its hash
+typedef struct pending_s {
+        unsigned int hash;
+        symbol_t * symbol;
+} pending_t;
+
+/// One subtrie for insert_many() to build, possibly on its own thread
+typedef struct bulk_job_s {
+        trie_node_t * node; /// The existing subtrie, may be NULL
+        int depth;
+        pending_t * items; /// The symbols to insert, in input order
+        pending_t * spare; /// Scratch space for as many symbols
+        size_t count;
+        int added; /// Number of names the subtrie did not hold yet
+        trie_node_t * result; /// The new subtrie, NULL on failure
+} bulk_job_t;
+
+static trie_node_t * insert_many(trie_node_t * node, int depth, pending_t * items, pending_t * spare, size_t count, int * added);
+
+/**
+ * Runs one bulk_job_t.
+ *
+ * @param arg: A pointer to the job
+ * @return: NULL
+ */
+static void * run_bulk_job(void * arg) {
+        bulk_job_t * job = arg;
+
+        job->result = insert_many(job->node, job->depth, job->items, job->spare, job->count, &job->added);
+        return NULL;
+}
+
+/**
+ * Returns a copy of node with many symbols inserted, like a sequence of
+ * insert() calls in input order but copying every node only once. The
+ * symbols are partitioned by the slot their hash selects at each level,
+ * so every subtrie is built from exactly the symbols that belong in it.
+ * The slots of the root are built on separate threads once there are
+ * SYMTAB_BULK_PARALLEL symbols.
+ *
+ * @param node: A pointer to the node, or NULL for an empty subtrie
+ * @param depth: The depth of node in the trie
+ * @param items: The symbols to insert; a later symbol replaces an earlier
+ *      one of the same name. Symbols that end up replaced are not retained
+ * @param spare: Scratch space for count symbols
+ * @param count: The number of symbols
+ * @param added: Incremented for every name that was not already present
+ * @return: A pointer to the new node, or NULL if memory allocation fails
+ */
+static trie_node_t * insert_many(trie_node_t * node, int depth, pending_t * items, pending_t * spare, size_t count, int * added) {
+        trie_node_t * copy = copy_node(node);
+        if(!copy) return NULL;
+
+        // stable counting sort into spare, one bucket per slot
+        size_t start[TRIE_FANOUT + 1] = {0};
+        for(size_t i = 0; i < count; i++) start[SLOT(items[i].hash, depth) + 1]++;
+        for(int s = 0; s < TRIE_FANOUT; s++) start[s + 1] += start[s];
+
+        size_t fill[TRIE_FANOUT];
+        memcpy(fill, start, sizeof(fill));
+        for(size_t i = 0; i < count; i++) spare[fill[SLOT(items[i].hash, depth)]++] = items[i];
+
+        bulk_job_t jobs[TRIE_FANOUT];
+        int njobs = 0;
+
+        for(int s = 0; s < TRIE_FANOUT; s++) {
+                pending_t * bucket = spare + start[s];
+                size_t k = start[s + 1] - start[s];
+                if(k == 0) continue;
+
+                if(copy->child[s] == NULL && depth == TRIE_LEVELS - 1) {
+                        for(size_t j = 0; j < k; j++) {
+                                int a;
+                                symbol_t * old = copy->entry[s];
+                                __atomic_add_fetch(&bucket[j].symbol->refs, 1, __ATOMIC_RELAXED);
+                                copy->entry[s] = replace_in_chain(old, bucket[j].symbol, &a);
+                                release_symbol(old);
+                                *added += a;
+                        }
+                        continue;
+                }
+
+                trie_node_t * child = copy->child[s];
+                if(child == NULL) {
+                        // a single name (however often repeated) fits in the slot
+                        symbol_t * last = bucket[k - 1].symbol;
+                        symbol_t * old = copy->entry[s];
+                        size_t j = 0;
+                        while(j < k - 1 && bucket[j].symbol->var_name == last->var_name) j++;
+
+                        if(j == k - 1 && (old == NULL || old->var_name == last->var_name)) {
+                                __atomic_add_fetch(&last->refs, 1, __ATOMIC_RELAXED);
+                                copy->entry[s] = last;
+                                release_symbol(old);
+                                *added += old == NULL;
+                                continue;
+                        }
+
+                        // otherwise push the resident symbol down a level first
+                        if((child = copy_node(NULL)) == NULL) {
+                                release_node(copy);
+                                return NULL;
+                        }
+                        if(old) child->entry[SLOT(intern_hash(old->var_name), depth + 1)] = old;
+                        copy->entry[s] = NULL;
+                        copy->child[s] = child;
+                }
+
+                jobs[njobs++] = (bulk_job_t){ child, depth + 1, bucket, items + start[s], k, 0, NULL };
+        }
+
+        pthread_t threads[TRIE_FANOUT];
+        int spawned[TRIE_FANOUT] = {0};
+        for(int i = 0; i < njobs; i++) {
+                if(depth == 0 && count >= SYMTAB_BULK_PARALLEL && i < njobs - 1)
+                        spawned[i] = pthread_create(&threads[i], NULL, run_bulk_job, &jobs[i]) == 0;
+                if(!spawned[i]) run_bulk_job(&jobs[i]);
+        }
+
+        int failed = 0;
+        for(int i = 0; i < njobs; i++) {
+                if(spawned[i]) pthread_join(threads[i], NULL);
+
+                int s = SLOT(jobs[i].items[0].hash, depth);
+                release_node(copy->child[s]);
+                copy->child[s] = jobs[i].result;
+                if(jobs[i].result == NULL) failed = 1;
+                *added += jobs[i].added;
+        }
+
+        if(failed) {
+                release_node(copy);
+                return NULL;
+        }
+        return copy;
+}
+
+/**
+ * Finds a symbol in a version of the table.
+ *
+ * @param root: A pointer to the root of the version's trie
+ * @param variable: The handle of the variable name
+ * @return: A pointer to the symbol if found, NULL if not found
+ */
+static symbol_t * find(trie_node_t * root, const char * variable) {
+        unsigned int hash = intern_hash(variable);
+        trie_node_t * node = root;
+
+        for(int depth = 0; node != NULL; depth++) {
+                int slot = SLOT(hash, depth);
+                if(node->child[slot] != NULL) {
+                        node = node->child[slot];
+                        continue;
+                }
+                for(symbol_t * curr = node->entry[slot]; curr != NULL; curr = curr->next) {
+                        if(curr->var_name == variable) return curr;
+                }
+                return NULL;
+        }
+        return NULL;
+}
+
+/**
+ * Frees the nodes of every version readers have retired and recycles
+ * their records. Must be called with the table's write_lock held.
+ *
+ * @param table: A pointer to the table
+ */
+static void reclaim(symtab_t * table) {
+        symtab_snapshot_t * version = atomic_exchange_explicit(&table->retired, NULL, memory_order_acquire);
+
+        while(version != NULL) {
+                symtab_snapshot_t * nxt = version->next_free;
+                release_node(version->root);
+                version->root = NULL;
+                version->next_free = table->free_versions;
+                table->free_versions = version;
+                version = nxt;
+        }
+}
+
+/**
+ * Makes a version record current, and reclaims the versions readers have
+ * retired. Must be called with the table's write_lock held.
+ *
+ * @param table: A pointer to the table
+ * @param root: A pointer to the root of the new version's trie
+ * @param size: The number of symbols in the new version
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+static int publish(symtab_t * table, trie_node_t * root, int size) {
+        reclaim(table);
+        symtab_snapshot_t * version = table->free_versions;
+
+        if(version) {
+                table->free_versions = version->next_free;
+        } else if((version = malloc(sizeof(symtab_snapshot_t))) == NULL) {
+                perror("Failed to allocate symbol table version");
+                return -1;
+        }
+
+        // the record may still be seen through stale pointers, but nobody
+        // can pin it until its count leaves zero
+        version->root = root;
+        version->size = size;
+        version->next_free = NULL;
+        version->table = table;
+        atomic_store_explicit(&version->refs, 1, memory_order_release);
+
+        symtab_snapshot_t * old = atomic_exchange_explicit(&table->current, version, memory_order_acq_rel);
+        if(old && atomic_fetch_sub_explicit(&old->refs, 1, memory_order_acq_rel) == 1) {
+                release_node(old->root);
+                old->root = NULL;
+                old->next_free = table->free_versions;
+                table->free_versions = old;
+        }
+        return 0;
+}
+
+/**
+ * Inserts a symbol into the current version and publishes the result.
+ *
+ * @param table: A pointer to the table
+ * @param symbol: A pointer to the symbol, owned by the table afterwards
+ * @param must_exist: If set, only replace an existing symbol
+ * @return: The symbol, or NULL if it could not be inserted
+ */
+static symbol_t * write_symbol(symtab_t * table, symbol_t * symbol, int must_exist) {
+        pthread_mutex_lock(&table->write_lock);
+
+        symtab_snapshot_t * cur = atomic_load_explicit(&table->current, memory_order_relaxed);
+        trie_node_t * root = cur ? cur->root : NULL;
+        int size = cur ? cur->size : 0;
+
+        if(must_exist && find(root, symbol->var_name) == NULL) {
+                pthread_mutex_unlock(&table->write_lock);
+                release_symbol(symbol);
+                return NULL;
+        }
+
+        int added = 0;
+        symbol->version = atomic_fetch_add(&write_clock, 1) + 1;
+        trie_node_t * nroot = insert(root, 0, intern_hash(symbol->var_name), symbol, &added);
+        if(!nroot || publish(table, nroot, size + added) < 0) {
+                pthread_mutex_unlock(&table->write_lock);
+                release_node(nroot);
+                return NULL;
+        }
+
+        if(table->write_hook) table->write_hook(symbol->var_name, symbol->val);
+        pthread_mutex_unlock(&table->write_lock);
         return symbol;
 }
 
 /**
- * Adds a new symbol to the symbol table.
+ * Creates an empty symbol table, separate from every other table.
  *
+ * @return: A pointer to the table, or NULL if memory allocation fails
+ */
+symtab_t * make_table(void) {
+        symtab_t * table = calloc(1, sizeof(symtab_t));
+
+        if(!table) {
+                perror("Failed to create symbol table");
+                return NULL;
+        }
+
+        atomic_init(&table->current, NULL);
+        pthread_mutex_init(&table->write_lock, NULL);
+        return table;
+}
+
+/**
+ * Returns the process-wide table, which the functions without a table
+ * argument use.
+ *
+ * @return: A pointer to the table, never NULL
+ */
+symtab_t * default_table(void) {
+        return &global;
+}
+
+/**
+ * Installs a function to be called after every addition or assignment to
+ * a table. The hook runs while writers are serialized, so it sees the
+ * writes in exactly the order their versions were published. It must not
+ * write to the table itself.
+ *
+ * @param table: A pointer to the table
+ * @param hook: The function to call, or NULL to remove the hook
+ */
+void symtab_set_hook(symtab_t * table, write_hook_t hook) {
+        pthread_mutex_lock(&table->write_lock);
+        table->write_hook = hook;
+        pthread_mutex_unlock(&table->write_lock);
+}
+
+/**
+ * Installs a write hook on the process-wide table, see symtab_set_hook().
+ *
+ * @param hook: The function to call, or NULL to remove the hook
+ */
+void set_write_hook(write_hook_t hook) {
+        symtab_set_hook(&global, hook);
+}
+
+/**
+ * Adds a new symbol to a table, replacing any symbol with the same name.
+ * The returned symbol belongs to the table and is only valid until the
+ * next write, unless the caller holds a snapshot containing it.
+ *
+ * @param table: A pointer to the table
  * @param name: A pointer to the variable name (string)
  * @param val: Initial value of the variable
  * @return: A pointer to the added symbol, or NULL if creation fails
  */
-symbol_t * add_symbol(char * name, int val) {
+symbol_t * symtab_add(symtab_t * table, const char * name, value_t val) {
         symbol_t * symbol = create_symbol(name, val);
 
         if(!symbol) return NULL;
 
-        symbol->next = symbol_table;
-        symbol_table = symbol;
-        size++;
-        return symbol;
+        return write_symbol(table, symbol, 0);
+}
+
+/**
+ * Adds a new symbol to the process-wide table, see symtab_add().
+ *
+ * @param name: A pointer to the variable name (string)
+ * @param val: Initial value of the variable
+ * @return: A pointer to the added symbol, or NULL if creation fails
+ */
+symbol_t * add_symbol(const char * name, value_t val) {
+        return symtab_add(&global, name, val);
+}
+
+/**
+ * Assigns a new value to an existing symbol of a table. Snapshots taken
+ * before the assignment keep seeing the old value.
+ *
+ * @param table: A pointer to the table
+ * @param name: A pointer to the variable name (string)
+ * @param val: The value to assign
+ * @return: A pointer to the assigned symbol, or NULL if it is not defined
+ */
+symbol_t * symtab_assign(symtab_t * table, const char * name, value_t val) {
+        symbol_t * symbol = create_symbol(name, val);
+
+        if(!symbol) return NULL;
+
+        return write_symbol(table, symbol, 1);
+}
+
+/**
+ * Assigns a new value to an existing symbol of the process-wide table,
+ * see symtab_assign().
+ *
+ * @param name: A pointer to the variable name (string)
+ * @param val: The value to assign
+ * @return: A pointer to the assigned symbol, or NULL if it is not defined
+ */
+symbol_t * assign_symbol(const char * name, value_t val) {
+        return symtab_assign(&global, name, val);
+}
+
+/**
+ * Adds many symbols to a table at once, as if by symtab_add() in order, so
+ * a later symbol replaces an earlier one of the same name. Only one
+ * version is published, and every trie node is built once instead of
+ * being copied for each symbol.
+ *
+ * @param table: A pointer to the table
+ * @param symbols: The symbols to add, from create_symbol(); the table
+ *      takes them over whether or not the call succeeds
+ * @param count: The number of symbols
+ * @return: 0 on success, -1 if memory allocation fails, in which case the
+ *      table is unchanged
+ */
+int symtab_add_many(symtab_t * table, symbol_t ** symbols, size_t count) {
+        if(count == 0) return 0;
+
+        pending_t * items = malloc(2 * count * sizeof(pending_t));
+        if(!items) {
+                perror("Failed to allocate symbols");
+                for(size_t i = 0; i < count; i++) release_symbol(symbols[i]);
+                return -1;
+        }
+
+        for(size_t i = 0; i < count; i++) {
+                items[i].hash = intern_hash(symbols[i]->var_name);
+                items[i].symbol = symbols[i];
+        }
+
+        pthread_mutex_lock(&table->write_lock);
+
+        unsigned long first = atomic_fetch_add(&write_clock, count) + 1;
+        for(size_t i = 0; i < count; i++) symbols[i]->version = first + i;
+
+        symtab_snapshot_t * cur = atomic_load_explicit(&table->current, memory_order_relaxed);
+        int added = 0, rc = 0;
+        trie_node_t * nroot = insert_many(cur ? cur->root : NULL, 0, items, items + count, count, &added);
+
+        if(!nroot || publish(table, nroot, (cur ? cur->size : 0) + added) < 0) {
+                release_node(nroot);
+                rc = -1;
+        } else if(table->write_hook) {
+                for(size_t i = 0; i < count; i++) table->write_hook(symbols[i]->var_name, symbols[i]->val);
+        }
+        pthread_mutex_unlock(&table->write_lock);
+
+        // the trie retained what it kept; this frees the replaced symbols
+        for(size_t i = 0; i < count; i++) release_symbol(symbols[i]);
+        free(items);
+        return rc;
 }
 
 /**
- * Builds the symbol table from a file
+ * Adds many symbols to the process-wide table at once, see
+ * symtab_add_many().
+ *
+ * @param symbols: The symbols to add, from create_symbol()
+ * @param count: The number of symbols
+ * @return: 0 on success, -1 if memory allocation fails
+ */
+int add_symbols(symbol_t ** symbols, size_t count) {
+        return symtab_add_many(&global, symbols, count);
+}
+
+/**
+ * Reads the value of a symbol.
+ *
+ * @param symbol: A pointer to the symbol
+ * @return: The value of the symbol
+ */
+value_t symbol_value(symbol_t * symbol) {
+        return symbol->val;
+}
+
+/**
+ * Reads the version of a symbol. Every addition and assignment, to any
+ * table, stamps the symbol it writes with a new, larger version, so two
+ * lookups of a name that return the same version saw the same write.
+ *
+ * @param symbol: A pointer to the symbol
+ * @return: The version of the symbol
+ */
+unsigned long symbol_version(symbol_t * symbol) {
+        return symbol->version;
+}
+
+/**
+ * Pins the current version of a table. Lookups through the snapshot see
+ * this version until it is unpinned. Never blocks.
+ *
+ * @param table: A pointer to the table
+ * @return: A pointer to the snapshot, to be released with unpin_table(),
+ *      or NULL if the table is empty
+ */
+symtab_snapshot_t * symtab_pin(symtab_t * table) {
+        while(1) {
+                symtab_snapshot_t * version = atomic_load_explicit(&table->current, memory_order_acquire);
+                if(version == NULL) return NULL;
+
+                long refs = atomic_load_explicit(&version->refs, memory_order_relaxed);
+                while(refs > 0 && !atomic_compare_exchange_weak_explicit(&version->refs, &refs, refs + 1,
+                                        memory_order_acq_rel, memory_order_relaxed));
+                if(refs == 0) continue;
+
+                if(atomic_load_explicit(&table->current, memory_order_acquire) == version) return version;
+                unpin_table(version);
+        }
+}
+
+/**
+ * Pins the current version of the process-wide table, see symtab_pin().
+ *
+ * @return: A pointer to the snapshot, to be released with unpin_table()
+ */
+symtab_snapshot_t * pin_table(void) {
+        return symtab_pin(&global);
+}
+
+/**
+ * Releases a snapshot taken with symtab_pin() or pin_table(). Never
+ * blocks: a version that is neither current nor pinned anymore is put on
+ * the table's retire list, and reclaimed by the next writer.
+ *
+ * @param snap: A pointer to the snapshot, may be NULL
+ */
+void unpin_table(symtab_snapshot_t * snap) {
+        if(snap == NULL || atomic_fetch_sub_explicit(&snap->refs, 1, memory_order_acq_rel) != 1) return;
+
+        // only writers take the list, and they take all of it, so a push
+        // cannot be confused by a record leaving and coming back
+        symtab_t * table = snap->table;
+        snap->next_free = atomic_load_explicit(&table->retired, memory_order_relaxed);
+        while(!atomic_compare_exchange_weak_explicit(&table->retired, &snap->next_free, snap,
+                                memory_order_release, memory_order_relaxed));
+}
+
+/**
+ * Looks up a variable in a snapshot of the symbol table by name.
+ *
+ * @param snap: A pointer to the snapshot, may be NULL for an empty table
+ * @param variable: A pointer to the variable name(string)
+ * @return: A pointer to the symbol if found, NULL if not found. The
+ *      symbol stays valid while the snapshot is pinned
+ */
+symbol_t * lookup_snapshot(symtab_snapshot_t * snap, const char * variable) {
+        // a name that was never interned was never given to a symbol
+        const char * name = snap ? intern_find(variable) : NULL;
+
+        return name ? find(snap->root, name) : NULL;
+}
+
+/**
+ * Looks up a variable by its interned name, as the evaluators do with
+ * the tokens of a tree. Skips the pool lookup of lookup_snapshot().
+ *
+ * @param snap: A pointer to the snapshot, may be NULL for an empty table
+ * @param name: The handle of the variable name, see intern()
+ * @return: A pointer to the symbol if found, NULL if not found. The
+ *      symbol stays valid while the snapshot is pinned
+ */
+symbol_t * lookup_interned(symtab_snapshot_t * snap, const char * name) {
+        return snap ? find(snap->root, name) : NULL;
+}
+
+/**
+ * Calls a function for every symbol below a trie node.
+ *
+ * @param node: A pointer to the node, may be NULL
+ * @param visit: The function to call
+ * @param arg: An argument passed through to visit
+ */
+static void walk_node(trie_node_t * node, void (*visit)(symbol_t *, void *), void * arg) {
+        if(node == NULL) return;
+
+        for(int i = 0; i < TRIE_FANOUT; i++) {
+                walk_node(node->child[i], visit, arg);
+                for(symbol_t * curr = node->entry[i]; curr != NULL; curr = curr->next) visit(curr, arg);
+        }
+}
+
+/**
+ * Calls a function for every symbol in a snapshot of the symbol table.
+ *
+ * @param snap: A pointer to the snapshot, may be NULL for an empty table
+ * @param visit: The function to call with each symbol
+ * @param arg: An argument passed through to visit
+ */
+void walk_snapshot(symtab_snapshot_t * snap, void (*visit)(symbol_t *, void *), void * arg) {
+        if(snap) walk_node(snap->root, visit, arg);
+}
+
+/**
+ * Builds the process-wide symbol table from a file
  *
  * @param filename: A pointer to the name of the file containing symbols
  */
 void build_table(char * filename) {
         if(filename == NULL) {
-                symbol_table = NULL;
-                size = 0;
+                free_table();
                 return;
         }
 
@@ -83,54 +835,117 @@ void build_table(char * filename) {
         }
 
         char name[BUFLEN];
-        int val;
-        while(fscanf(file, "%*s %s %d", name, &val) == 2) {
+        value_t val;
+        while(fscanf(file, "%*s %s " VALUE_SCN, name, &val) == 2) {
                 add_symbol(name, val);
         }
         fclose(file);
 }
 
 /**
- * Dumps the contents of the symbol table to standard output
+ * Prints one symbol for symtab_dump().
+ *
+ * @param symbol: A pointer to the symbol
+ * @param arg: Unused
  */
-void dump_table(void) {
+static void dump_symbol(symbol_t * symbol, void * arg) {
+        char text[sizeof(", Value: ") + VALUE_TEXT_MAX + 1] = ", Value: ";
+        size_t len = sizeof(", Value: ") - 1;
+
+        (void)arg;
+        len += value_format(symbol->val, text + len);
+        text[len++] = '\n';
+
+        fputs("\tName: ", stdout);
+        fputs(symbol->var_name, stdout);
+        fwrite(text, 1, len, stdout);
+}
+
+/**
+ * Dumps the contents of a table to standard output
+ *
+ * @param table: A pointer to the table
+ */
+void symtab_dump(symtab_t * table) {
         printf("SYMBOL TABLE:\n");
 
-        for(symbol_t * curr = symbol_table; curr != NULL; curr = curr->next) {
-                printf("\tName: %s, Value: %d\n", curr->var_name, curr->val);
-        }
+        symtab_snapshot_t * snap = symtab_pin(table);
+        walk_snapshot(snap, dump_symbol, NULL);
+        unpin_table(snap);
+}
+
+/**
+ * Dumps the contents of the process-wide table to standard output
+ */
+void dump_table(void) {
+        symtab_dump(&global);
 }
 
 /**
- * Looks up a variable in the symbol table by name
+ * Looks up a variable in the current version of the process-wide table
+ * by name. The symbol is copied while its version is pinned, since a
+ * concurrent write may free the version as soon as it is unpinned; the
+ * copy belongs to the calling thread and is overwritten by its next call.
+ * Callers that need several lookups to agree should pin a snapshot and
+ * use lookup_snapshot().
  *
  * @param variable: A pointer to the variable name(string)
- * @return: A pointer to the symbol if found, NULL if not found
+ * @return: A pointer to the copy of the symbol if found, NULL if not found
  */
-symbol_t * lookup_table(char * variable) {
-        for(symbol_t * curr = symbol_table; curr != NULL; curr = curr->next) {
-                if(strcmp(curr->var_name, variable) == 0) return curr;
-        }
+symbol_t * lookup_table(const char * variable) {
+        static _Thread_local symbol_t found;
+        symtab_snapshot_t * snap = pin_table();
+        symbol_t * symbol = lookup_snapshot(snap, variable);
 
-        return NULL;
+        // the reference count is the writers', so it is not copied
+        if(symbol) {
+                found.var_name = symbol->var_name;
+                found.val = symbol->val;
+                found.version = symbol->version;
+                symbol = &found;
+        }
+        unpin_table(snap);
+        return symbol;
 }
 
 /**
- * Frees all memory associated with the symbol table
+ * Removes every symbol from a table and frees its versions. The table
+ * can be written to again afterwards.
+ *
+ * @param table: A pointer to the table
  */
-void free_table(void) {
-        symbol_t * curr = symbol_table;
+void symtab_clear(symtab_t * table) {
+        symtab_snapshot_t * version = atomic_exchange(&table->current, NULL);
+
+        if(version) {
+                release_node(version->root);
+                free(version);
+        }
+        reclaim(table);
 
-        while(curr != NULL) {
-                symbol_t * nxt = curr->next;
-                free(curr->var_name);
-                free(curr);
-                curr = nxt;
+        while(table->free_versions != NULL) {
+                symtab_snapshot_t * nxt = table->free_versions->next_free;
+                free(table->free_versions);
+                table->free_versions = nxt;
         }
+}
 
-        symbol_table = NULL;
-        size = 0;
+/**
+ * Frees all memory associated with the process-wide symbol table
+ */
+void free_table(void) {
+        symtab_clear(&global);
+}
+
+/**
+ * Frees a table made with make_table() and every symbol in it.
+ *
+ * @param table: A pointer to the table, may be NULL
+ */
+void destroy_table(symtab_t * table) {
+        if(table == NULL) return;
 
-        free(symbol_table);
-        symbol_table = NULL;
+        symtab_clear(table);
+        pthread_mutex_destroy(&table->write_lock);
+        free(table);
 }
@@ -0,0 +1,93 @@
+/**
+ * Interface for the symbol table, which maps variable names to their
+ * values, see value.h. The table is safe to use from several threads:
+ * lookups never block, while additions and assignments are serialized.
+ * Readers that need one consistent view of the table pin a snapshot of it.
+ * Besides the process-wide table the plain functions use, any number of
+ * independent tables can be made with make_table().
+ *
+ * @file        symtab.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <stddef.h>
+#include "value.h"
+
+#define BUFLEN 1024
+#define SYMTAB_BULK_PARALLEL 65536 /// Smallest add_symbols() batch built on several threads
+
+/// A variable and its value in one version of the symbol table
+typedef struct symbol_s {
+        const char * var_name; /// Name of the variable, interned (see intern.h)
+        value_t val; /// Value of the variable in this version
+        struct symbol_s * next; /// Next symbol whose name hashes the same
+        int refs; /// Number of table nodes (or chains) holding the symbol
+        unsigned long version; /// Write that gave the symbol this value, see symbol_version()
+} symbol_t;
+
+/// An independent symbol table, see make_table()
+typedef struct symtab_s symtab_t;
+
+/// A pinned, immutable version of the symbol table
+typedef struct symtab_snapshot_s symtab_snapshot_t;
+
+/// Observer of every addition and assignment, see set_write_hook()
+typedef void (*write_hook_t)(const char * name, value_t val);
+
+symbol_t * create_symbol(const char * name, value_t val);
+
+symbol_t * create_symbol_len(const char * name, size_t len, value_t val);
+
+symbol_t * add_symbol(const char * name, value_t val);
+
+symbol_t * assign_symbol(const char * name, value_t val);
+
+int add_symbols(symbol_t ** symbols, size_t count);
+
+value_t symbol_value(symbol_t * symbol);
+
+unsigned long symbol_version(symbol_t * symbol);
+
+symtab_snapshot_t * pin_table(void);
+
+void unpin_table(symtab_snapshot_t * snap);
+
+symbol_t * lookup_snapshot(symtab_snapshot_t * snap, const char * variable);
+
+symbol_t * lookup_interned(symtab_snapshot_t * snap, const char * name);
+
+void walk_snapshot(symtab_snapshot_t * snap, void (*visit)(symbol_t *, void *), void * arg);
+
+void set_write_hook(write_hook_t hook);
+
+void build_table(char * filename);
+
+void dump_table(void);
+
+symbol_t * lookup_table(const char * variable);
+
+void free_table(void);
+
+symtab_t * make_table(void);
+
+symtab_t * default_table(void);
+
+symbol_t * symtab_add(symtab_t * table, const char * name, value_t val);
+
+symbol_t * symtab_assign(symtab_t * table, const char * name, value_t val);
+
+int symtab_add_many(symtab_t * table, symbol_t ** symbols, size_t count);
+
+symtab_snapshot_t * symtab_pin(symtab_t * table);
+
+void symtab_set_hook(symtab_t * table, write_hook_t hook);
+
+void symtab_dump(symtab_t * table);
+
+void symtab_clear(symtab_t * table);
+
+void destroy_table(symtab_t * table);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * Test and benchmark for compiled expression artifacts. Compiles a large
+ * expression file, and checks that every tree rebuilt from the artifact
+ * is the tree the reader builds from the same line, with the same line
+ * number, tokens, hash and result. Also checks that an artifact is
+ * refused once its source changes or its bytes are damaged, and that a
+ * file with a line that does not parse is not compiled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "artifact.h"
+#include "parser.h"
+#include "reader.h"
+#include "symtab.h"
+
+#define LINES 200000
+#define SOURCE "test_artifact.txt"
+#define PATH "test_artifact.bin"
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// writes a file of every kind of line the reader accepts
+void write_source(void) {
+        FILE * file = fopen(SOURCE, "w");
+        unsigned int seed = 11;
+
+        fprintf(file, "# generated expressions\n\n");
+        for(int i = 0; i < LINES; i++) {
+                int a = rand_r(&seed) % 1000, b = rand_r(&seed) % 1000 + 1;
+                switch(i % 6) {
+                        case 0: fprintf(file, "x %d + y *\n", a); break;
+                        case 1: fprintf(file, "  %d %d / x %% # comment\n", a, b); break;
+                        case 2: fprintf(file, "x %d - %d -%d ?\n", a, b, a); break;
+                        case 3: fprintf(file, "v%d %d x + =\n", a % 50, b); break;
+                        case 4: fprintf(file, "\n"); break;
+                        case 5: fprintf(file, "99999999999999999999 %d - 99999999999999999000 - y *\n", a); break;
+                }
+        }
+        fclose(file);
+}
+
+void test_compile(void) {
+        write_source();
+        add_symbol("x", 3);
+        add_symbol("y", 7);
+        for(int i = 0; i < 50; i++) {
+                char name[8];
+                snprintf(name, sizeof(name), "v%d", i);
+                add_symbol(name, i);
+        }
+
+        double start = now_ms();
+        int rc = artifact_compile(SOURCE, PATH);
+        double compile_ms = now_ms() - start;
+
+        artifact_t * art = rc == 0 ? artifact_open(PATH, SOURCE) : NULL;
+        if(!art) {
+                printf("Test Failed: could not compile or open the artifact\n");
+                return;
+        }
+
+        // rebuilding alone, then parsing alone, for comparison
+        size_t count = artifact_count(art);
+        start = now_ms();
+        for(size_t i = 0; i < count; i++) cleanup_tree(artifact_tree(art, i, NULL, NULL));
+        double rebuild_ms = now_ms() - start;
+
+        FILE * in = fopen(SOURCE, "r");
+        reader_t * reader = make_reader(in);
+        tree_node_t * tree;
+        start = now_ms();
+        while(read_tree(reader, &tree) != READ_END) cleanup_tree(tree);
+        double parse_ms = now_ms() - start;
+        free_reader(reader);
+
+        rewind(in);
+        reader = make_reader(in);
+        size_t index = 0;
+        int wrong = 0;
+        char expected[256], got[256];
+        read_status_t status;
+        while((status = read_tree(reader, &tree)) != READ_END) {
+                if(status == READ_BLANK) continue;
+
+                unsigned long line;
+                const char * head;
+                tree_node_t * built = index < count ? artifact_tree(art, index++, &line, &head) : NULL;
+                if(!tree || !built) {
+                        wrong++;
+                        cleanup_tree(tree);
+                        cleanup_tree(built);
+                        continue;
+                }
+
+                format_infix(tree, expected, sizeof(expected));
+                format_infix(built, got, sizeof(got));
+                eval_error_t err1, err2;
+                value_t v1 = eval_tree_status(tree, &err1), v2 = eval_tree_status(built, &err2);
+
+                // names are shared with the parsed tree, literals are copied
+                tree_node_t * left = built->type == INTERIOR ? ((interior_node_t *)built->node)->left : NULL;
+                int shared = !left || left->type != LEAF || ((leaf_node_t *)left->node)->exp_type != SYMBOL ||
+                        left->token == ((interior_node_t *)tree->node)->left->token;
+                wrong += line != reader->lineno || strcmp(head, reader->head) != 0 || strcmp(expected, got) != 0 ||
+                        built->hash != tree->hash || built->size != tree->size || built->pure != tree->pure ||
+                        built->token != tree->token || !shared || v1 != v2 || err1 != err2;
+                cleanup_tree(tree);
+                cleanup_tree(built);
+        }
+        wrong += index != count || artifact_lines(art) != reader->lineno;
+        free_reader(reader);
+        fclose(in);
+        artifact_close(art);
+
+        printf("compiled %zu expressions in %.1f ms; rebuilt in %.1f ms, parsed in %.1f ms\n",
+                        count, compile_ms, rebuild_ms, parse_ms);
+        if(wrong == 0) printf("Test Successful: every rebuilt tree matches the parsed one\n");
+        else printf("Test Failed: %d trees differ\n", wrong);
+        free_table();
+}
+
+// opens and closes the artifact
+int opens(const char * source) {
+        artifact_t * art = artifact_open(PATH, source);
+        artifact_close(art);
+        return art != NULL;
+}
+
+void test_refused(void) {
+        int wrong = !opens(SOURCE);
+
+        // damage one byte in the middle, then put it back
+        FILE * file = fopen(PATH, "r+b");
+        fseek(file, 0, SEEK_END);
+        long middle = ftell(file) / 2;
+        fseek(file, middle, SEEK_SET);
+        int c = fgetc(file);
+        fseek(file, middle, SEEK_SET);
+        fputc(c ^ 0x20, file);
+        fflush(file);
+        wrong += opens(SOURCE);
+        fseek(file, middle, SEEK_SET);
+        fputc(c, file);
+        fclose(file);
+        wrong += !opens(NULL);
+
+        // change the source by one line
+        file = fopen(SOURCE, "a");
+        fprintf(file, "1 2 +\n");
+        fclose(file);
+        wrong += opens(SOURCE);
+
+        // a line that does not parse stops compiling
+        file = fopen(SOURCE, "a");
+        fprintf(file, "1 +\n");
+        fclose(file);
+        wrong += artifact_compile(SOURCE, PATH) == 0;
+
+        if(wrong == 0) printf("Test Successful: damaged, stale and invalid artifacts refused\n");
+        else printf("Test Failed: %d artifacts accepted\n", wrong);
+        remove(SOURCE);
+        remove(PATH);
+}
+
+int main() {
+        test_compile();
+        test_refused();
+        return 0;
+}
@@ -0,0 +1,199 @@
+/**
+ * Test for exact arithmetic past the range of a value. Random bignum sums,
+ * differences, products, quotients and remainders are checked against
+ * 128-bit integers and their text against printf's. Then expressions
+ * whose intermediate results overflow are evaluated by walking the tree
+ * and by running their compiled programs, which must agree on every exact
+ * result and report an overflow for every result that does not fit.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bignum.h"
+#include "parser.h"
+#include "tier.h"
+#include "diag.h"
+
+#define ROUNDS 100000
+
+static int failures = 0;
+
+// keeps the overflow reports out of the output
+void drop(const char * msg, void * arg) {
+        (void)msg;
+        (void)arg;
+}
+
+// printf() has no 128-bit conversion, so the digits come out in two halves
+void format_wide(__int128 val, char * buf) {
+        unsigned __int128 mag = val < 0 ? -(unsigned __int128)val : (unsigned __int128)val;
+        const unsigned long long split = 1000000000000000000ull;
+
+        if(mag < split) sprintf(buf, "%s%llu", val < 0 ? "-" : "", (unsigned long long)mag);
+        else if(mag / split < split) {
+                sprintf(buf, "%s%llu%018llu", val < 0 ? "-" : "",
+                                (unsigned long long)(mag / split), (unsigned long long)(mag % split));
+        } else {
+                sprintf(buf, "%s%llu%018llu%018llu", val < 0 ? "-" : "", (unsigned long long)(mag / split / split),
+                                (unsigned long long)(mag / split % split), (unsigned long long)(mag % split));
+        }
+}
+
+// a random number of up to 62 bits, so products fit in 128 bits
+__int128 random_wide(unsigned int * seed) {
+        int bits = rand_r(seed) % 63;
+        __int128 val = ((__int128)rand_r(seed) << 31 | rand_r(seed)) << 31 | rand_r(seed);
+        val &= ((__int128)1 << bits) - 1;
+        return rand_r(seed) % 2 ? -val : val;
+}
+
+bignum_t * to_big(__int128 val) {
+        char text[64];
+        format_wide(val, text);
+        return big_parse(text, strlen(text));
+}
+
+void check(bignum_t * got, __int128 want, const char * what) {
+        char text[64], expected[64];
+        format_wide(want, expected);
+        big_format(got, text, sizeof(text));
+        if(strcmp(text, expected) != 0 && failures++ < 10) printf("%s gave %s, not %s\n", what, text, expected);
+        big_free(got);
+}
+
+void test_operations(void) {
+        unsigned int seed = 5;
+
+        for(int round = 0; round < ROUNDS; round++) {
+                __int128 x = random_wide(&seed) * (rand_r(&seed) % 2 ? random_wide(&seed) : 1);
+                __int128 y = random_wide(&seed);
+                bignum_t * a = to_big(x), * b = to_big(y), * q, * r;
+
+                check(big_add(a, b), x + y, "sum");
+                check(big_sub(a, b), x - y, "difference");
+                check(big_mul(b, b), y * y, "product");
+                if(y != 0 && big_divmod(a, b, &q, &r) == 0) {
+                        check(q, x / y, "quotient");
+                        check(r, x % y, "remainder");
+                }
+                big_free(a);
+                big_free(b);
+        }
+
+        // every machine integer goes through and comes back unchanged
+        long long edges[] = { 0, 1, -1, 4294967295ll, 4294967296ll, -4294967296ll, 9223372036854775807ll, -9223372036854775807ll - 1 };
+        for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+                char text[32], expected[32];
+                long long back = 0;
+                bignum_t * big = big_from_long(edges[i]);
+
+                big_format(big, text, sizeof(text));
+                snprintf(expected, sizeof(expected), "%lld", edges[i]);
+                if((strcmp(text, expected) != 0 || big_to_long(big, -9223372036854775807ll - 1, 9223372036854775807ll, &back) != 0 || back != edges[i]) && failures++ < 10) {
+                        printf("%s came back as %s (%lld)\n", expected, text, back);
+                }
+                big_free(big);
+        }
+
+        if(failures == 0) printf("Test Successful: %d rounds of bignum operations\n", ROUNDS);
+        else printf("Test Failed: %d wrong bignum results\n", failures);
+}
+
+#ifndef VALUE_DOUBLE
+// a postfix expression over literals near the edges of a value and a..c
+size_t random_text(char * buf, int depth, unsigned int * seed) {
+        const char * leaves[] = { "a", "b", "c", "2", "-1", "65536", "46341", "2147483647", "-2147483648",
+                "9223372036854775807", "-9223372036854775808", "99999999999999999999" };
+        const char * ops[] = { "+", "-", "*", "/", "%" };
+        size_t len;
+
+        if(depth <= 0 || rand_r(seed) % 4 == 0) return sprintf(buf, "%s", leaves[rand_r(seed) % 12]);
+        if(rand_r(seed) % 8 == 0) {
+                len = sprintf(buf, "%c ", "abc"[rand_r(seed) % 3]);
+                len += random_text(buf + len, depth - 1, seed);
+                return len + sprintf(buf + len, " =");
+        }
+        len = random_text(buf, depth - 1, seed);
+        buf[len++] = ' ';
+        len += random_text(buf + len, depth - 1, seed);
+        return len + sprintf(buf + len, " %s", ops[rand_r(seed) % 5]);
+}
+
+void test_evaluation(void) {
+        symtab_t * trees = make_table(), * progs = make_table();
+        const char * names[] = { "a", "b", "c" };
+        unsigned int seed = 9;
+        char text[4096];
+        int wrong = 0, overflows = 0;
+
+        for(int i = 0; i < 3; i++) {
+                symtab_add(trees, (char *)names[i], 1000 * (i + 1));
+                symtab_add(progs, (char *)names[i], 1000 * (i + 1));
+        }
+        set_diag_sink(drop, NULL);
+        for(int round = 0; round < ROUNDS / 10; round++) {
+                random_text(text, 1 + rand_r(&seed) % 5, &seed);
+                tree_node_t * tree = make_parse_tree(text);
+                if(!tree) continue;
+
+                code_t * code = compile_tree(tree);
+                eval_error_t e1, e2;
+                value_t r1 = eval_tree_in(trees, tree, &e1);
+                value_t r2 = code ? run_code(code, progs, &e2) : eval_tree_in(progs, tree, &e2);
+                overflows += e1 == EVAL_OVERFLOW;
+
+                if((r1 != r2 || e1 != e2) && wrong++ < 10) {
+                        printf("mismatch on '%s': " VALUE_FMT " (%d) and " VALUE_FMT " (%d)\n", text, r1, e1, r2, e2);
+                }
+                free_code(code);
+                cleanup_tree(tree);
+        }
+
+        // exact intermediates give exact results once they fit again
+        const char * exact[][2] = {
+                { "99999999999999999999 99999999999999999999 * 99999999999999999999 / 99999999999999999998 -", "1" },
+                { "99999999999999999999 99999999999999999998 -", "1" },
+                { "-2147483648 -1 * 2 /", "1073741824" },
+                { "-9223372036854775808 -1 * 8589934592 /", "1073741824" },
+                { "2147483647 2147483647 * 2147483647 % 1 +", "1" },
+        };
+        for(size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++) {
+                char line[128], got[64];
+                eval_error_t err;
+                snprintf(line, sizeof(line), "%s", exact[i][0]);
+                tree_node_t * tree = make_parse_tree(line);
+                snprintf(got, sizeof(got), VALUE_FMT, eval_tree_in(trees, tree, &err));
+                if((err != EVAL_OK || strcmp(got, exact[i][1]) != 0) && wrong++ < 10) printf("'%s' gave %s (%d)\n", exact[i][0], got, err);
+                cleanup_tree(tree);
+        }
+
+        // a value that does not fit is never stored
+        char line[] = "a 99999999999999999999 =";
+        symtab_snapshot_t * snap = symtab_pin(trees);
+        value_t kept = symbol_value(lookup_snapshot(snap, "a"));
+        unpin_table(snap);
+        eval_error_t err;
+        tree_node_t * tree = make_parse_tree(line);
+        eval_tree_in(trees, tree, &err);
+        snap = symtab_pin(trees);
+        if((err != EVAL_OVERFLOW || symbol_value(lookup_snapshot(snap, "a")) != kept) && wrong++ < 10) printf("out of range assignment gave %d\n", err);
+        unpin_table(snap);
+        cleanup_tree(tree);
+        set_diag_sink(NULL, NULL);
+
+        if(wrong == 0) printf("Test Successful: tree and program agree, %d overflows reported\n", overflows);
+        else printf("Test Failed: %d wrong evaluations\n", wrong);
+        destroy_table(trees);
+        destroy_table(progs);
+}
+#endif
+
+int main() {
+        printf("Testing bignum operations...\n");
+        test_operations();
+#ifndef VALUE_DOUBLE
+        printf("Testing exact evaluation...\n");
+        test_evaluation();
+#endif
+        return 0;
+}
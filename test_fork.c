@@ -0,0 +1,143 @@
+/**
+ * Test and benchmark for fork-join evaluation. Evaluates a large balanced
+ * tree sequentially and on pools of increasing size, checking that every
+ * pool gives the sequential result, that assignments still take effect
+ * in order around a parallel subtree, and that errors found in parallel
+ * are reported in the order sequential evaluation finds them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "parser.h"
+#include "symtab.h"
+#include "forkjoin.h"
+#include "diag.h"
+
+#define TREE_DEPTH 21
+#define MAX_THREADS 16
+#define ERROR_DEPTH 18
+#define ERROR_ROUNDS 20
+
+static int failures = 0;
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// a balanced tree of + and - over literals and symbols, so the result
+// stays small and every node is reached
+tree_node_t * balanced(int depth, unsigned int * seed) {
+        char tok[16];
+
+        if(depth == 0) {
+                if(rand_r(seed) % 2) {
+                        snprintf(tok, sizeof(tok), "%d", rand_r(seed) % 10);
+                        return make_leaf(INTEGER, tok);
+                }
+                snprintf(tok, sizeof(tok), "v%d", rand_r(seed) % 16);
+                return make_leaf(SYMBOL, tok);
+        }
+
+        tree_node_t * left = balanced(depth - 1, seed);
+        tree_node_t * right = balanced(depth - 1, seed);
+        return rand_r(seed) % 2 ? make_interior(ADD_OP, "+", left, right) : make_interior(SUB_OP, "-", left, right);
+}
+
+void test_speedup(tree_node_t * tree) {
+        double start = now_ms();
+        value_t expected = eval_tree(tree);
+        double base = now_ms() - start;
+
+        printf("sequential: %8.1f ms, %zu nodes\n", base, tree_size(tree));
+        for(int n = 2; n <= MAX_THREADS; n *= 2) {
+                start_workers(n);
+                start = now_ms();
+                value_t result = eval_tree(tree);
+                double ms = now_ms() - start;
+                stop_workers();
+
+                printf("%2d threads: %8.1f ms, %5.2fx\n", n, ms, base / ms);
+                if(result != expected) failures++;
+        }
+
+        if(failures == 0) printf("Test Successful: every pool gave " VALUE_FMT "\n", expected);
+        else printf("Test Failed: %d pools disagreed with " VALUE_FMT "\n", failures, expected);
+}
+
+void test_assignment(tree_node_t * tree) {
+        // (x = tree) + x must read the assigned value, not the old one
+        tree_node_t * assign = make_interior(ASSIGN_OP, "=", make_leaf(SYMBOL, "x"), tree);
+        tree_node_t * root = make_interior(ADD_OP, "+", assign, make_leaf(SYMBOL, "x"));
+
+        start_workers(4);
+        value_t expected = eval_tree(tree);
+        value_t result = eval_tree(root);
+        stop_workers();
+
+        if(!root->pure && result == 2 * expected) printf("Test Successful: assignment serialized, got " VALUE_FMT "\n", result);
+        else printf("Test Failed: expected " VALUE_FMT ", got " VALUE_FMT "\n", 2 * expected, result);
+        cleanup_tree(root);
+}
+
+// appends a reported error to a buffer; thieves may call it at once
+static pthread_mutex_t msgs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void keep_msgs(const char * msg, void * arg) {
+        pthread_mutex_lock(&msgs_lock);
+        strncat(arg, msg, 255 - strlen(arg));
+        pthread_mutex_unlock(&msgs_lock);
+}
+
+void test_error_order(void) {
+        unsigned int seed = 2;
+        char expected[256] = "", msgs[256];
+        int wrong = 0;
+
+        // the left operand fails last thing, the right one first thing
+        tree_node_t * left = make_interior(ADD_OP, "+", balanced(ERROR_DEPTH, &seed), make_leaf(SYMBOL, "late"));
+        tree_node_t * right = make_interior(ADD_OP, "+", make_leaf(SYMBOL, "early"), balanced(ERROR_DEPTH, &seed));
+        tree_node_t * root = make_interior(SUB_OP, "-", left, right);
+
+        set_diag_sink(keep_msgs, expected);
+        eval_tree(root);
+        start_workers(4);
+        for(int i = 0; i < ERROR_ROUNDS; i++) {
+                msgs[0] = '\0';
+                set_diag_sink(keep_msgs, msgs);
+                eval_tree(root);
+                if(strcmp(msgs, expected) != 0) wrong++;
+        }
+        stop_workers();
+        set_diag_sink(NULL, NULL);
+
+        if(wrong == 0) printf("Test Successful: errors reported in sequential order %d times\n", ERROR_ROUNDS);
+        else printf("Test Failed: errors reordered in %d of %d evaluations\n", wrong, ERROR_ROUNDS);
+        failures += wrong;
+        cleanup_tree(root);
+}
+
+int main() {
+        char name[16];
+        unsigned int seed = 1;
+
+        for(int i = 0; i < 16; i++) {
+                snprintf(name, sizeof(name), "v%d", i);
+                add_symbol(name, i);
+        }
+        add_symbol("x", -1);
+
+        tree_node_t * tree = balanced(TREE_DEPTH, &seed);
+        printf("Testing fork-join speedup...\n");
+        test_speedup(tree);
+        printf("Testing assignment around a parallel subtree...\n");
+        test_assignment(tree);
+        printf("Testing the order of errors found in parallel...\n");
+        test_error_order();
+
+        free_table();
+        return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * Test for the string interning pool. Names are interned from several
+ * threads at once, across many table resizes, and every thread must get
+ * the same handle for the same text. Names interned earlier must be
+ * found by intern_find(), which takes no lock, while other threads grow
+ * the pool, and names never interned must not be found. Then trees that repeat a few names many times must share one
+ * copy of each name with the symbol table.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "intern.h"
+#include "parser.h"
+#include "symtab.h"
+
+#define NAMES 50000
+#define THREADS 4
+
+static const char * handles[THREADS][NAMES];
+
+// interns every name, each thread starting at its own place
+void * intern_all(void * arg) {
+        long id = (long)arg;
+        char name[32];
+
+        for(long i = 0; i < NAMES; i++) {
+                long n = (i + id * NAMES / THREADS) % NAMES;
+                sprintf(name, "v%ld_%ld", n * 7919 % 100003, n);
+                handles[id][n] = intern(name);
+        }
+        return NULL;
+}
+
+void test_handles(void) {
+        pthread_t threads[THREADS];
+        size_t before = intern_count();
+        int wrong = 0;
+
+        for(long t = 0; t < THREADS; t++) pthread_create(&threads[t], NULL, intern_all, (void *)t);
+        for(long t = 0; t < THREADS; t++) pthread_join(threads[t], NULL);
+
+        for(long i = 0; i < NAMES; i++) {
+                char name[32];
+                sprintf(name, "v%ld_%ld", i * 7919 % 100003, i);
+
+                unsigned int hash = 2166136261u;
+                for(char * c = name; *c; c++) hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+                for(int t = 1; t < THREADS; t++) wrong += handles[t][i] != handles[0][i];
+                wrong += handles[0][i] == NULL || strcmp(handles[0][i], name) != 0;
+                wrong += intern_find(name) != handles[0][i] || intern_len(name, strlen(name)) != handles[0][i];
+                wrong += handles[0][i] && intern_hash(handles[0][i]) != hash;
+        }
+        wrong += intern_count() - before != NAMES;
+        wrong += intern_find("never_interned") != NULL || intern_count() - before != NAMES;
+        wrong += intern_len("abc", 2) != intern("ab");
+
+        if(wrong == 0) printf("Test Successful: %d threads got the same %d handles\n", THREADS, NAMES);
+        else printf("Test Failed: %d wrong handles\n", wrong);
+}
+
+// finds every name interned by test_handles(), over and over
+void * find_all(void * arg) {
+        long wrong = 0;
+        char name[32];
+
+        (void)arg;
+        for(int round = 0; round < 4; round++) {
+                for(long i = 0; i < NAMES; i += 7) {
+                        sprintf(name, "v%ld_%ld", i * 7919 % 100003, i);
+                        wrong += intern_find(name) != handles[0][i];
+
+                        // probes end in the slots the growers fill
+                        sprintf(name, "m%ld_%d", i, round);
+                        wrong += intern_find(name) != NULL;
+                }
+        }
+        return (void *)wrong;
+}
+
+// interns new names, growing every shard's table
+void * grow_all(void * arg) {
+        char name[32];
+
+        for(long i = 0; i < NAMES; i++) {
+                sprintf(name, "g%ld_%ld", (long)arg, i);
+                intern(name);
+        }
+        return NULL;
+}
+
+void test_find(void) {
+        pthread_t threads[THREADS];
+        long wrong = 0;
+
+        for(long t = 0; t < THREADS; t++) pthread_create(&threads[t], NULL, t % 2 ? grow_all : find_all, (void *)t);
+        for(long t = 0; t < THREADS; t++) {
+                void * found;
+                pthread_join(threads[t], &found);
+                if(t % 2 == 0) wrong += (long)found;
+        }
+
+        if(wrong == 0) printf("Test Successful: names found while the pool grew\n");
+        else printf("Test Failed: %ld names found wrongly while the pool grew\n", wrong);
+}
+
+void test_sharing(void) {
+        char text[64];
+        tree_node_t * trees[1000];
+        int wrong = 0;
+
+        add_symbol("alpha", 1);
+        add_symbol("beta", 2);
+        size_t before = 0;
+
+        // after the first tree, every name and operator is in the pool
+        for(int i = 0; i < 1000; i++) {
+                snprintf(text, sizeof(text), "alpha beta %d * 1 + =", i);
+                trees[i] = make_parse_tree(text);
+                if(i == 0) before = intern_count();
+        }
+
+        // the tokens of every tree and the symbol are the same copy
+        const char * name = lookup_table("alpha")->var_name;
+        for(int i = 0; i < 1000; i++) {
+                tree_node_t * target = ((interior_node_t *)trees[i]->node)->left;
+                wrong += trees[i] == NULL || target->token != name || eval_tree(trees[i]) != i * 2 + 1;
+                cleanup_tree(trees[i]);
+        }
+        wrong += intern_count() != before;
+        free_table();
+
+        if(wrong == 0) printf("Test Successful: 1000 trees share their names with the table\n");
+        else printf("Test Failed: %d trees with their own copies or results\n", wrong);
+}
+
+int main() {
+        printf("Testing interning from several threads...\n");
+        test_handles();
+        printf("Testing lookups while interning...\n");
+        test_find();
+        printf("Testing shared names...\n");
+        test_sharing();
+        return 0;
+}
@@ -0,0 +1,284 @@
+/**
+ * Test for the interpreter binary, which must be built as ./interp in the
+ * current directory. Runs it on a file that repeats a few expressions
+ * with tiering on, at the prompt and in the pipeline, and checks that the
+ * tier report on standard error shows them promoted and running their
+ * programs, and that the results are those of a run without tiering. Also
+ * checks that lines that do not parse report the same errors at the
+ * prompt and in the pipeline, and that the server answers a pipelining
+ * client in order, with error lines, and stops reading from a client that
+ * does not read its answers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define LINES 20000
+#define SYMBOLS "test_interp_sym.txt"
+#define INPUT "test_interp_in.txt"
+#define OUTPUT "test_interp_out.txt"
+#define ERRORS "test_interp_err.txt"
+#define SOCKET "test_interp.sock"
+#define REQUESTS 5000
+#define FLOOD (16 << 20)
+
+// reads a whole file into a string, to be freed by the caller
+char * slurp(const char * path) {
+        FILE * file = fopen(path, "r");
+        if(!file) return NULL;
+
+        fseek(file, 0, SEEK_END);
+        long len = ftell(file);
+        rewind(file);
+        char * text = malloc(len + 1);
+        if(text) text[fread(text, 1, len, file)] = '\0';
+        fclose(file);
+        return text;
+}
+
+// runs the interpreter on the input, keeping its output and errors
+int run(const char * flags) {
+        char command[256];
+        snprintf(command, sizeof(command), "./interp %s -o ndjson " SYMBOLS " < " INPUT " > " OUTPUT " 2> " ERRORS, flags);
+        return system(command);
+}
+
+void test_promotion(const char * flags, const char * plain) {
+        char tiered[64];
+        snprintf(tiered, sizeof(tiered), "-T 16%s%s", *flags ? " " : "", flags);
+
+        int rc = run(tiered);
+        char * out = slurp(OUTPUT), * err = slurp(ERRORS);
+        unsigned long hot = 0, tree = 0, code = 0, promoted = 0;
+        const char * report = err ? strstr(err, "tier: ") : NULL;
+
+        if(report) sscanf(report, "tier: hot after %lu runs; %lu tree runs (%*f ms), %lu code runs (%*f ms); %lu promoted",
+                        &hot, &tree, &code, &promoted);
+        if(rc == 0 && out && strcmp(out, plain) == 0 && hot == 16 && promoted == 3 && tree + code == LINES && code > 0) {
+                printf("Test Successful: '%s' promoted %lu expressions, %lu of %d runs compiled\n", tiered, promoted, code, LINES);
+        } else {
+                printf("Test Failed: '%s' reported '%.*s'\n", tiered, report ? (int)strcspn(report, "\n") : 0, report ? report : "");
+        }
+        free(out);
+        free(err);
+}
+
+void test_diagnostics(void) {
+        FILE * file = fopen(INPUT, "w");
+        fprintf(file, "1 2 ?\n   \n1 +\n+ 1 2\n1 2 3\n1 2 : ?\n1 $ +\n\t# comment\n1 2 +\r\n");
+
+        // long enough to be built on several threads, failing midway
+        for(int i = 0; i < 200000; i++) fprintf(file, "1 2 + ");
+        fprintf(file, "%% : 3 +\n");
+        for(int i = 0; i < 200000; i++) fprintf(file, "1 2 + ");
+        fprintf(file, "+ + 3 +\n");
+        fclose(file);
+
+        run("");
+        char * out = slurp(OUTPUT), * err = slurp(ERRORS);
+        run("-j 2");
+        char * jout = slurp(OUTPUT), * jerr = slurp(ERRORS);
+
+        if(out && err && jout && jerr && strcmp(out, jout) == 0 && strcmp(err, jerr) == 0 && *err) {
+                printf("Test Successful: the prompt and the pipeline report the same errors\n");
+        } else {
+                printf("Test Failed: the prompt reported\n%s\nthe pipeline reported\n%s\n", err ? err : "", jerr ? jerr : "");
+        }
+        free(out);
+        free(err);
+        free(jout);
+        free(jerr);
+}
+
+// connects to the server, waiting for it to start listening
+int connect_server(void) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, SOCKET);
+
+        for(int tries = 0; tries < 500; tries++) {
+                int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+                close(fd);
+                nanosleep(&(struct timespec){ 0, 10000000 }, NULL);
+        }
+        return -1;
+}
+
+// writes a whole buffer to a blocking socket
+int send_all(int fd, const char * buf, size_t len) {
+        while(len > 0) {
+                ssize_t n = write(fd, buf, len);
+                if(n < 0) return -1;
+                buf += n;
+                len -= n;
+        }
+        return 0;
+}
+
+// reads until the server hangs up, returning the answers
+char * read_all(int fd, size_t * len) {
+        size_t cap = 1 << 16;
+        char * text = malloc(cap);
+        *len = 0;
+        ssize_t n;
+        while(text && (n = read(fd, text + *len, cap - *len - 1)) > 0) {
+                *len += n;
+                if(cap - *len < 2 && !(text = realloc(text, cap *= 2))) break;
+        }
+        if(text) text[*len] = '\0';
+        return text;
+}
+
+// sends requests without waiting, checking every answer is in its place
+int test_pipelined(void) {
+        int fd = connect_server();
+        if(fd < 0) return -1;
+
+        size_t len = 0, cap = REQUESTS * 16 + 16;
+        char * requests = malloc(cap);
+        len += sprintf(requests, "1 +\n");
+        for(int i = 0; i < REQUESTS; i++) {
+                if(i % 5 == 4) len += sprintf(requests + len, "1 0 /\n");
+                else len += sprintf(requests + len, "%d 1 +\n", i);
+        }
+        int rc = send_all(fd, requests, len);
+        shutdown(fd, SHUT_WR);
+        free(requests);
+
+        char * answers = read_all(fd, &len);
+        close(fd);
+        if(rc < 0 || !answers) {
+                free(answers);
+                return -1;
+        }
+
+        int wrong = strncmp(answers, "1 + ! parse_error\t", 18) != 0;
+        char * line = strchr(answers, '\n');
+        for(int i = 0; i < REQUESTS && line; i++) {
+                line++;
+                char * value = strstr(line, " = ");
+                char * error = strstr(line, " ! division_by_zero\t");
+                char * end = strchr(line, '\n');
+                if(i % 5 == 4) wrong += !error || error > end;
+                else wrong += !value || value > end || strtod(value + 3, NULL) != i + 1;
+                line = end;
+        }
+        wrong += !line || line[1] != '\0';
+        free(answers);
+        return wrong;
+}
+
+// floods the server without reading, then reads every answer
+int test_flood(size_t * taken) {
+        int fd = connect_server();
+        if(fd < 0) return -1;
+
+        char * requests = malloc(FLOOD);
+        for(size_t i = 0; i < FLOOD; i += 6) memcpy(requests + i, "1 1 +\n", 6);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        // write until the server has stopped taking input for a while
+        size_t sent = 0;
+        for(int idle = 0; idle < 50 && sent < FLOOD; ) {
+                ssize_t n = write(fd, requests + sent, FLOOD - sent);
+                if(n > 0) {
+                        sent += n;
+                        idle = 0;
+                } else {
+                        idle++;
+                        nanosleep(&(struct timespec){ 0, 10000000 }, NULL);
+                }
+        }
+        *taken = sent;
+
+        // a last line cut short is answered all the same
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        shutdown(fd, SHUT_WR);
+        free(requests);
+
+        size_t len;
+        char * answers = read_all(fd, &len);
+        close(fd);
+
+        size_t lines = 0;
+        for(char * c = answers; c && (c = strchr(c, '\n')) != NULL; c++) lines++;
+        free(answers);
+        return lines != (sent + 5) / 6;
+}
+
+void test_server(void) {
+        pid_t pid = fork();
+        if(pid == 0) {
+                freopen("/dev/null", "w", stdout);
+                freopen(ERRORS, "w", stderr);
+                execl("./interp", "./interp", "-s", SOCKET, SYMBOLS, (char *)NULL);
+                _exit(127);
+        }
+
+        int wrong = test_pipelined();
+        size_t taken = 0;
+        int flooded = test_flood(&taken);
+
+        kill(pid, SIGTERM);
+        int status;
+        waitpid(pid, &status, 0);
+
+        if(wrong == 0 && flooded == 0 && taken < FLOOD / 2 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                printf("Test Successful: answered in order, took %zu of %d bytes from a client that did not read\n",
+                                taken, FLOOD);
+        } else {
+                printf("Test Failed: %d answers wrong, flood %s after %zu bytes\n", wrong,
+                                flooded ? "lost answers" : "answered", taken);
+        }
+        remove(SOCKET);
+}
+
+int main() {
+        FILE * file = fopen(SYMBOLS, "w");
+        fprintf(file, "a 1\nb 2\n");
+        fclose(file);
+
+        // three expressions, each repeated on thousands of lines
+        file = fopen(INPUT, "w");
+        for(int i = 0; i < LINES; i++) {
+                switch(i % 3) {
+                        case 0: fprintf(file, "a b 1 + =\n"); break;
+                        case 1: fprintf(file, "a b + 3 * # comment\n"); break;
+                        case 2: fprintf(file, "  a 2 %% b a ? \n"); break;
+                }
+        }
+        fclose(file);
+
+        run("");
+        char * plain = slurp(OUTPUT);
+        if(!plain) {
+                printf("Test Failed: could not run ./interp\n");
+                return 0;
+        }
+
+        printf("Testing promotion at the prompt...\n");
+        test_promotion("", plain);
+        printf("Testing promotion in the pipeline...\n");
+        test_promotion("-j 2", plain);
+
+        free(plain);
+        printf("Testing errors at the prompt and in the pipeline...\n");
+        test_diagnostics();
+        printf("Testing the server...\n");
+        test_server();
+        remove(SYMBOLS);
+        remove(INPUT);
+        remove(OUTPUT);
+        remove(ERRORS);
+        return 0;
+}
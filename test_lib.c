@@ -0,0 +1,203 @@
+/**
+ * Test for the embeddable interpreter library. Runs contexts side by side
+ * on several threads, each counting the same symbol name up in its own
+ * table, executes one prepared expression from several threads, and
+ * checks the status and kept message of every kind of failure. Then fails
+ * each allocation made while preparing an expression in turn, and checks
+ * that every one is reported as no memory rather than ending the process.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "libinterp.h"
+
+#define CONTEXTS 4
+#define STEPS 10000
+
+static int failures = 0;
+
+// which of this thread's allocations fails, or -1 for none
+static _Thread_local long fail_at = -1;
+static _Thread_local long allocs = 0;
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+
+static int fail_alloc(void) {
+        return fail_at >= 0 && allocs++ == fail_at;
+}
+
+void * malloc(size_t size) {
+        return fail_alloc() ? NULL : __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size) {
+        return fail_alloc() ? NULL : __libc_calloc(count, size);
+}
+
+void * realloc(void * ptr, size_t size) {
+        return fail_alloc() ? NULL : __libc_realloc(ptr, size);
+}
+
+// counts x up from the thread's number, one prepared assignment at a time
+void * count_up(void * arg) {
+        interp_t * ctx = arg;
+        interp_status_t status;
+        value_t result = 0;
+
+        interp_expr_t * step = interp_prepare(ctx, "x x 1 + =", &status);
+        for(int i = 0; step && i < STEPS; i++) {
+                if(interp_execute(step, &result) != INTERP_OK) break;
+        }
+        interp_release(step);
+        return NULL;
+}
+
+void test_contexts(void) {
+        interp_t * ctx[CONTEXTS];
+        pthread_t threads[CONTEXTS];
+        int wrong = 0;
+
+        for(int i = 0; i < CONTEXTS; i++) {
+                ctx[i] = interp_create(NULL);
+                interp_define(ctx[i], "x", i * STEPS * 10);
+        }
+        for(int i = 0; i < CONTEXTS; i++) pthread_create(&threads[i], NULL, count_up, ctx[i]);
+        for(int i = 0; i < CONTEXTS; i++) pthread_join(threads[i], NULL);
+
+        for(int i = 0; i < CONTEXTS; i++) {
+                value_t x = -1;
+                interp_lookup(ctx[i], "x", &x);
+                if(x != i * STEPS * 10 + STEPS) wrong++;
+                interp_destroy(ctx[i]);
+        }
+
+        if(wrong == 0) printf("Test Successful: %d contexts kept their own symbols\n", CONTEXTS);
+        else printf("Test Failed: %d contexts saw each other's writes\n", wrong);
+        failures += wrong;
+}
+
+// executes a shared expression and checks every result
+void * execute_shared(void * arg) {
+        interp_expr_t * expr = arg;
+        value_t result;
+
+        for(int i = 0; i < STEPS; i++) {
+                if(interp_execute(expr, &result) != INTERP_OK || result != 42) return (void *)1;
+        }
+        return NULL;
+}
+
+void test_shared_expression(void) {
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status;
+        pthread_t threads[CONTEXTS];
+        int wrong = 0;
+
+        interp_define(ctx, "a", 6);
+        interp_define(ctx, "b", 7);
+        interp_expr_t * expr = interp_prepare(ctx, "a b *", &status);
+
+        for(int i = 0; i < CONTEXTS; i++) pthread_create(&threads[i], NULL, execute_shared, expr);
+        for(int i = 0; i < CONTEXTS; i++) {
+                void * bad;
+                pthread_join(threads[i], &bad);
+                if(bad) wrong++;
+        }
+
+        // released along with the context
+        interp_prepare(ctx, "a b +", &status);
+
+        if(status == INTERP_OK && wrong == 0) printf("Test Successful: one expression executed on %d threads\n", CONTEXTS);
+        else printf("Test Failed: %d threads got a wrong result\n", wrong);
+        failures += wrong;
+        interp_destroy(ctx);
+}
+
+void test_statuses(void) {
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status;
+        char error[INTERP_ERROR_LEN];
+        value_t result;
+        int wrong = 0;
+
+        interp_define(ctx, "x", 5);
+
+        interp_expr_t * expr = interp_prepare(ctx, "x 0 /", &status);
+        if(interp_execute(expr, &result) != INTERP_DIVISION_BY_ZERO) wrong++;
+        interp_last_error(ctx, error, sizeof(error));
+        if(strcmp(error, "Error: division by zero") != 0) wrong++;
+        interp_release(expr);
+
+        expr = interp_prepare(ctx, "y 1 +", &status);
+        if(interp_execute(expr, &result) != INTERP_UNDEFINED_SYMBOL) wrong++;
+        interp_last_error(ctx, error, sizeof(error));
+        if(strcmp(error, "Error: undefined symbol 'y'") != 0) wrong++;
+        interp_release(expr);
+
+        if(interp_prepare(ctx, "1 +", &status) != NULL || status != INTERP_PARSE_ERROR) wrong++;
+        interp_last_error(ctx, error, sizeof(error));
+        if(strcmp(error, "Error: not enough operands for operator '+'") != 0) wrong++;
+
+        if(interp_define(ctx, "9lives", 1) != INTERP_INVALID_NAME) wrong++;
+        if(interp_load(ctx, "no/such/file") != INTERP_LOAD_ERROR) wrong++;
+
+        // a success leaves the last error in place
+        expr = interp_prepare(ctx, "x 2 *", &status);
+        if(interp_execute(expr, &result) != INTERP_OK || result != 10) wrong++;
+        interp_release(expr);
+        if(interp_last_error(ctx, error, sizeof(error)) == 0) wrong++;
+
+        if(strcmp(interp_status_name(INTERP_DIVISION_BY_ZERO), "division_by_zero") != 0) wrong++;
+
+        if(wrong == 0) printf("Test Successful: every failure reported its status\n");
+        else printf("Test Failed: %d statuses or messages were wrong\n", wrong);
+        failures += wrong;
+        interp_destroy(ctx);
+}
+
+void test_no_memory(void) {
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status;
+        value_t result;
+        int wrong = 0;
+        long n;
+
+        interp_define(ctx, "x", 5);
+
+        // fail the first allocation, then the second, until none is left to fail
+        for(n = 0; ; n++) {
+                allocs = 0;
+                fail_at = n;
+                interp_expr_t * expr = interp_prepare(ctx, "y x 2 * 3 + = 4 1 ?", &status);
+                int failed = allocs > n;
+                fail_at = -1;
+
+                if(!failed) {
+                        if(!expr || interp_execute(expr, &result) != INTERP_OK || result != 4) wrong++;
+                        interp_release(expr);
+                        break;
+                }
+                if(expr || status != INTERP_NO_MEMORY) wrong++;
+                interp_release(expr);
+        }
+
+        if(wrong == 0) printf("Test Successful: %ld failed allocations reported as no memory\n", n);
+        else printf("Test Failed: %d failed allocations reported wrongly\n", wrong);
+        failures += wrong;
+        interp_destroy(ctx);
+}
+
+int main() {
+        printf("Testing independent contexts...\n");
+        test_contexts();
+        printf("Testing a shared prepared expression...\n");
+        test_shared_expression();
+        printf("Testing statuses and errors...\n");
+        test_statuses();
+        printf("Testing failed allocations...\n");
+        test_no_memory();
+        return 0;
+}
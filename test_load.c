@@ -0,0 +1,123 @@
+/**
+ * Test and benchmark for the symbol file loader. Writes a large symbol
+ * file with comments, blank lines and redefinitions, loads it on several
+ * threads, and checks every symbol against the definitions it was written
+ * from. Also checks that a file with an invalid line adds nothing and
+ * that the context it was loaded into keeps the error, and that values
+ * with trailing text are rejected rather than cut short.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "symtab.h"
+#include "loader.h"
+#include "libinterp.h"
+
+#define SYMBOLS 1000000
+#define NAMES 400000 /// Fewer names than definitions, so many are redefined
+#define PATH "test_load.txt"
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void test_load(value_t * expected) {
+        FILE * file = fopen(PATH, "w");
+        unsigned int seed = 7;
+
+        for(int i = 0; i < NAMES; i++) expected[i] = 0;
+        fprintf(file, "# generated symbols\n\n");
+        for(int i = 0; i < SYMBOLS; i++) {
+                int name = rand_r(&seed) % NAMES;
+                int val = rand_r(&seed) - RAND_MAX / 2;
+                expected[name] = val ? val : 1;
+                if(i % 10 == 0) fprintf(file, "  v%d\t" VALUE_FMT "   # comment\n", name, expected[name]);
+                else fprintf(file, "v%d " VALUE_FMT "\n", name, expected[name]);
+        }
+        fclose(file);
+
+        interp_t * ctx = interp_create(NULL);
+        double start = now_ms();
+        int rc = load_symbols(interp_table(ctx), PATH, 4);
+        printf("loaded %d definitions in %.1f ms\n", SYMBOLS, now_ms() - start);
+
+        int failures = rc != 0;
+        char name[16];
+        for(int i = 0; i < NAMES; i++) {
+                snprintf(name, sizeof(name), "v%d", i);
+                value_t val;
+                interp_status_t status = interp_lookup(ctx, name, &val);
+                if(expected[i] == 0 ? status == INTERP_OK : status != INTERP_OK || val != expected[i]) failures++;
+        }
+
+        if(failures == 0) printf("Test Successful: every symbol has its last value\n");
+        else printf("Test Failed: %d symbols are wrong\n", failures);
+        interp_destroy(ctx);
+}
+
+void test_invalid(void) {
+        FILE * file = fopen(PATH, "w");
+        fprintf(file, "a 1\n# fine\nb 2\n3c 4\nd 5\n");
+        fclose(file);
+
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status = interp_load(ctx, PATH);
+        char error[INTERP_ERROR_LEN];
+        value_t val;
+
+        interp_last_error(ctx, error, sizeof(error));
+        if(status == INTERP_LOAD_ERROR && interp_lookup(ctx, "a", &val) == INTERP_UNDEFINED_SYMBOL &&
+                        strncmp(error, PATH ":4:", strlen(PATH ":4:")) == 0) printf("Test Successful: invalid file rejected with '%s'\n", error);
+        else printf("Test Failed: invalid file loaded\n");
+        interp_destroy(ctx);
+}
+
+// loads a one-line file and returns the status, with the value of x
+interp_status_t load_line(const char * text, value_t * val) {
+        FILE * file = fopen(PATH, "w");
+        fprintf(file, "%s\n", text);
+        fclose(file);
+
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status = interp_load(ctx, PATH);
+        if(status == INTERP_OK) status = interp_lookup(ctx, "x", val);
+        interp_destroy(ctx);
+        return status;
+}
+
+void test_literals(void) {
+        const char * bad[] = { "x 12abc", "x 1 2", "x -", "x 0.5.5", "x 1e", "x +-1" };
+        int wrong = 0;
+        value_t val;
+
+        for(size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) wrong += load_line(bad[i], &val) != INTERP_LOAD_ERROR;
+        wrong += load_line("x -42  # comment", &val) != INTERP_OK || val != -42;
+#ifdef VALUE_DOUBLE
+        wrong += load_line("x 0.5", &val) != INTERP_OK || val != 0.5;
+        wrong += load_line("x -2.5e-3", &val) != INTERP_OK || val != -2.5e-3;
+        wrong += load_line("x 1e400", &val) != INTERP_LOAD_ERROR;
+#else
+        wrong += load_line("x 0.5", &val) != INTERP_LOAD_ERROR;
+#endif
+
+        if(wrong == 0) printf("Test Successful: values read whole, trailing text rejected\n");
+        else printf("Test Failed: %d lines read wrongly\n", wrong);
+}
+
+int main() {
+        value_t * expected = malloc(NAMES * sizeof(value_t));
+
+        printf("Testing parallel symbol loading...\n");
+        test_load(expected);
+        printf("Testing an invalid symbol file...\n");
+        test_invalid();
+        printf("Testing value literals...\n");
+        test_literals();
+
+        remove(PATH);
+        free(expected);
+        return 0;
+}
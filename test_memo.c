@@ -0,0 +1,123 @@
+/**
+ * Test and benchmark for the result cache. Evaluates one expression over
+ * and over, checking that repeats hit the cache and give the same result,
+ * and that writing a symbol the expression reads makes it evaluate again,
+ * while writing one in the arm of a ternary that was not taken does not.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "symtab.h"
+#include "memo.h"
+
+#define REPEATS 1000
+#define TERMS 2000
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// x y + x - y + ... : long, but reads only two symbols
+tree_node_t * long_expression(void) {
+        char * exp = malloc(TERMS * 16);
+        size_t len = sprintf(exp, "x");
+
+        for(int i = 1; i <= TERMS; i++) len += sprintf(exp + len, " %s %s", i % 2 ? "y" : "x", i % 2 ? "+" : "-");
+        tree_node_t * tree = make_parse_tree(exp);
+        free(exp);
+        return tree;
+}
+
+double time_repeats(tree_node_t * tree, value_t * result) {
+        double start = now_ms();
+        for(int i = 0; i < REPEATS; i++) *result = eval_tree(tree);
+        return now_ms() - start;
+}
+
+// the number of hits so far, from the cache's report
+unsigned long hits(void) {
+        unsigned long lookups, count = 0;
+        FILE * file = tmpfile();
+        memo_report(file);
+        rewind(file);
+        if(fscanf(file, "memo: %lu lookups, %lu hits", &lookups, &count) != 2) count = 0;
+        fclose(file);
+        return count;
+}
+
+void test_untaken(void) {
+        char text[] = "missing y x ?";
+        tree_node_t * tree = make_parse_tree(text);
+        int wrong = 0;
+
+        // only x and y are read, so the undefined arm does not stop caching
+        unsigned long before = hits();
+        eval_error_t err;
+        wrong += eval_tree_status(tree, &err) != 3 || err != EVAL_OK;
+        wrong += eval_tree(tree) != 3 || hits() != before + 1;
+        add_symbol("missing", 5);
+        wrong += eval_tree(tree) != 3 || hits() != before + 2;
+        assign_symbol("y", 8);
+        wrong += eval_tree(tree) != 8 || hits() != before + 2;
+        assign_symbol("x", 0);
+        wrong += eval_tree(tree) != 5 || hits() != before + 2;
+        wrong += eval_tree(tree) != 5 || hits() != before + 3;
+
+        if(wrong == 0) printf("Test Successful: only the symbols a ternary reads are dependencies\n");
+        else printf("Test Failed: %d wrong results or hits\n", wrong);
+        cleanup_tree(tree);
+}
+
+int main() {
+        add_symbol("x", 10);
+        add_symbol("y", 3);
+        add_symbol("z", 0);
+        tree_node_t * tree = long_expression();
+
+        value_t plain, cached;
+        double base = time_repeats(tree, &plain);
+        memo_start(64);
+        double ms = time_repeats(tree, &cached);
+        printf("%d evaluations: %.1f ms uncached, %.1f ms cached\n", REPEATS, base, ms);
+        memo_report(stdout);
+
+        if(cached == plain) printf("Test Successful: cached result " VALUE_FMT " matches\n", cached);
+        else printf("Test Failed: cached " VALUE_FMT ", expected " VALUE_FMT "\n", cached, plain);
+
+        // writing an unrelated symbol keeps the entry, writing x does not
+        add_symbol("z", 4);
+        value_t same = eval_tree(tree);
+        assign_symbol("x", 11);
+        value_t changed = eval_tree(tree);
+        memo_stop();
+        value_t expected = eval_tree(tree);
+        memo_start(64);
+        if(same == plain && changed != plain && changed == expected) printf("Test Successful: writes to read symbols invalidate\n");
+        else printf("Test Failed: got " VALUE_FMT " and " VALUE_FMT " after writes\n", same, changed);
+
+        // a fresh parse of the same text hits the same entry
+        char text[] = "x y +";
+        tree_node_t * a = make_parse_tree(strcpy(text, "x y +"));
+        value_t first = eval_tree(a);
+        tree_node_t * b = make_parse_tree(strcpy(text, "x y +"));
+        value_t second = eval_tree(b);
+        tree_node_t * c = make_parse_tree(strcpy(text, "y x +"));
+        eval_tree(c);
+        memo_report(stdout);
+        if(first == 14 && second == 14) printf("Test Successful: reparsed expression reuses its result\n");
+        else printf("Test Failed: got " VALUE_FMT " and " VALUE_FMT "\n", first, second);
+
+        cleanup_tree(a);
+        cleanup_tree(b);
+        cleanup_tree(c);
+        cleanup_tree(tree);
+
+        test_untaken();
+        memo_stop();
+        free_table();
+        return 0;
+}
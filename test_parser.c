@@ -4,6 +4,11 @@
 #include "stack.h"
 #include "tree_node.h"
 #include "parser.h"
+#include "symtab.h"
+#include "builder.h"
+#include "reader.h"
+#include "libinterp.h"
+#include "diag.h"
 
 void test_parse_int() {
         stack_t * stk = make_stack();
@@ -83,14 +88,212 @@ void test_eval() {
         push(stk, strdup("+"));
 
         tree_node_t * n1 = parse(stk);
-        int result1 = eval_tree(n1);
-        printf("Result: %d\n", result1);
-        if(result1 != 8) printf("Test Successful: Result of '5 + 3' = %d\n", result1);
+        value_t result1 = eval_tree(n1);
+        printf("Result: " VALUE_FMT "\n", result1);
+        if(result1 == 8) printf("Test Successful: Result of '5 + 3' = " VALUE_FMT "\n", result1);
         else printf("Test Failed for eval\n");
         free_stack(stk);
         cleanup_tree(n1);
 }
 
+void test_lazy_ternary() {
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status;
+        value_t result1 = 0, result2 = 0, x = 0;
+
+        interp_define(ctx, "x", 3);
+
+        // 0 ? 1 : (x = 9), only the false arm may run
+        interp_expr_t * taken = interp_prepare(ctx, "x 9 = 1 0 ?", &status);
+        interp_execute(taken, &result1);
+
+        // 1 ? 1 : (x = 7), the assignment must not run
+        interp_expr_t * skipped = interp_prepare(ctx, "x 7 = 1 1 ?", &status);
+        interp_execute(skipped, &result2);
+
+        interp_lookup(ctx, "x", &x);
+        if(result1 == 9 && result2 == 1 && x == 9) printf("Test Successful: Ternary evaluated only the taken arm\n");
+        else printf("Test Failed: ternary results " VALUE_FMT ", " VALUE_FMT " with x = " VALUE_FMT "\n", result1, result2, x);
+        interp_destroy(ctx);
+}
+
+void test_make_parse_tree() {
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status;
+        char infix[64];
+        value_t result = 0;
+
+        interp_expr_t * expr = interp_prepare(ctx, "1 2 + 3 *", &status);
+        if(expr) {
+                interp_execute(expr, &result);
+                interp_infix(expr, infix, sizeof(infix));
+        }
+
+        if(result == 9 && strcmp(infix, "((1  + 2 ) * 3 )") == 0) printf("Test Successful: Built tree for '%s'\n", infix);
+        else printf("Test Failed: make_parse_tree gave '%s' = " VALUE_FMT "\n", expr ? infix : "", result);
+        interp_release(expr);
+        interp_destroy(ctx);
+}
+
+void test_tree_shape() {
+        char exp[] = "1 2 + 3 4 5 ? *";
+        tree_node_t * tree = make_parse_tree(exp);
+        size_t nodes = tree_size(tree);
+        int depth = tree_depth(tree);
+
+        if(nodes == 9 && depth == 4) printf("Test Successful: Tree has %zu nodes, depth %d\n", nodes, depth);
+        else printf("Test Failed: Expected 9 nodes, depth 4, got %zu nodes, depth %d\n", nodes, depth);
+        cleanup_tree(tree);
+}
+
+int same_nodes(tree_node_t * a, tree_node_t * b) {
+        if(a == NULL || b == NULL) return a == b;
+        if(a->type != b->type || strcmp(a->token, b->token) != 0) return 0;
+        if(a->size != b->size || a->pure != b->pure) return 0;
+        if(a->type == LEAF) return ((leaf_node_t *)a->node)->exp_type == ((leaf_node_t *)b->node)->exp_type;
+
+        interior_node_t * x = (interior_node_t *)a->node;
+        interior_node_t * y = (interior_node_t *)b->node;
+        return x->op == y->op && same_nodes(x->left, y->left) && same_nodes(x->right, y->right);
+}
+
+// a random valid expression of at least the given number of tokens
+char * random_expression(int tokens) {
+        const char * ops[] = { "+", "-", "*", "/", "%", "=", "?" };
+        size_t cap = 32 * (size_t)tokens + 64, len = 0;
+        char * exp = malloc(cap);
+        int depth = 0;
+
+        srand(42);
+        for(int i = 0; i < tokens || depth > 1; i++) {
+                int r = rand() % 16;
+                if(depth >= 3 && r == 0) {
+                        len += sprintf(exp + len, "? ");
+                        depth -= 2;
+                } else if(depth >= 2 && (r < 7 || i >= tokens)) {
+                        len += sprintf(exp + len, "%s ", ops[r % 6]);
+                        depth--;
+                } else {
+                        if(r % 2) len += sprintf(exp + len, "%d\t", rand() % 2000 - 1000);
+                        else len += sprintf(exp + len, "v%d  ", rand() % 100);
+                        depth++;
+                }
+        }
+        return exp;
+}
+
+static char errors[1024];
+
+// keeps the errors reported, in order
+void keep_error(const char * msg, void * arg) {
+        (void)arg;
+        strncat(errors, msg, sizeof(errors) - strlen(errors) - 1);
+}
+
+// checks that a long line fails with the same errors built in parallel
+// as read one line at a time
+int same_errors(const char * format, const char * exp) {
+        size_t len = 2 * strlen(exp) + 64;
+        char * par = malloc(len), * line = malloc(len), built[sizeof(errors)];
+        snprintf(par, len, format, exp, exp);
+        strcpy(line, par);
+
+        reader_t * reader = make_reader(NULL);
+        set_diag_sink(keep_error, NULL);
+        errors[0] = '\0';
+        tree_node_t * tree = build_parse_tree(par, 8);
+        strcpy(built, errors);
+        errors[0] = '\0';
+        tree_node_t * read = read_line(reader, line);
+        set_diag_sink(NULL, NULL);
+
+        int same = tree == NULL && read == NULL && built[0] != '\0' && strcmp(built, errors) == 0;
+        free_reader(reader);
+        free(par);
+        free(line);
+        return same;
+}
+
+void test_parallel_build() {
+        char * exp = random_expression(40000);
+
+        char * seq_exp = strdup(exp);
+        tree_node_t * seq = make_parse_tree(seq_exp);
+        tree_node_t * par = build_parse_tree(exp, 8);
+
+        if(seq && same_nodes(seq, par)) printf("Test Successful: Parallel build matches parse() for %zu nodes\n", tree_size(seq));
+        else printf("Test Failed: Parallel build differs from parse()\n");
+        cleanup_tree(seq);
+        cleanup_tree(par);
+        free(seq_exp);
+        free(exp);
+
+        char bad[] = "1 2 + +", extra[] = "1 2 3 +";
+        if(build_parse_tree(bad, 8) == NULL && build_parse_tree(extra, 8) == NULL) printf("Test Successful: Parallel build rejects invalid expressions\n");
+        else printf("Test Failed: Parallel build accepted an invalid expression\n");
+
+        // an underflow, too many operands, and a token handed to read_line()
+        exp = random_expression(40000);
+        if(same_errors("%s + + %s", exp) && same_errors("%s %s", exp) && same_errors("%s %s : +", exp) &&
+                        same_errors("%s $ %s +", exp)) {
+                printf("Test Successful: Parallel build reports the errors read_line() does\n");
+        } else {
+                printf("Test Failed: Parallel build reported '%s'\n", errors);
+        }
+        free(exp);
+}
+
+void test_invalid_token() {
+        char bad[] = "1 $ +", alt[] = "1 2 :";
+        reader_t * reader = make_reader(NULL);
+
+        set_diag_sink(keep_error, NULL);
+        errors[0] = '\0';
+        tree_node_t * parsed = make_parse_tree(bad);
+        int ok = parsed == NULL && strstr(errors, "Invalid token '$'") != NULL;
+        errors[0] = '\0';
+        tree_node_t * read = read_line(reader, strcpy(bad, "1 $ +"));
+        ok = ok && read == NULL && strstr(errors, "Invalid token '$'") != NULL;
+        set_diag_sink(NULL, NULL);
+
+        // a ':' of its own is still an alternative
+        tree_node_t * tree = make_parse_tree(alt);
+        ok = ok && tree && tree->type == INTERIOR && ((interior_node_t *)tree->node)->op == ALT_OP;
+        cleanup_tree(tree);
+        free_reader(reader);
+
+        if(ok) printf("Test Successful: Tokens that are not operands or operators are parse errors\n");
+        else printf("Test Failed: An invalid token parsed, reporting '%s'\n", errors);
+}
+
+void test_stream_read() {
+        char * exp = random_expression(200000);
+        FILE * in = tmpfile();
+
+        fprintf(in, "# comment only\n%s # trailing comment\n\n1 2 3 +\n7", exp);
+        rewind(in);
+
+        reader_t * reader = make_reader(in);
+        tree_node_t * tree, * big;
+        int ok = read_tree(reader, &tree) == READ_BLANK;
+        ok = ok && read_tree(reader, &big) == READ_LINE && reader->lineno == 2;
+        ok = ok && read_tree(reader, &tree) == READ_BLANK;
+        ok = ok && read_tree(reader, &tree) == READ_LINE && tree == NULL;
+        ok = ok && read_tree(reader, &tree) == READ_LINE && tree != NULL && reader->lineno == 5;
+        cleanup_tree(tree);
+        ok = ok && read_tree(reader, &tree) == READ_END;
+
+        tree_node_t * seq = make_parse_tree(exp);
+        if(ok && seq && same_nodes(seq, big)) printf("Test Successful: Streamed %zu-node expression matches parse()\n", tree_size(seq));
+        else printf("Test Failed: Streamed expressions differ from parse()\n");
+
+        cleanup_tree(seq);
+        cleanup_tree(big);
+        free_reader(reader);
+        fclose(in);
+        free(exp);
+}
+
 int main() {
         printf("Testing for integer parsing...\n");
         test_parse_int();
@@ -103,6 +306,18 @@ int main() {
 
         printf("Testing eval...\n");
         test_eval();
+        printf("Testing full tree construction...\n");
+        test_make_parse_tree();
+        printf("Testing lazy ternary evaluation...\n");
+        test_lazy_ternary();
+        printf("Testing tree size and depth...\n");
+        test_tree_shape();
+        printf("Testing parallel tree construction...\n");
+        test_parallel_build();
+        printf("Testing invalid tokens...\n");
+        test_invalid_token();
+        printf("Testing streamed expression reading...\n");
+        test_stream_read();
 
         return 0;
 }
@@ -0,0 +1,152 @@
+/**
+ * Differential test and benchmark for the token scanner. Random tokens are
+ * placed at every alignment and checked against the scalar scanner and
+ * against is_num(), is_operator() and atoi(), which parse() relied on
+ * before. Then a large batch of expressions is tokenized both ways.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "parser.h"
+#include "scan.h"
+
+#define ROUNDS 200000
+#define BATCH (8 * 1024 * 1024)
+
+static int failures = 0;
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// what parse() made of a token before the scanner
+scan_kind_t reference_kind(char * tok) {
+        if(is_num(tok)) return SCAN_INTEGER;
+        if(isalpha((unsigned char)tok[0])) return SCAN_SYMBOL;
+        if(is_operator(tok)) return SCAN_OPERATOR;
+        if(strcmp(tok, "?") == 0) return SCAN_TERNARY;
+        return SCAN_OTHER;
+}
+
+// a token biased towards the cases that are easy to get wrong
+void random_token(char * tok, unsigned int * seed) {
+        const char * alphabet = "0123456789-+*/%=?:abeEzAZ_.#\x80\xff";
+        int len = 1 + rand_r(seed) % (rand_r(seed) % 4 ? 4 : 40);
+        int digits = rand_r(seed) % 2;
+
+        for(int i = 0; i < len; i++) {
+                if(digits) tok[i] = (i == 0 && rand_r(seed) % 3 == 0) ? '-' : '0' + rand_r(seed) % 10;
+                else tok[i] = alphabet[rand_r(seed) % strlen(alphabet)];
+        }
+        tok[len] = '\0';
+}
+
+void test_tokens(void) {
+        const char * ends[] = { "", " ", "\t", "\r\n", "\n" };
+        unsigned int seed = 1;
+        char tok[64], buf[256];
+
+        for(int round = 0; round < ROUNDS; round++) {
+                random_token(tok, &seed);
+                size_t len = strlen(tok), lead = rand_r(&seed) % 40, offset = rand_r(&seed) % 64;
+
+                // leading separators, the token, then a separator or the end
+                char * p = buf + offset;
+                for(size_t i = 0; i < lead; i++) p[i] = " \t\r\n"[rand_r(&seed) % 4];
+                sprintf(p + lead, "%s%s", tok, ends[rand_r(&seed) % 5]);
+
+                scan_kind_t kind, scalar;
+                size_t skip = scan_space(p);
+                size_t n = scan_token(p + skip, &kind);
+                size_t m = scan_token_scalar(p + skip, &scalar);
+
+                int ok = skip == lead && skip == scan_space_scalar(p) && n == len && m == len;
+                ok = ok && kind == scalar && kind == reference_kind(tok);
+#ifdef VALUE_DOUBLE
+                if(ok && kind == SCAN_INTEGER) ok = scan_value(tok, len) == strtod(tok, NULL);
+#else
+                if(ok && kind == SCAN_INTEGER) ok = scan_int(tok, len) == atoi(tok) && scan_int_scalar(tok, len) == atoi(tok);
+#endif
+
+                if(!ok && failures++ < 10) printf("mismatch on token '%s' at offset %zu\n", tok, offset + lead);
+        }
+
+        // literals that do not fit an int convert as atoi() does
+        const char * edges[] = { "2147483647", "-2147483648", "2147483648", "-2147483649", "99999999999",
+                "123456789012345678", "9223372036854775807", "92233720368547758070", "-0", "00000000000000000001" };
+        for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+                if(scan_int(edges[i], strlen(edges[i])) != atoi(edges[i]) && failures++ < 10) printf("mismatch on literal %s\n", edges[i]);
+        }
+
+#ifdef VALUE_DOUBLE
+        // decimal and exponent literals are values, tokens that only start like one are not
+        const char * decimals[] = { "0.5", "-0.5", ".5", "5.", "1e3", "-2.5E-3", "1e+3", "00.10" };
+        const char * others[] = { "0.5x", "1e", "1e+", "1.2.3", ".", "-.", "-", "1e3.5", "0x10", "inf" };
+        for(size_t i = 0; i < sizeof(decimals) / sizeof(decimals[0]); i++) {
+                scan_kind_t kind;
+                size_t len = strlen(decimals[i]);
+                int ok = scan_token(decimals[i], &kind) == len && kind == SCAN_INTEGER && scan_value(decimals[i], len) == strtod(decimals[i], NULL);
+                if(!ok && failures++ < 10) printf("literal %s is not a value\n", decimals[i]);
+        }
+        for(size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+                scan_kind_t kind;
+                scan_token(others[i], &kind);
+                if((kind == SCAN_INTEGER || is_num((char *)others[i])) && failures++ < 10) printf("token %s is a value\n", others[i]);
+        }
+#endif
+
+        if(failures == 0) printf("Test Successful: scanner agrees with is_num, is_operator and atoi\n");
+        else printf("Test Failed: %d mismatches\n", failures);
+}
+
+void test_batch_speed(void) {
+        char * batch = malloc(BATCH + 1);
+        unsigned int seed = 2;
+        size_t len = 0;
+
+        while(len < BATCH - 64) len += sprintf(batch + len, "%d v%d + %d * ", rand_r(&seed) % 100000, rand_r(&seed) % 100, rand_r(&seed) % 1000);
+        batch[len] = '\0';
+
+        double start = now_ms();
+        long sum = 0;
+        size_t count = 0;
+        for(char * p = batch + scan_space(batch); *p; ) {
+                scan_kind_t kind;
+                size_t n = scan_token(p, &kind);
+                if(kind == SCAN_INTEGER) sum += scan_int(p, n);
+                count++;
+                p += n;
+                p += scan_space(p);
+        }
+        double fast = now_ms() - start;
+
+        char * copy = strdup(batch);
+        start = now_ms();
+        long check = 0;
+        size_t tokens = 0;
+        char * save = NULL;
+        for(char * tok = strtok_r(copy, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save)) {
+                if(is_num(tok)) check += atoi(tok);
+                else if(!isalpha((unsigned char)tok[0])) is_operator(tok);
+                tokens++;
+        }
+        double slow = now_ms() - start;
+
+        printf("%zu tokens: scanner %.1f ms, strtok/is_num/atoi %.1f ms\n", count, fast, slow);
+        if(count == tokens && sum == check) printf("Test Successful: both ways give the same tokens\n");
+        else printf("Test Failed: %zu and %zu tokens\n", count, tokens);
+        free(copy);
+        free(batch);
+}
+
+int main() {
+        printf("Testing the scanner against the scalar classifiers...\n");
+        test_tokens();
+        printf("Testing the scanner on a large batch...\n");
+        test_batch_speed();
+        return 0;
+}
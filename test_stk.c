@@ -1,7 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "stack.h"
 
+#define MANY (STACK_CHUNK * 3 + 7)
+
+// counts the chunks from the top one down that are not where they were
+int moved_chunks(stack_t * stk, stack_chunk_t ** chunks) {
+        int moved = 0, n = 0;
+        for(stack_chunk_t * chunk = stk->chunk; chunk; chunk = chunk->below) moved += chunks[n++] != chunk;
+        return moved;
+}
+
 int main() {
         stack_t * stk = make_stack();
 
@@ -25,6 +35,36 @@ int main() {
         free(y);
         free_stack(stk);
 
-        printf("TEST STACK SUCCESSFUL\n");
+        // tokens across several chunks, popped back and forth over
+        // several boundaries into the same chunks, then freed with the
+        // stack while still on it
+        stk = make_stack();
+        char token[16];
+        int wrong = 0;
+        for(int i = 1; i <= MANY; i++) {
+                sprintf(token, "%d", i);
+                push(stk, strdup(token));
+        }
+        stack_chunk_t * chunks[MANY / STACK_CHUNK + 1];
+        int n = 0;
+        for(stack_chunk_t * chunk = stk->chunk; chunk; chunk = chunk->below) chunks[n++] = chunk;
+        for(int round = 0; round < 3; round++) {
+                for(int i = MANY; i > STACK_CHUNK - 2; i--) {
+                        wrong += atoi((char *)top(stk)) != i;
+                        free(top(stk));
+                        pop(stk);
+                }
+                for(int i = STACK_CHUNK - 1; i <= MANY; i++) {
+                        sprintf(token, "%d", i);
+                        push(stk, strdup(token));
+                }
+                wrong += moved_chunks(stk, chunks);
+        }
+        wrong += stack_size(stk) != MANY || atoi((char *)top(stk)) != MANY;
+        free_stack(stk);
+        free_stack(NULL);
+
+        if(wrong == 0) printf("TEST STACK SUCCESSFUL\n");
+        else printf("TEST STACK FAILED: %d wrong elements\n", wrong);
         return 0;
 }
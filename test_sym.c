@@ -5,7 +5,7 @@
 
 void print_symbol(symbol_t * symbol) {
         if(symbol) {
-                printf("Found: Name = %s, Value = %d\n", symbol->var_name, symbol->val);
+                printf("Found: Name = %s, Value = " VALUE_FMT "\n", symbol->var_name, symbol->val);
         } else {
                 printf("Not found\n");
         }
@@ -0,0 +1,107 @@
+/**
+ * Stress test for concurrent symbol table access. Readers look symbols up
+ * in pinned snapshots, and with lookup_table(), while a writer keeps
+ * assigning and adding them; build it with -fsanitize=thread to check the
+ * table for data races, or -fsanitize=address for symbols used after the
+ * write that replaced them freed them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "symtab.h"
+
+#define NUM_SYMBOLS 256
+#define MAX_THREADS 64
+#define RUN_MS 200
+
+static atomic_int running;
+static atomic_int failures;
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// every value ever stored is even, so an odd read is a torn or bogus value,
+// and a snapshot must keep returning the value it first showed
+void * reader(void * arg) {
+        unsigned long * lookups = arg;
+        unsigned int seed = (unsigned int)(size_t)arg;
+        unsigned long count = 0;
+        char name[16];
+
+        while(atomic_load(&running)) {
+                snprintf(name, sizeof(name), "v%d", rand_r(&seed) % NUM_SYMBOLS);
+                symtab_snapshot_t * snap = pin_table();
+                symbol_t * symbol = lookup_snapshot(snap, name);
+                if(!symbol || (long long)symbol_value(symbol) % 2 != 0) atomic_fetch_add(&failures, 1);
+                else if(symbol_value(lookup_snapshot(snap, name)) != symbol_value(symbol)) atomic_fetch_add(&failures, 1);
+                unpin_table(snap);
+
+                // the symbol must outlive the pin lookup_table() takes
+                symbol = lookup_table(name);
+                if(!symbol || (long long)symbol_value(symbol) % 2 != 0 || strcmp(symbol->var_name, name) != 0) atomic_fetch_add(&failures, 1);
+                count += 2;
+        }
+        *lookups = count;
+        return NULL;
+}
+
+void * writer(void * arg) {
+        (void)arg;
+        unsigned int seed = 1;
+        char name[16];
+        int added = 0;
+
+        while(atomic_load(&running)) {
+                snprintf(name, sizeof(name), "v%d", rand_r(&seed) % NUM_SYMBOLS);
+                assign_symbol(name, 2 * (rand_r(&seed) % 1000));
+                if(rand_r(&seed) % 64 == 0) {
+                        snprintf(name, sizeof(name), "w%d", added++);
+                        add_symbol(name, 0);
+                }
+        }
+        return NULL;
+}
+
+int main() {
+        char name[16];
+        for(int i = 0; i < NUM_SYMBOLS; i++) {
+                snprintf(name, sizeof(name), "v%d", i);
+                add_symbol(name, 2 * i);
+        }
+
+        for(int n = 1; n <= MAX_THREADS; n *= 2) {
+                pthread_t readers[MAX_THREADS], w;
+                unsigned long lookups[MAX_THREADS] = { 0 };
+
+                atomic_store(&running, 1);
+                pthread_create(&w, NULL, writer, NULL);
+                double start = now_ms();
+                for(int i = 0; i < n; i++) pthread_create(&readers[i], NULL, reader, &lookups[i]);
+
+                struct timespec run = { 0, RUN_MS * 1000000L };
+                nanosleep(&run, NULL);
+                atomic_store(&running, 0);
+
+                unsigned long total = 0;
+                for(int i = 0; i < n; i++) {
+                        pthread_join(readers[i], NULL);
+                        total += lookups[i];
+                }
+                double ms = now_ms() - start;
+                pthread_join(w, NULL);
+
+                printf("%2d reader(s): %12.0f lookups/sec\n", n, total / ms * 1000.0);
+        }
+
+        if(atomic_load(&failures) == 0) printf("Test Successful: all lookups saw a valid value\n");
+        else printf("Test Failed: %d lookups saw an invalid value\n", atomic_load(&failures));
+
+        free_table();
+        return 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * Test and benchmark for tiered execution. Random expressions with
+ * assignments, ternaries and failures are evaluated by walking the tree
+ * and by running their compiled programs, on two tables with the same
+ * symbols, and must give the same results, errors and tables. Then a
+ * prepared expression is run until the compiler thread promotes it, and
+ * both tiers are timed. Last, trees on either side of the size limit are
+ * checked to be compiled and cached alike.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "parser.h"
+#include "libinterp.h"
+#include "tier.h"
+#include "diag.h"
+
+#define ROUNDS 20000
+#define RUNS 200000
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// keeps the program quiet while failures are being compared
+void drop(const char * msg, void * arg) {
+        (void)msg;
+        (void)arg;
+}
+
+// a postfix expression over a..e, with q never defined
+size_t random_text(char * buf, int depth, unsigned int * seed) {
+        const char * ops[] = { "+", "-", "*", "/", "%" };
+        int pick = depth <= 0 ? rand_r(seed) % 2 : rand_r(seed) % 8;
+        size_t len = 0;
+
+        if(pick == 0) return sprintf(buf, "%d", rand_r(seed) % 7 - 2);
+        if(pick == 1) return sprintf(buf, "%c", "abcdeq"[rand_r(seed) % 6]);
+        if(pick == 2) {
+                len = sprintf(buf, "%c ", "abcq"[rand_r(seed) % 4]);
+                len += random_text(buf + len, depth - 1, seed);
+                return len + sprintf(buf + len, " =");
+        }
+        if(pick == 3) {
+                for(int i = 0; i < 3; i++) {
+                        len += random_text(buf + len, depth - 1, seed);
+                        buf[len++] = ' ';
+                }
+                return len + sprintf(buf + len, "?");
+        }
+        len = random_text(buf, depth - 1, seed);
+        buf[len++] = ' ';
+        len += random_text(buf + len, depth - 1, seed);
+        return len + sprintf(buf + len, " %s", ops[rand_r(seed) % 5]);
+}
+
+void fill(symtab_t * table) {
+        const char * names[] = { "a", "b", "c", "d", "e" };
+        for(int i = 0; i < 5; i++) symtab_add(table, (char *)names[i], i + 1);
+}
+
+int same_tables(symtab_t * x, symtab_t * y) {
+        const char * names[] = { "a", "b", "c", "d", "e", "q" };
+        symtab_snapshot_t * sx = symtab_pin(x), * sy = symtab_pin(y);
+        int same = 1;
+
+        for(int i = 0; i < 6; i++) {
+                symbol_t * p = lookup_snapshot(sx, (char *)names[i]), * q = lookup_snapshot(sy, (char *)names[i]);
+                if((p == NULL) != (q == NULL) || (p && symbol_value(p) != symbol_value(q))) same = 0;
+        }
+        unpin_table(sx);
+        unpin_table(sy);
+        return same;
+}
+
+void test_equivalence(void) {
+        symtab_t * trees = make_table(), * progs = make_table();
+        unsigned int seed = 3;
+        char text[8192];
+        int failures = 0, compiled = 0;
+
+        fill(trees);
+        fill(progs);
+        set_diag_sink(drop, NULL);
+        for(int round = 0; round < ROUNDS; round++) {
+                random_text(text, 1 + rand_r(&seed) % 6, &seed);
+                tree_node_t * tree = make_parse_tree(text);
+                if(!tree) continue;
+
+                code_t * code = compile_tree(tree);
+                eval_error_t e1, e2;
+                value_t r1 = eval_tree_in(trees, tree, &e1);
+                value_t r2 = code ? run_code(code, progs, &e2) : eval_tree_in(progs, tree, &e2);
+                compiled += code != NULL;
+
+                if((r1 != r2 || e1 != e2 || !same_tables(trees, progs)) && failures++ < 10) {
+                        printf("mismatch on '%s': " VALUE_FMT " (%d) and " VALUE_FMT " (%d)\n", text, r1, e1, r2, e2);
+                }
+                free_code(code);
+                cleanup_tree(tree);
+        }
+        set_diag_sink(NULL, NULL);
+
+        if(failures == 0) printf("Test Successful: %d compiled expressions match the tree\n", compiled);
+        else printf("Test Failed: %d mismatches\n", failures);
+        destroy_table(trees);
+        destroy_table(progs);
+}
+
+void test_promotion(void) {
+        interp_t * ctx = interp_create(NULL);
+        interp_status_t status;
+        value_t result = 0, expected = 0;
+
+        fill(interp_table(ctx));
+        interp_expr_t * expr = interp_prepare(ctx, "a b + c * d e - / a b * + c 1 ? 2 3 c ? *", &status);
+
+        tier_start(1000);
+        double start = now_ms();
+        for(int i = 0; i < 1000; i++) interp_execute(expr, &expected);
+        double tree = now_ms() - start;
+
+        // the compiler thread publishes the program when it is done
+        for(int i = 0; i < 1000 && interp_tier(expr) != TIER_CODE; i++) usleep(1000);
+
+        start = now_ms();
+        int wrong = 0;
+        for(int i = 0; i < RUNS; i++) {
+                interp_execute(expr, &result);
+                wrong += result != expected;
+        }
+        double code = now_ms() - start;
+
+        printf("1000 tree runs %.2f us each, %d code runs %.2f us each\n", tree, RUNS, code * 1000 / RUNS);
+        if(interp_tier(expr) == TIER_CODE && wrong == 0) printf("Test Successful: hot expression promoted and still gives " VALUE_FMT "\n", expected);
+        else printf("Test Failed: expression in tier %d, %d wrong results\n", interp_tier(expr), wrong);
+        tier_report(stdout);
+
+        interp_release(expr);
+        interp_destroy(ctx);
+        tier_stop();
+}
+
+void test_size_limit(void) {
+        tree_node_t * tree = make_interior(ADD_OP, "+", make_leaf(INTEGER, "1"), make_leaf(INTEGER, "2"));
+        tier_cache_t * cache = make_tier_cache(16);
+        size_t real = tree->size;
+        int wrong = 0;
+
+        // a tree as large as the limit goes to the fork-join evaluator instead
+        for(size_t size = TIER_MAX_SIZE - 1; size <= TIER_MAX_SIZE; size++) {
+                tree->size = size;
+                code_t * code = compile_tree(tree);
+                tier_slot_t * slot = tier_cached(cache, tree);
+                int tiered = size < TIER_MAX_SIZE;
+
+                wrong += (code != NULL) != tiered || (slot != NULL) != tiered;
+                if(code) free_code(code);
+        }
+        tree->size = real;
+
+        if(wrong == 0) printf("Test Successful: compiler and cache agree on the size limit\n");
+        else printf("Test Failed: compiler and cache disagree on %d sizes\n", wrong);
+        free_tier_cache(cache);
+        cleanup_tree(tree);
+}
+
+int main() {
+        printf("Testing compiled expressions against the tree...\n");
+        test_equivalence();
+        printf("Testing promotion of a hot expression...\n");
+        test_promotion();
+        printf("Testing the size limit...\n");
+        test_size_limit();
+        return 0;
+}
@@ -0,0 +1,311 @@
+/**
+ * Test and benchmark for the value type of a build. Checks the division,
+ * remainder and overflow results of the build's type, then times the
+ * evaluator on random expressions against a hand-written evaluator for the
+ * same type that does no overflow checks, which must give the same
+ * results at nearly the same speed. Also checks that value_format() and
+ * format_digits() write the same bytes as printf, and times them against
+ * it. Build it once per type, with no flag, -DVALUE_INT64 or
+ * -DVALUE_DOUBLE on every file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+#include "scan.h"
+#include "forkjoin.h"
+#include "diag.h"
+
+#define EXPRESSIONS 2000
+#define ROUNDS 200
+#define REPEATS 9
+#define SLACK 1.15 /// Slowest the evaluator may be next to the hand-written one
+#define FORMATS 1000000 /// Random values formatted both ways
+
+#if defined(VALUE_DOUBLE)
+typedef double ref_t;
+#elif defined(VALUE_INT64)
+typedef long long ref_t;
+#else
+typedef int ref_t;
+#endif
+
+typedef struct expect_s {
+        const char * exp;
+        const char * value; /// As printed with VALUE_FMT, NULL if it must fail
+} expect_t;
+
+static const expect_t expected[] = {
+#if defined(VALUE_DOUBLE)
+        { "7 2 /", "3.5" },
+        { "-7 2 /", "-3.5" },
+        { "-7 2 %", "-1" },
+        { "7 -2 %", "1" },
+        { "1 3 /", "0.333333333333333" },
+        { "-2147483648 -1 /", "2147483648" },
+        { "4000000000", "4000000000" },
+        { "9223372036854775807 2 *", "1.84467440737096e+19" },
+#elif defined(VALUE_INT64)
+        { "7 2 /", "3" },
+        { "-7 2 /", "-3" },
+        { "-7 2 %", "-1" },
+        { "7 -2 %", "1" },
+        { "1 3 /", "0" },
+        { "-2147483648 -1 /", "2147483648" },
+        { "4000000000", "4000000000" },
+        { "-9223372036854775808 -1 /", NULL },
+        { "9223372036854775807 1 + 2 /", "4611686018427387904" },
+        { "9223372036854775807 9223372036854775807 * 9223372036854775807 /", "9223372036854775807" },
+        { "-9223372036854775808 -1 %", "0" },
+#else
+        { "7 2 /", "3" },
+        { "-7 2 /", "-3" },
+        { "-7 2 %", "-1" },
+        { "7 -2 %", "1" },
+        { "1 3 /", "0" },
+        { "-2147483648 -1 /", NULL },
+        { "-2147483648 -1 %", "0" },
+        { "-2147483648 -1 / -1 *", "-2147483648" },
+        { "4000000000", NULL },
+        { "4000000000 2 /", "2000000000" },
+        { "2147483647 1 + 2147483647 -", "1" },
+        { "65536 65536 * 65536 %", "0" },
+#endif
+        { "5 0 /", NULL },
+        { "5 0 %", NULL },
+};
+
+static double now_ms(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// keeps the division by zero and overflow reports out of the output
+void drop(const char * msg, void * arg) {
+        (void)msg;
+        (void)arg;
+}
+
+// eval_node() written for one type, without value.h
+ref_t ref_eval(tree_node_t * node, symtab_snapshot_t * snap, eval_error_t * err) {
+        if(node == NULL) return 0;
+        if(node->type == LEAF) {
+                leaf_node_t * leaf = (leaf_node_t *)node->node;
+                if(leaf->exp_type == INTEGER) return (ref_t)scan_long(node->token, strlen(node->token));
+                symbol_t * symbol = lookup_snapshot(snap, node->token);
+                if(symbol != NULL) return symbol->val;
+                if(*err == EVAL_OK) *err = EVAL_UNDEFINED_SYMBOL;
+                return 0;
+        }
+
+        interior_node_t * interior = (interior_node_t *)node->node;
+        if(node->pure && node->size >= FORK_MIN_SIZE) return 0;
+        if(interior->op == Q_OP) {
+                interior_node_t * alt = (interior_node_t *)interior->right->node;
+                return ref_eval(ref_eval(interior->left, snap, err) ? alt->left : alt->right, snap, err);
+        }
+
+        ref_t left = 0;
+        if(interior->op != ASSIGN_OP) left = ref_eval(interior->left, snap, err);
+        ref_t right = ref_eval(interior->right, snap, err);
+        switch(interior->op) {
+                case ADD_OP: return left + right;
+                case SUB_OP: return left - right;
+                case MUL_OP: return left * right;
+                case DIV_OP:
+                case MOD_OP:
+                        if(right == 0) {
+                                if(*err == EVAL_OK) *err = EVAL_DIVISION_BY_ZERO;
+                                return 0;
+                        }
+#if defined(VALUE_DOUBLE)
+                        return interior->op == DIV_OP ? left / right : fmod(left, right);
+#else
+                        if(right == -1) return interior->op == DIV_OP ? -left : 0;
+                        return interior->op == DIV_OP ? left / right : left % right;
+#endif
+                default:
+                        if(*err == EVAL_OK) *err = EVAL_INVALID_OPERATOR;
+                        return 0;
+        }
+}
+
+// a pure postfix expression over small literals and a..e
+size_t random_text(char * buf, int depth, unsigned int * seed) {
+        const char * ops[] = { "+", "-", "*", "/", "%" };
+        size_t len;
+
+        if(depth <= 0 || rand_r(seed) % 4 == 0) {
+                if(rand_r(seed) % 2) return sprintf(buf, "%d", rand_r(seed) % 9 + 1);
+                return sprintf(buf, "%c", "abcde"[rand_r(seed) % 5]);
+        }
+        len = random_text(buf, depth - 1, seed);
+        buf[len++] = ' ';
+        len += random_text(buf + len, depth - 1, seed);
+        return len + sprintf(buf + len, " %s", ops[rand_r(seed) % 5]);
+}
+
+void test_semantics(void) {
+        int wrong = 0;
+
+        set_diag_sink(drop, NULL);
+        for(size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+                char text[64], got[64];
+                eval_error_t err;
+
+                snprintf(text, sizeof(text), "%s", expected[i].exp);
+                tree_node_t * tree = make_parse_tree(text);
+                value_t value = eval_tree_status(tree, &err);
+                snprintf(got, sizeof(got), VALUE_FMT, value);
+
+                if(expected[i].value ? err != EVAL_OK || strcmp(got, expected[i].value) != 0 : err == EVAL_OK) {
+                        printf("'%s' gave %s (%d)\n", expected[i].exp, got, err);
+                        wrong++;
+                }
+                cleanup_tree(tree);
+        }
+        set_diag_sink(NULL, NULL);
+
+        if(wrong == 0) printf("Test Successful: %s division, remainder and overflow\n", VALUE_NAME);
+        else printf("Test Failed: %d wrong %s results\n", wrong, VALUE_NAME);
+}
+
+void test_speed(void) {
+        const char * names[] = { "a", "b", "c", "d", "e" };
+        tree_node_t * trees[EXPRESSIONS];
+        unsigned int seed = 11;
+        char text[4096];
+        int wrong = 0;
+
+        for(int i = 0; i < 5; i++) add_symbol((char *)names[i], i + 2);
+        // only expressions without errors, whose reports would dominate
+        for(int i = 0; i < EXPRESSIONS; i++) {
+                eval_error_t err;
+                do {
+                        random_text(text, 7, &seed);
+                        trees[i] = make_parse_tree(text);
+                        set_diag_sink(drop, NULL);
+                        eval_tree_status(trees[i], &err);
+                        set_diag_sink(NULL, NULL);
+                        if(err != EVAL_OK) cleanup_tree(trees[i]);
+                } while(err != EVAL_OK);
+        }
+
+        symtab_snapshot_t * snap = pin_table();
+        double best = 1e30, best_ref = 1e30;
+        volatile value_t sink = 0;
+
+        set_diag_sink(drop, NULL);
+        for(int r = 0; r < REPEATS; r++) {
+                double start = now_ms();
+                for(int round = 0; round < ROUNDS; round++) {
+                        for(int i = 0; i < EXPRESSIONS; i++) {
+                                eval_error_t err = EVAL_OK;
+                                sink = eval_snapshot(trees[i], snap, &err);
+                        }
+                }
+                double took = now_ms() - start;
+                if(took < best) best = took;
+
+                start = now_ms();
+                for(int round = 0; round < ROUNDS; round++) {
+                        for(int i = 0; i < EXPRESSIONS; i++) {
+                                eval_error_t err = EVAL_OK;
+                                sink = ref_eval(trees[i], snap, &err);
+                        }
+                }
+                took = now_ms() - start;
+                if(took < best_ref) best_ref = took;
+        }
+
+        for(int i = 0; i < EXPRESSIONS; i++) {
+                eval_error_t e1 = EVAL_OK, e2 = EVAL_OK;
+                value_t got = eval_snapshot(trees[i], snap, &e1);
+                ref_t want = ref_eval(trees[i], snap, &e2);
+                if(e1 != e2 || (e1 == EVAL_OK && got != want)) wrong++;
+                cleanup_tree(trees[i]);
+        }
+        set_diag_sink(NULL, NULL);
+        unpin_table(snap);
+        free_table();
+        (void)sink;
+
+        printf("%s: evaluator %.1f ms, hand-written %.1f ms for %d expressions (%+.1f%%)\n",
+                        VALUE_NAME, best, best_ref, EXPRESSIONS * ROUNDS, (best / best_ref - 1) * 100);
+        if(wrong == 0 && best <= best_ref * SLACK) printf("Test Successful: overflow checks cost next to nothing\n");
+        else printf("Test Failed: %d wrong results, %.2fx the hand-written time\n", wrong, best / best_ref);
+}
+
+// a random value of random width and sign
+value_t random_value(unsigned int * seed) {
+        uint64_t bits = ((uint64_t)rand_r(seed) << 42) ^ ((uint64_t)rand_r(seed) << 21) ^ (uint64_t)rand_r(seed);
+        bits >>= rand_r(seed) % 64;
+#if defined(VALUE_DOUBLE)
+        return (rand_r(seed) % 2 ? -1.0 : 1.0) * (double)bits / (double)(1 + rand_r(seed) % 1000);
+#else
+        value_t val = (value_t)bits;
+        return rand_r(seed) % 2 ? val : (value_t)(0 - (uint64_t)val);
+#endif
+}
+
+void test_format(void) {
+        char want[64], got[64];
+        int wrong = 0;
+
+        // every width of unsigned integer, at and around its powers of ten
+        uint64_t power = 1;
+        for(int i = 0; i < 20; i++, power *= 10) {
+                uint64_t around[] = { power - 1, power, power + 1, power * 9 + (power - 1) };
+                for(int j = 0; j < 4; j++) {
+                        snprintf(want, sizeof(want), "%" PRIu64, around[j]);
+                        size_t len = format_digits(around[j], got);
+                        wrong += len != strlen(want) || strcmp(want, got) != 0;
+                }
+        }
+        snprintf(want, sizeof(want), "%" PRIu64, UINT64_MAX);
+        wrong += format_digits(UINT64_MAX, got) != strlen(want) || strcmp(want, got) != 0;
+
+        // the ends of the value type, then random values
+#if defined(VALUE_DOUBLE)
+        value_t edges[] = { 0, -0.0, 1, -1, 0.1, 1e15, 1e16, -1e300, 5e-324, 1.0 / 3, 2147483648.0 };
+#else
+        value_t edges[] = { 0, 1, -1, 9, -9, 10, -10, VALUE_MAX, VALUE_MIN, VALUE_MAX - 1, VALUE_MIN + 1 };
+#endif
+        unsigned int seed = 5;
+        static value_t values[FORMATS];
+        for(int i = 0; i < FORMATS; i++) values[i] = i < (int)(sizeof(edges) / sizeof(edges[0])) ? edges[i] : random_value(&seed);
+
+        for(int i = 0; i < FORMATS; i++) {
+                int want_len = snprintf(want, sizeof(want), VALUE_FMT, values[i]);
+                size_t len = value_format(values[i], got);
+                if(len != (size_t)want_len || memcmp(want, got, len + 1) != 0) {
+                        if(wrong < 5) printf("'%s' formatted as '%s'\n", want, got);
+                        wrong++;
+                }
+        }
+
+        size_t sink = 0;
+        double start = now_ms();
+        for(int i = 0; i < FORMATS; i++) sink += (size_t)snprintf(want, sizeof(want), VALUE_FMT, values[i]);
+        double printf_ms = now_ms() - start;
+        start = now_ms();
+        for(int i = 0; i < FORMATS; i++) sink += value_format(values[i], got);
+        double format_ms = now_ms() - start;
+        (void)sink;
+
+        printf("%s: value_format %.1f ms, snprintf %.1f ms for %d values\n", VALUE_NAME, format_ms, printf_ms, FORMATS);
+        if(wrong == 0) printf("Test Successful: every value written as printf writes it\n");
+        else printf("Test Failed: %d values written differently\n", wrong);
+}
+
+int main() {
+        printf("Testing %s arithmetic...\n", VALUE_NAME);
+        test_semantics();
+        printf("Testing %s formatting...\n", VALUE_NAME);
+        test_format();
+        printf("Timing the %s evaluator...\n", VALUE_NAME);
+        test_speed();
+        return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * Test for the write-ahead log. Assigns the widest values of the build's
+ * value type many times over, closes the log, and checks that replaying
+ * it into a fresh table gives back every last value exactly. Then limits
+ * the size of files the process may write, and checks that writes the
+ * log cannot hold are never reported durable.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include "symtab.h"
+#include "wal.h"
+
+#define PATH "test_wal.log"
+#define ROUNDS 20000
+
+#ifdef VALUE_DOUBLE
+static const value_t extremes[] = { -1.2345678901234567e-308, -DBL_MAX, 0.1, -4.9406564584124654e-324 };
+#else
+static const value_t extremes[] = { VALUE_MIN, VALUE_MAX, VALUE_MIN + 1, -1 };
+#endif
+#define COUNT (sizeof(extremes) / sizeof(extremes[0]))
+
+static const char * names[COUNT] = { "x", "a_rather_long_symbol_name_to_log", "y", "z" };
+
+void remove_files(void) {
+        remove(PATH);
+        remove(PATH ".snap");
+        remove(PATH ".old");
+}
+
+void test_round_trip(void) {
+        symtab_t * table = make_table();
+        remove_files();
+        for(size_t i = 0; i < COUNT; i++) symtab_add(table, names[i], 0);
+
+        if(wal_open(table, PATH, 1) < 0) {
+                printf("Test Failed: could not open the log\n");
+                destroy_table(table);
+                return;
+        }
+
+        // every round shifts the values, so the last round decides them
+        for(int r = 0; r < ROUNDS; r++) {
+                for(size_t i = 0; i < COUNT; i++) symtab_assign(table, names[i], extremes[(i + r) % COUNT]);
+        }
+        wal_wait(wal_lsn());
+        wal_close();
+        destroy_table(table);
+
+        table = make_table();
+        for(size_t i = 0; i < COUNT; i++) symtab_add(table, names[i], 0);
+        int rc = wal_open(table, PATH, 1);
+        wal_close();
+
+        int wrong = rc < 0;
+        symtab_snapshot_t * snap = symtab_pin(table);
+        for(size_t i = 0; i < COUNT; i++) {
+                symbol_t * symbol = lookup_snapshot(snap, names[i]);
+                value_t expected = extremes[(i + ROUNDS - 1) % COUNT];
+                if(!symbol || memcmp(&symbol->val, &expected, sizeof(value_t)) != 0) {
+                        printf("'%s' replayed as " VALUE_EXACT_FMT ", expected " VALUE_EXACT_FMT "\n",
+                                        names[i], symbol ? symbol->val : 0, expected);
+                        wrong++;
+                }
+        }
+        unpin_table(snap);
+        destroy_table(table);
+        remove_files();
+
+        if(wrong == 0) printf("Test Successful: %d rounds of " VALUE_NAME " extremes replayed exactly\n", ROUNDS);
+        else printf("Test Failed: %d values lost in the log\n", wrong);
+}
+
+void test_failure(void) {
+        symtab_t * table = make_table();
+        remove_files();
+        symtab_add(table, "x", 0);
+
+        if(wal_open(table, PATH, 1) < 0) {
+                printf("Test Failed: could not open the log\n");
+                destroy_table(table);
+                return;
+        }
+        symtab_assign(table, "x", 1);
+        unsigned long first = wal_lsn();
+        int wrong = wal_wait(first) != 0;
+
+        // writing past the limit fails with EFBIG instead of a signal
+        struct rlimit old, limit;
+        getrlimit(RLIMIT_FSIZE, &old);
+        limit = old;
+        limit.rlim_cur = 4096;
+        signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &limit);
+
+        for(int i = 0; i < 1000; i++) symtab_assign(table, "x", i);
+        unsigned long last = wal_lsn();
+        wrong += wal_wait(last) != -1 || wal_wait(first) != 0;
+
+        // a later write that does fit is not durable either
+        setrlimit(RLIMIT_FSIZE, &old);
+        symtab_assign(table, "x", 2);
+        wrong += wal_wait(wal_lsn()) != -1;
+
+        wal_close();
+        destroy_table(table);
+        remove_files();
+
+        if(wrong == 0) printf("Test Successful: writes the log lost are not reported durable\n");
+        else printf("Test Failed: %d lost writes reported durable\n", wrong);
+}
+
+int main() {
+        printf("Testing log round trip...\n");
+        test_round_trip();
+        printf("Testing failed log writes...\n");
+        test_failure();
+        return 0;
+}
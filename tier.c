@@ -0,0 +1,617 @@
+/**
+ * Implementation of tiered execution. Every prepared expression counts
+ * its runs. The run that reaches the hot threshold queues the expression
+ * for the compiler thread and goes on walking the tree; later runs pick up
+ * the compiled program as soon as it is published, so compiling never
+ * holds up an evaluation.
+ *
+ * A program is the expression in postfix order as an array of
+ * instructions for a small stack machine: literals are converted once,
+ * operators need no dispatch on the node type, and a ternary becomes a
+ * conditional jump over the arm it does not take. Running it has exactly
+ * the effects of eval_tree_in(): the same evaluation order, the same
+ * errors reported the same way, assignments re-pinning the table, and the
+ * result cache consulted for expressions without assignments. Trees that
+ * eval_tree_in() would reject without evaluating them, and trees large
+ * enough for the fork-join evaluator, are not compiled.
+ *
+ * Time spent in each tier and in the compiler is counted so the hot
+ * threshold can be tuned with tier_report().
+ *
+ * @file        tier.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "tier.h"
+#include "memo.h"
+#include "diag.h"
+
+/// What an instruction does
+typedef enum instr_kind_e {
+        INSTR_PUSH, /// Push value
+        INSTR_LOAD, /// Push the value of the symbol name
+        INSTR_ADD,
+        INSTR_SUB,
+        INSTR_MUL,
+        INSTR_APPLY, /// Replace the top two values by apply_num(arg, ...)
+        INSTR_STORE, /// Assign the top value to the symbol name
+        INSTR_JUMP_ZERO, /// Pop a value and jump to arg if it is 0
+        INSTR_JUMP /// Jump to arg
+} instr_kind_t;
+
+/// One instruction of a program
+typedef struct instr_s {
+        instr_kind_t kind;
+        int arg; /// Operator or jump target
+        value_t value; /// Literal of a push
+        const char * name; /// Symbol of a load or store, a token of the tree
+} instr_t;
+
+/// Slots of expressions run before, by structure, see tier_cached()
+struct tier_cache_s {
+        tier_slot_t ** slots; /// One per possible hash, masked; each owns its tree
+        size_t mask;
+};
+
+/// A compiled expression
+struct code_s {
+        tree_node_t * tree; /// The expression the program was compiled from
+        instr_t * instrs;
+        size_t count, cap;
+        int depth; /// Most values on the stack at once
+};
+
+static unsigned long hot = TIER_DEFAULT_HOT; /// Runs that make an expression hot
+static int running = 0;
+static int stopping = 0;
+static pthread_t compiler;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER; /// Guards the queue and compiling
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER; /// Signals the compiler
+static pthread_cond_t compiled = PTHREAD_COND_INITIALIZER; /// Signals tier_forget()
+static tier_slot_t * queue_head = NULL;
+static tier_slot_t * queue_tail = NULL;
+static tier_slot_t * compiling = NULL; /// The slot the compiler is working on
+
+static atomic_ulong tree_runs, code_runs; /// Runs in each tier
+static atomic_ulong tree_ns, code_ns; /// Time spent in each tier
+static atomic_ulong promoted, stuck; /// Expressions compiled, and not compilable
+static atomic_ulong compile_ns, code_bytes;
+
+/**
+ * Reads a monotonic clock.
+ *
+ * @return: The time in nanoseconds
+ */
+static unsigned long now_ns(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long)ts.tv_sec * 1000000000ul + (unsigned long)ts.tv_nsec;
+}
+
+/**
+ * Appends an instruction to a program.
+ *
+ * @param code: A pointer to the program
+ * @param kind: What the instruction does
+ * @param arg: Its operator or jump target
+ * @param name: Its symbol, or NULL
+ * @return: The index of the instruction, or -1 if memory allocation fails
+ */
+static long emit(code_t * code, instr_kind_t kind, int arg, const char * name) {
+        if(code->count == code->cap) {
+                size_t cap = code->cap ? 2 * code->cap : 16;
+                instr_t * grown = realloc(code->instrs, cap * sizeof(instr_t));
+                if(!grown) return -1;
+                code->instrs = grown;
+                code->cap = cap;
+        }
+        code->instrs[code->count] = (instr_t){ kind, arg, 0, name };
+        return (long)code->count++;
+}
+
+/**
+ * Compiles a subtree, in the order eval_node() evaluates it.
+ *
+ * @param code: A pointer to the program
+ * @param node: A pointer to the root of the subtree
+ * @param depth: The number of values on the stack below the subtree's
+ * @return: 0 on success, -1 if the subtree is not compilable or memory
+ *      allocation fails
+ */
+static int compile_node(code_t * code, tree_node_t * node, int depth) {
+        if(depth + 1 > code->depth) code->depth = depth + 1;
+
+        if(node->type == LEAF) {
+                if(((leaf_node_t *)node->node)->exp_type == INTEGER) {
+                        // literals that only fit a bignum stay on the tree
+                        eval_error_t err = EVAL_OK;
+                        num_t literal = literal_num(node->token, strlen(node->token), &err);
+                        if(literal.big || err != EVAL_OK) {
+                                free_num(literal);
+                                return -1;
+                        }
+
+                        long at = emit(code, INSTR_PUSH, 0, NULL);
+                        if(at < 0) return -1;
+                        code->instrs[at].value = literal.val;
+                        return 0;
+                }
+                return emit(code, INSTR_LOAD, 0, node->token) < 0 ? -1 : 0;
+        }
+
+        interior_node_t * interior = (interior_node_t *)node->node;
+
+        if(interior->op == Q_OP) {
+                tree_node_t * arms = interior->right;
+                if(arms->type != INTERIOR || ((interior_node_t *)arms->node)->op != ALT_OP) return -1;
+
+                interior_node_t * alt = (interior_node_t *)arms->node;
+                if(compile_node(code, interior->left, depth) < 0) return -1;
+                long skip = emit(code, INSTR_JUMP_ZERO, 0, NULL);
+                if(skip < 0 || compile_node(code, alt->left, depth) < 0) return -1;
+                long done = emit(code, INSTR_JUMP, 0, NULL);
+                if(done < 0) return -1;
+                code->instrs[skip].arg = (int)code->count;
+                if(compile_node(code, alt->right, depth) < 0) return -1;
+                code->instrs[done].arg = (int)code->count;
+                return 0;
+        }
+
+        if(interior->op == ASSIGN_OP) {
+                tree_node_t * target = interior->left;
+                if(target->type != LEAF || ((leaf_node_t *)target->node)->exp_type != SYMBOL) return -1;
+                if(compile_node(code, interior->right, depth) < 0) return -1;
+                return emit(code, INSTR_STORE, 0, target->token) < 0 ? -1 : 0;
+        }
+
+        if(compile_node(code, interior->left, depth) < 0 || compile_node(code, interior->right, depth + 1) < 0) return -1;
+
+        instr_kind_t kind = interior->op == ADD_OP ? INSTR_ADD : interior->op == SUB_OP ? INSTR_SUB :
+                interior->op == MUL_OP ? INSTR_MUL : INSTR_APPLY;
+        return emit(code, kind, (int)interior->op, NULL) < 0 ? -1 : 0;
+}
+
+/**
+ * Compiles an expression tree to a program.
+ *
+ * @param tree: A pointer to the root of the tree, which must outlive the
+ *      program, as the program refers to its symbol names
+ * @return: A pointer to the program, or NULL if the tree is too large or
+ *      eval_tree_in() would reject it, or if memory allocation fails
+ */
+code_t * compile_tree(tree_node_t * tree) {
+        if(tree == NULL || tree->size >= TIER_MAX_SIZE) return NULL;
+
+        code_t * code = calloc(1, sizeof(code_t));
+        if(!code) return NULL;
+
+        code->tree = tree;
+        if(compile_node(code, tree, 0) < 0) {
+                free_code(code);
+                return NULL;
+        }
+        return code;
+}
+
+/**
+ * Records why an evaluation failed, unless an earlier error already did.
+ */
+static void fail(eval_error_t * err, eval_error_t why) {
+        if(*err == EVAL_OK) *err = why;
+}
+
+/**
+ * Runs a program on a value stack.
+ *
+ * @param code: A pointer to the program
+ * @param stack: The value stack, with room for code->depth values
+ * @param table: The table assignments write to
+ * @param snap: The pinned snapshot, re-pinned after each assignment
+ * @param reads: The symbols read so far, for the result cache, or NULL
+ * @param err: A pointer to the evaluation's error status
+ * @return: The exact value the program leaves on the stack
+ */
+static num_t execute(code_t * code, num_t * stack, symtab_t * table, symtab_snapshot_t ** snap, memo_reads_t * reads, eval_error_t * err) {
+        num_t * sp = stack;
+        instr_t * instrs = code->instrs;
+        value_t val;
+
+        for(size_t pc = 0; pc < code->count; pc++) {
+                instr_t * in = &instrs[pc];
+                switch(in->kind) {
+                        case INSTR_PUSH:
+                                *sp++ = NUM(in->value);
+                                break;
+                        case INSTR_LOAD: {
+                                symbol_t * symbol = lookup_interned(*snap, in->name);
+                                memo_read(reads, in->name);
+                                if(symbol != NULL) {
+                                        *sp++ = NUM(symbol_value(symbol));
+                                } else {
+                                        diag("Error: undefined symbol '%s'\n", in->name);
+                                        fail(err, EVAL_UNDEFINED_SYMBOL);
+                                        *sp++ = NUM(0);
+                                }
+                                break;
+                        }
+                        case INSTR_ADD:
+                                sp--;
+                                if(!sp[-1].big && !sp[0].big && !value_add(sp[-1].val, sp[0].val, &val)) sp[-1].val = val;
+                                else sp[-1] = apply_num(ADD_OP, sp[-1], sp[0], err);
+                                break;
+                        case INSTR_SUB:
+                                sp--;
+                                if(!sp[-1].big && !sp[0].big && !value_sub(sp[-1].val, sp[0].val, &val)) sp[-1].val = val;
+                                else sp[-1] = apply_num(SUB_OP, sp[-1], sp[0], err);
+                                break;
+                        case INSTR_MUL:
+                                sp--;
+                                if(!sp[-1].big && !sp[0].big && !value_mul(sp[-1].val, sp[0].val, &val)) sp[-1].val = val;
+                                else sp[-1] = apply_num(MUL_OP, sp[-1], sp[0], err);
+                                break;
+                        case INSTR_APPLY:
+                                sp--;
+                                sp[-1] = apply_num((op_type_t)in->arg, sp[-1], sp[0], err);
+                                break;
+                        case INSTR_STORE:
+                                if(sp[-1].big) {
+                                        diag("Error: value assigned to '%s' is out of range\n", in->name);
+                                        fail(err, EVAL_OVERFLOW);
+                                        free_num(sp[-1]);
+                                        sp[-1] = NUM(0);
+                                } else if(table && symtab_assign(table, in->name, sp[-1].val) != NULL) {
+                                        unpin_table(*snap);
+                                        *snap = symtab_pin(table);
+                                } else {
+                                        diag("Error: undefined symbol '%s'\n", in->name);
+                                        fail(err, EVAL_UNDEFINED_SYMBOL);
+                                        sp[-1] = NUM(0);
+                                }
+                                break;
+                        case INSTR_JUMP_ZERO:
+                                sp--;
+                                if(!sp->big && sp->val == 0) pc = (size_t)in->arg - 1;
+                                free_num(*sp);
+                                break;
+                        case INSTR_JUMP:
+                                pc = (size_t)in->arg - 1;
+                                break;
+                }
+        }
+        return stack[0];
+}
+
+/**
+ * Runs a compiled expression against a symbol table, with the same
+ * effects as eval_tree_in() on the tree it was compiled from.
+ *
+ * @param code: A pointer to the program
+ * @param table: A pointer to the table to read and assign symbols in
+ * @param err: A pointer to store why the evaluation failed at, or EVAL_OK
+ * @return: The result of the evaluation
+ */
+value_t run_code(code_t * code, symtab_t * table, eval_error_t * err) {
+        *err = EVAL_OK;
+
+        symtab_snapshot_t * snap = symtab_pin(table);
+        value_t result;
+        if(memo_lookup(code->tree, snap, &result) == 0) {
+                unpin_table(snap);
+                return result;
+        }
+
+        num_t small[TIER_SMALL_STACK];
+        num_t * stack = code->depth <= TIER_SMALL_STACK ? small : malloc(code->depth * sizeof(num_t));
+        if(!stack) {
+                unpin_table(snap);
+                return eval_tree_in(table, code->tree, err);
+        }
+
+        memo_reads_t watch, * reads = memo_watch(code->tree, &watch);
+        result = num_value(execute(code, stack, table, &snap, reads, err), err);
+        if(*err == EVAL_OK) memo_store(code->tree, reads, snap, result);
+
+        memo_unwatch(reads);
+        if(stack != small) free(stack);
+        unpin_table(snap);
+        return result;
+}
+
+/**
+ * Measures the memory a program takes.
+ *
+ * @param code: A pointer to the program
+ * @return: Its size in bytes
+ */
+size_t code_size(code_t * code) {
+        return sizeof(code_t) + code->cap * sizeof(instr_t);
+}
+
+/**
+ * Frees a program.
+ *
+ * @param code: A pointer to the program, may be NULL
+ */
+void free_code(code_t * code) {
+        if(code == NULL) return;
+
+        free(code->instrs);
+        free(code);
+}
+
+/**
+ * Compiler thread: compiles queued expressions one at a time.
+ *
+ * @param arg: Unused
+ * @return: NULL
+ */
+static void * compile_loop(void * arg) {
+        (void)arg;
+
+        pthread_mutex_lock(&queue_lock);
+        while(1) {
+                while(!stopping && queue_head == NULL) pthread_cond_wait(&queued, &queue_lock);
+                if(stopping) break;
+
+                tier_slot_t * slot = queue_head;
+                queue_head = slot->next;
+                if(queue_head == NULL) queue_tail = NULL;
+                compiling = slot;
+                pthread_mutex_unlock(&queue_lock);
+
+                unsigned long start = now_ns();
+                code_t * code = compile_tree(slot->tree);
+                atomic_fetch_add(&compile_ns, now_ns() - start);
+
+                if(code) {
+                        atomic_fetch_add(&promoted, 1);
+                        atomic_fetch_add(&code_bytes, code_size(code));
+                        atomic_store_explicit(&slot->code, code, memory_order_release);
+                        atomic_store(&slot->state, TIER_CODE);
+                } else {
+                        atomic_fetch_add(&stuck, 1);
+                        atomic_store(&slot->state, TIER_STUCK);
+                }
+
+                pthread_mutex_lock(&queue_lock);
+                compiling = NULL;
+                pthread_cond_broadcast(&compiled);
+        }
+        pthread_mutex_unlock(&queue_lock);
+        return NULL;
+}
+
+/**
+ * Starts tiered execution and its compiler thread. Does nothing if it is
+ * already running.
+ *
+ * @param runs: The number of runs after which an expression is compiled
+ * @return: 0 on success, -1 if the compiler thread could not be started
+ */
+int tier_start(unsigned long runs) {
+        if(running) return 0;
+
+        hot = runs > 0 ? runs : TIER_DEFAULT_HOT;
+        stopping = 0;
+        if(pthread_create(&compiler, NULL, compile_loop, NULL) != 0) {
+                perror("Failed to start compiler thread");
+                return -1;
+        }
+        running = 1;
+        return 0;
+}
+
+/**
+ * Checks if expressions are being promoted.
+ *
+ * @return: 1 if tier_start() was called, 0 otherwise
+ */
+int tier_enabled(void) {
+        return running;
+}
+
+/**
+ * Sets up the tiering state of a new prepared expression.
+ *
+ * @param slot: A pointer to the state
+ * @param tree: A pointer to the expression's tree
+ */
+void tier_init(tier_slot_t * slot, tree_node_t * tree) {
+        slot->tree = tree;
+        atomic_init(&slot->runs, 0);
+        atomic_init(&slot->state, TIER_TREE);
+        atomic_init(&slot->code, NULL);
+        slot->next = NULL;
+}
+
+/**
+ * Queues an expression for the compiler thread.
+ *
+ * @param slot: A pointer to the expression's state, in TIER_QUEUED
+ */
+static void submit(tier_slot_t * slot) {
+        pthread_mutex_lock(&queue_lock);
+        slot->next = NULL;
+        if(queue_tail) queue_tail->next = slot;
+        else queue_head = slot;
+        queue_tail = slot;
+        pthread_cond_signal(&queued);
+        pthread_mutex_unlock(&queue_lock);
+}
+
+/**
+ * Evaluates a prepared expression in the highest tier it has reached,
+ * queueing it for compilation when it becomes hot.
+ *
+ * @param slot: A pointer to the expression's state
+ * @param table: A pointer to the table to read and assign symbols in
+ * @param err: A pointer to store why the evaluation failed at, or EVAL_OK
+ * @return: The result of the evaluation
+ */
+value_t tier_eval(tier_slot_t * slot, symtab_t * table, eval_error_t * err) {
+        code_t * code = atomic_load_explicit(&slot->code, memory_order_acquire);
+        unsigned long start = now_ns();
+        value_t result;
+
+        if(code) {
+                result = run_code(code, table, err);
+                atomic_fetch_add_explicit(&code_runs, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&code_ns, now_ns() - start, memory_order_relaxed);
+                return result;
+        }
+
+        result = eval_tree_in(table, slot->tree, err);
+        atomic_fetch_add_explicit(&tree_runs, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&tree_ns, now_ns() - start, memory_order_relaxed);
+
+        int idle = TIER_TREE;
+        if(running && atomic_fetch_add_explicit(&slot->runs, 1, memory_order_relaxed) + 1 >= hot &&
+                        atomic_compare_exchange_strong(&slot->state, &idle, TIER_QUEUED)) submit(slot);
+        return result;
+}
+
+/**
+ * Takes an expression out of tiering before it is freed: drops it from
+ * the queue, waits if it is being compiled, and frees its program.
+ *
+ * @param slot: A pointer to the expression's state
+ */
+void tier_forget(tier_slot_t * slot) {
+        if(atomic_load(&slot->state) == TIER_QUEUED) {
+                pthread_mutex_lock(&queue_lock);
+                tier_slot_t * prev = NULL;
+                for(tier_slot_t * cur = queue_head; cur; prev = cur, cur = cur->next) {
+                        if(cur != slot) continue;
+                        if(prev) prev->next = cur->next;
+                        else queue_head = cur->next;
+                        if(queue_tail == cur) queue_tail = prev;
+                        break;
+                }
+                while(compiling == slot) pthread_cond_wait(&compiled, &queue_lock);
+                pthread_mutex_unlock(&queue_lock);
+        }
+
+        code_t * code = atomic_exchange(&slot->code, NULL);
+        if(code) {
+                atomic_fetch_sub(&code_bytes, code_size(code));
+                free_code(code);
+        }
+}
+
+/**
+ * Makes a cache of tier slots for callers that parse the same expression
+ * again and again, such as the interpreter reading one line at a time, so
+ * the runs of every copy add up on one slot. The cache is direct-mapped by
+ * the structural hash of the tree, and a new expression replaces whatever
+ * was in its slot. It is used by one thread.
+ *
+ * @param count: The number of slots, rounded up to a power of two
+ * @return: A pointer to the cache, or NULL if memory allocation fails
+ */
+tier_cache_t * make_tier_cache(size_t count) {
+        size_t size = 1;
+        while(size < count) size *= 2;
+
+        tier_cache_t * cache = malloc(sizeof(tier_cache_t));
+        tier_slot_t ** slots = calloc(size, sizeof(tier_slot_t *));
+        if(!cache || !slots) {
+                free(cache);
+                free(slots);
+                return NULL;
+        }
+        cache->slots = slots;
+        cache->mask = size - 1;
+        return cache;
+}
+
+/**
+ * Frees a cached slot along with its program and its copy of the tree.
+ *
+ * @param slot: A pointer to the slot, may be NULL
+ */
+static void drop_slot(tier_slot_t * slot) {
+        if(slot == NULL) return;
+
+        tier_forget(slot);
+        cleanup_tree(slot->tree);
+        free(slot);
+}
+
+/**
+ * Finds the slot of an expression with the same structure and tokens as
+ * a tree, adding one with a private copy of the tree if there is none.
+ *
+ * @param cache: A pointer to the cache
+ * @param tree: A pointer to the root of the tree, still owned by the caller
+ * @return: A pointer to the slot to pass to tier_eval(), or NULL if the
+ *      tree is too large to tier or memory allocation fails
+ */
+tier_slot_t * tier_cached(tier_cache_t * cache, tree_node_t * tree) {
+        if(tree == NULL || tree->size >= TIER_MAX_SIZE) return NULL;
+
+        tier_slot_t ** entry = &cache->slots[tree->hash & cache->mask];
+        if(*entry && same_tree((*entry)->tree, tree)) return *entry;
+
+        tier_slot_t * slot = malloc(sizeof(tier_slot_t));
+        tree_node_t * copy = slot ? copy_tree(tree, NULL) : NULL;
+        if(!copy) {
+                free(slot);
+                return NULL;
+        }
+
+        drop_slot(*entry);
+        tier_init(slot, copy);
+        return *entry = slot;
+}
+
+/**
+ * Frees a cache of tier slots and every slot in it.
+ *
+ * @param cache: A pointer to the cache, may be NULL
+ */
+void free_tier_cache(tier_cache_t * cache) {
+        if(cache == NULL) return;
+
+        for(size_t i = 0; i <= cache->mask; i++) drop_slot(cache->slots[i]);
+        free(cache->slots);
+        free(cache);
+}
+
+/**
+ * Writes how many runs and how much time each tier took, and what the
+ * compiler did.
+ *
+ * @param out: The stream to write to
+ */
+void tier_report(FILE * out) {
+        if(!running && atomic_load(&tree_runs) + atomic_load(&code_runs) == 0) return;
+
+        fprintf(out, "tier: hot after %lu runs; %lu tree runs (%.1f ms), %lu code runs (%.1f ms); "
+                        "%lu promoted, %lu not compilable, %.1f ms compiling, %lu code bytes\n",
+                        hot, atomic_load(&tree_runs), atomic_load(&tree_ns) / 1e6,
+                        atomic_load(&code_runs), atomic_load(&code_ns) / 1e6,
+                        atomic_load(&promoted), atomic_load(&stuck), atomic_load(&compile_ns) / 1e6,
+                        atomic_load(&code_bytes));
+}
+
+/**
+ * Stops the compiler thread. Queued expressions stay on the tree, while
+ * compiled ones keep running their programs.
+ */
+void tier_stop(void) {
+        if(!running) return;
+
+        pthread_mutex_lock(&queue_lock);
+        stopping = 1;
+        pthread_cond_signal(&queued);
+        pthread_mutex_unlock(&queue_lock);
+        pthread_join(compiler, NULL);
+
+        queue_head = queue_tail = NULL;
+        running = 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * Interface for tiered execution. A prepared expression starts out being
+ * evaluated by walking its tree; once it has run often enough, it is
+ * compiled to a flat program on a background thread and runs that
+ * program from then on.
+ *
+ * @file        tier.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef TIER_H
+#define TIER_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include "parser.h"
+#include "forkjoin.h"
+
+#define TIER_DEFAULT_HOT 64 /// Runs before an expression is compiled
+#define TIER_MAX_SIZE FORK_MIN_SIZE /// Trees this large are left to the fork-join evaluator
+#define TIER_SMALL_STACK 64 /// Deepest program that runs without allocating
+#define TIER_CACHE_SIZE 1024 /// Slots the interpreter keeps for the expressions it reads
+
+/// How far an expression has been promoted
+typedef enum tier_state_e {
+        TIER_TREE, /// Evaluated by walking the tree
+        TIER_QUEUED, /// Waiting for, or being compiled by, the background thread
+        TIER_CODE, /// Runs its compiled program
+        TIER_STUCK /// Could not be compiled, so stays on the tree
+} tier_state_t;
+
+/// Tier slots found by expression, see make_tier_cache()
+typedef struct tier_cache_s tier_cache_t;
+
+/// A compiled expression, see compile_tree()
+typedef struct code_s code_t;
+
+/// The tiering state of one prepared expression
+typedef struct tier_slot_s {
+        tree_node_t * tree; /// The expression, owned by its prepared expression
+        atomic_ulong runs;
+        atomic_int state; /// A tier_state_t
+        code_t * _Atomic code; /// Set once the state is TIER_CODE
+        struct tier_slot_s * next; /// Next slot waiting to be compiled
+} tier_slot_t;
+
+int tier_start(unsigned long hot);
+
+int tier_enabled(void);
+
+void tier_init(tier_slot_t * slot, tree_node_t * tree);
+
+value_t tier_eval(tier_slot_t * slot, symtab_t * table, eval_error_t * err);
+
+void tier_forget(tier_slot_t * slot);
+
+tier_cache_t * make_tier_cache(size_t count);
+
+tier_slot_t * tier_cached(tier_cache_t * cache, tree_node_t * tree);
+
+void free_tier_cache(tier_cache_t * cache);
+
+void tier_report(FILE * out);
+
+void tier_stop(void);
+
+code_t * compile_tree(tree_node_t * tree);
+
+value_t run_code(code_t * code, symtab_t * table, eval_error_t * err);
+
+size_t code_size(code_t * code);
+
+void free_code(code_t * code);
+
+#endif
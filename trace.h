@@ -0,0 +1,21 @@
+/**
+ * Debug tracing for the parser, tree builder and stack. Traces are
+ * compiled in only when building with -DDEBUG_TRACE, since printing on
+ * every token would otherwise dominate the run time and interleave with
+ * the interpreter's output when several threads parse at once.
+ *
+ * @file        trace.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+#ifdef DEBUG_TRACE
+#define TRACE(...) printf(__VA_ARGS__)
+#else
+#define TRACE(...) ((void)0)
+#endif
+
+#endif
@@ -1,4 +1,4 @@
-**
+/**
  * Implementation of tree node structures for expression parsing and evaluation.
  * This file provides functions to create and manage tree nodes used in binary trees.
  * The nodes are categorized into *interior* nodes, representing operators, and *leaf* nodes,
@@ -17,23 +17,59 @@
 #include <stdlib.h>
 #include <string.h>
 #include "tree_node.h"
+#include "intern.h"
+#include "diag.h"
+#include "trace.h"
 
 /**
  * Creates an interior tree node. Interior nodes are used to represent operations
  * in expression trees.
  *
  * @param op: The operator type (e.g., ADD, SUBTRACT, etc.)
- * @param token: The string representation of the operator
+ * @param token: The string representation of the operator, interned by
+ *      the node
  * @param left: Pointer to the left child node
  * @param right: Pointer to the right child node
  * @return: A pointer to the newly created interior node, or NULL if an error occurs
  */
-tree_node_t * make_interior(op_type_t op, char * token, tree_node_t * left, tree_node_t * right) {
+tree_node_t * make_interior(op_type_t op, const char * token, tree_node_t * left, tree_node_t * right) {
         if(!left || !right) {
-                fprintf(stderr, "Error: NULL left or right node passed to make_interior()\n");
+                diag("Error: NULL left or right node passed to make_interior()\n");
+                return NULL;
+        }
+
+        if(!token || token[0] == '\0') {
+                diag("[make_interior]: received invalid or empty token\n");
+                return NULL;
+        }
+        TRACE("[make_interior]: Tok = %s\n", token);
+        const char * handle = intern(token);
+        if(!handle) {
+                diag("[make_interior]: failed to intern token '%s'\n", token);
                 return NULL;
         }
 
+        tree_node_t * node = make_interior_hashed(op, handle, left, right, 0);
+        if(node) measure_interior(node);
+        TRACE("\t[make_interior]: Created interior node: op='%d', token='%s'\n", op, token);
+        return node;
+}
+
+/**
+ * Creates an interior tree node whose token is already interned and whose
+ * hash is already known, as when a tree is rebuilt from a compiled
+ * artifact.
+ *
+ * @param op: The operator type
+ * @param token: The handle of the operator's token, see intern.h
+ * @param left: Pointer to the left child node
+ * @param right: Pointer to the right child node
+ * @param hash: The hash measure_interior() would give the node
+ * @return: A pointer to the newly created interior node, or NULL if an error occurs
+ */
+tree_node_t * make_interior_hashed(op_type_t op, const char * token, tree_node_t * left, tree_node_t * right, unsigned long hash) {
+        if(!left || !right) return NULL;
+
         tree_node_t * node = malloc(sizeof(tree_node_t));
 
         if(node == NULL) return NULL;
@@ -45,66 +81,118 @@ tree_node_t * make_interior(op_type_t op, char * token, tree_node_t * left, tree
                 return NULL;
         }
 
-        if(!token || token[0] == '\0') {
-                fprintf(stderr, "[make_interior]: received invalid or empty token\n");
-                free(interior);
-                free(node);
-                return NULL;
-        }
-        printf("[make_interior]: Tok = %s\n", token);
-        node->token = strdup(token);
-        if(!node->token) {
-                fprintf(stderr,"[make_interior]: strdup failed for token '%s'\n", token);
-                free(interior);
-                free(node);
-                return NULL;
-        }
-
         interior->op = op;
         interior->left = left;
         interior->right = right;
 
         node->type = INTERIOR;
+        node->token = token;
         node->node = interior;
-        printf("\t[make_interior]: Created interior node: op='%d', token='%s'\n", op, node->token);
+        node->size = 1 + left->size + right->size;
+        node->pure = op != ASSIGN_OP && left->pure && right->pure;
+        node->hash = hash;
         return node;
 }
 
+/**
+ * Hashes a token (64-bit FNV-1a).
+ *
+ * @param token: A pointer to the token
+ * @param seed: The value to start hashing from
+ * @return: The hash of the token
+ */
+static unsigned long hash_token(const char * token, unsigned long seed) {
+        unsigned long hash = seed;
+
+        while(*token) {
+                hash ^= (unsigned char)*token++;
+                hash *= 1099511628211ul;
+        }
+        return hash;
+}
+
+/**
+ * Recomputes the size, purity and hash of an interior node from its
+ * children. Used when a child is replaced after the node was created.
+ *
+ * @param node: A pointer to the interior node
+ */
+void measure_interior(tree_node_t * node) {
+        interior_node_t * interior = (interior_node_t *)node->node;
+
+        node->size = 1 + interior->left->size + interior->right->size;
+        node->pure = interior->op != ASSIGN_OP && interior->left->pure && interior->right->pure;
+
+        // the children are mixed in unevenly, so swapping them changes the hash
+        unsigned long hash = hash_token(node->token, 14695981039346656037ul);
+        hash = (hash ^ interior->left->hash) * 1099511628211ul;
+        hash = (hash ^ (interior->right->hash + 0x9e3779b97f4a7c15ul)) * 1099511628211ul;
+        node->hash = hash ^ (hash >> 29);
+}
+
+/**
+ * Hashes a leaf's token, as make_leaf() does.
+ *
+ * @param exp_type: The expression type of the leaf
+ * @param token: A pointer to the token
+ * @return: The hash of the leaf
+ */
+unsigned long hash_leaf(exp_type_t exp_type, const char * token) {
+        return hash_token(token, 14695981039346656037ul + exp_type);
+}
+
 /**
  * Creates a leaf tree node. Leaf nodes are used to represent constants or
  * variable names in expression trees. They have no children.
  *
  * @param exp_type: The expression type (e.g., CONSTANT, VARIABLE, etc.)
- * @param token: The string representation of the constant or variable
+ * @param token: The string representation of the constant or variable.
+ *      A variable name is interned; a literal is copied into the leaf
  * @return: A pointer to the newly created leaf node, or NULL if an error occurs
  */
-tree_node_t * make_leaf(exp_type_t exp_type, char * token) {
-        tree_node_t * node = (tree_node_t *)malloc(sizeof(tree_node_t));
+tree_node_t * make_leaf(exp_type_t exp_type, const char * token) {
+        const char * handle = exp_type == INTEGER ? token : intern(token);
 
-        if(node == NULL) {
-                fprintf(stderr, "Failed to allocate memory for tree node\n");
+        if(handle == NULL) {
+                diag("Failed to intern token\n");
                 return NULL;
         }
 
-        leaf_node_t * leaf = malloc(sizeof(leaf_node_t));
-//      printf("\t[make_leaf]: Allocated tree_node_t at %p\n", (void*)node);
+        tree_node_t * node = make_leaf_hashed(exp_type, handle, hash_leaf(exp_type, token));
+        if(node == NULL) diag("Failed to allocate memory for leaf node\n");
+        else TRACE("\t[make_leaf]: SUCCESSFULLY CREATED LEAF NODE\n");
+        return node;
+}
+
+/**
+ * Creates a leaf tree node whose hash is already known, as when a tree is
+ * rebuilt from a compiled artifact.
+ *
+ * @param exp_type: The expression type
+ * @param token: The text of a literal, which is copied into the leaf, or
+ *      the handle of a variable name, see intern.h
+ * @param hash: The hash hash_leaf() gives the leaf
+ * @return: A pointer to the newly created leaf node, or NULL if memory
+ *      allocation fails
+ */
+tree_node_t * make_leaf_hashed(exp_type_t exp_type, const char * token, unsigned long hash) {
+        tree_node_t * node = (tree_node_t *)malloc(sizeof(tree_node_t));
+
+        if(node == NULL) return NULL;
+
+        size_t literal = exp_type == INTEGER ? strlen(token) + 1 : 0;
+        leaf_node_t * leaf = malloc(sizeof(leaf_node_t) + literal);
         if(leaf == NULL) {
-                fprintf(stderr, "Failed to allocate memory for leaf node\n");
                 free(node);
                 return NULL;
         }
-//      printf("\t[make_leaf]: Allocated leaf_node_t at %p\n", (void *)leaf);
         leaf->exp_type = exp_type;
 
         node->type = LEAF;
-        node->token = strdup(token);
-        if(node->token == NULL) {
-                fprintf(stderr, "Failed to duplicate token\n");
-                free(node);
-                return NULL;
-        }
-//      printf("\t[make_leaf]: Duplicated token '%s' at %p\n", node->token, (void *)node->token);
-        node->node = NULL;
-        printf("\t[make_leaf]: SUCCESSFULLY CREATED LEAF NODE\n");
+        node->token = literal ? memcpy(leaf->literal, token, literal) : token;
+        node->node = leaf;
+        node->size = 1;
+        node->pure = 1;
+        node->hash = hash;
         return node;
 }
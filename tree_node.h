@@ -0,0 +1,74 @@
+/**
+ * Interface for the nodes of an expression tree. Interior nodes hold an
+ * operator and its two operands; leaf nodes hold an integer literal or a
+ * variable name.
+ *
+ * @file        tree_node.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef TREE_NODE_H
+#define TREE_NODE_H
+
+#include <stddef.h>
+
+/// Operators of interior nodes
+typedef enum op_type_e {
+        ADD_OP,
+        SUB_OP,
+        MUL_OP,
+        DIV_OP,
+        MOD_OP,
+        ASSIGN_OP,
+        Q_OP,
+        ALT_OP,
+        NO_OP
+} op_type_t;
+
+/// Kinds of leaf nodes
+typedef enum exp_type_e {
+        INTEGER,
+        SYMBOL
+} exp_type_t;
+
+/// Kinds of tree nodes
+typedef enum node_type_e {
+        INTERIOR,
+        LEAF
+} node_type_t;
+
+/// An operator applied to two subtrees
+typedef struct interior_node_s {
+        op_type_t op;
+        struct tree_node_s * left;
+        struct tree_node_s * right;
+} interior_node_t;
+
+/// An integer literal or a variable
+typedef struct leaf_node_s {
+        exp_type_t exp_type;
+        char literal[]; /// Text of an integer literal, which the token points to
+} leaf_node_t;
+
+/// A node of an expression tree
+typedef struct tree_node_s {
+        node_type_t type;
+        const char * token; /// Operator, literal or variable name as written; interned unless a literal
+        void * node; /// interior_node_t or leaf_node_t, depending on type
+        size_t size; /// Number of nodes in the subtree
+        int pure; /// Set if the subtree contains no assignment
+        unsigned long hash; /// Hash of the subtree's structure and tokens
+} tree_node_t;
+
+tree_node_t * make_interior(op_type_t op, const char * token, tree_node_t * left, tree_node_t * right);
+
+void measure_interior(tree_node_t * node);
+
+tree_node_t * make_interior_hashed(op_type_t op, const char * token, tree_node_t * left, tree_node_t * right, unsigned long hash);
+
+tree_node_t * make_leaf(exp_type_t exp_type, const char * token);
+
+tree_node_t * make_leaf_hashed(exp_type_t exp_type, const char * token, unsigned long hash);
+
+unsigned long hash_leaf(exp_type_t exp_type, const char * token);
+
+#endif
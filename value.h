@@ -0,0 +1,244 @@
+/**
+ * Definition of the type every value of the interpreter has. The type is
+ * picked when the interpreter is built: values are 32-bit integers by
+ * default, 64-bit integers with -DVALUE_INT64 and doubles with
+ * -DVALUE_DOUBLE. Every file that handles values is compiled for the one
+ * type, so each build is its own binary with the arithmetic below inlined
+ * into its evaluator, symbol table and literal conversion, and all object
+ * files of a build must use the same flag.
+ *
+ * The integer operations report overflow instead of wrapping around, with
+ * the compiler's overflow-checking builtins, so the evaluator can carry on
+ * exactly with a bignum (see parser.c). Doubles never overflow this way.
+ *
+ * Values are written out as text with value_format(), which gives the
+ * same bytes as VALUE_FMT without going through printf for integers.
+ *
+ * @file        value.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#if defined(VALUE_INT64) && defined(VALUE_DOUBLE)
+#error "define at most one of VALUE_INT64 and VALUE_DOUBLE"
+#endif
+
+#define VALUE_TEXT_MAX 25 /// Longest value written by value_format() or VALUE_EXACT_FMT, terminator included
+
+#if defined(VALUE_DOUBLE)
+
+#include <stdio.h>
+#include <math.h>
+
+typedef double value_t;
+#define VALUE_NAME "double"
+#define VALUE_FMT "%.15g" /// Format of a value shown to the user
+#define VALUE_EXACT_FMT "%.17g" /// Format that reads back as the same value
+#define VALUE_SCN "%lf"
+
+#elif defined(VALUE_INT64)
+
+typedef int64_t value_t;
+#define VALUE_NAME "int64"
+#define VALUE_MIN INT64_MIN
+#define VALUE_MAX INT64_MAX
+#define VALUE_DIGITS 18 /// Digits of a literal that always fits
+#define VALUE_FMT "%" PRId64
+#define VALUE_EXACT_FMT VALUE_FMT
+#define VALUE_SCN "%" SCNd64
+
+#else
+
+#define VALUE_INT32
+typedef int32_t value_t;
+#define VALUE_NAME "int32"
+#define VALUE_MIN INT32_MIN
+#define VALUE_MAX INT32_MAX
+#define VALUE_DIGITS 9 /// Digits of a literal that always fits
+#define VALUE_FMT "%" PRId32
+#define VALUE_EXACT_FMT VALUE_FMT
+#define VALUE_SCN "%" SCNd32
+
+#endif
+
+/**
+ * Adds two values.
+ *
+ * @param left: The first operand
+ * @param right: The second operand
+ * @param sum: A pointer to store the sum at, if it fits
+ * @return: 1 if the sum does not fit in a value_t, 0 if it does
+ */
+static inline int value_add(value_t left, value_t right, value_t * sum) {
+#ifdef VALUE_DOUBLE
+        *sum = left + right;
+        return 0;
+#else
+        return __builtin_add_overflow(left, right, sum);
+#endif
+}
+
+/**
+ * Subtracts two values.
+ *
+ * @param left: The minuend
+ * @param right: The subtrahend
+ * @param diff: A pointer to store the difference at, if it fits
+ * @return: 1 if the difference does not fit in a value_t, 0 if it does
+ */
+static inline int value_sub(value_t left, value_t right, value_t * diff) {
+#ifdef VALUE_DOUBLE
+        *diff = left - right;
+        return 0;
+#else
+        return __builtin_sub_overflow(left, right, diff);
+#endif
+}
+
+/**
+ * Multiplies two values.
+ *
+ * @param left: The first operand
+ * @param right: The second operand
+ * @param prod: A pointer to store the product at, if it fits
+ * @return: 1 if the product does not fit in a value_t, 0 if it does
+ */
+static inline int value_mul(value_t left, value_t right, value_t * prod) {
+#ifdef VALUE_DOUBLE
+        *prod = left * right;
+        return 0;
+#else
+        return __builtin_mul_overflow(left, right, prod);
+#endif
+}
+
+/**
+ * Divides two values. Integers truncate toward zero, and the one quotient
+ * that does not fit is the smallest value divided by -1. Doubles divide
+ * as IEEE 754 does.
+ *
+ * @param left: The dividend
+ * @param right: The divisor, which must not be 0
+ * @param quot: A pointer to store the quotient at, if it fits
+ * @return: 1 if the quotient does not fit in a value_t, 0 if it does
+ */
+static inline int value_div(value_t left, value_t right, value_t * quot) {
+#ifndef VALUE_DOUBLE
+        if(right == -1 && left == VALUE_MIN) return 1;
+#endif
+        *quot = left / right;
+        return 0;
+}
+
+/**
+ * Takes the remainder of dividing two values, which always fits. It has
+ * the sign of the dividend for integers and doubles alike, so that
+ * quotient * right + remainder == left for integers.
+ *
+ * @param left: The dividend
+ * @param right: The divisor, which must not be 0
+ * @return: The remainder
+ */
+static inline value_t value_mod(value_t left, value_t right) {
+#ifdef VALUE_DOUBLE
+        return fmod(left, right);
+#else
+        if(right == -1) return 0;
+        return left % right;
+#endif
+}
+
+/**
+ * Reads a whole value written with VALUE_EXACT_FMT.
+ *
+ * @param text: A pointer to the terminated text of the value
+ * @param val: A pointer to store the value at
+ * @return: 0 on success, -1 if the text is not a value or it does not fit
+ */
+static inline int value_parse(const char * text, value_t * val) {
+        char * end;
+
+        errno = 0;
+#ifdef VALUE_DOUBLE
+        // a subnormal value sets ERANGE too, but reads back exactly
+        double v = strtod(text, &end);
+        if(end == text || *end != '\0' || (errno && fabs(v) == HUGE_VAL)) return -1;
+#else
+        long long v = strtoll(text, &end, 10);
+        if(end == text || *end != '\0' || errno || v < VALUE_MIN || v > VALUE_MAX) return -1;
+#endif
+        *val = (value_t)v;
+        return 0;
+}
+
+/**
+ * Writes an unsigned integer in decimal, as "%" PRIu64 does. The length
+ * is worked out first, so the digits are written straight into place, two
+ * at a time from a table of digit pairs.
+ *
+ * @param n: The integer
+ * @param buf: A pointer to room for at least 21 bytes
+ * @return: The number of digits written, not counting the terminator
+ */
+static inline size_t format_digits(uint64_t n, char * buf) {
+        static const char pairs[] =
+                "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                "8081828384858687888990919293949596979899";
+        static const uint64_t powers[] = {
+                0, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+                1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+                100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+                1000000000000000000ull, 10000000000000000000ull
+        };
+
+        // 1233 / 4096 is just over log10(2), so the guess is the number of
+        // digits of n or one less, and comparing with a power of ten decides
+        int bits = 64 - __builtin_clzll(n | 1);
+        int guess = (bits * 1233) >> 12;
+        size_t len = (size_t)guess + (n >= powers[guess]);
+
+        char * p = buf + len;
+        *p = '\0';
+        while(n >= 100) {
+                unsigned int pair = (unsigned int)(n % 100) * 2;
+                n /= 100;
+                *--p = pairs[pair + 1];
+                *--p = pairs[pair];
+        }
+        if(n >= 10) {
+                *--p = pairs[n * 2 + 1];
+                *--p = pairs[n * 2];
+        } else {
+                *--p = (char)('0' + n);
+        }
+        return len;
+}
+
+/**
+ * Writes a value as text, byte for byte as VALUE_FMT does.
+ *
+ * @param val: The value
+ * @param buf: A pointer to room for VALUE_TEXT_MAX bytes
+ * @return: The length of the text, not counting the terminator
+ */
+static inline size_t value_format(value_t val, char * buf) {
+#ifdef VALUE_DOUBLE
+        return (size_t)snprintf(buf, VALUE_TEXT_MAX, VALUE_FMT, val);
+#else
+        // the magnitude is taken unsigned, so the most negative value has one
+        if(val < 0) {
+                buf[0] = '-';
+                return 1 + format_digits(0 - (uint64_t)(int64_t)val, buf + 1);
+        }
+        return format_digits((uint64_t)val, buf);
+#endif
+}
+
+#endif
@@ -0,0 +1,474 @@
+/**
+ * Implementation of the write-ahead log for symbol table writes. Every
+ * addition and assignment is appended to the log as a line in the same
+ * "name value" format as a symbol file.
+ *
+ * ## Group commit:
+ * Appending only copies the record into a buffer. A background flusher
+ * thread writes the buffer out and fsyncs it once the oldest pending
+ * record has waited for the latency budget, or earlier once enough bytes
+ * are pending, so one fsync covers every record appended in the meantime.
+ * Each record gets a log sequence number (LSN); wal_wait() blocks until
+ * a given LSN is durable, for callers that must not acknowledge a write
+ * before then. Once a write or fsync of the log fails, no later record is
+ * durable either, so wal_wait() reports the failure for every LSN that was
+ * not durable before it.
+ *
+ * ## Files:
+ * - `<path>`: the log of writes since the last compaction
+ * - `<path>.snap`: a compacted copy of the whole table
+ * - `<path>.old`: the log being compacted, present only if a compaction
+ *   was interrupted
+ *
+ * At startup the snapshot, the old log and the log are replayed, in that
+ * order, on top of the already loaded symbol file. Replay is idempotent,
+ * since every record holds an absolute value, so it does not matter how
+ * far an interrupted compaction got. A torn record at the end of the log
+ * is ignored.
+ *
+ * @file        wal.c
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "wal.h"
+#include "symtab.h"
+
+#define RECORD_SLACK (1 + VALUE_TEXT_MAX + 1) /// Room for the separator, value and newline of a record
+
+static int fd = -1; /// The open log
+static symtab_t * logged = NULL; /// The table whose writes are logged
+static char * log_path = NULL;
+static int budget_ms = WAL_DEFAULT_BUDGET_MS;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /// Guards everything below
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER; /// Signals the flusher
+static pthread_cond_t synced = PTHREAD_COND_INITIALIZER; /// Signals waiters
+static char * pending = NULL; /// Records not yet written out
+static size_t pending_len = 0, pending_cap = 0;
+static struct timespec first_pending; /// When the oldest pending record arrived
+static unsigned long appended_lsn = 0; /// LSN of the newest record
+static unsigned long durable_lsn = 0; /// LSN of the newest fsynced record
+static int failed = 0; /// Set once writing out the log failed, see wal_wait()
+static unsigned long since_compact = 0; /// Records appended since the last compaction
+static int closing = 0;
+static pthread_t flusher;
+
+/**
+ * Builds the path of one of the log's companion files.
+ *
+ * @param suffix: The suffix to append to the log path
+ * @return: A newly allocated path. Exits the program if memory
+ *      allocation fails
+ */
+static char * companion(const char * suffix) {
+        char * path = malloc(strlen(log_path) + strlen(suffix) + 1);
+
+        if(!path) {
+                perror("Failed to allocate log path");
+                exit(EXIT_FAILURE);
+        }
+        strcpy(path, log_path);
+        strcat(path, suffix);
+        return path;
+}
+
+/**
+ * Writes a whole buffer to a file descriptor.
+ *
+ * @param out: The file descriptor
+ * @param buf: A pointer to the data
+ * @param len: The number of bytes to write
+ * @return: 0 on success, -1 on failure
+ */
+static int write_all(int out, const char * buf, size_t len) {
+        while(len > 0) {
+                ssize_t n = write(out, buf, len);
+                if(n < 0) {
+                        if(errno == EINTR) continue;
+                        return -1;
+                }
+                buf += n;
+                len -= n;
+        }
+        return 0;
+}
+
+/**
+ * Fsyncs the directory holding the log, making renames durable.
+ */
+static void sync_dir(void) {
+        char * dir = strdup(log_path);
+        char * slash = dir ? strrchr(dir, '/') : NULL;
+        int dfd;
+
+        if(!dir) return;
+        if(slash) *(slash == dir ? slash + 1 : slash) = '\0';
+        dfd = open(slash ? dir : ".", O_RDONLY | O_DIRECTORY);
+        if(dfd >= 0) {
+                fsync(dfd);
+                close(dfd);
+        }
+        free(dir);
+}
+
+/**
+ * Applies one log record to the symbol table.
+ *
+ * @param line: A pointer to the record, without its newline
+ * @return: 0 on success, -1 if the record is malformed
+ */
+static int apply_record(char * line) {
+        char * save = NULL;
+        char * name = strtok_r(line, " \t", &save);
+        char * num = strtok_r(NULL, " \t", &save);
+        value_t val;
+
+        if(!name || !num || value_parse(num, &val) < 0) return -1;
+
+        if(symtab_assign(logged, name, val) == NULL) symtab_add(logged, name, val);
+        return 0;
+}
+
+/**
+ * Replays a log or snapshot file into the symbol table.
+ *
+ * @param path: The path of the file, which may not exist
+ * @return: The number of records applied, or -1 if the file is corrupt
+ */
+static long replay(const char * path) {
+        FILE * file = fopen(path, "r");
+        if(!file) return 0;
+
+        char * line = NULL;
+        size_t cap = 0;
+        ssize_t len;
+        long count = 0, lineno = 0;
+
+        while((len = getline(&line, &cap, file)) != -1) {
+                lineno++;
+                if(line[len - 1] != '\n') {
+                        fprintf(stderr, "%s:%ld: ignoring torn record\n", path, lineno);
+                        break;
+                }
+                line[len - 1] = '\0';
+                if(apply_record(line) < 0) {
+                        fprintf(stderr, "%s:%ld: Error: malformed record\n", path, lineno);
+                        count = -1;
+                        break;
+                }
+                count++;
+        }
+
+        free(line);
+        fclose(file);
+        return count;
+}
+
+/**
+ * Writes out and fsyncs every pending record. Called with lock held;
+ * the lock is dropped during I/O unless hold is set. The records become
+ * durable only if the write and the fsync both succeed.
+ *
+ * @param spare: A pointer to the flusher's spare buffer, swapped with the
+ *      pending one so appends can continue during the write
+ * @param spare_cap: A pointer to the spare buffer's capacity
+ * @param hold: If set, keep the lock for the whole flush
+ */
+static void flush_locked(char ** spare, size_t * spare_cap, int hold) {
+        if(pending_len == 0) return;
+
+        char * buf = pending;
+        size_t len = pending_len, cap = pending_cap;
+        unsigned long lsn = appended_lsn;
+
+        pending = *spare;
+        pending_cap = *spare_cap;
+        pending_len = 0;
+
+        if(!hold) pthread_mutex_unlock(&lock);
+        int rc = write_all(fd, buf, len) < 0 || fdatasync(fd) < 0 ? -1 : 0;
+        if(rc < 0) perror("wal: failed to write log");
+        if(!hold) pthread_mutex_lock(&lock);
+
+        // the log now has a hole, so nothing after it is durable either
+        *spare = buf;
+        *spare_cap = cap;
+        if(rc < 0) failed = 1;
+        else if(!failed) durable_lsn = lsn;
+        pthread_cond_broadcast(&synced);
+}
+
+/**
+ * Writes one symbol to a compaction snapshot.
+ *
+ * @param symbol: A pointer to the symbol
+ * @param arg: The snapshot FILE
+ */
+static void write_symbol_record(symbol_t * symbol, void * arg) {
+        fprintf((FILE *)arg, "%s " VALUE_EXACT_FMT "\n", symbol->var_name, symbol->val);
+}
+
+/**
+ * Writes a pinned version of the table to the snapshot file, atomically
+ * replacing the previous one.
+ *
+ * @param snap: A pointer to the pinned version
+ * @return: 0 on success, -1 on failure
+ */
+static int write_snapshot(symtab_snapshot_t * snap) {
+        char * tmp = companion(".snap.tmp");
+        char * path = companion(".snap");
+        FILE * file = fopen(tmp, "w");
+        int rc = -1;
+
+        if(file) {
+                walk_snapshot(snap, write_symbol_record, file);
+                if(fflush(file) == 0 && fsync(fileno(file)) == 0 && fclose(file) == 0) {
+                        rc = rename(tmp, path);
+                } else {
+                        fclose(file);
+                }
+        }
+        if(rc < 0) perror("wal: failed to write snapshot");
+        else sync_dir();
+
+        free(tmp);
+        free(path);
+        return rc;
+}
+
+/**
+ * Compacts the log: moves the current log aside, starts a new one, and
+ * writes the table as of the switch to the snapshot file. Called with
+ * lock held; the lock is dropped while the snapshot is written.
+ *
+ * @param spare: A pointer to the flusher's spare buffer
+ * @param spare_cap: A pointer to the spare buffer's capacity
+ */
+static void compact_locked(char ** spare, size_t * spare_cap) {
+        char * old = companion(".old");
+
+        // every record in the old log is already part of this version
+        flush_locked(spare, spare_cap, 1);
+        symtab_snapshot_t * snap = symtab_pin(logged);
+
+        int nfd = -1;
+        if(rename(log_path, old) == 0) nfd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if(nfd < 0) {
+                perror("wal: failed to rotate log");
+                rename(old, log_path);
+                free(old);
+                pthread_mutex_unlock(&lock);
+                unpin_table(snap);
+                pthread_mutex_lock(&lock);
+                return;
+        }
+        close(fd);
+        fd = nfd;
+        since_compact = 0;
+        sync_dir();
+
+        pthread_mutex_unlock(&lock);
+        if(write_snapshot(snap) == 0) unlink(old);
+        unpin_table(snap);
+        pthread_mutex_lock(&lock);
+        free(old);
+}
+
+/**
+ * Adds a number of milliseconds to a point in time.
+ */
+static struct timespec add_ms(struct timespec t, int ms) {
+        t.tv_sec += ms / 1000;
+        t.tv_nsec += (ms % 1000) * 1000000L;
+        if(t.tv_nsec >= 1000000000L) {
+                t.tv_sec++;
+                t.tv_nsec -= 1000000000L;
+        }
+        return t;
+}
+
+/**
+ * Flusher thread: commits pending records in groups and compacts the
+ * log when it has grown.
+ *
+ * @param arg: Unused
+ * @return: NULL
+ */
+static void * flush_loop(void * arg) {
+        (void)arg;
+        char * spare = NULL;
+        size_t spare_cap = 0;
+
+        pthread_mutex_lock(&lock);
+        while(!closing || pending_len > 0) {
+                if(pending_len == 0) {
+                        pthread_cond_wait(&work, &lock);
+                        continue;
+                }
+
+                // let the group grow until the oldest record's budget is spent
+                struct timespec deadline = add_ms(first_pending, budget_ms);
+                while(!closing && pending_len < WAL_FLUSH_BYTES &&
+                                pthread_cond_timedwait(&work, &lock, &deadline) != ETIMEDOUT);
+
+                flush_locked(&spare, &spare_cap, 0);
+                if(since_compact >= WAL_COMPACT_RECORDS && !closing) compact_locked(&spare, &spare_cap);
+        }
+        pthread_mutex_unlock(&lock);
+
+        free(spare);
+        return NULL;
+}
+
+/**
+ * Appends a record for a symbol table write. Installed as the table's
+ * write hook, so records are appended in version order.
+ *
+ * @param name: A pointer to the variable name
+ * @param val: The value written
+ */
+static void append_record(const char * name, value_t val) {
+        size_t need = strlen(name) + RECORD_SLACK;
+
+        pthread_mutex_lock(&lock);
+
+        if(pending_len + need > pending_cap) {
+                size_t ncap = pending_cap ? pending_cap * 2 : WAL_FLUSH_BYTES;
+                while(ncap < pending_len + need) ncap *= 2;
+                char * nbuf = realloc(pending, ncap);
+                if(!nbuf) {
+                        perror("wal: failed to grow log buffer");
+                        pthread_mutex_unlock(&lock);
+                        return;
+                }
+                pending = nbuf;
+                pending_cap = ncap;
+        }
+
+        int first = pending_len == 0;
+        if(first) clock_gettime(CLOCK_REALTIME, &first_pending);
+        int len = snprintf(pending + pending_len, need, "%s " VALUE_EXACT_FMT "\n", name, val);
+        if(len < 0 || (size_t)len >= need) {
+                fprintf(stderr, "wal: failed to format record for '%s'\n", name);
+                pthread_mutex_unlock(&lock);
+                return;
+        }
+        pending_len += len;
+        appended_lsn++;
+        since_compact++;
+
+        // wake the flusher to start the budget clock, or to commit early
+        if(first || pending_len >= WAL_FLUSH_BYTES) pthread_cond_signal(&work);
+        pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Opens the write-ahead log, replays it on top of a symbol table, and
+ * starts logging every later addition and assignment to that table.
+ *
+ * @param table: A pointer to the table
+ * @param path: The path of the log file
+ * @param budget: The longest time in milliseconds a record may wait for
+ *      its fsync
+ * @return: 0 on success, -1 on failure
+ */
+int wal_open(symtab_t * table, const char * path, int budget) {
+        logged = table;
+        log_path = strdup(path);
+        failed = closing = 0;
+        budget_ms = budget > 0 ? budget : WAL_DEFAULT_BUDGET_MS;
+
+        char * snap = companion(".snap");
+        char * old = companion(".old");
+        int interrupted = access(old, F_OK) == 0;
+        long replayed = 0, n;
+
+        if((n = replay(snap)) < 0 || (replayed = n, (n = replay(old)) < 0) ||
+                        (replayed += n, (n = replay(log_path)) < 0)) {
+                free(snap);
+                free(old);
+                return -1;
+        }
+        replayed += n;
+        free(snap);
+
+        fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if(fd < 0) {
+                perror(log_path);
+                free(old);
+                return -1;
+        }
+
+        // finish an interrupted compaction before the old log can be clobbered
+        if(interrupted) {
+                symtab_snapshot_t * table = symtab_pin(logged);
+                if(write_snapshot(table) == 0 && ftruncate(fd, 0) == 0) unlink(old);
+                unpin_table(table);
+        }
+        free(old);
+
+        fprintf(stderr, "wal: replayed %ld records from %s\n", replayed, log_path);
+
+        symtab_set_hook(logged, append_record);
+        pthread_create(&flusher, NULL, flush_loop, NULL);
+        return 0;
+}
+
+/**
+ * Returns the sequence number of the most recently logged write.
+ *
+ * @return: The LSN, 0 if nothing has been logged
+ */
+unsigned long wal_lsn(void) {
+        pthread_mutex_lock(&lock);
+        unsigned long lsn = appended_lsn;
+        pthread_mutex_unlock(&lock);
+        return lsn;
+}
+
+/**
+ * Waits until a logged write is durable.
+ *
+ * @param lsn: The sequence number of the write, as from wal_lsn()
+ * @return: 0 once the write is durable, -1 if writing out the log failed
+ *      before it was, in which case the write must not be acknowledged
+ */
+int wal_wait(unsigned long lsn) {
+        pthread_mutex_lock(&lock);
+        while(durable_lsn < lsn && fd >= 0 && !failed) pthread_cond_wait(&synced, &lock);
+        int rc = durable_lsn >= lsn ? 0 : -1;
+        pthread_mutex_unlock(&lock);
+        return rc;
+}
+
+/**
+ * Stops logging, commits every pending record and closes the log.
+ */
+void wal_close(void) {
+        if(fd < 0) return;
+
+        symtab_set_hook(logged, NULL);
+
+        pthread_mutex_lock(&lock);
+        closing = 1;
+        pthread_cond_signal(&work);
+        pthread_mutex_unlock(&lock);
+        pthread_join(flusher, NULL);
+
+        close(fd);
+        fd = -1;
+        free(pending);
+        pending = NULL;
+        pending_len = pending_cap = 0;
+        free(log_path);
+        log_path = NULL;
+}
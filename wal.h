@@ -0,0 +1,25 @@
+/**
+ * Interface for the write-ahead log, which makes additions and
+ * assignments to the symbol table survive a crash.
+ *
+ * @file        wal.h
+ * @author      Sophia Le (sel5881@rit.edu)
+ */
+#ifndef WAL_H
+#define WAL_H
+
+#include "symtab.h"
+
+#define WAL_DEFAULT_BUDGET_MS 5 /// Longest a record waits for its fsync
+#define WAL_FLUSH_BYTES (256 * 1024) /// Pending bytes that force an early fsync
+#define WAL_COMPACT_RECORDS 100000 /// Records between two compactions
+
+int wal_open(symtab_t * table, const char * path, int budget_ms);
+
+unsigned long wal_lsn(void);
+
+int wal_wait(unsigned long lsn);
+
+void wal_close(void);
+
+#endif